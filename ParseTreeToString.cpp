@@ -4,6 +4,7 @@
  * @see "Seattle University, CPSC5300, Spring 2020"
  */
 #include "ParseTreeToString.h"
+#include "heap_storage.h"
 
 using namespace std;
 using namespace hsql;
@@ -62,18 +63,30 @@ bool ParseTreeToString::is_reserved_word(string candidate) {
     return false;
 }
 
-string ParseTreeToString::operator_expression(const Expr *expr) {
+string ParseTreeToString::operator_expression(const Expr *expr, Form form) {
     if (expr == NULL)
         return "null";
 
-    string ret;
     if (expr->opType == Expr::NOT)
-        ret += "NOT ";
-    ret += expression(expr->expr) + " ";
+        return "NOT " + expression(expr->expr, form);
+    if (expr->opType == Expr::UMINUS)
+        return "-" + expression(expr->expr, form);
+
+    string ret;
+    ret += expression(expr->expr, form) + " ";
     switch (expr->opType) {
         case Expr::SIMPLE_OP:
             ret += expr->opChar;
             break;
+        case Expr::NOT_EQUALS:
+            ret += "<>";
+            break;
+        case Expr::LESS_EQ:
+            ret += "<=";
+            break;
+        case Expr::GREATER_EQ:
+            ret += ">=";
+            break;
         case Expr::AND:
             ret += "AND";
             break;
@@ -85,12 +98,23 @@ string ParseTreeToString::operator_expression(const Expr *expr) {
             break;
     }
     if (expr->expr2 != NULL)
-        ret += " " + expression(expr->expr2);
+        ret += " " + expression(expr->expr2, form);
     return ret;
 }
 
 string ParseTreeToString::expression(const Expr *expr) {
+    return expression(expr, PLAIN);
+}
+
+// A literal (or negated integer literal) comes out as ? when STRIPPED.
+string ParseTreeToString::expression(const Expr *expr, Form form) {
     string ret;
+    bool literal = expr->type == kExprLiteralString || expr->type == kExprLiteralInt ||
+                   expr->type == kExprLiteralFloat;
+    if (expr->type == kExprOperator && expr->opType == Expr::UMINUS && expr->expr != NULL)
+        literal = expr->expr->type == kExprLiteralInt;
+    if (form == STRIPPED && literal)
+        return "?";
     switch (expr->type) {
         case kExprStar:
             ret += "*";
@@ -107,11 +131,28 @@ string ParseTreeToString::expression(const Expr *expr) {
         case kExprLiteralInt:
             ret += to_string(expr->ival);
             break;
+        case kExprPlaceholder:
+            ret += "?";
+            break;
         case kExprFunctionRef:
-            ret += string(expr->name) + "?" + expr->expr->name;
+            ret += string(expr->name) + "(" + (expr->distinct ? "DISTINCT " : "");
+            if (expr->exprList != NULL) {
+                bool doComma = false;
+                for (Expr *arg : *expr->exprList) {
+                    if (doComma)
+                        ret += ", ";
+                    ret += expression(arg, form);
+                    doComma = true;
+                }
+            } else if (expr->expr != NULL) {
+                ret += expression(expr->expr, form);
+            }
+            ret += ")";
             break;
         case kExprOperator:
-            ret += operator_expression(expr);
+            ret += operator_expression(expr, form);
+            if (form != PLAIN)
+                ret = "(" + ret + ")";
             break;
         default:
             ret += "???";
@@ -122,7 +163,7 @@ string ParseTreeToString::expression(const Expr *expr) {
     return ret;
 }
 
-string ParseTreeToString::table_ref(const TableRef *table) {
+string ParseTreeToString::table_ref(const TableRef *table, Form form) {
     string ret;
     switch (table->type) {
         case kTableSelect:
@@ -134,7 +175,7 @@ string ParseTreeToString::table_ref(const TableRef *table) {
                 ret += string(" AS ") + table->alias;
             break;
         case kTableJoin:
-            ret += table_ref(table->join->left);
+            ret += table_ref(table->join->left, form);
             switch (table->join->type) {
                 case kJoinCross:
                 case kJoinInner:
@@ -153,16 +194,16 @@ string ParseTreeToString::table_ref(const TableRef *table) {
                     ret += " NATURAL JOIN ";
                     break;
             }
-            ret += table_ref(table->join->right);
+            ret += table_ref(table->join->right, form);
             if (table->join->condition != NULL)
-                ret += " ON " + expression(table->join->condition);
+                ret += " ON " + expression(table->join->condition, form);
             break;
         case kTableCrossProduct:
             bool doComma = false;
             for (TableRef *tbl : *table->list) {
                 if (doComma)
                     ret += ", ";
-                ret += table_ref(tbl);
+                ret += table_ref(tbl, form);
                 doComma = true;
             }
             break;
@@ -189,23 +230,73 @@ string ParseTreeToString::column_definition(const ColumnDefinition *col) {
     return ret;
 }
 
-string ParseTreeToString::select(const SelectStatement *stmt) {
+// Select list literals are kept even when STRIPPED: they name and type the result columns.
+string ParseTreeToString::select(const SelectStatement *stmt, Form form) {
     string ret("SELECT ");
     bool doComma = false;
     for (Expr *expr : *stmt->selectList) {
         if (doComma)
             ret += ", ";
-        ret += expression(expr);
+        ret += expression(expr, form == PLAIN ? PLAIN : GROUPED);
         doComma = true;
     }
-    ret += " FROM " + table_ref(stmt->fromTable);
+    ret += " FROM " + table_ref(stmt->fromTable, form);
     if (stmt->whereClause != NULL)
-        ret += " WHERE " + expression(stmt->whereClause);
+        ret += " WHERE " + expression(stmt->whereClause, form);
+    if (stmt->groupBy != NULL) {
+        ret += " GROUP BY ";
+        doComma = false;
+        for (Expr *expr : *stmt->groupBy->columns) {
+            if (doComma)
+                ret += ", ";
+            ret += expression(expr);
+            doComma = true;
+        }
+    }
+    if (stmt->order != NULL) {
+        ret += " ORDER BY ";
+        doComma = false;
+        for (OrderDescription *order : *stmt->order) {
+            if (doComma)
+                ret += ", ";
+            ret += expression(order->expr) + (order->type == kOrderDesc ? " DESC" : "");
+            doComma = true;
+        }
+    }
+    if (stmt->limit != NULL) {
+        if (stmt->limit->limit != kNoLimit)
+            ret += " LIMIT " + to_string(stmt->limit->limit);
+        if (stmt->limit->offset != kNoOffset)
+            ret += " OFFSET " + to_string(stmt->limit->offset);
+    }
     return ret;
 }
 
-string ParseTreeToString::insert(const InsertStatement *stmt) {
-    return "INSERT ...";
+string ParseTreeToString::insert(const InsertStatement *stmt, Form form) {
+    string ret("INSERT INTO ");
+    ret += stmt->tableName;
+    bool doComma = false;
+    if (stmt->columns != NULL) {
+        ret += " (";
+        for (char *column : *stmt->columns) {
+            if (doComma)
+                ret += ", ";
+            ret += column;
+            doComma = true;
+        }
+        ret += ")";
+    }
+    if (stmt->type != InsertStatement::kInsertValues)
+        return ret + " " + select(stmt->select, form);
+    ret += " VALUES (";
+    doComma = false;
+    for (Expr *expr : *stmt->values) {
+        if (doComma)
+            ret += ", ";
+        ret += expression(expr, form);
+        doComma = true;
+    }
+    return ret + ")";
 }
 
 string ParseTreeToString::create(const CreateStatement *stmt) {
@@ -281,9 +372,9 @@ string ParseTreeToString::show(const ShowStatement *stmt) {
 string ParseTreeToString::statement(const SQLStatement *stmt) {
     switch (stmt->type()) {
         case kStmtSelect:
-            return select((const SelectStatement *) stmt);
+            return select((const SelectStatement *) stmt, PLAIN);
         case kStmtInsert:
-            return insert((const InsertStatement *) stmt);
+            return insert((const InsertStatement *) stmt, PLAIN);
         case kStmtCreate:
             return create((const CreateStatement *) stmt);
         case kStmtDrop:
@@ -304,3 +395,70 @@ string ParseTreeToString::statement(const SQLStatement *stmt) {
             return "Not implemented";
     }
 }
+
+string ParseTreeToString::fingerprint(const SQLStatement *stmt) {
+    switch (stmt->type()) {
+        case kStmtSelect:
+            return select((const SelectStatement *) stmt, STRIPPED);
+        case kStmtInsert:
+            return insert((const InsertStatement *) stmt, STRIPPED);
+        default:
+            return statement(stmt);
+    }
+}
+
+// fingerprint of a single statement, or "" if it doesn't parse
+static string test_fingerprint(const string &sql) {
+    SQLParserResult *parse = SQLParser::parseSQLString(sql);
+    string fingerprint;
+    if (parse->isValid() && parse->size() == 1)
+        fingerprint = ParseTreeToString::fingerprint(parse->getStatement(0));
+    delete parse;
+    return fingerprint;
+}
+
+/**
+ * Test that statements share a fingerprint exactly when they differ only in the literals of their
+ * conditions and INSERT values.
+ * @return true if the tests all succeeded
+ */
+bool test_parse_tree_to_string() {
+    // statements in a group share a fingerprint; statements in different groups don't
+    const vector<vector<string>> groups = {
+            {"SELECT a, b FROM t WHERE a = 1 AND b = 'x'", "SELECT a, b FROM t WHERE a = -20 AND b = 'yy'"},
+            {"SELECT a FROM t WHERE a = 1 AND b = 'x'"},
+            {"SELECT a, b FROM t WHERE a = 1 OR b = 'x'"},
+            {"SELECT a, b FROM t WHERE a < 1 AND b = 'x'"},
+            {"SELECT a, b FROM t WHERE b = 1 AND a = 'x'"},
+            {"SELECT a, b FROM u WHERE a = 1 AND b = 'x'"},
+            {"SELECT a FROM t WHERE (a = 1 OR a = 2) AND b = 3", "SELECT a FROM t WHERE (a = 4 OR a = 5) AND b = 6"},
+            {"SELECT a FROM t WHERE a = 1 OR (a = 2 AND b = 3)"},
+            {"SELECT a FROM t"},
+            {"SELECT a, 1 FROM t"},
+            {"SELECT a, 2 FROM t"},
+            {"SELECT a FROM t LIMIT 10"},
+            {"SELECT a FROM t LIMIT 20"},
+            {"SELECT a FROM t ORDER BY a"},
+            {"SELECT a FROM t ORDER BY b"},
+            {"SELECT a FROM t ORDER BY a DESC"},
+            {"SELECT COUNT(*) FROM t GROUP BY a"},
+            {"SELECT COUNT(*) FROM t GROUP BY b"},
+            {"INSERT INTO t VALUES (1, 'x')", "INSERT INTO t VALUES (-2, 'yy')"},
+            {"INSERT INTO t (a, b) VALUES (1, 'x')", "INSERT INTO t (a, b) VALUES (3, 'z')"},
+            {"INSERT INTO t (b, a) VALUES ('x', 1)"},
+            {"INSERT INTO u VALUES (1, 'x')"}};
+    vector<string> fingerprints;
+    for (auto &group: groups) {
+        string first = test_fingerprint(group.front());
+        if (first.empty())
+            return assertion_failure("no fingerprint for " + group.front());
+        for (auto &sql: group)
+            if (test_fingerprint(sql) != first)
+                return assertion_failure("fingerprints differ: " + group.front() + " and " + sql);
+        for (auto &other: fingerprints)
+            if (other == first)
+                return assertion_failure("fingerprint shared by " + group.front() + ": " + first);
+        fingerprints.push_back(first);
+    }
+    return true;
+}
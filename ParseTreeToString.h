@@ -21,27 +21,50 @@ public:
      */
     static std::string statement(const hsql::SQLStatement *statement);
 
+    /**
+     * Unparse a statement with the literals of its conditions and INSERT values replaced by ?,
+     * and every nested operation in parentheses, so that two statements get the same fingerprint
+     * exactly when they differ only in those literals.
+     * @param statement  Hyrise AST pointer
+     * @returns          the statement's fingerprint
+     */
+    static std::string fingerprint(const hsql::SQLStatement *statement);
+
     /**
      * Check if a given word is a reserved word in our version of SQL.
      */
     static bool is_reserved_word(std::string word);
 
+    /**
+     * Unparse an expression.
+     * @param expr  Hyrise AST pointer of the expression
+     * @returns     string of the SQL expression
+     */
+    static std::string expression(const hsql::Expr *expr);
+
 private:
     // reserved words
     static const std::vector<std::string> reserved_words;
 
+    // how to unparse: as written, with nested operations in parentheses, or also with literals as ?
+    enum Form {
+        PLAIN,
+        GROUPED,
+        STRIPPED
+    };
+
     // sub-expressions
-    static std::string operator_expression(const hsql::Expr *expr);
+    static std::string expression(const hsql::Expr *expr, Form form);
 
-    static std::string expression(const hsql::Expr *expr);
+    static std::string operator_expression(const hsql::Expr *expr, Form form);
 
-    static std::string table_ref(const hsql::TableRef *table);
+    static std::string table_ref(const hsql::TableRef *table, Form form);
 
     static std::string column_definition(const hsql::ColumnDefinition *col);
 
-    static std::string select(const hsql::SelectStatement *stmt);
+    static std::string select(const hsql::SelectStatement *stmt, Form form);
 
-    static std::string insert(const hsql::InsertStatement *stmt);
+    static std::string insert(const hsql::InsertStatement *stmt, Form form);
 
     static std::string create(const hsql::CreateStatement *stmt);
 
@@ -49,3 +72,5 @@ private:
 
     static std::string show(const hsql::ShowStatement *stmt);
 };
+
+bool test_parse_tree_to_string();
@@ -3,7 +3,22 @@
  * @author Kevin Lundeen
  * @see "Seattle University, CPSC5300, Spring 2020"
  */
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
 #include "SQLExec.h"
+#include "result_writer.h"
+#include "ParseTreeToString.h"
+#include "bulk_load.h"
+#include "counters.h"
+#include "expression.h"
+#include "hash_join.h"
+#include "merge_join.h"
+#include "parallel_scan.h"
+#include "table_dump.h"
+#include "trace.h"
+#include "transaction.h"
 
 using namespace std;
 using namespace hsql;
@@ -11,38 +26,36 @@ using namespace hsql;
 // define static data
 Tables *SQLExec::tables = nullptr;
 Indices *SQLExec::indices = nullptr;
+Statistics *SQLExec::statistics = nullptr;
+atomic<uint64_t> SQLExec::schema_version(0);
+mutex SQLExec::schema_lock;
+SQLSession SQLExec::default_session;
+StatementStatistics *SQLExec::statement_statistics = nullptr;
 
-// make query result be printable
-ostream &operator<<(ostream &out, const QueryResult &qres) {
-    if (qres.column_names != nullptr) {
-        for (auto const &column_name: *qres.column_names)
-            out << column_name << " ";
-        out << endl << "+";
-        for (unsigned int i = 0; i < qres.column_names->size(); i++)
-            out << "----------+";
-        out << endl;
-        for (auto const &row: *qres.rows) {
-            for (auto const &column_name: *qres.column_names) {
-                Value value = row->at(column_name);
-                switch (value.data_type) {
-                    case ColumnAttribute::INT:
-                        out << value.n;
-                        break;
-                    case ColumnAttribute::TEXT:
-                        out << "\"" << value.s << "\"";
-                        break;
-                    case ColumnAttribute::BOOLEAN:
-                        out << (value.n == 0 ? "false" : "true");
-                        break;
-                    default:
-                        out << "???";
-                }
-                out << " ";
+void QueryResult::write(ResultWriter &writer) const {
+    if (this->column_names != nullptr) {
+        writer.begin(*this->column_names,
+                     this->column_attributes != nullptr ? *this->column_attributes : ColumnAttributes());
+        ValueRow row;
+        if (this->source != nullptr) {
+            while (this->source->next(row))
+                writer.row(row);
+        } else {
+            for (auto const &dict: *this->rows) {
+                row.clear();
+                for (auto const &column_name: *this->column_names)
+                    row.push_back(dict->at(column_name));
+                writer.row(row);
             }
-            out << endl;
         }
     }
-    out << qres.message;
+    writer.end(get_message());
+}
+
+// make query result be printable (in the table format)
+ostream &operator<<(ostream &out, const QueryResult &qres) {
+    TableWriter writer(out);
+    qres.write(writer);
     return out;
 }
 
@@ -66,35 +79,631 @@ QueryResult::~QueryResult() {
         }
         delete rows;
     }
+    delete source;
+}
+
+
+static thread_local SQLSession *current_session = nullptr;
+
+/**
+ * roll back the session's transaction and forget its prepared statements
+ */
+SQLSession::~SQLSession() {
+    delete this->transaction;
+    for (auto const &entry : this->prepared)
+        delete entry.second.parse;
+}
+
+/**
+ * make a session (and its transaction) the calling thread's, until the scope ends
+ * @param session  the session
+ */
+SQLSession::Scope::Scope(SQLSession &session)
+        : session(session), outer(current_session), outer_transaction(Transaction::current()) {
+    current_session = &session;
+    Transaction::set_current(session.transaction);
+}
+
+SQLSession::Scope::~Scope() {
+    this->session.transaction = Transaction::current();
+    current_session = this->outer;
+    Transaction::set_current(this->outer_transaction);
+}
+
+SQLSession *SQLSession::current() {
+    return current_session;
 }
 
 
+/**
+ * @class SQLExec::SelectRows - the rows of a select, pulled from its plan as they are read.
+ *
+ * The plan is opened before the result is returned and closed when it runs out of rows (or the
+ * result is deleted), then put (back) in the plan cache. The select is then recorded in the
+ * statement statistics, timed from when it started being planned to when its last row was read.
+ */
+class SQLExec::SelectRows : public RowSource {
+public:
+    SelectRows(EvalPlan *plan, PlanCache &plan_cache, const string &fingerprint,
+               const vector<ColumnAttribute::DataType> &types, uint64_t schema_version,
+               chrono::steady_clock::time_point started, unique_ptr<PageTally> pages)
+            : plan(plan), plan_cache(plan_cache), fingerprint(fingerprint), types(types),
+              schema_version(schema_version), started(started), pages(move(pages)), rows(0), done(false) {}
+
+    virtual ~SelectRows() {
+        if (!this->done)
+            finish();
+        delete this->plan;
+    }
+
+    bool next(ValueRow &row) override {
+        if (this->done)
+            return false;
+        PageTally::Scope counting(this->pages.get());
+        try {
+            if (this->plan->next(row)) {
+                this->rows++;
+                return true;
+            }
+        } catch (DbRelationError &e) {
+            fail();
+            throw SQLExecError(string("DbRelationError: ") + e.what());
+        } catch (...) {
+            fail();
+            throw;
+        }
+        finish();
+        return false;
+    }
+
+    string get_message() const override {
+        return "successfully fetch " + to_string(this->rows) + " rows";
+    }
+
+protected:
+    EvalPlan *plan;  // checked out of the plan cache until it is done
+    PlanCache &plan_cache;
+    string fingerprint;
+    vector<ColumnAttribute::DataType> types;
+    uint64_t schema_version;
+    chrono::steady_clock::time_point started;
+    unique_ptr<PageTally> pages;  // read by the plan (and its scan workers) so far
+    uint64_t rows;
+    bool done;
+
+    void finish() {
+        this->done = true;
+        this->plan->close();
+        this->plan_cache.put(this->fingerprint, this->plan, this->types, this->schema_version);
+        this->plan = nullptr;
+        uint64_t nanos = (uint64_t) chrono::duration_cast<chrono::nanoseconds>(
+                chrono::steady_clock::now() - this->started).count();
+        statement_statistics->record(this->fingerprint, nanos, this->rows, this->pages->get());
+    }
+
+    // a plan that failed part way may be left open, so it is not kept
+    void fail() {
+        this->done = true;
+        delete this->plan;
+        this->plan = nullptr;
+    }
+};
+
+
 /**
  * exectute the specific statement
  * @param statement  pointer to the statement
  */
 QueryResult *SQLExec::execute(const SQLStatement *statement) {
-    if(tables == nullptr){
-        tables = new Tables();
-    }
-    if(indices == nullptr){
-        indices = new Indices();
-    }
-    
+    initialize();
+    return measure(statement, ParseTreeToString::fingerprint(statement), ValueRow());
+}
+
+/**
+ * execute a statement and add what it cost to the statistics of its fingerprint
+ * @param statement    pointer to the statement
+ * @param fingerprint  the statement's fingerprint
+ * @param arguments    values of the statement's placeholders
+ */
+QueryResult *SQLExec::measure(const SQLStatement *statement, const string &fingerprint, const ValueRow &arguments) {
+    uint64_t nanos = 0;
+    PageTally pages;
+    PageTally::Scope counting(&pages);
+    QueryResult *result = nullptr;
+    bool in_transaction = Transaction::current() != nullptr;
     try {
+        Stopwatch watch(nanos);
+        // a schema change is made under the lock from before its snapshot is taken until it has committed
+        unique_lock<mutex> schema_guard(schema_lock, defer_lock);
+        if (statement->isType(kStmtCreate) || statement->isType(kStmtDrop)) {
+            if (in_transaction)
+                throw SQLExecError(string(statement->isType(kStmtCreate) ? "CREATE" : "DROP")
+                                   + " can't be run inside a transaction");
+            schema_guard.lock();
+            schema_changed();
+        }
+        Autocommit autocommit;
         switch (statement->type()) {
             case kStmtCreate:
-                return create((const CreateStatement *) statement);
+                result = create((const CreateStatement *) statement);
+                break;
             case kStmtDrop:
-                return drop((const DropStatement *) statement);
+                result = drop((const DropStatement *) statement);
+                break;
             case kStmtShow:
-                return show((const ShowStatement *) statement);
+                result = show((const ShowStatement *) statement);
+                break;
+            case kStmtInsert:
+            case kStmtSelect:
+                result = run(statement, fingerprint, arguments);
+                break;
             default:
                 return new QueryResult("not implemented");
         }
+        autocommit.commit();
+    } catch (DbRelationError &e) {
+        delete result;
+        throw statement_failed(string("DbRelationError: ") + e.what());
+    } catch (SQLExecError &e) {
+        delete result;
+        throw statement_failed(e.what());
+    }
+    if (result->get_source() != nullptr)
+        return result;  // recorded once its rows are read
+    uint64_t rows = 0;
+    if (statement->isType(kStmtInsert))
+        rows = 1;
+    else if (result->get_rows() != nullptr)
+        rows = result->get_rows()->size();
+    statement_statistics->record(fingerprint, nanos, rows, pages.get());
+    return result;
+}
+
+/**
+ * roll back the transaction begun with BEGIN, if any, since a statement in it failed
+ * @param message  the statement's error
+ */
+SQLExecError SQLExec::statement_failed(const string &message) {
+    Transaction *transaction = Transaction::current();
+    if (transaction == nullptr)
+        return SQLExecError(message);
+    Transaction::set_current(nullptr);
+    delete transaction;
+    return SQLExecError(message + " (transaction rolled back)");
+}
+
+/**
+ * execute BEGIN
+ */
+QueryResult *SQLExec::begin() {
+    if (Transaction::current() != nullptr)
+        throw SQLExecError("a transaction is already in progress");
+    Transaction::set_current(new Transaction());
+    return new QueryResult("began transaction");
+}
+
+/**
+ * execute COMMIT
+ */
+QueryResult *SQLExec::commit() {
+    unique_ptr<Transaction> transaction(Transaction::current());
+    if (!transaction)
+        throw SQLExecError("no transaction in progress");
+    Transaction::set_current(nullptr);
+    try {
+        transaction->commit();
     } catch (DbRelationError &e) {
         throw SQLExecError(string("DbRelationError: ") + e.what());
     }
+    return new QueryResult("committed transaction");
+}
+
+/**
+ * execute ROLLBACK
+ */
+QueryResult *SQLExec::rollback() {
+    unique_ptr<Transaction> transaction(Transaction::current());
+    if (!transaction)
+        throw SQLExecError("no transaction in progress");
+    Transaction::set_current(nullptr);
+    transaction->rollback();
+    return new QueryResult("rolled back transaction");
+}
+
+/**
+ * open the schema tables the first time they are needed (by whichever thread gets there first)
+ */
+void SQLExec::initialize() {
+    static once_flag initialized;
+    call_once(initialized, [] {
+        tables = new Tables();
+        indices = new Indices();
+        statistics = new Statistics();
+        statement_statistics = new StatementStatistics();
+    });
+}
+
+Indices &SQLExec::get_indices() {
+    initialize();
+    return *indices;
+}
+
+/**
+ * the calling thread's session, or the default one
+ */
+SQLSession &SQLExec::session() {
+    SQLSession *session = SQLSession::current();
+    return session != nullptr ? *session : default_session;
+}
+
+/**
+ * stop using the cached plans before the schema or statistics change: the planner might choose
+ * differently now. Other sessions' plans are not used again once they see the new version.
+ */
+void SQLExec::schema_changed() {
+    schema_version++;
+    session().plan_cache.clear();
+}
+
+/**
+ * run a select or insert
+ * @param statement    pointer to the statement
+ * @param fingerprint  the statement's fingerprint, which its cached plan is found by
+ * @param arguments    values of the statement's placeholders
+ */
+QueryResult *SQLExec::run(const SQLStatement *statement, const string &fingerprint, const ValueRow &arguments) {
+    Parameters parameters;
+    uint placeholders = number_parameters(statement, arguments, parameters);
+    if (placeholders != arguments.size())
+        throw SQLExecError("statement has " + to_string(placeholders) + " parameters but " +
+                           to_string(arguments.size()) + " values were given");
+    if (statement->isType(kStmtInsert))
+        return insert((const InsertStatement *) statement, parameters);
+    return select((const SelectStatement *) statement, fingerprint, parameters);
+}
+
+// the ON conditions of the joins in a FROM clause
+static void join_conditions(const TableRef *table, vector<const Expr *> &conditions) {
+    if (table->type == kTableJoin) {
+        join_conditions(table->join->left, conditions);
+        join_conditions(table->join->right, conditions);
+        if (table->join->condition != nullptr)
+            conditions.push_back(table->join->condition);
+    } else if (table->type == kTableCrossProduct) {
+        for (TableRef *tbl : *table->list)
+            join_conditions(tbl, conditions);
+    }
+}
+
+/**
+ * number the parameters of a statement: the placeholders anywhere in it, and the literals of its
+ * conditions and INSERT values (select list literals stay constants, as they name the columns)
+ * @param statement   pointer to the statement
+ * @param arguments   values of the statement's placeholders
+ * @param parameters  where to put the parameters
+ */
+uint SQLExec::number_parameters(const SQLStatement *statement, const ValueRow &arguments, Parameters &parameters) {
+    uint placeholders = 0;
+    if (statement->isType(kStmtInsert)) {
+        const InsertStatement *insert = (const InsertStatement *) statement;
+        if (insert->values != nullptr)
+            for (const Expr *expr : *insert->values)
+                number_parameters(expr, true, arguments, parameters, placeholders);
+    } else if (statement->isType(kStmtSelect)) {
+        const SelectStatement *select = (const SelectStatement *) statement;
+        for (const Expr *expr : *select->selectList)
+            number_parameters(expr, false, arguments, parameters, placeholders);
+        vector<const Expr *> conditions;
+        if (select->fromTable != nullptr)
+            join_conditions(select->fromTable, conditions);
+        if (select->whereClause != nullptr)
+            conditions.push_back(select->whereClause);
+        for (const Expr *condition : conditions)
+            number_parameters(condition, true, arguments, parameters, placeholders);
+    }
+    return placeholders;
+}
+
+/**
+ * number the parameters in an expression
+ * @param expr          pointer to the expression
+ * @param literals      whether literals are numbered too
+ * @param arguments     values of the statement's placeholders
+ * @param parameters    where to put the parameters
+ * @param placeholders  count of placeholders found
+ */
+void SQLExec::number_parameters(const Expr *expr, bool literals, const ValueRow &arguments, Parameters &parameters,
+                                uint &placeholders) {
+    if (expr == nullptr)
+        return;
+    if (expr->type == kExprPlaceholder) {
+        placeholders++;
+        parameters.numbers[expr] = (uint) parameters.values.size();
+        if (expr->ival >= 0 && (uint64_t) expr->ival < arguments.size())
+            parameters.values.push_back(arguments[expr->ival]);
+        else
+            parameters.values.push_back(Value());
+        return;
+    }
+    if (literals && (expr->type == kExprLiteralInt || expr->type == kExprLiteralString ||
+                     (expr->type == kExprOperator && expr->opType == Expr::UMINUS && expr->expr != nullptr &&
+                      expr->expr->type == kExprLiteralInt))) {
+        parameters.numbers[expr] = (uint) parameters.values.size();
+        parameters.values.push_back(literal(expr));
+        return;
+    }
+    number_parameters(expr->expr, literals, arguments, parameters, placeholders);
+    number_parameters(expr->expr2, literals, arguments, parameters, placeholders);
+    if (expr->exprList != nullptr)
+        for (const Expr *item : *expr->exprList)
+            number_parameters(item, literals, arguments, parameters, placeholders);
+}
+
+/**
+ * the number of the parameter an expression is, or -1
+ * @param expr        pointer to the expression
+ * @param parameters  the statement's parameters
+ */
+int SQLExec::parameter(const Expr *expr, const Parameters &parameters) {
+    auto found = parameters.numbers.find(expr);
+    return found == parameters.numbers.end() ? -1 : (int) found->second;
+}
+
+/**
+ * keep a parsed SELECT or INSERT under a name
+ * @param name   name of the prepared statement
+ * @param parse  the parsed statement
+ */
+QueryResult *SQLExec::prepare(Identifier name, SQLParserResult *parse) {
+    initialize();
+    try {
+        map<Identifier, SQLSession::PreparedStatement> &prepared = session().prepared;
+        if (prepared.count(name) > 0)
+            throw SQLExecError("prepared statement " + name + " already exists");
+        if (parse->size() != 1)
+            throw SQLExecError("only one statement can be prepared at a time");
+        const SQLStatement *statement = parse->getStatement(0);
+        if (!statement->isType(kStmtSelect) && !statement->isType(kStmtInsert))
+            throw SQLExecError("only SELECT and INSERT statements can be prepared");
+        Parameters parameters;
+        uint placeholders = number_parameters(statement, ValueRow(), parameters);
+        prepared[name] = SQLSession::PreparedStatement{parse, ParseTreeToString::fingerprint(statement), placeholders};
+        return new QueryResult("prepared " + name + " with " + to_string(placeholders) + " parameters");
+    } catch (...) {
+        delete parse;
+        throw;
+    }
+}
+
+/**
+ * run a prepared statement: it is not parsed again, and its plan comes from the plan cache
+ * @param name       name of the prepared statement
+ * @param arguments  values of its placeholders
+ */
+QueryResult *SQLExec::execute_prepared(Identifier name, const ValueRow &arguments) {
+    initialize();
+    auto &prepared = session().prepared;
+    auto found = prepared.find(name);
+    if (found == prepared.end())
+        throw SQLExecError("prepared statement " + name + " does not exist");
+    return measure(found->second.parse->getStatement(0), found->second.fingerprint, arguments);
+}
+
+/**
+ * forget a prepared statement
+ * @param name  name of the prepared statement
+ */
+QueryResult *SQLExec::deallocate(Identifier name) {
+    auto &prepared = session().prepared;
+    auto found = prepared.find(name);
+    if (found == prepared.end())
+        throw SQLExecError("prepared statement " + name + " does not exist");
+    delete found->second.parse;
+    prepared.erase(found);
+    return new QueryResult("deallocated " + name);
+}
+
+/**
+ * execute ANALYZE <table>: scan the table and replace its rows in _statistics
+ * @param table_name  name of the table to analyze
+ */
+QueryResult *SQLExec::analyze(Identifier table_name) {
+    initialize();
+    if (Transaction::current() != nullptr)
+        throw statement_failed("ANALYZE can't be run inside a transaction");
+    try {
+        lock_guard<mutex> guard(schema_lock);
+        if (!table_exist(table_name))
+            throw SQLExecError("table " + table_name + " doesn't exist");
+        Autocommit autocommit;
+        TableStatistics table_statistics;
+        table_statistics.gather(*tables->get_table(table_name));
+        schema_changed();
+        statistics->put_statistics(table_name, table_statistics);
+        autocommit.commit();
+        return new QueryResult("analyzed " + table_name + ": " + to_string(table_statistics.rows) + " rows in "
+                               + to_string(table_statistics.pages) + " pages");
+    } catch (DbRelationError &e) {
+        throw SQLExecError(string("DbRelationError: ") + e.what());
+    }
+}
+
+/**
+ * execute COPY <table> FROM '<file>': append the rows of a CSV or TSV file to the table and its indices
+ * @param table_name  name of the table to load
+ * @param path        file to read
+ * @param delimiter   ',' for CSV or '\t' for TSV
+ * @param header      whether the file's first line holds column names
+ */
+QueryResult *SQLExec::copy_from(Identifier table_name, string path, char delimiter, bool header) {
+    initialize();
+    try {
+        if (!table_exist(table_name))
+            throw SQLExecError("table " + table_name + " doesn't exist");
+        RelationRef table = tables->get_table(table_name);
+        IndexNames index_names = indices->get_index_names(table_name);
+        Handles handles;
+        uint64_t nanos = 0;
+        uint64_t rows;
+        {
+            Stopwatch watch(nanos);
+            Autocommit autocommit;
+            BulkLoad load(*table, path, delimiter, header, ParallelScan::default_threads);
+            rows = load.run(index_names.empty() ? nullptr : &handles);
+            for (Identifier index_name : index_names) {
+                IndexRef index = indices->get_index(table_name, index_name);
+                for (auto const &handle : handles)
+                    index->insert(handle);
+            }
+            autocommit.commit();
+        }
+        double seconds = max(nanos, (uint64_t) 1) / 1e9;
+        ostringstream message;
+        message << "copied " << rows << " rows into " << table_name;
+        if (!index_names.empty())
+            message << " and " << index_names.size() << " indices";
+        message << " in " << fixed << setprecision(3) << seconds << " s (" << (uint64_t) (rows / seconds)
+                << " rows/s)";
+        return new QueryResult(message.str());
+    } catch (DbRelationError &e) {
+        throw statement_failed(string("DbRelationError: ") + e.what());
+    } catch (SQLExecError &e) {
+        throw statement_failed(e.what());
+    }
+}
+
+/**
+ * execute COPY <table> TO '<file>': write the table's rows to a CSV or TSV file
+ * @param table_name  name of the table to export
+ * @param path        file to write
+ * @param delimiter   ',' for CSV or '\t' for TSV
+ * @param header      whether to write a line of column names first
+ */
+QueryResult *SQLExec::copy_to(Identifier table_name, string path, char delimiter, bool header) {
+    initialize();
+    try {
+        if (!table_exist(table_name))
+            throw SQLExecError("table " + table_name + " doesn't exist");
+        ofstream out(path, ios::binary | ios::trunc);
+        if (!out)
+            throw SQLExecError("cannot create " + path);
+        uint64_t nanos = 0;
+        uint64_t rows = 0;
+        {
+            Stopwatch watch(nanos);
+            Autocommit autocommit;  // one snapshot for the whole scan
+            TableScan scan(tables->get_table(table_name), table_name);
+            DelimitedWriter writer(out, delimiter, header);
+            scan.open();
+            writer.begin(scan.get_column_names(), scan.get_column_attributes());
+            ValueRow row;
+            while (scan.next(row)) {
+                writer.row(row);
+                rows++;
+            }
+            writer.end("");
+            scan.close();
+            autocommit.commit();
+            out.close();
+        }
+        if (out.fail())
+            throw SQLExecError("cannot write " + path);
+        double seconds = max(nanos, (uint64_t) 1) / 1e9;
+        ostringstream message;
+        message << "copied " << rows << " rows from " << table_name << " in " << fixed << setprecision(3)
+                << seconds << " s (" << (uint64_t) (rows / seconds) << " rows/s)";
+        return new QueryResult(message.str());
+    } catch (DbRelationError &e) {
+        throw SQLExecError(string("DbRelationError: ") + e.what());
+    }
+}
+
+// e.g. "4096 blocks (16.0 MB) in 0.052 s (307.7 MB/s)"
+static string block_rate(uint64_t blocks, uint64_t nanos) {
+    double megabytes = blocks * (double) DbBlock::BLOCK_SZ / (1024 * 1024);
+    double seconds = max(nanos, (uint64_t) 1) / 1e9;
+    ostringstream text;
+    text << blocks << " blocks (" << fixed << setprecision(1) << megabytes << " MB) in " << setprecision(3)
+         << seconds << " s (" << setprecision(1) << megabytes / seconds << " MB/s)";
+    return text.str();
+}
+
+/**
+ * execute COPY <table> TO '<file>' RAW: dump the table's blocks
+ * @param table_name  name of the table to dump
+ * @param path        file to write
+ */
+QueryResult *SQLExec::dump(Identifier table_name, string path) {
+    initialize();
+    try {
+        if (!table_exist(table_name))
+            throw SQLExecError("table " + table_name + " doesn't exist");
+        uint64_t nanos = 0;
+        uint64_t blocks;
+        {
+            Stopwatch watch(nanos);
+            Autocommit autocommit;  // one snapshot for every block
+            blocks = TableDump::dump(*tables->get_table(table_name), table_name, path);
+            autocommit.commit();
+        }
+        return new QueryResult("dumped " + table_name + ": " + block_rate(blocks, nanos));
+    } catch (DbRelationError &e) {
+        throw SQLExecError(string("DbRelationError: ") + e.what());
+    }
+}
+
+/**
+ * execute COPY <table> FROM '<file>' RAW: append the blocks of a dump to the table and its rows to its indices
+ * @param table_name  name of the table to restore into
+ * @param path        dump to read
+ */
+QueryResult *SQLExec::restore(Identifier table_name, string path) {
+    initialize();
+    try {
+        uint64_t nanos = 0;
+        uint64_t rows, blocks;
+        IndexNames index_names;
+        {
+            Stopwatch watch(nanos);
+            Autocommit autocommit;
+            TableDump dump(path);
+            if (!table_exist(table_name)) {
+                static const char *TYPE_NAMES[] = {"INT", "TEXT", "BOOLEAN"};
+                string columns;
+                for (uint i = 0; i < dump.column_names.size(); i++)
+                    columns += string(i > 0 ? ", " : "") + dump.column_names[i] + " "
+                               + TYPE_NAMES[dump.column_attributes[i].get_data_type()];
+                throw SQLExecError("table " + table_name + " doesn't exist; create it first with CREATE TABLE "
+                                   + table_name + " (" + columns + ")");
+            }
+            RelationRef table = tables->get_table(table_name);
+            ColumnAttributes column_attributes = table->get_column_attributes();
+            bool same = table->get_column_names() == dump.column_names
+                        && column_attributes.size() == dump.column_attributes.size();
+            for (uint i = 0; same && i < column_attributes.size(); i++)
+                same = column_attributes[i].get_data_type() == dump.column_attributes[i].get_data_type();
+            if (!same)
+                throw SQLExecError("the columns of " + table_name + " are not those of the dump of "
+                                   + dump.table_name);
+            index_names = indices->get_index_names(table_name);
+            Handles handles;
+            rows = dump.restore(*table, index_names.empty() ? nullptr : &handles, blocks);
+            for (Identifier index_name : index_names) {
+                IndexRef index = indices->get_index(table_name, index_name);
+                for (auto const &handle : handles)
+                    index->insert(handle);
+            }
+            autocommit.commit();
+        }
+        string message = "restored " + to_string(rows) + " rows into " + table_name;
+        if (!index_names.empty())
+            message += " and " + to_string(index_names.size()) + " indices";
+        return new QueryResult(message + ": " + block_rate(blocks, nanos));
+    } catch (DbRelationError &e) {
+        throw statement_failed(string("DbRelationError: ") + e.what());
+    } catch (SQLExecError &e) {
+        throw statement_failed(e.what());
+    }
 }
 
 /**
@@ -144,8 +753,8 @@ QueryResult *SQLExec::create_index(const CreateStatement *statement) {
         throw SQLExecError(table_name + " not exist， can't build index on it");
     }
 
-	DbRelation& table = SQLExec::tables->get_table(table_name);
-	const ColumnNames& table_columns = table.get_column_names();
+	RelationRef table = SQLExec::tables->get_table(table_name);
+	const ColumnNames& table_columns = table->get_column_names();
 	for (auto const& col_name : *statement->indexColumns) {
 		if (find(table_columns.begin(), table_columns.end(), col_name) == table_columns.end()) {
 			throw SQLExecError(string("column '" + string(col_name) + "' does not exist"));
@@ -159,15 +768,17 @@ QueryResult *SQLExec::create_index(const CreateStatement *statement) {
 	row["is_unique"] = Value(string(statement->indexType) == "BTREE");
 	int seq = 0;
 	Handles inHandles;
-    DbIndex* index = nullptr;
+    IndexRef index;
 	try {
 		for (auto const &col_name : *statement->indexColumns) {
 			row["seq_in_index"] = Value(++seq);
 			row["column_name"] = Value(col_name);
 			inHandles.push_back(SQLExec::indices->insert(&row));
 		}
-		index = &(indices->get_index(table_name, index_name));
+		index = indices->get_index(table_name, index_name);
 		index->create();
+		ColumnNames key_columns(statement->indexColumns->begin(), statement->indexColumns->end());
+		load_index(*table, *index, key_columns);
 	}
 	catch (...) {
         if(index != nullptr){
@@ -184,6 +795,40 @@ QueryResult *SQLExec::create_index(const CreateStatement *statement) {
 	return new QueryResult("created index " + index_name);
 }
 
+/**
+ * insert the rows already in a table into a new index in key order, so a B-tree fills its leaves
+ * from left to right instead of splitting pages all over
+ * @param table        table being indexed
+ * @param index        the new, empty index
+ * @param key_columns  columns of the index key
+ */
+void SQLExec::load_index(DbRelation &table, DbIndex &index, const ColumnNames &key_columns) {
+    SortKeys keys;
+    for (uint i = 0; i < key_columns.size(); i++)
+        keys.push_back(SortKey{i, false});
+    Sorter sorter(keys);
+
+    // sort (key..., block id, record id)
+    ValueRow row;
+    Handles *handles = table.select();
+    for (auto const &handle : *handles) {
+        ValueDict *values = table.project(handle, &key_columns);
+        row.clear();
+        for (auto const &column : key_columns)
+            row.push_back((*values)[column]);
+        row.push_back(Value((int32_t) handle.first));
+        row.push_back(Value((int32_t) handle.second));
+        delete values;
+        sorter.add(row);
+    }
+    delete handles;
+
+    sorter.sort();
+    uint n = (uint) key_columns.size();
+    while (sorter.next(row))
+        index.insert(Handle((BlockID) row[n].n, (RecordID) row[n + 1].n));
+}
+
 /**
  * exectute the create table statement
  * @param statement  pointer to the statement
@@ -197,9 +842,9 @@ QueryResult *SQLExec::create_table(const CreateStatement *statement) {
     Handle table_handle = tables->insert(&row);
 
     Handles col_handles;
-    DbRelation *column_table = nullptr;
+    RelationRef column_table;
     try{
-        column_table = &(tables->get_table(Columns::TABLE_NAME));
+        column_table = tables->get_table(Columns::TABLE_NAME);
         for (ColumnDefinition *col : *statement->columns) {
             Identifier column_name;
             ColumnAttribute column_attribute;
@@ -211,11 +856,11 @@ QueryResult *SQLExec::create_table(const CreateStatement *statement) {
             col_handles.push_back(column_table->insert(&row));
         }
         // creat new table & cache new table
-        DbRelation& table = tables->get_table(table_name);
+        RelationRef table = tables->get_table(table_name);
         if (statement->ifNotExists)
-            table.create_if_not_exists();
+            table->create_if_not_exists();
         else
-            table.create();
+            table->create();
     } catch (exception& e){
         if(column_table != nullptr){
             try{
@@ -277,6 +922,9 @@ QueryResult *SQLExec::drop_table(const DropStatement *statement) {
     if(table_name == Indices::TABLE_NAME){
         throw SQLExecError("can't drop _indices");
     }
+    if(table_name == Statistics::TABLE_NAME){
+        throw SQLExecError("can't drop _statistics");
+    }
     if(!table_exist(table_name)){
         throw SQLExecError(table_name + " not exist");
     }
@@ -287,19 +935,20 @@ QueryResult *SQLExec::drop_table(const DropStatement *statement) {
         drop_index(table_name, index_name);
     }
 
-    DbRelation &table = tables->get_table(table_name);
-    DbRelation &column = tables->get_table(Columns::TABLE_NAME);
+    RelationRef table = tables->get_table(table_name);
+    RelationRef column = tables->get_table(Columns::TABLE_NAME);
     
     ValueDict where;
     where["table_name"] = Value(table_name);
     // delete table from _columns
-    Handles *handles = column.select(&where);
+    Handles *handles = column->select(&where);
     for(Handle handle : *handles){
-        column.del(handle);
+        column->del(handle);
     }
     delete handles;
-    // delete table from DB
-    table.drop();
+    // delete table's statistics and the table from DB
+    statistics->del_statistics(table_name);
+    table->drop();
     // delete table from _tables
     handles = tables->select(&where);
     for(Handle handle : *handles){
@@ -329,9 +978,9 @@ QueryResult *SQLExec::drop_index(const DropStatement *statement){
  * @param index_name  the index name
  */
 void SQLExec::drop_index(Identifier table_name, Identifier index_name){
-    DbIndex& index = indices->get_index(table_name, index_name);
+    IndexRef index = indices->get_index(table_name, index_name);
     // delete physical index
-    index.drop();
+    index->drop();
     // delete records from _indices
     ValueDict where;
     where["table_name"] = Value(table_name);
@@ -361,6 +1010,84 @@ QueryResult *SQLExec::show(const ShowStatement *statement) {
     }
 }
 
+// a counter as a TEXT column value: counters soon pass what an INT column holds
+static Value counter(uint64_t n) {
+    return Value(to_string(n));
+}
+
+/**
+ * show the statistics of each statement fingerprint, highest total time first
+ */
+QueryResult *SQLExec::show_statement_stats() {
+    initialize();
+    vector<StatementStatistics::Summary> summaries;
+    statement_statistics->get_summaries(summaries);
+    sort(summaries.begin(), summaries.end(),
+         [](const StatementStatistics::Summary &a, const StatementStatistics::Summary &b) {
+             return a.total_nanos > b.total_nanos;
+         });
+
+    ColumnNames *col_names = new ColumnNames{"query", "calls", "total_ms", "min_us", "max_us", "p99_us", "rows",
+                                             "pages"};
+    ColumnAttributes *col_attrs = new ColumnAttributes(col_names->size(), ColumnAttribute(ColumnAttribute::TEXT));
+    ValueDicts *rows = new ValueDicts();
+    for (auto const &summary : summaries) {
+        ValueDict *row = new ValueDict();
+        (*row)["query"] = Value(summary.fingerprint);
+        (*row)["calls"] = counter(summary.calls);
+        (*row)["total_ms"] = counter(summary.total_nanos / 1000000);
+        (*row)["min_us"] = counter(summary.min_nanos / 1000);
+        (*row)["max_us"] = counter(summary.max_nanos / 1000);
+        (*row)["p99_us"] = counter(summary.p99_nanos / 1000);
+        (*row)["rows"] = counter(summary.rows);
+        (*row)["pages"] = counter(summary.pages);
+        rows->push_back(row);
+    }
+    string message = "successfully fetch " + to_string(rows->size()) + " rows";
+    if (statement_statistics->get_dropped() > 0)
+        message += " (" + to_string(statement_statistics->get_dropped()) + " executions not tracked: table full)";
+    return new QueryResult(col_names, col_attrs, rows, message);
+}
+
+/**
+ * show the engine's counters and the buffer pool, log and lock statistics, one per row
+ */
+QueryResult *SQLExec::show_status() {
+    vector<pair<string, uint64_t>> status;
+    for (int counter = 0; counter < Counters::COUNTERS; counter++)
+        status.emplace_back(Counters::name((Counters::Counter) counter), Counters::get((Counters::Counter) counter));
+
+    DB_MPOOL_STAT *pool = nullptr;
+    if (_DB_ENV->memp_stat(&pool, nullptr, 0) == 0 && pool != nullptr) {
+        status.emplace_back("buffer_pool_hits", pool->st_cache_hit);
+        status.emplace_back("buffer_pool_misses", pool->st_cache_miss);
+        status.emplace_back("buffer_pool_pages_in", pool->st_page_in);
+        status.emplace_back("buffer_pool_pages_out", pool->st_page_out);
+        status.emplace_back("buffer_pool_evictions", (uint64_t) pool->st_ro_evict + pool->st_rw_evict);
+        status.emplace_back("buffer_pool_pages", pool->st_pages);
+        status.emplace_back("buffer_pool_dirty_pages", pool->st_page_dirty);
+    }
+    free(pool);
+
+    const LogManager *log = Transaction::get_log();
+    if (log != nullptr) {
+        status.emplace_back("commits", log->get_commits());
+        status.emplace_back("log_syncs", log->get_syncs());
+    }
+    status.emplace_back("lock_waits", Transaction::get_lock_manager().get_waits());
+    status.emplace_back("deadlocks", Transaction::get_lock_manager().get_deadlocks());
+
+    ColumnNames *col_names = new ColumnNames{"name", "value"};
+    ColumnAttributes *col_attrs = new ColumnAttributes(col_names->size(), ColumnAttribute(ColumnAttribute::TEXT));
+    ValueDicts *rows = new ValueDicts();
+    for (auto const &entry : status) {
+        ValueDict *row = new ValueDict();
+        (*row)["name"] = Value(entry.first);
+        (*row)["value"] = counter(entry.second);
+        rows->push_back(row);
+    }
+    return new QueryResult(col_names, col_attrs, rows, "successfully fetch " + to_string(rows->size()) + " rows");
+}
 
 /**
  * exectute the show index statement
@@ -404,7 +1131,8 @@ QueryResult *SQLExec::show_tables() {
     for(Handle handle : *handles){
         ValueDict *row = tables->project(handle, col_names);
         Value name = row->at("table_name");
-        if(name != Value(Tables::TABLE_NAME) && name != Value(Columns::TABLE_NAME) && name != Value(Indices::TABLE_NAME)){
+        if(name != Value(Tables::TABLE_NAME) && name != Value(Columns::TABLE_NAME) && name != Value(Indices::TABLE_NAME)
+           && name != Value(Statistics::TABLE_NAME)){
             rows->push_back(row);
         } else {
             delete row;
@@ -425,15 +1153,920 @@ QueryResult *SQLExec::show_columns(const ShowStatement *statement) {
     tables->get_columns(Columns::TABLE_NAME, *col_names, *col_attrs);
 
     ValueDicts *rows = new ValueDicts();
-    DbRelation &column = tables->get_table(Columns::TABLE_NAME);
+    RelationRef column = tables->get_table(Columns::TABLE_NAME);
     ValueDict where;
     where["table_name"] = Value(statement->tableName);
-    Handles *handles = column.select(&where);
+    Handles *handles = column->select(&where);
     for(Handle handle : *handles){
-        ValueDict *row = column.project(handle, col_names);
+        ValueDict *row = column->project(handle, col_names);
         rows->push_back(row);
     }
     delete handles;
     return new QueryResult(col_names, col_attrs, rows, 
         "successfully fetch " + to_string(rows->size()) + " rows");
 }
+
+/**
+ * convert an AST literal to a Value
+ * @param expr  pointer to the literal expression
+ */
+Value SQLExec::literal(const Expr *expr) {
+    switch (expr->type) {
+        case kExprLiteralInt:
+            return Value((int32_t) expr->ival);
+        case kExprLiteralString:
+            return Value(string(expr->name));
+        case kExprOperator:
+            if (expr->opType == Expr::UMINUS && expr->expr != nullptr && expr->expr->type == kExprLiteralInt)
+                return Value((int32_t) -expr->expr->ival);
+        default:
+            throw SQLExecError("only integer and string literals are supported");
+    }
+}
+
+/**
+ * exectute the insert statement
+ * @param statement  pointer to the statement
+ */
+QueryResult *SQLExec::insert(const InsertStatement *statement, const Parameters &parameters) {
+    Identifier table_name = statement->tableName;
+    if (statement->type != InsertStatement::kInsertValues)
+        throw SQLExecError("only INSERT ... VALUES is implemented");
+    if (!table_exist(table_name))
+        throw SQLExecError(table_name + " not exist");
+
+    RelationRef table = tables->get_table(table_name);
+    const ColumnNames &table_columns = table->get_column_names();
+    ColumnAttributes table_attributes = table->get_column_attributes();
+    ColumnNames column_names;
+    if (statement->columns != nullptr) {
+        for (auto const &col_name : *statement->columns)
+            column_names.push_back(col_name);
+    } else {
+        column_names = table_columns;
+    }
+    if (column_names.size() != statement->values->size())
+        throw SQLExecError("number of values does not match number of columns");
+
+    ValueDict row;
+    for (uint i = 0; i < column_names.size(); i++) {
+        auto column = find(table_columns.begin(), table_columns.end(), column_names[i]);
+        if (column == table_columns.end())
+            throw SQLExecError("column '" + column_names[i] + "' does not exist");
+        ColumnAttribute ca = table_attributes[column - table_columns.begin()];
+        int number = parameter(statement->values->at(i), parameters);
+        Value value = number >= 0 ? parameters.values[number] : literal(statement->values->at(i));
+        if ((value.data_type == ColumnAttribute::TEXT) != (ca.get_data_type() == ColumnAttribute::TEXT))
+            throw SQLExecError("wrong type of value for column '" + column_names[i] + "'");
+        value.data_type = ca.get_data_type();
+        row[column_names[i]] = value;
+    }
+
+    Handle handle = table->insert(&row);
+    IndexNames index_names = indices->get_index_names(table_name);
+    for (Identifier index_name : index_names)
+        indices->get_index(table_name, index_name)->insert(handle);
+    string suffix = index_names.empty() ? "" : " and " + to_string(index_names.size()) + " indices";
+    return new QueryResult("successfully inserted 1 row into " + table_name + suffix);
+}
+
+/**
+ * flatten a conjunction into its comparisons
+ * @param expr  pointer to the condition
+ * @param list  list to add the comparisons to
+ */
+void SQLExec::conjuncts(const Expr *expr, vector<const Expr *> &list) {
+    if (expr->type == kExprOperator && expr->opType == Expr::AND) {
+        conjuncts(expr->expr, list);
+        conjuncts(expr->expr2, list);
+    } else {
+        list.push_back(expr);
+    }
+}
+
+/**
+ * get the comparison a binary operator expression performs
+ * @param expr  pointer to the comparison
+ */
+ColumnPredicate::Comparison SQLExec::comparison(const Expr *expr) {
+    if (expr->type != kExprOperator)
+        throw SQLExecError("unsupported condition");
+    switch (expr->opType) {
+        case Expr::SIMPLE_OP:
+            if (expr->opChar == '=')
+                return ColumnPredicate::EQ;
+            if (expr->opChar == '<')
+                return ColumnPredicate::LT;
+            if (expr->opChar == '>')
+                return ColumnPredicate::GT;
+            throw SQLExecError(string("unsupported operator '") + expr->opChar + "'");
+        case Expr::NOT_EQUALS:
+            return ColumnPredicate::NE;
+        case Expr::LESS_EQ:
+            return ColumnPredicate::LE;
+        case Expr::GREATER_EQ:
+            return ColumnPredicate::GE;
+        default:
+            throw SQLExecError("unsupported operator in condition");
+    }
+}
+
+// whether an expression is a comparison that comparison() understands
+static bool is_comparison(const Expr *expr) {
+    if (expr->type != kExprOperator)
+        return false;
+    switch (expr->opType) {
+        case Expr::SIMPLE_OP:
+            return expr->opChar == '=' || expr->opChar == '<' || expr->opChar == '>';
+        case Expr::NOT_EQUALS:
+        case Expr::LESS_EQ:
+        case Expr::GREATER_EQ:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// whether literal() can convert an expression
+static bool is_literal(const Expr *expr) {
+    if (expr->type == kExprOperator && expr->opType == Expr::UMINUS)
+        expr = expr->expr;
+    return expr != nullptr && (expr->type == kExprLiteralInt || expr->type == kExprLiteralString);
+}
+
+/**
+ * compile a condition or select list expression for the rows of a plan
+ * @param expr  pointer to the expression
+ * @param plan  plan whose rows the expression is evaluated on
+ */
+Expression *SQLExec::compile(const Expr *expr, const EvalPlan *plan, const Parameters &parameters) {
+    Expression *expression = new Expression(ParseTreeToString::expression(expr));
+    try {
+        expression->finish(compile(expr, plan, parameters, *expression));
+    } catch (...) {
+        delete expression;
+        throw;
+    }
+    return expression;
+}
+
+/**
+ * compile one node of an expression, its operands first
+ * @param expr        pointer to the node
+ * @param plan        plan whose rows the expression is evaluated on
+ * @param expression  the program being compiled
+ */
+Expression::Operand SQLExec::compile(const Expr *expr, const EvalPlan *plan, const Parameters &parameters,
+                                     Expression &expression) {
+    int number = parameter(expr, parameters);
+    if (number >= 0)
+        return expression.parameter((uint) number, parameters.values[number]);
+    switch (expr->type) {
+        case kExprColumnRef: {
+            int col = plan->column_index(expr->table == nullptr ? "" : expr->table, expr->name);
+            if (col < 0)
+                throw SQLExecError(string("column '") + expr->name + "' does not exist");
+            ColumnAttribute ca = plan->get_column_attributes()[col];
+            return expression.column((uint) col, ca.get_data_type());
+        }
+        case kExprLiteralInt:
+        case kExprLiteralString:
+            return expression.constant(literal(expr));
+        case kExprOperator:
+            break;
+        default:
+            throw SQLExecError("only columns, literals and operators are supported in expressions");
+    }
+
+    if (expr->opType == Expr::UMINUS && is_literal(expr))
+        return expression.constant(literal(expr));
+    Expression::Operand left = compile(expr->expr, plan, parameters, expression);
+    if (expr->opType == Expr::AND || expr->opType == Expr::OR) {
+        uint jump = expression.begin_logical(expr->opType == Expr::AND, left);
+        return expression.end_logical(jump, compile(expr->expr2, plan, parameters, expression));
+    }
+    if (expr->opType == Expr::NOT)
+        return expression.logical_not(left);
+    if (expr->opType == Expr::UMINUS)
+        return expression.negate(left);
+    if (expr->expr2 == nullptr)
+        throw SQLExecError("unsupported operator in " + ParseTreeToString::expression(expr));
+    Expression::Operand right = compile(expr->expr2, plan, parameters, expression);
+    if (is_comparison(expr))
+        return expression.compare(comparison(expr), left, right);
+    if (expr->opType == Expr::SIMPLE_OP)
+        return expression.arithmetic(expr->opChar, left, right);
+    throw SQLExecError("unsupported operator in " + ParseTreeToString::expression(expr));
+}
+
+/**
+ * find which scan a column reference belongs to
+ * @param scans   scans of the FROM clause
+ * @param column  pointer to the column reference
+ */
+uint SQLExec::find_scan(const vector<TableScan *> &scans, const Expr *column) {
+    Identifier qualifier = column->table == nullptr ? "" : column->table;
+    int found = -1;
+    for (uint i = 0; i < scans.size(); i++) {
+        if (scans[i]->column_index(qualifier, column->name) < 0)
+            continue;
+        if (found >= 0)
+            throw SQLExecError(string("column reference '") + column->name + "' is ambiguous");
+        found = (int) i;
+    }
+    if (found < 0)
+        throw SQLExecError(string("column '") + column->name + "' does not exist");
+    return (uint) found;
+}
+
+/**
+ * make a scan for each table in the FROM clause
+ * @param table       pointer to the table reference
+ * @param scans       list to add the scans to
+ * @param conditions  list to add the join conditions to
+ */
+void SQLExec::from_tables(const TableRef *table, vector<TableScan *> &scans, vector<const Expr *> &conditions) {
+    switch (table->type) {
+        case kTableName: {
+            Identifier table_name = table->name;
+            if (!table_exist(table_name))
+                throw SQLExecError("table " + table_name + " doesn't exist");
+            RelationRef relation = tables->get_table(table_name);
+            scans.push_back(new ParallelScan(relation, table->alias != nullptr ? table->alias : table_name));
+            break;
+        }
+        case kTableJoin:
+            if (table->join->type != kJoinInner && table->join->type != kJoinCross)
+                throw SQLExecError("only inner joins are implemented");
+            from_tables(table->join->left, scans, conditions);
+            from_tables(table->join->right, scans, conditions);
+            if (table->join->condition != nullptr)
+                conjuncts(table->join->condition, conditions);
+            break;
+        case kTableCrossProduct:
+            for (TableRef *tbl : *table->list)
+                from_tables(tbl, scans, conditions);
+            break;
+        default:
+            throw SQLExecError("subqueries in FROM are not implemented");
+    }
+}
+
+/**
+ * build the plan for the FROM and WHERE clauses: comparisons against literals are pushed into the
+ * table scans, equalities between columns of different tables become join keys, and any other
+ * condition is compiled into a Filter over the joined rows
+ * @param from   pointer to the FROM clause
+ * @param where  pointer to the WHERE clause (or nullptr)
+ */
+EvalPlan *SQLExec::from_plan(const TableRef *from, const Expr *where, const Parameters &parameters) {
+    vector<TableScan *> scans;
+    vector<bool> joined;
+    EvalPlan *plan = nullptr;
+    try {
+        vector<const Expr *> conditions;
+        from_tables(from, scans, conditions);
+        if (where != nullptr)
+            conjuncts(where, conditions);
+        joined.assign(scans.size(), false);
+        vector<Estimate> estimates;
+        for (auto const &scan : scans)
+            estimates.push_back(estimate(scan));
+
+        vector<JoinEdge> edges;
+        vector<const Expr *> residuals;  // conditions left for a Filter over the joined rows
+        for (const Expr *condition : conditions) {
+            if (!is_comparison(condition)) {
+                residuals.push_back(condition);
+                continue;
+            }
+            ColumnPredicate::Comparison cmp = comparison(condition);
+            const Expr *column = condition->expr;
+            const Expr *constant = condition->expr2;
+            if (column->type == kExprColumnRef && constant->type == kExprColumnRef) {
+                JoinEdge edge = {{column, constant}, {find_scan(scans, column), find_scan(scans, constant)}, false};
+                if (cmp == ColumnPredicate::EQ && edge.scans[0] != edge.scans[1])
+                    edges.push_back(edge);
+                else
+                    residuals.push_back(condition);
+                continue;
+            }
+
+            // put the column on the left, flipping the comparison if it was on the right
+            if (column->type != kExprColumnRef) {
+                swap(column, constant);
+                if (cmp == ColumnPredicate::LT)
+                    cmp = ColumnPredicate::GT;
+                else if (cmp == ColumnPredicate::LE)
+                    cmp = ColumnPredicate::GE;
+                else if (cmp == ColumnPredicate::GT)
+                    cmp = ColumnPredicate::LT;
+                else if (cmp == ColumnPredicate::GE)
+                    cmp = ColumnPredicate::LE;
+            }
+            int number = parameter(constant, parameters);
+            if (column->type != kExprColumnRef || number < 0) {
+                residuals.push_back(condition);
+                continue;
+            }
+            uint which = find_scan(scans, column);
+            TableScan *scan = scans[which];
+            int col = scan->column_index(column->table == nullptr ? "" : column->table, column->name);
+            Value value = parameters.values[number];
+            ColumnAttribute ca = scan->get_column_attributes()[col];
+            if ((value.data_type == ColumnAttribute::TEXT) != (ca.get_data_type() == ColumnAttribute::TEXT))
+                throw SQLExecError(string("wrong type of value to compare with column '") + column->name + "'");
+            value.data_type = ca.get_data_type();
+            ColumnPredicate predicate((uint) col, cmp, value, number);
+            scan->filter(predicate);
+            estimate_filter(estimates[which], scan, predicate);
+        }
+        plan = join_plan(scans, estimates, edges, joined);
+        if (!residuals.empty()) {
+            Expressions compiled;
+            try {
+                for (const Expr *condition : residuals)
+                    compiled.push_back(compile(condition, plan, parameters));
+            } catch (...) {
+                for (auto const &expression : compiled)
+                    delete expression;
+                throw;
+            }
+            plan = new Filter(plan, compiled);
+        }
+    } catch (...) {
+        delete plan;
+        for (uint i = 0; i < scans.size(); i++)
+            if (i >= joined.size() || !joined[i])
+                delete scans[i];
+        throw;
+    }
+    return plan;
+}
+
+/**
+ * estimate what an unfiltered scan produces: the table's current row count, and from its statistics
+ * (if it has been analyzed) the width of its rows and the distinct values and skew of each column
+ * @param scan  pointer to the scan
+ */
+SQLExec::Estimate SQLExec::estimate(const TableScan *scan) {
+    DbRelation &table = scan->get_relation();
+    StatisticsRef table_statistics = statistics->get_statistics(table.get_table_name());
+    const ColumnNames &names = scan->get_column_names();
+    ColumnAttributes attributes = scan->get_column_attributes();
+    Estimate estimate;
+    estimate.rows = (double) table.row_count();
+    estimate.width = sizeof(ValueRow);
+    for (uint i = 0; i < names.size(); i++) {
+        estimate.width += sizeof(Value) + (attributes[i].get_data_type() == ColumnAttribute::TEXT ? 16 : 0);
+        const ColumnStatistics *column = nullptr;
+        if (table_statistics != nullptr && table_statistics->columns.count(names[i]) > 0)
+            column = &table_statistics->columns.at(names[i]);
+        if (column != nullptr) {
+            estimate.distinct.push_back(max<double>(1, column->distinct));
+            estimate.skew.push_back(column->most_common());
+        } else {
+            estimate.distinct.push_back(max(1.0, estimate.rows));  // as if every value were different
+            estimate.skew.push_back(0);
+        }
+    }
+    if (table_statistics != nullptr && table_statistics->rows > 0)
+        estimate.width = table_statistics->row_width;
+    return estimate;
+}
+
+/**
+ * narrow a scan's estimate by the selectivity of a pushed-down comparison: from the column's
+ * histogram if the table has been analyzed, otherwise a fixed guess
+ * @param estimate   the scan's estimate
+ * @param scan       pointer to the scan
+ * @param predicate  the comparison
+ */
+void SQLExec::estimate_filter(Estimate &estimate, const TableScan *scan, const ColumnPredicate &predicate) {
+    StatisticsRef table_statistics = statistics->get_statistics(scan->get_relation().get_table_name());
+    const Identifier &name = scan->get_column_names()[predicate.column];
+    double selectivity = default_selectivity(predicate.comparison);
+    if (table_statistics != nullptr && table_statistics->columns.count(name) > 0)
+        selectivity = table_statistics->columns.at(name).selectivity(predicate.comparison, predicate.value);
+    estimate.rows *= selectivity;
+    if (predicate.comparison == ColumnPredicate::EQ) {
+        estimate.distinct[predicate.column] = 1;
+        estimate.skew[predicate.column] = 1;
+    }
+    for (auto &distinct : estimate.distinct)
+        distinct = min(distinct, max(1.0, estimate.rows));
+}
+
+/**
+ * join the scans greedily: start with the table expected to produce the fewest rows, then keep
+ * adding the connected table that gives the smallest estimated result (rows of both sides over
+ * the larger number of distinct join key values). Each join hashes its smaller side, except when
+ * the statistics say one join key value has more rows than fit in memory even after a Grace hash
+ * join partitions them; then it is a merge join with those rows streaming through on the left.
+ * @param scans      the filtered scans, in FROM order
+ * @param estimates  what each scan is expected to produce
+ * @param edges      the equalities between columns of different scans
+ * @param joined     which scans have become part of the plan
+ */
+EvalPlan *SQLExec::join_plan(const vector<TableScan *> &scans, vector<Estimate> &estimates, vector<JoinEdge> &edges,
+                             vector<bool> &joined) {
+    uint first = 0;
+    for (uint i = 0; i < scans.size(); i++) {
+        scans[i]->set_estimated_rows(estimates[i].rows);
+        if (estimates[i].rows < estimates[first].rows)
+            first = i;
+    }
+    EvalPlan *plan = scans[first];
+    joined[first] = true;
+    vector<uint> layout = {first};  // scans in the order their columns come out of the plan
+    double rows = estimates[first].rows;
+    double width = estimates[first].width;
+
+    // ordinal of one side of an edge in its scan, and that side's distinct values
+    auto ordinal = [&scans](const JoinEdge &edge, uint side) {
+        const Expr *column = edge.columns[side];
+        return (uint) scans[edge.scans[side]]->column_index(column->table == nullptr ? "" : column->table,
+                                                            column->name);
+    };
+    auto distinct = [&](const JoinEdge &edge, uint side, double side_rows) {
+        return min(estimates[edge.scans[side]].distinct[ordinal(edge, side)], max(1.0, side_rows));
+    };
+
+    try {
+        for (uint step = 1; step < scans.size(); step++) {
+            int next = -1;
+            bool connected = false;
+            double next_rows = 0;
+            for (uint i = 0; i < scans.size(); i++) {
+                if (joined[i])
+                    continue;
+                double result = rows * estimates[i].rows;
+                bool linked = false;
+                for (auto const &edge : edges) {
+                    int side = edge.scans[0] == i ? 0 : edge.scans[1] == i ? 1 : -1;
+                    if (edge.used || side < 0 || !joined[edge.scans[1 - side]])
+                        continue;
+                    linked = true;
+                    result /= max(distinct(edge, side, estimates[i].rows), distinct(edge, 1 - side, rows));
+                }
+                if (next < 0 || (linked && !connected) || (linked == connected && result < next_rows)) {
+                    next = (int) i;
+                    connected = linked;
+                    next_rows = result;
+                }
+            }
+
+            Estimate &next_estimate = estimates[next];
+            vector<uint> plan_keys, scan_keys;
+            double plan_skew = 1, scan_skew = 1;
+            for (auto &edge : edges) {
+                int side = edge.scans[0] == (uint) next ? 0 : edge.scans[1] == (uint) next ? 1 : -1;
+                if (edge.used || side < 0 || !joined[edge.scans[1 - side]])
+                    continue;
+                const Expr *inner = edge.columns[side];
+                const Expr *outer = edge.columns[1 - side];
+                int plan_key = plan->column_index(outer->table == nullptr ? "" : outer->table, outer->name);
+                uint scan_key = ordinal(edge, (uint) side);
+                ColumnAttribute plan_ca = plan->get_column_attributes()[plan_key];
+                ColumnAttribute scan_ca = scans[next]->get_column_attributes()[scan_key];
+                if (plan_ca.get_data_type() != scan_ca.get_data_type())
+                    throw SQLExecError(string("cannot join ") + outer->name + " with " + inner->name +
+                                       " of a different type");
+                plan_keys.push_back((uint) plan_key);
+                scan_keys.push_back(scan_key);
+
+                // a composite key is at most as skewed as its least skewed column
+                Estimate &outer_estimate = estimates[edge.scans[1 - side]];
+                uint outer_key = ordinal(edge, 1 - (uint) side);
+                plan_skew = min(plan_skew, outer_estimate.skew[outer_key]);
+                scan_skew = min(scan_skew, next_estimate.skew[scan_key]);
+
+                // rows that join share the key values found on both sides
+                double both = min(distinct(edge, 1 - (uint) side, rows),
+                                  distinct(edge, (uint) side, next_estimate.rows));
+                outer_estimate.distinct[outer_key] = next_estimate.distinct[scan_key] = both;
+                edge.used = true;
+            }
+
+            double plan_bytes = rows * width;
+            double scan_bytes = next_estimate.rows * next_estimate.width;
+            bool plan_builds = plan_bytes < scan_bytes;
+            double build_hot = plan_builds ? plan_skew * plan_bytes : scan_skew * scan_bytes;
+            double probe_hot = plan_builds ? scan_skew * scan_bytes : plan_skew * plan_bytes;
+            bool plan_left;
+            if (!plan_keys.empty() && build_hot > EvalPlan::memory_budget && probe_hot < build_hot) {
+                plan_left = plan_builds;
+                if (plan_left)
+                    plan = new MergeJoin(plan, scans[next], plan_keys, scan_keys);
+                else
+                    plan = new MergeJoin(scans[next], plan, scan_keys, plan_keys);
+            } else {
+                plan_left = !plan_builds;
+                if (plan_left)
+                    plan = new HashJoin(plan, scans[next], plan_keys, scan_keys);
+                else
+                    plan = new HashJoin(scans[next], plan, scan_keys, plan_keys);
+            }
+            plan->set_estimated_rows(next_rows);
+            joined[next] = true;
+            if (plan_left)
+                layout.push_back((uint) next);
+            else
+                layout.insert(layout.begin(), (uint) next);
+            rows = next_rows;
+            width += next_estimate.width;
+        }
+
+        // put the columns back in FROM order
+        if (!is_sorted(layout.begin(), layout.end())) {
+            vector<uint> offsets(scans.size());
+            uint offset = 0;
+            for (auto const &i : layout) {
+                offsets[i] = offset;
+                offset += (uint) scans[i]->get_column_names().size();
+            }
+            vector<uint> ordinals;
+            for (uint i = 0; i < scans.size(); i++)
+                for (uint col = 0; col < scans[i]->get_column_names().size(); col++)
+                    ordinals.push_back(offsets[i] + col);
+            plan = new Project(plan, ordinals, false);
+            plan->set_estimated_rows(rows);
+        }
+    } catch (...) {
+        delete plan;
+        throw;
+    }
+    return plan;
+}
+
+/**
+ * bind the columns of an ORDER BY clause to the plan's output
+ * @param order  pointer to the ORDER BY clause
+ * @param plan   plan whose rows are being sorted
+ */
+SortKeys SQLExec::sort_keys(const vector<OrderDescription *> *order, const EvalPlan *plan) {
+    SortKeys keys;
+    for (auto const &description : *order) {
+        const Expr *expr = description->expr;
+        if (expr->type != kExprColumnRef)
+            throw SQLExecError("only columns are supported in ORDER BY");
+        int col = plan->column_index(expr->table == nullptr ? "" : expr->table, expr->name);
+        if (col < 0)
+            throw SQLExecError(string("column '") + expr->name + "' does not exist");
+        keys.push_back(SortKey{(uint) col, description->type == kOrderDesc});
+    }
+    return keys;
+}
+
+/**
+ * exectute the select statement, with its cached plan if there is one
+ * @param statement    pointer to the statement
+ * @param fingerprint  the statement's fingerprint
+ * @param parameters   the statement's parameters
+ */
+QueryResult *SQLExec::select(const SelectStatement *statement, const string &fingerprint,
+                             const Parameters &parameters) {
+    if (statement->fromTable == nullptr)
+        throw SQLExecError("SELECT without FROM is not implemented");
+    chrono::steady_clock::time_point started = chrono::steady_clock::now();
+    QueryResult *count = count_rows(statement);
+    if (count != nullptr)
+        return count;
+
+    // pages read from here on are the result's, which records them once its last row is read
+    unique_ptr<PageTally> pages(new PageTally());
+    PageTally::Scope counting(pages.get());
+
+    vector<ColumnAttribute::DataType> types;
+    for (auto const &value : parameters.values)
+        types.push_back(value.data_type);
+    SQLSession &current = session();
+    PlanCache &plan_cache = current.plan_cache;
+    uint64_t version = schema_version.load();
+    unique_ptr<EvalPlan> plan;
+    {
+        Stopwatch watch(current.plan_nanos);
+        Trace::Span span("plan", "sql");
+        plan.reset(plan_cache.take(fingerprint, types, version));
+        if (plan != nullptr)
+            plan->bind(parameters.values);
+        else
+            plan.reset(select_plan(statement, parameters));
+    }
+    plan->open();  // a plan that fails to open may be left half open, so it is not kept
+
+    ColumnNames *col_names = new ColumnNames(plan->get_column_names());
+    ColumnAttributes *col_attrs = new ColumnAttributes(plan->get_column_attributes());
+    return new QueryResult(col_names, col_attrs, new SelectRows(plan.release(), plan_cache, fingerprint, types,
+                                                                version, started, move(pages)));
+}
+
+/**
+ * build the plan for a select statement
+ * @param statement  pointer to the statement
+ */
+EvalPlan *SQLExec::select_plan(const SelectStatement *statement, const Parameters &parameters) {
+    EvalPlan *plan = from_plan(statement->fromTable, statement->whereClause, parameters);
+    try {
+        vector<uint> projection;
+        bool computed = false;
+        bool grouped = statement->groupBy != nullptr;
+        for (Expr *expr : *statement->selectList)
+            grouped = grouped || is_aggregate(expr);
+        if (grouped) {
+            plan = group_plan(statement, plan, projection);
+        } else {
+            for (Expr *expr : *statement->selectList) {
+                if (expr->type == kExprStar) {
+                    for (uint i = 0; i < plan->get_column_names().size(); i++)
+                        projection.push_back(i);
+                } else if (expr->type == kExprColumnRef) {
+                    int col = plan->column_index(expr->table == nullptr ? "" : expr->table, expr->name);
+                    if (col < 0)
+                        throw SQLExecError(string("column '") + expr->name + "' does not exist");
+                    projection.push_back((uint) col);
+                } else {
+                    computed = true;
+                }
+            }
+        }
+        // ORDER BY with a LIMIT keeps just the top rows instead of sorting them all
+        int64_t limit = statement->limit == nullptr ? kNoLimit : statement->limit->limit;
+        int64_t offset = statement->limit == nullptr ? 0 : max<int64_t>(statement->limit->offset, 0);
+        bool top_n = statement->order != nullptr && limit >= 0;
+        if (top_n)
+            plan = new TopN(plan, sort_keys(statement->order, plan), (uint64_t) limit, (uint64_t) offset);
+        else if (statement->order != nullptr)
+            plan = new Sort(plan, sort_keys(statement->order, plan));
+        TableScan *scan = dynamic_cast<TableScan *>(plan);
+        if (computed)
+            plan = compute_plan(statement->selectList, plan, parameters);
+        else if (scan != nullptr)
+            scan->project(projection);
+        else
+            plan = new Project(plan, projection);
+        if (!top_n && (limit >= 0 || offset > 0))
+            plan = new Limit(plan, limit, offset);
+    } catch (...) {
+        delete plan;
+        throw;
+    }
+    return plan;
+}
+
+/**
+ * evaluate a select list with expressions in it
+ * @param select_list  pointer to the select list
+ * @param plan         plan whose rows the select list is evaluated on
+ */
+EvalPlan *SQLExec::compute_plan(const vector<Expr *> *select_list, EvalPlan *plan, const Parameters &parameters) {
+    Expressions expressions;
+    ColumnNames names;
+    try {
+        for (Expr *expr : *select_list) {
+            if (expr->type == kExprStar) {
+                for (uint i = 0; i < plan->get_column_names().size(); i++) {
+                    ColumnAttribute ca = plan->get_column_attributes()[i];
+                    Expression *column = new Expression(plan->column_label(i));
+                    expressions.push_back(column);
+                    column->finish(column->column(i, ca.get_data_type()));
+                    names.push_back(plan->get_column_names()[i]);
+                }
+            } else {
+                expressions.push_back(compile(expr, plan, parameters));
+                if (expr->alias != nullptr)
+                    names.push_back(expr->alias);
+                else
+                    names.push_back(expr->type == kExprColumnRef ? expr->name : expressions.back()->get_label());
+            }
+        }
+    } catch (...) {
+        for (auto const &expression : expressions)
+            delete expression;
+        throw;
+    }
+    return new Compute(plan, expressions, names);
+}
+
+/**
+ * execute EXPLAIN [ANALYZE] of a select statement
+ * @param statement  pointer to the statement being explained
+ * @param analyze    whether to run the plan and report what was measured
+ */
+QueryResult *SQLExec::explain(const SQLStatement *statement, bool analyze) {
+    initialize();
+    try {
+        if (statement->type() != kStmtSelect)
+            throw SQLExecError("only SELECT statements can be explained");
+        const SelectStatement *select = (const SelectStatement *) statement;
+        if (select->fromTable == nullptr)
+            throw SQLExecError("SELECT without FROM is not implemented");
+
+        vector<string> lines;
+        if (counts_rows(select)) {
+            Identifier table_name = select->fromTable->name;
+            if (!table_exist(table_name))
+                throw SQLExecError("table " + table_name + " doesn't exist");
+            lines.push_back("RowCount " + table_name + " (from the table's row count, no scan)");
+        } else {
+            Parameters parameters;
+            if (number_parameters(select, ValueRow(), parameters) > 0)
+                throw SQLExecError("cannot explain a statement with parameters");
+            EvalPlan *plan = select_plan(select, parameters);
+            try {
+                if (analyze) {
+                    uint64_t nanos = 0;
+                    {
+                        Stopwatch watch(nanos);
+                        Autocommit autocommit;
+                        plan->instrument();
+                        ValueRow row;
+                        plan->open();
+                        while (plan->next(row))
+                            continue;
+                        plan->close();
+                        autocommit.commit();
+                    }
+                    plan->explain(lines);
+                    ostringstream total;
+                    total << "Execution time: " << fixed << setprecision(3) << nanos / 1e6 << " ms";
+                    lines.push_back(total.str());
+                } else {
+                    plan->explain(lines);
+                }
+            } catch (...) {
+                delete plan;
+                throw;
+            }
+            delete plan;
+        }
+
+        ColumnNames *col_names = new ColumnNames{"QUERY PLAN"};
+        ColumnAttributes *col_attrs = new ColumnAttributes{ColumnAttribute(ColumnAttribute::TEXT)};
+        ValueDicts *rows = new ValueDicts();
+        for (auto const &line : lines) {
+            ValueDict *row = new ValueDict();
+            (*row)["QUERY PLAN"] = Value(line);
+            rows->push_back(row);
+        }
+        return new QueryResult(col_names, col_attrs, rows, "successfully explained");
+    } catch (DbRelationError &e) {
+        throw SQLExecError(string("DbRelationError: ") + e.what());
+    }
+}
+
+// the single argument of a function call (nullptr if it does not have exactly one)
+static const Expr *argument(const Expr *call) {
+    if (call->exprList != nullptr)
+        return call->exprList->size() == 1 ? (*call->exprList)[0] : nullptr;
+    return call->expr;
+}
+
+/**
+ * check whether an expression is a call of an aggregate function
+ * @param expr  pointer to the expression
+ */
+bool SQLExec::is_aggregate(const Expr *expr) {
+    return expr->type == kExprFunctionRef;
+}
+
+/**
+ * the output column name of an aggregate: its alias, or else the call as written, e.g. "sum(f.id)"
+ * @param expr  pointer to the aggregate function call
+ */
+Identifier SQLExec::aggregate_name(const Expr *expr) {
+    if (expr->alias != nullptr)
+        return expr->alias;
+    Identifier name = expr->name;
+    transform(name.begin(), name.end(), name.begin(), ::tolower);
+    const Expr *arg = argument(expr);
+    if (arg == nullptr || arg->type == kExprStar)
+        return name + "(*)";
+    if (arg->table != nullptr)
+        return name + "(" + arg->table + "." + arg->name + ")";
+    return name + "(" + (arg->name == nullptr ? "" : arg->name) + ")";
+}
+
+/**
+ * bind an aggregate function call to the plan it aggregates
+ * @param expr  pointer to the aggregate function call
+ * @param plan  plan producing the rows being aggregated
+ */
+Aggregate SQLExec::aggregate(const Expr *expr, const EvalPlan *plan) {
+    Identifier name = expr->name;
+    transform(name.begin(), name.end(), name.begin(), ::tolower);
+    if (expr->distinct)
+        throw SQLExecError("DISTINCT aggregates are not implemented");
+    const Expr *arg = argument(expr);
+    if (arg == nullptr)
+        throw SQLExecError(name + " takes exactly one argument");
+    if (arg->type == kExprStar) {
+        if (name != "count")
+            throw SQLExecError(name + "(*) is not allowed");
+        return Aggregate{Aggregate::COUNT_ROWS, 0};
+    }
+    if (arg->type != kExprColumnRef)
+        throw SQLExecError("only columns can be aggregated");
+    int col = plan->column_index(arg->table == nullptr ? "" : arg->table, arg->name);
+    if (col < 0)
+        throw SQLExecError(string("column '") + arg->name + "' does not exist");
+    if (name == "count")
+        return Aggregate{Aggregate::COUNT, (uint) col};
+    if (name == "min")
+        return Aggregate{Aggregate::MIN, (uint) col};
+    if (name == "max")
+        return Aggregate{Aggregate::MAX, (uint) col};
+    if (name == "sum") {
+        ColumnAttribute ca = plan->get_column_attributes()[col];
+        if (ca.get_data_type() != ColumnAttribute::INT)
+            throw SQLExecError(string("cannot sum non-INT column '") + arg->name + "'");
+        return Aggregate{Aggregate::SUM, (uint) col};
+    }
+    throw SQLExecError("function " + name + " is not implemented");
+}
+
+/**
+ * put a HashAggregate for the GROUP BY clause and aggregates of a select on top of its plan
+ * @param statement   pointer to the select statement
+ * @param plan        plan producing the rows to aggregate
+ * @param projection  returned by reference: ordinals of the select list in the aggregate's output
+ */
+EvalPlan *SQLExec::group_plan(const SelectStatement *statement, EvalPlan *plan, vector<uint> &projection) {
+    vector<uint> group_columns;
+    if (statement->groupBy != nullptr) {
+        if (statement->groupBy->having != nullptr)
+            throw SQLExecError("HAVING is not implemented");
+        for (Expr *expr : *statement->groupBy->columns) {
+            if (expr->type != kExprColumnRef)
+                throw SQLExecError("only columns are supported in GROUP BY");
+            int col = plan->column_index(expr->table == nullptr ? "" : expr->table, expr->name);
+            if (col < 0)
+                throw SQLExecError(string("column '") + expr->name + "' does not exist");
+            group_columns.push_back((uint) col);
+        }
+    }
+
+    Aggregates aggregates;
+    ColumnNames aggregate_names;
+    vector<int> positions;  // >= 0: which group column, < 0: -1 - which aggregate
+    for (Expr *expr : *statement->selectList) {
+        if (is_aggregate(expr)) {
+            aggregates.push_back(aggregate(expr, plan));
+            aggregate_names.push_back(aggregate_name(expr));
+            positions.push_back(-(int) aggregates.size());
+        } else if (expr->type == kExprColumnRef) {
+            int col = plan->column_index(expr->table == nullptr ? "" : expr->table, expr->name);
+            auto group = find(group_columns.begin(), group_columns.end(), (uint) col);
+            if (col < 0 || group == group_columns.end())
+                throw SQLExecError(string("column '") + expr->name + "' must be in GROUP BY or an aggregate");
+            positions.push_back((int) (group - group_columns.begin()));
+        } else {
+            throw SQLExecError("only grouped columns and aggregates can be selected with GROUP BY");
+        }
+    }
+    for (auto const &position : positions)
+        projection.push_back(position >= 0 ? (uint) position : (uint) (group_columns.size() - 1 - position));
+    return new HashAggregate(plan, group_columns, aggregates, aggregate_names);
+}
+
+/**
+ * check whether a select statement is just SELECT COUNT(*) FROM <table> (a LIMIT could drop its row)
+ * @param statement  pointer to the select statement
+ */
+bool SQLExec::counts_rows(const SelectStatement *statement) {
+    const TableRef *from = statement->fromTable;
+    if (from->type != kTableName || statement->whereClause != nullptr || statement->groupBy != nullptr
+        || statement->limit != nullptr || statement->selectList->size() != 1)
+        return false;
+    const Expr *expr = (*statement->selectList)[0];
+    if (!is_aggregate(expr) || expr->distinct || argument(expr) == nullptr || argument(expr)->type != kExprStar)
+        return false;
+    Identifier name = expr->name;
+    transform(name.begin(), name.end(), name.begin(), ::tolower);
+    return name == "count";
+}
+
+/**
+ * answer SELECT COUNT(*) FROM <table> from the table's row count, without scanning it
+ * @param statement  pointer to the select statement
+ * @returns          the result, or nullptr if the statement is anything more than that
+ */
+QueryResult *SQLExec::count_rows(const SelectStatement *statement) {
+    if (!counts_rows(statement))
+        return nullptr;
+    const Expr *expr = (*statement->selectList)[0];
+    Identifier table_name = statement->fromTable->name;
+    if (!table_exist(table_name))
+        throw SQLExecError("table " + table_name + " doesn't exist");
+    uint64_t count = tables->get_table(table_name)->row_count();
+    if (count > INT32_MAX)
+        throw SQLExecError("row count " + to_string(count) + " is out of range for INT");
+
+    ColumnNames *col_names = new ColumnNames{aggregate_name(expr)};
+    ColumnAttributes *col_attrs = new ColumnAttributes{ColumnAttribute(ColumnAttribute::INT)};
+    ValueDicts *rows = new ValueDicts();
+    ValueDict *row = new ValueDict();
+    (*row)[(*col_names)[0]] = Value((int32_t) count);
+    rows->push_back(row);
+    return new QueryResult(col_names, col_attrs, rows, "successfully fetch 1 rows");
+}
@@ -5,10 +5,21 @@
  */
 #pragma once
 
+#include <atomic>
 #include <exception>
+#include <mutex>
 #include <string>
 #include "SQLParser.h"
 #include "schema_tables.h"
+#include "eval_plan.h"
+#include "sort.h"
+#include "aggregate.h"
+#include "expression.h"
+#include "plan_cache.h"
+#include "statement_statistics.h"
+
+class ResultWriter;
+class Transaction;
 
 /**
  * @class SQLExecError - exception for SQLExec methods
@@ -19,18 +30,50 @@ public:
 };
 
 
+/**
+ * @class RowSource - the rows of a query result, produced one at a time as they are printed
+ * instead of all being built before the result is returned.
+ */
+class RowSource {
+public:
+    virtual ~RowSource() {}
+
+    /**
+     * Produce the next row.
+     * @param row  returned by reference: the next row, in the order of the result's columns
+     * @returns    false if there are no more rows
+     */
+    virtual bool next(ValueRow &row) = 0;
+
+    /**
+     * The result's message, once all the rows have been produced.
+     */
+    virtual std::string get_message() const = 0;
+};
+
+
 /**
  * @class QueryResult - data structure to hold all the returned data for a query execution
+ *
+ * The rows are either all held in rows, or streamed from a row source that printing the result
+ * pulls them from, so the first rows are printed before the last are read and memory does not
+ * grow with the result. A streamed result can only be printed once, and must be printed or
+ * deleted before the next statement is executed.
  */
 class QueryResult {
 public:
-    QueryResult() : column_names(nullptr), column_attributes(nullptr), rows(nullptr), message("") {}
+    QueryResult() : column_names(nullptr), column_attributes(nullptr), rows(nullptr), source(nullptr), message("") {}
 
     QueryResult(std::string message) : column_names(nullptr), column_attributes(nullptr), rows(nullptr),
-                                       message(message) {}
+                                       source(nullptr), message(message) {}
 
     QueryResult(ColumnNames *column_names, ColumnAttributes *column_attributes, ValueDicts *rows, std::string message)
-            : column_names(column_names), column_attributes(column_attributes), rows(rows), message(message) {}
+            : column_names(column_names), column_attributes(column_attributes), rows(rows), source(nullptr),
+              message(message) {}
+
+    QueryResult(ColumnNames *column_names, ColumnAttributes *column_attributes, RowSource *source)
+            : column_names(column_names), column_attributes(column_attributes), rows(nullptr), source(source),
+              message("") {}
 
     virtual ~QueryResult();
 
@@ -40,7 +83,18 @@ public:
 
     ValueDicts *get_rows() const { return rows; }
 
-    const std::string &get_message() const { return message; }
+    RowSource *get_source() const { return source; }
+
+    /**
+     * The result's message (for a streamed result, once its rows have been read).
+     */
+    std::string get_message() const { return source != nullptr ? source->get_message() : message; }
+
+    /**
+     * Write the result's columns, rows and message, reading a streamed result's rows as they are written.
+     * @param writer  writer for the output format
+     */
+    void write(ResultWriter &writer) const;
 
     friend std::ostream &operator<<(std::ostream &stream, const QueryResult &qres);
 
@@ -48,12 +102,91 @@ protected:
     ColumnNames *column_names;
     ColumnAttributes *column_attributes;
     ValueDicts *rows;
+    RowSource *source;
     std::string message;
 };
 
 
+/**
+ * @class SQLSession - what SQLExec keeps for one client from one statement to the next: the
+ * transaction begun with BEGIN, the statements kept by PREPARE and the plans of recent selects.
+ *
+ * A thread runs statements for the session made current in it by a Scope, so a server can run
+ * each client's statements on whichever of its threads is free; a session must not be current
+ * in two threads at once. Statements run with no current session share a default one.
+ */
+class SQLSession {
+public:
+    SQLSession() : transaction(nullptr), plan_nanos(0) {}
+
+    /**
+     * Rolls back the session's transaction, if one is in progress, and forgets its prepared statements.
+     */
+    virtual ~SQLSession();
+
+    SQLSession(const SQLSession &other) = delete;
+
+    SQLSession &operator=(const SQLSession &other) = delete;
+
+    /**
+     * @class Scope - the calling thread runs statements for a session (and its transaction)
+     * while this is in scope.
+     */
+    class Scope {
+    public:
+        explicit Scope(SQLSession &session);
+
+        virtual ~Scope();
+
+        Scope(const Scope &other) = delete;
+
+        Scope &operator=(const Scope &other) = delete;
+
+    protected:
+        SQLSession &session;
+        SQLSession *outer;
+        Transaction *outer_transaction;
+    };
+
+    /**
+     * The calling thread's session, or nullptr.
+     */
+    static SQLSession *current();
+
+    /**
+     * Whether the session has a transaction in progress (asked while it is not current).
+     */
+    bool in_transaction() const { return transaction != nullptr; }
+
+    /**
+     * Total time the session's selects have spent being planned (or finding and binding a cached plan).
+     */
+    uint64_t get_plan_nanos() const { return plan_nanos; }
+
+protected:
+    friend class SQLExec;
+
+    /*
+     * A statement kept by PREPARE.
+     */
+    struct PreparedStatement {
+        hsql::SQLParserResult *parse;
+        std::string fingerprint;
+        uint placeholders;
+    };
+
+    Transaction *transaction;  // the session's transaction, while no thread is running it
+    std::map<Identifier, PreparedStatement> prepared;
+    PlanCache plan_cache;      // plans of recently run selects, valid while the schema version does not change
+    uint64_t plan_nanos;
+};
+
+
 /**
  * @class SQLExec - execution engine
+ *
+ * Any number of threads may execute statements at once, each for its own session (SQLSession).
+ * CREATE, DROP and ANALYZE change the schema one at a time.
  */
 class SQLExec {
 public:
@@ -64,10 +197,246 @@ public:
      */
     static QueryResult *execute(const hsql::SQLStatement *statement);
 
+    /**
+     * Execute ANALYZE <table_name>: gather the table's statistics into _statistics for the planner.
+     * @param table_name  table to analyze
+     * @returns           the query result (freed by caller)
+     */
+    static QueryResult *analyze(Identifier table_name);
+
+    /**
+     * Execute COPY <table_name> FROM '<file>': append the rows of a CSV or TSV file to a table
+     * (and its indices), parsing the file on several threads.
+     * @param table_name  table to load
+     * @param path        file to read
+     * @param delimiter   ',' for CSV or '\t' for TSV
+     * @param header      whether the file's first line holds column names (and is skipped)
+     * @returns           the query result, with the number of rows and rows per second (freed by caller)
+     */
+    static QueryResult *copy_from(Identifier table_name, std::string path, char delimiter, bool header);
+
+    /**
+     * Execute COPY <table_name> TO '<file>': write a table's rows to a CSV or TSV file that
+     * copy_from can read back.
+     * @param table_name  table to export
+     * @param path        file to write (replaced if it exists)
+     * @param delimiter   ',' for CSV or '\t' for TSV
+     * @param header      whether to start the file with a line of column names
+     * @returns           the query result, with the number of rows and rows per second (freed by caller)
+     */
+    static QueryResult *copy_to(Identifier table_name, std::string path, char delimiter, bool header);
+
+    /**
+     * Execute COPY <table_name> TO '<file>' RAW: write the table's blocks as they are stored,
+     * with its columns, to a dump that restore can read back (see TableDump).
+     * @param table_name  table to dump
+     * @param path        file to write (replaced if it exists)
+     * @returns           the query result, with the number of blocks and megabytes per second (freed by caller)
+     */
+    static QueryResult *dump(Identifier table_name, std::string path);
+
+    /**
+     * Execute COPY <table_name> FROM '<file>' RAW: append the blocks of a dump to a table with the
+     * same columns, without decoding its rows, then add the rows to the table's indices.
+     * @param table_name  table to restore into
+     * @param path        dump to read
+     * @returns           the query result, with the number of rows and megabytes per second (freed by caller)
+     */
+    static QueryResult *restore(Identifier table_name, std::string path);
+
+    /**
+     * Execute EXPLAIN [ANALYZE] <statement>: show the plan chosen for a select, one operator per row.
+     * With analyze, the plan is also run and each operator shows its rows in and out, its time
+     * (including its inputs') and, for scans, the pages read, buffer pool hits and bytes decoded.
+     * @param statement  the Hyrise AST of the statement to explain
+     * @param analyze    whether to run the plan and show what was measured
+     * @returns          the query result (freed by caller)
+     */
+    static QueryResult *explain(const hsql::SQLStatement *statement, bool analyze);
+
+    /**
+     * Execute PREPARE <name> AS <statement>: keep a SELECT or INSERT, whose values may be ?
+     * placeholders, to be run by name with execute_prepared.
+     * @param name   name of the prepared statement
+     * @param parse  the parsed statement (owned by SQLExec from now on)
+     * @returns      the query result (freed by caller)
+     */
+    static QueryResult *prepare(Identifier name, hsql::SQLParserResult *parse);
+
+    /**
+     * Execute EXECUTE <name>(<values>): run a prepared statement without parsing it again, and
+     * (if it was run before with values of the same types) without planning it again.
+     * @param name       name of the prepared statement
+     * @param arguments  value of each placeholder, in order
+     * @returns          the query result (freed by caller)
+     */
+    static QueryResult *execute_prepared(Identifier name, const ValueRow &arguments);
+
+    /**
+     * Execute DEALLOCATE <name>: forget a prepared statement.
+     * @param name  name of the prepared statement
+     * @returns     the query result (freed by caller)
+     */
+    static QueryResult *deallocate(Identifier name);
+
+    /**
+     * Execute BEGIN: start a transaction that the statements that follow join, until COMMIT or
+     * ROLLBACK (other statements each run in a transaction of their own). A statement that fails
+     * inside the transaction rolls all of it back. CREATE, DROP and ANALYZE can't be run inside one.
+     * @returns  the query result (freed by caller)
+     */
+    static QueryResult *begin();
+
+    /**
+     * Execute COMMIT: make the changes of the transaction begun with BEGIN durable.
+     * @returns  the query result (freed by caller)
+     */
+    static QueryResult *commit();
+
+    /**
+     * Execute ROLLBACK: discard the changes of the transaction begun with BEGIN.
+     * @returns  the query result (freed by caller)
+     */
+    static QueryResult *rollback();
+
+    /**
+     * Execute SHOW STATEMENT STATS: per statement fingerprint, the number of calls, their total,
+     * minimum, maximum and 99th percentile time, and the rows and blocks they returned and read,
+     * most expensive first. The numbers are TEXT, since they outgrow an INT.
+     * @returns  the query result (freed by caller)
+     */
+    static QueryResult *show_statement_stats();
+
+    /**
+     * Execute SHOW STATUS: the engine's counters (see Counters), the Berkeley DB buffer pool's
+     * statistics, and the commits, log syncs, lock waits and deadlocks so far. The values are
+     * TEXT, since they outgrow an INT.
+     * @returns  the query result (freed by caller)
+     */
+    static QueryResult *show_status();
+
+    /**
+     * The catalog of indices, for programs that work on the tables directly (the tables are
+     * looked up with Tables::get_table).
+     * @returns  the _indices table
+     */
+    static Indices &get_indices();
+
 protected:
-    // the one place in the system that holds the _tables table and _indices table
+    // the one place in the system that holds the _tables, _indices and _statistics tables
     static Tables *tables;
     static Indices *indices;
+    static Statistics *statistics;
+
+    // bumped by every change to the schema, so plans cached before it are not used
+    static std::atomic<uint64_t> schema_version;
+    static std::mutex schema_lock;
+
+    // the session of statements run with no current one
+    static SQLSession default_session;
+
+    // what each kind of statement has cost, for SHOW STATEMENT STATS
+    static StatementStatistics *statement_statistics;
+
+    /*
+     * The rows of a select, pulled from its cached plan as its result is printed.
+     */
+    class SelectRows;
+
+    /*
+     * The values a statement is planned and run with for its parameters: its ? placeholders and
+     * the literals of its conditions and INSERT values, numbered in the order they are found.
+     */
+    struct Parameters {
+        ValueRow values;
+        std::map<const hsql::Expr *, uint> numbers;
+    };
+
+    /*
+     * An equality between columns of two tables of a FROM clause.
+     */
+    struct JoinEdge {
+        const hsql::Expr *columns[2];
+        uint scans[2];
+        bool used;
+    };
+
+    /*
+     * What the planner expects a scan to produce.
+     */
+    struct Estimate {
+        double rows;
+        double width;                  // bytes of memory per row
+        std::vector<double> distinct;  // per column: number of distinct values
+        std::vector<double> skew;      // per column: fraction of the rows holding the most common value
+    };
+
+    static void initialize();
+
+    /**
+     * The session the calling thread runs statements for.
+     */
+    static SQLSession &session();
+
+    /**
+     * Note a change to the schema or the statistics: no cached plan may be used after this.
+     */
+    static void schema_changed();
+
+    /**
+     * Execute a statement, recording its time, rows and blocks read under its fingerprint
+     * (a streamed select is recorded once its rows have been read).
+     * @param statement    AST of the statement
+     * @param fingerprint  the statement's fingerprint (see ParseTreeToString::fingerprint)
+     * @param arguments    value of each placeholder, in order
+     * @returns            the query result (freed by caller)
+     */
+    static QueryResult *measure(const hsql::SQLStatement *statement, const std::string &fingerprint,
+                                const ValueRow &arguments);
+
+    /**
+     * The error for a statement that failed, rolling back the transaction begun with BEGIN if any.
+     * @param message  what went wrong
+     * @returns        the exception to throw
+     */
+    static SQLExecError statement_failed(const std::string &message);
+
+    /**
+     * Run a SELECT or INSERT with the given placeholder values.
+     * @param statement    AST of the statement
+     * @param fingerprint  the statement's fingerprint (see ParseTreeToString::fingerprint)
+     * @param arguments    value of each placeholder, in order
+     * @returns            the query result (freed by caller)
+     */
+    static QueryResult *run(const hsql::SQLStatement *statement, const std::string &fingerprint,
+                            const ValueRow &arguments);
+
+    /**
+     * Number the parameters of a statement and collect their values
+     * @param statement   AST of the statement
+     * @param arguments   value of each placeholder, in order
+     * @param parameters  returned by reference: the parameters
+     * @returns           number of placeholders in the statement
+     */
+    static uint number_parameters(const hsql::SQLStatement *statement, const ValueRow &arguments,
+                                  Parameters &parameters);
+
+    /**
+     * Number the parameters in an expression (depth first, left to right)
+     * @param expr          AST of the expression
+     * @param literals      whether literals are parameters too (or only placeholders)
+     * @param arguments     value of each placeholder, in order
+     * @param parameters    returned by reference: the parameters found are added
+     * @param placeholders  returned by reference: incremented per placeholder found
+     */
+    static void number_parameters(const hsql::Expr *expr, bool literals, const ValueRow &arguments,
+                                  Parameters &parameters, uint &placeholders);
+
+    /**
+     * The number of the parameter an AST node is
+     * @returns  the number, or -1 if the node is not a parameter
+     */
+    static int parameter(const hsql::Expr *expr, const Parameters &parameters);
 
     // recursive decent into the AST
     static QueryResult *create(const hsql::CreateStatement *statement);
@@ -76,6 +445,8 @@ protected:
 
     static QueryResult *create_index(const hsql::CreateStatement *statement);
 
+    static void load_index(DbRelation &table, DbIndex &index, const ColumnNames &key_columns);
+
     static QueryResult *drop(const hsql::DropStatement *statement);
 
     static QueryResult *drop_table(const hsql::DropStatement *statement);
@@ -94,6 +465,173 @@ protected:
 
     static QueryResult *show_index(const hsql::ShowStatement *statement);
 
+    static QueryResult *insert(const hsql::InsertStatement *statement, const Parameters &parameters);
+
+    /**
+     * Run a select with the plan cached for its fingerprint, or build and cache one
+     * @param statement    AST of the select
+     * @param fingerprint  the select's fingerprint
+     * @param parameters   values of its parameters
+     * @returns            the query result, streaming its rows from the plan (freed by caller)
+     */
+    static QueryResult *select(const hsql::SelectStatement *statement, const std::string &fingerprint,
+                               const Parameters &parameters);
+
+    /**
+     * Build the whole plan for a select: FROM and WHERE, grouping, ordering, projection and limit
+     * @param statement   AST of the select
+     * @param parameters  values of its parameters (the plan can be bound to others later)
+     * @returns           the plan (freed by caller)
+     */
+    static EvalPlan *select_plan(const hsql::SelectStatement *statement, const Parameters &parameters);
+
+    /**
+     * Put a Compute on top of a plan for a select list with expressions in it
+     * @param select_list  AST of the select list
+     * @param plan         plan producing the rows (owned by the result from now on, unless this throws)
+     * @param parameters   values of the statement's parameters
+     * @returns            plan producing one column per select list item (or per column, for *)
+     */
+    static EvalPlan *compute_plan(const std::vector<hsql::Expr *> *select_list, EvalPlan *plan,
+                                  const Parameters &parameters);
+
+    /**
+     * Check whether a select is just SELECT COUNT(*) FROM <table>
+     * @param statement  AST of the select
+     */
+    static bool counts_rows(const hsql::SelectStatement *statement);
+
+    /**
+     * Answer SELECT COUNT(*) FROM <table> from the table's row count metadata
+     * @param statement  AST of the select
+     * @returns          the result, or nullptr if the select is not just that
+     */
+    static QueryResult *count_rows(const hsql::SelectStatement *statement);
+
+    /**
+     * Put the grouping and aggregates of a select on top of the plan for its FROM clause
+     * @param statement   AST of the select
+     * @param plan        plan producing the rows to be grouped (owned by the result from now on)
+     * @param projection  returned by reference: select list ordinals in the output of the result
+     * @returns           plan producing one row per group
+     */
+    static EvalPlan *group_plan(const hsql::SelectStatement *statement, EvalPlan *plan,
+                                std::vector<uint> &projection);
+
+    /**
+     * Bind an aggregate function call to the columns of a plan
+     * @param expr  AST of the function call
+     * @param plan  plan producing the rows to be aggregated
+     * @returns     the aggregate
+     */
+    static Aggregate aggregate(const hsql::Expr *expr, const EvalPlan *plan);
+
+    static Identifier aggregate_name(const hsql::Expr *expr);
+
+    static bool is_aggregate(const hsql::Expr *expr);
+
+    /**
+     * Bind the columns of an ORDER BY clause to a plan's output columns
+     * @param order  AST of the ORDER BY clause
+     * @param plan   plan whose rows are to be sorted
+     * @returns      sort keys for a Sort of plan
+     */
+    static SortKeys sort_keys(const std::vector<hsql::OrderDescription *> *order, const EvalPlan *plan);
+
+    /**
+     * Build the scans and joins for a FROM clause and its filtering conditions
+     * @param from        AST of the FROM clause
+     * @param where       AST of the WHERE clause (nullptr if none)
+     * @param parameters  values of the statement's parameters
+     * @returns           plan producing the joined and filtered rows (freed by caller)
+     */
+    static EvalPlan *from_plan(const hsql::TableRef *from, const hsql::Expr *where, const Parameters &parameters);
+
+    /**
+     * Estimate a scan's output from its table's statistics (or from guesses if it was never analyzed)
+     * @param scan  unfiltered scan of a table
+     * @returns     estimate of the scan's output
+     */
+    static Estimate estimate(const TableScan *scan);
+
+    /**
+     * Narrow a scan's estimate for a comparison pushed down into the scan
+     * @param estimate   returned by reference: the scan's estimate
+     * @param scan       the scan
+     * @param predicate  the comparison
+     */
+    static void estimate_filter(Estimate &estimate, const TableScan *scan, const ColumnPredicate &predicate);
+
+    /**
+     * Join the scans of a FROM clause, choosing the join order, the join method and each hash
+     * join's build side by estimated cost
+     * @param scans      filtered scans, in FROM order
+     * @param estimates  estimate of each scan's output
+     * @param edges      equalities between columns of different scans
+     * @param joined     returned by reference: which scans are now owned by the plan
+     * @returns          plan producing the joined rows, with the columns in FROM order
+     */
+    static EvalPlan *join_plan(const std::vector<TableScan *> &scans, std::vector<Estimate> &estimates,
+                               std::vector<JoinEdge> &edges, std::vector<bool> &joined);
+
+    /**
+     * Make a scan for each table named in a FROM clause, collecting the ON conditions of any joins
+     * @param table       AST of the FROM clause (or part of it)
+     * @param scans       returned by reference: one scan per table, in order
+     * @param conditions  returned by reference: the comparisons from the ON clauses
+     */
+    static void from_tables(const hsql::TableRef *table, std::vector<TableScan *> &scans,
+                            std::vector<const hsql::Expr *> &conditions);
+
+    /**
+     * Flatten a conjunction into its comparisons
+     * @param expr  AST of the condition
+     * @param list  returned by reference: the comparisons ANDed together in expr
+     */
+    static void conjuncts(const hsql::Expr *expr, std::vector<const hsql::Expr *> &list);
+
+    /**
+     * Get the comparison a binary operator expression performs
+     * @param expr  AST of the comparison
+     * @returns     the comparison
+     */
+    static ColumnPredicate::Comparison comparison(const hsql::Expr *expr);
+
+    /**
+     * Compile a condition or select list expression for the rows of a plan
+     * @param expr        AST of the expression
+     * @param plan        plan whose output rows the expression will be evaluated on
+     * @param parameters  values of the statement's parameters
+     * @returns           the compiled expression (freed by caller)
+     */
+    static Expression *compile(const hsql::Expr *expr, const EvalPlan *plan, const Parameters &parameters);
+
+    /**
+     * Compile one node of an expression (and its operands) into a program
+     * @param expr        AST of the node
+     * @param plan        plan whose output rows the expression will be evaluated on
+     * @param parameters  values of the statement's parameters
+     * @param expression  returned by reference: the program, with the node's instructions added
+     * @returns           the operand holding the node's value
+     */
+    static Expression::Operand compile(const hsql::Expr *expr, const EvalPlan *plan, const Parameters &parameters,
+                                       Expression &expression);
+
+    /**
+     * Find which scan a column reference belongs to
+     * @param scans   scans of the FROM clause
+     * @param column  AST column reference
+     * @returns       index into scans
+     */
+    static uint find_scan(const std::vector<TableScan *> &scans, const hsql::Expr *column);
+
+    /**
+     * Convert an AST literal to a Value
+     * @param expr  AST literal (integer or string, possibly negated)
+     * @returns     the literal's value
+     */
+    static Value literal(const hsql::Expr *expr);
+
     /**
      * Pull out column name and attributes from AST's column definition clause
      * @param col                AST column definition
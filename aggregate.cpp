@@ -0,0 +1,395 @@
+/**
+ * @file aggregate.cpp - implementation of grouping and aggregate functions
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#include <climits>
+#include <cstring>
+#include "aggregate.h"
+#include "heap_storage.h"
+#include "parallel_scan.h"
+
+using namespace std;
+
+static int compare(const Value &a, const Value &b) {
+    if (a.data_type == ColumnAttribute::TEXT)
+        return a.s.compare(b.s);
+    return a.n < b.n ? -1 : a.n > b.n ? 1 : 0;
+}
+
+static bool is_extreme(Aggregate::Function function) {
+    return function == Aggregate::MIN || function == Aggregate::MAX;
+}
+
+
+/*
+ * *********************************
+ * AggregateTable class implementation
+ * *********************************
+ */
+
+AggregateTable::AggregateTable(const vector<uint> &group_columns, const Aggregates &aggregates)
+        : group_columns(group_columns), aggregates(aggregates), bytes(0), next_group(0) {
+}
+
+void AggregateTable::add(const ValueRow &row) {
+    this->key.clear();
+    for (auto const &column: this->group_columns)
+        encode_value(row[column], this->key);
+    Accumulator *accumulator = &this->accumulators[find_group(this->key) * this->aggregates.size()];
+    for (auto const &aggregate: this->aggregates) {
+        switch (aggregate.function) {
+            case Aggregate::COUNT_ROWS:
+            case Aggregate::COUNT:
+                accumulator->n++;
+                break;
+            case Aggregate::SUM:
+                accumulator->n += row[aggregate.column].n;
+                break;
+            case Aggregate::MIN:
+            case Aggregate::MAX: {
+                const Value &value = row[aggregate.column];
+                int cmp = accumulator->n == 0 ? 0 : compare(value, accumulator->value);
+                if (accumulator->n == 0 || (aggregate.function == Aggregate::MIN ? cmp < 0 : cmp > 0))
+                    accumulator->value = value;
+                accumulator->n++;
+                break;
+            }
+        }
+        accumulator++;
+    }
+}
+
+void AggregateTable::touch(const ValueRow &row) {
+    this->key.clear();
+    for (auto const &column: this->group_columns)
+        encode_value(row[column], this->key);
+    find_group(this->key);
+}
+
+// Record layout: 32-bit key length, key, then per aggregate a 64-bit n and (MIN/MAX of any rows) the value.
+void AggregateTable::merge(const string &record) {
+    uint32_t key_size;
+    memcpy(&key_size, record.data(), sizeof(key_size));
+    this->key.assign(record.data() + sizeof(key_size), key_size);
+    Accumulator *accumulator = &this->accumulators[find_group(this->key) * this->aggregates.size()];
+    const char *p = record.data() + sizeof(key_size) + key_size;
+    Value value;
+    for (auto const &aggregate: this->aggregates) {
+        int64_t n;
+        memcpy(&n, p, sizeof(n));
+        p += sizeof(n);
+        if (is_extreme(aggregate.function)) {
+            if (n > 0) {
+                decode_value(p, value);
+                int cmp = accumulator->n == 0 ? 0 : compare(value, accumulator->value);
+                if (accumulator->n == 0 || (aggregate.function == Aggregate::MIN ? cmp < 0 : cmp > 0))
+                    accumulator->value = value;
+            }
+        }
+        accumulator->n += n;
+        accumulator++;
+    }
+}
+
+void AggregateTable::merge(const AggregateTable &other) {
+    string record;
+    for (auto const &entry: other.index) {
+        other.encode_group(entry.first, entry.second, record);
+        merge(record);
+    }
+}
+
+void AggregateTable::spill(vector<SpillFile *> &partitions, uint level) {
+    string record;
+    for (auto const &entry: this->index) {
+        encode_group(entry.first, entry.second, record);
+        partition_of(entry.first, partitions, level)->write(record);
+    }
+    clear();
+}
+
+void AggregateTable::respill(const string &record, vector<SpillFile *> &partitions, uint level) {
+    uint32_t key_size;
+    memcpy(&key_size, record.data(), sizeof(key_size));
+    partition_of(record.substr(sizeof(key_size), key_size), partitions, level)->write(record);
+}
+
+// The key's hash, salted by the level and mixed (splitmix64's finalizer), so the groups that fell
+// into one partition at a level are spread over all of them at the next.
+SpillFile *AggregateTable::partition_of(const string &key, vector<SpillFile *> &partitions, uint level) {
+    uint64_t spread = hash<string>()(key) + (level + 1) * 0x9e3779b97f4a7c15ULL;
+    spread = (spread ^ (spread >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    spread = (spread ^ (spread >> 27)) * 0x94d049bb133111ebULL;
+    spread ^= spread >> 31;
+    return partitions[spread % partitions.size()];
+}
+
+bool AggregateTable::next(ValueRow &row) {
+    if (this->next_group >= this->groups.size())
+        return false;
+    uint group = this->next_group++;
+    row = this->groups[group];
+    const Accumulator *accumulator = &this->accumulators[group * this->aggregates.size()];
+    for (auto const &aggregate: this->aggregates) {
+        if (is_extreme(aggregate.function)) {
+            row.push_back(accumulator->n > 0 ? accumulator->value : Value());
+        } else {
+            if (accumulator->n < INT_MIN || accumulator->n > INT_MAX)
+                throw DbRelationError("aggregate result " + to_string(accumulator->n) + " is out of range for INT");
+            row.push_back(Value((int32_t) accumulator->n));
+        }
+        accumulator++;
+    }
+    return true;
+}
+
+void AggregateTable::clear() {
+    this->index.clear();
+    this->groups.clear();
+    this->accumulators.clear();
+    this->bytes = 0;
+    this->next_group = 0;
+}
+
+void AggregateTable::encode_group(const string &key, uint32_t group, string &record) const {
+    uint32_t key_size = (uint32_t) key.size();
+    record.assign((const char *) &key_size, sizeof(key_size));
+    record.append(key);
+    const Accumulator *accumulator = &this->accumulators[group * this->aggregates.size()];
+    for (auto const &aggregate: this->aggregates) {
+        record.append((const char *) &accumulator->n, sizeof(accumulator->n));
+        if (is_extreme(aggregate.function) && accumulator->n > 0)
+            encode_value(accumulator->value, record);
+        accumulator++;
+    }
+}
+
+uint32_t AggregateTable::find_group(const string &key) {
+    auto found = this->index.find(key);
+    if (found != this->index.end())
+        return found->second;
+    uint32_t group = (uint32_t) this->groups.size();
+    this->index.emplace(key, group);
+    this->groups.push_back(ValueRow());
+    decode_row(key, this->groups.back());
+    this->accumulators.resize(this->accumulators.size() + this->aggregates.size(), Accumulator{0, Value()});
+    this->bytes += 2 * sizeof(void *) + sizeof(string) + key.capacity() + sizeof(uint32_t)
+                   + row_bytes(this->groups.back()) + this->aggregates.size() * sizeof(Accumulator);
+    return group;
+}
+
+
+/*
+ * ********************************
+ * HashAggregate class implementation
+ * ********************************
+ */
+
+// ctor - grouping columns keep their names, aggregates are named by the caller
+HashAggregate::HashAggregate(EvalPlan *relation, const vector<uint> &group_columns, const Aggregates &aggregates,
+                             const ColumnNames &aggregate_names)
+        : relation(relation), group_columns(group_columns), aggregates(aggregates), table(group_columns, aggregates) {
+    for (auto const &column: group_columns) {
+        this->column_names.push_back(relation->get_column_names()[column]);
+        this->column_attributes.push_back(relation->get_column_attributes()[column]);
+        this->table_names.push_back(relation->get_table_names()[column]);
+    }
+    for (uint i = 0; i < aggregates.size(); i++) {
+        this->column_names.push_back(aggregate_names[i]);
+        if (is_extreme(aggregates[i].function))
+            this->column_attributes.push_back(relation->get_column_attributes()[aggregates[i].column]);
+        else
+            this->column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+        this->table_names.push_back("");
+    }
+}
+
+HashAggregate::~HashAggregate() {
+    close();
+    delete this->relation;
+}
+
+// Accumulate the whole input, spilling partial groups to the partitions whenever the table gets too big.
+void HashAggregate::do_open() {
+    do_close();
+    ParallelScan *scan = dynamic_cast<ParallelScan *>(this->relation);
+    if (scan != nullptr && scan->get_threads() > 1) {
+        open_parallel(*scan);
+    } else {
+        ValueRow row;
+        this->relation->open();
+        while (this->relation->next(row)) {
+            this->table.add(row);
+            if (this->table.get_bytes() > memory_budget)
+                spill();
+        }
+        this->relation->close();
+    }
+
+    if (!this->partitions.empty()) {
+        this->table.spill(this->partitions);
+        for (auto const &file: this->partitions) {
+            file->rewind();
+            this->pending.push_back(Partition{file, 0});
+        }
+        this->partitions.clear();
+    } else if (this->group_columns.empty()) {
+        this->table.touch(ValueRow());
+    }
+}
+
+// Each scan thread pre-aggregates into a table of its own, merged into the main table when it gets big.
+void HashAggregate::open_parallel(ParallelScan &scan) {
+    uint threads = scan.get_max_threads();
+    size_t budget = memory_budget / threads;
+    vector<unique_ptr<AggregateTable>> partials;
+    for (uint i = 0; i < threads; i++)
+        partials.emplace_back(new AggregateTable(this->group_columns, this->aggregates));
+    mutex merge_lock;
+    auto merge = [this](AggregateTable &partial) {
+        this->table.merge(partial);
+        partial.clear();
+        if (this->table.get_bytes() > memory_budget)
+            spill();
+    };
+    scan.run([&](uint worker, ValueRows &rows) {
+        AggregateTable &partial = *partials[worker];
+        for (auto const &row: rows)
+            partial.add(row);
+        if (partial.get_bytes() > budget) {
+            lock_guard<mutex> guard(merge_lock);
+            merge(partial);
+        }
+        return true;
+    });
+    for (auto const &partial: partials)
+        merge(*partial);
+}
+
+void HashAggregate::spill() {
+    for (uint i = this->partitions.size(); i < NUM_PARTITIONS; i++)
+        this->partitions.push_back(TempFileManager::create());
+    this->table.spill(this->partitions);
+}
+
+bool HashAggregate::do_next(ValueRow &row) {
+    while (!this->table.next(row)) {
+        if (!load_partition())
+            return false;
+    }
+    // MIN/MAX over no rows at all
+    for (uint i = this->group_columns.size(); i < row.size(); i++) {
+        ColumnAttribute attribute = this->column_attributes[i];
+        if (row[i].data_type != attribute.get_data_type())
+            row[i].data_type = attribute.get_data_type();
+    }
+    return true;
+}
+
+void HashAggregate::do_close() {
+    this->table.clear();
+    for (auto const &file: this->partitions)
+        delete file;
+    this->partitions.clear();
+    for (auto const &partition: this->pending)
+        delete partition.file;
+    this->pending.clear();
+    this->relation->close();
+}
+
+// "HashAggregate by a.x: count(*), max(a.y)"
+string HashAggregate::describe() const {
+    string description = "HashAggregate";
+    for (uint i = 0; i < this->group_columns.size(); i++)
+        description += (i == 0 ? " by " : ", ") + this->relation->column_label(this->group_columns[i]);
+    for (uint i = (uint) this->group_columns.size(); i < this->column_names.size(); i++)
+        description += (i == this->group_columns.size() ? ": " : ", ") + this->column_names[i];
+    return description;
+}
+
+// Empty the table and merge the partial groups of the next partition into it. If they outgrow the
+// memory budget, the table and the rest of the partition are split into partitions of their own
+// (by the next level's hash), which are loaded in turn instead.
+bool HashAggregate::load_partition() {
+    this->table.clear();
+    while (!this->pending.empty()) {
+        Partition partition = this->pending.back();
+        this->pending.pop_back();
+        unique_ptr<SpillFile> file(partition.file);
+        uint level = partition.level + 1;
+        vector<SpillFile *> split;
+        string record;
+        while (file->read(record)) {
+            if (!split.empty()) {
+                AggregateTable::respill(record, split, level);
+                continue;
+            }
+            this->table.merge(record);
+            if (this->table.get_bytes() > memory_budget && level <= MAX_LEVELS) {
+                for (uint i = 0; i < NUM_PARTITIONS; i++) {
+                    split.push_back(TempFileManager::create());
+                    this->pending.push_back(Partition{split.back(), level});  // closed with the rest if we fail
+                }
+                this->table.spill(split, level);
+            }
+        }
+        if (split.empty())
+            return true;
+        for (auto const &part: split)
+            part->rewind();
+    }
+    return false;
+}
+
+// HashAggregate that lets the test see how much its table holds
+class TestAggregate : public HashAggregate {
+public:
+    TestAggregate(EvalPlan *relation, const vector<uint> &group_columns, const Aggregates &aggregates,
+                  const ColumnNames &aggregate_names)
+            : HashAggregate(relation, group_columns, aggregates, aggregate_names) {}
+
+    size_t held() const { return this->table.get_bytes(); }
+};
+
+/**
+ * Test a grouping that spills, with a memory budget small enough that the spilled partitions
+ * have to be split again.
+ * @return true if the tests all succeeded
+ */
+bool test_aggregate() {
+    const int32_t GROUPS = 5000;
+    ValueRows rows;
+    for (int32_t i = 0; i < 3 * GROUPS; i++)
+        rows.push_back(ValueRow{Value(i % GROUPS), Value(i)});
+    ColumnAttributes attributes(2, ColumnAttribute(ColumnAttribute::INT));
+    Aggregates aggregates{Aggregate{Aggregate::COUNT_ROWS, 0}, Aggregate{Aggregate::SUM, 1},
+                          Aggregate{Aggregate::MIN, 1}};
+    size_t budget = EvalPlan::memory_budget;
+    EvalPlan::memory_budget = 4096;
+    TestAggregate aggregate(new RowsScan(ColumnNames{"g", "v"}, attributes, rows), vector<uint>{0}, aggregates,
+                            ColumnNames{"n", "total", "least"});
+    vector<bool> seen(GROUPS, false);
+    int32_t groups = 0;
+    size_t held = 0;
+    bool ok = true;
+    ValueRow row;
+    aggregate.open();
+    while (ok && aggregate.next(row)) {
+        int32_t g = row[0].n;
+        held = max(held, aggregate.held());
+        ok = g >= 0 && g < GROUPS && !seen[g] && row[1].n == 3 && row[2].n == 3 * g + 3 * GROUPS
+             && row[3].n == g;
+        if (ok)
+            seen[g] = true;
+        groups++;
+    }
+    aggregate.close();
+    EvalPlan::memory_budget = budget;
+    if (!ok)
+        return assertion_failure("aggregate group", row[0].n, row[1].n);
+    if (groups != GROUPS)
+        return assertion_failure("aggregate groups", groups);
+    if (held > 4096 + 1024)
+        return assertion_failure("aggregate spill held", held);
+    return true;
+}
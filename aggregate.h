@@ -0,0 +1,209 @@
+/**
+ * @file aggregate.h - grouping and aggregate functions
+ * Aggregate
+ * AggregateTable
+ * HashAggregate
+ *
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#pragma once
+
+#include <unordered_map>
+#include "eval_plan.h"
+#include "spill_file.h"
+
+class ParallelScan;
+
+/**
+ * One aggregate function computed for each group.
+ */
+struct Aggregate {
+    enum Function {
+        COUNT_ROWS,  // COUNT(*)
+        COUNT,
+        SUM,
+        MIN,
+        MAX
+    };
+    Function function;
+    uint column;  // ordinal of the argument in the input row (unused for COUNT_ROWS)
+};
+typedef std::vector<Aggregate> Aggregates;
+
+
+/**
+ * @class AggregateTable - hash table from group key to the running aggregates of the group.
+ *
+ * Groups are keyed on the encoded group column values. The running aggregates are partial:
+ * two tables over different parts of the input (different scan threads, or before and after
+ * a spill) can be combined by writing one out with spill() and merge()ing the records into
+ * the other.
+ */
+class AggregateTable {
+public:
+    /**
+     * @param group_columns  ordinals of the grouping columns in the input row
+     * @param aggregates     aggregates to compute for each group
+     */
+    AggregateTable(const std::vector<uint> &group_columns, const Aggregates &aggregates);
+
+    virtual ~AggregateTable() {}
+
+    /**
+     * Fold an input row into its group.
+     * @param row  input row
+     */
+    virtual void add(const ValueRow &row);
+
+    /**
+     * Make sure a row's group exists, even if no rows are ever added to it.
+     * @param row  input row (only its grouping columns are looked at)
+     */
+    virtual void touch(const ValueRow &row);
+
+    /**
+     * Fold in the partial aggregates of a group written by spill().
+     * @param record  one record from a spill file
+     */
+    virtual void merge(const std::string &record);
+
+    /**
+     * Fold in all the groups of another table.
+     * @param other  table over some other part of the input
+     */
+    virtual void merge(const AggregateTable &other);
+
+    /**
+     * Write each group's partial aggregates to one of the partitions (chosen by the hash of the
+     * group key, so a group always goes to the same partition), then empty the table.
+     * @param partitions  files to write to
+     * @param level       how many times the groups have been partitioned before (each level
+     *                    splits them by a different hash)
+     */
+    virtual void spill(std::vector<SpillFile *> &partitions, uint level = 0);
+
+    /**
+     * Write a record written by spill() at a lower level to the partition its group goes to at
+     * this level.
+     * @param record      one record from a spill file
+     * @param partitions  files to write to
+     * @param level       as for spill()
+     */
+    static void respill(const std::string &record, std::vector<SpillFile *> &partitions, uint level);
+
+    /**
+     * Produce the next group: its group column values followed by its final aggregates.
+     * @param row  returned by reference: the group's output row
+     * @returns    false if there are no more groups
+     */
+    virtual bool next(ValueRow &row);
+
+    /**
+     * Forget all the groups.
+     */
+    virtual void clear();
+
+    /**
+     * Number of groups.
+     */
+    size_t size() const { return groups.size(); }
+
+    /**
+     * Approximate bytes of memory held by the groups.
+     */
+    size_t get_bytes() const { return bytes; }
+
+protected:
+    /*
+     * Running value of one aggregate: the count or sum in n, or for MIN and MAX the number of
+     * values seen in n and the smallest/largest of them in value.
+     */
+    struct Accumulator {
+        int64_t n;
+        Value value;
+    };
+
+    std::vector<uint> group_columns;
+    Aggregates aggregates;
+    std::unordered_map<std::string, uint32_t> index;  // group key -> group number
+    ValueRows groups;  // group column values of each group
+    std::vector<Accumulator> accumulators;  // aggregates.size() per group
+    size_t bytes;
+    uint next_group;
+    std::string key;
+
+    virtual uint32_t find_group(const std::string &key);
+
+    static SpillFile *partition_of(const std::string &key, std::vector<SpillFile *> &partitions, uint level);
+
+    void encode_group(const std::string &key, uint32_t group, std::string &record) const;
+};
+
+
+/**
+ * @class HashAggregate - GROUP BY: one output row per group of input rows with the same values in
+ * the grouping columns. Output columns are the grouping columns followed by the aggregates.
+ *
+ * Groups are accumulated in an AggregateTable. If it outgrows EvalPlan::memory_budget its partial
+ * aggregates are spilled into hash partitions and the table starts afresh; at the end each
+ * partition is merged back into the emptied table on its own and its groups are emitted. A
+ * partition whose groups still don't fit is split again, by a different hash, up to MAX_LEVELS
+ * deep (past that it is loaded whole). Over a
+ * ParallelScan, each scan thread pre-aggregates into its own table first. With no grouping
+ * columns there is exactly one output row, even for no input.
+ */
+class HashAggregate : public EvalPlan {
+public:
+    /**
+     * Number of partitions the groups are split into when the table spills.
+     */
+    static const uint NUM_PARTITIONS = 32;
+
+    /**
+     * Number of times a partition is split again before it is loaded whatever its size.
+     */
+    static const uint MAX_LEVELS = 4;
+
+    /**
+     * @param relation         input plan (owned by the HashAggregate from now on)
+     * @param group_columns    ordinals of the grouping columns in the input
+     * @param aggregates       aggregates to compute
+     * @param aggregate_names  output column name for each aggregate
+     */
+    HashAggregate(EvalPlan *relation, const std::vector<uint> &group_columns, const Aggregates &aggregates,
+                  const ColumnNames &aggregate_names);
+
+    virtual ~HashAggregate();
+
+    virtual std::vector<EvalPlan *> get_inputs() const { return std::vector<EvalPlan *>{relation}; }
+
+    virtual std::string describe() const;
+
+protected:
+    EvalPlan *relation;
+    std::vector<uint> group_columns;
+    Aggregates aggregates;
+    AggregateTable table;
+    std::vector<SpillFile *> partitions;  // written while the input is read
+
+    // a spilled partition not yet loaded, and the level it was split at
+    struct Partition {
+        SpillFile *file;
+        uint level;
+    };
+    std::vector<Partition> pending;
+
+    virtual void do_open();
+
+    virtual bool do_next(ValueRow &row);
+
+    virtual void do_close();
+
+    virtual void open_parallel(ParallelScan &scan);
+
+    virtual void spill();
+
+    virtual bool load_partition();
+};
+
+bool test_aggregate();
@@ -0,0 +1,101 @@
+/**
+ * @file bench_scan.cpp - throughput of parallel table scans as the number of threads grows
+ *
+ * Usage: bench_scan dbenvpath [rows]
+ * Fills a scratch table, then times a filtered scan of it with 1, 2, 4, ... threads up to the
+ * number of cores, printing rows scanned per second and the speedup over one thread.
+ *
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include "db_cxx.h"
+#include "heap_storage.h"
+#include "parallel_scan.h"
+
+using namespace std;
+
+DbEnv *_DB_ENV;
+
+const uint CACHE_MB = 512;  // big enough to hold the table, so we time the scan and not the disk
+const uint RUNS = 3;
+
+// best of RUNS, in seconds
+static double time_scan(HeapTable &table, uint threads, int32_t below, uint64_t &selected) {
+    double best = 0;
+    for (uint run = 0; run < RUNS; run++) {
+        ParallelScan scan(table, "_bench_scan", threads);
+        scan.filter(ColumnPredicate(0, ColumnPredicate::LT, Value(below)));
+        atomic<uint64_t> count(0);
+        auto start = chrono::steady_clock::now();
+        scan.run([&count](uint worker, ValueRows &rows) {
+            count += rows.size();
+            return true;
+        });
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (run == 0 || seconds < best)
+            best = seconds;
+        selected = count;
+    }
+    return best;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        cerr << "Usage: bench_scan dbenvpath [rows]" << endl;
+        return EXIT_FAILURE;
+    }
+    uint64_t rows = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1000000;
+
+    DbEnv env(0U);
+    env.set_cachesize(0, CACHE_MB * 1024 * 1024, 1);
+    try {
+        env.open(argv[1], DB_CREATE | DB_INIT_MPOOL | DB_THREAD, 0);
+    } catch (DbException &exc) {
+        cerr << "(bench_scan: " << exc.what() << ")" << endl;
+        return EXIT_FAILURE;
+    }
+    _DB_ENV = &env;
+
+    ColumnNames column_names = {"id", "data"};
+    ColumnAttributes column_attributes = {ColumnAttribute(ColumnAttribute::INT),
+                                          ColumnAttribute(ColumnAttribute::TEXT)};
+    HeapTable table("_bench_scan", column_names, column_attributes);
+    try {
+        table.drop();
+    } catch (...) {
+        // left over from an earlier run, or not
+    }
+    table.create();
+    ValueDict row;
+    for (uint64_t i = 0; i < rows; i++) {
+        row["id"] = Value((int32_t) i);
+        row["data"] = Value("row number " + to_string(i % 1000));
+        table.insert(&row);
+    }
+    BlockIDs *block_ids = table.block_ids();
+    cout << rows << " rows in " << block_ids->size() << " blocks" << endl;
+    delete block_ids;
+
+    cout << setw(8) << "threads" << setw(16) << "rows/sec" << setw(10) << "speedup" << endl;
+    double base = 0;
+    uint cores = ParallelScan::default_threads;
+    for (uint threads = 1; threads <= cores; threads = threads < cores && threads * 2 > cores ? cores : threads * 2) {
+        uint64_t selected;
+        double seconds = time_scan(table, threads, (int32_t) (rows / 2), selected);
+        double rate = rows / seconds;
+        if (threads == 1)
+            base = rate;
+        cout << setw(8) << threads << setw(16) << (uint64_t) rate << setw(9) << fixed << setprecision(2)
+             << rate / base << "x" << endl;
+        if (threads == cores)
+            break;
+    }
+
+    table.drop();
+    env.close(0U);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,472 @@
+/**
+ * @file bench_storage.cpp - microbenchmarks of the storage engine, for catching regressions
+ *
+ * Usage: bench_storage dbenvpath [name-prefix]
+ * Times SlottedPage add/get/put/del at several record sizes and fill levels, HeapTable
+ * marshal/unmarshal for several schemas, HeapFile get/put of cached blocks, and Value and
+ * ValueDict construction. Each benchmark runs for at least MIN_MILLIS of measured time; setup
+ * (filling pages, say) is not measured. Prints a JSON document with, per benchmark, its name,
+ * the operations run, nanoseconds per operation and allocations (operator new calls, not
+ * Berkeley DB's mallocs) per operation. Only the benchmarks whose names start with the prefix
+ * are run, if one is given.
+ *
+ * $ ./bench_storage ~/cpsc5300/data > bench.json
+ *
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+#include "db_cxx.h"
+#include "heap_storage.h"
+
+using namespace std;
+
+DbEnv *_DB_ENV;
+
+const uint64_t MIN_MILLIS = 100;  // measured time per benchmark
+const uint CACHE_MB = 64;         // big enough to hold the benchmark file, so we time the cache and not the disk
+const uint PAGES = 64;            // pages set up for each measured batch of SlottedPage operations
+const BlockID FILE_BLOCKS = 256;  // blocks in the HeapFile benchmarks' file
+
+static atomic<uint64_t> allocations(0);
+
+void *operator new(size_t size) {
+    allocations.fetch_add(1, memory_order_relaxed);
+    void *p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr)
+        throw bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    free(p);
+}
+
+// keep the compiler from optimizing away the computation of a value
+template<typename T>
+static void keep(const T &value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+/*
+ * Adds up the time and allocations between each start() and stop().
+ */
+class Meter {
+public:
+    Meter() : nanos(0), allocs(0), start_allocs(0) {}
+
+    void start() {
+        this->start_allocs = allocations.load(memory_order_relaxed);
+        this->started = chrono::steady_clock::now();
+    }
+
+    void stop() {
+        auto stopped = chrono::steady_clock::now();
+        this->allocs += allocations.load(memory_order_relaxed) - this->start_allocs;
+        this->nanos += (uint64_t) chrono::duration_cast<chrono::nanoseconds>(stopped - this->started).count();
+    }
+
+    uint64_t nanos;
+    uint64_t allocs;
+
+protected:
+    uint64_t start_allocs;
+    chrono::steady_clock::time_point started;
+};
+
+/*
+ * Runs the benchmarks and prints their results as JSON.
+ */
+class Bench {
+public:
+    explicit Bench(const string &prefix) : prefix(prefix), count(0) {
+        cout << "{" << endl;
+        cout << "  \"context\": {\"block_size\": " << DbBlock::BLOCK_SZ << ", \"min_millis\": " << MIN_MILLIS
+             << "}," << endl;
+        cout << "  \"benchmarks\": [";
+    }
+
+    ~Bench() {
+        cout << endl << "  ]" << endl << "}" << endl;
+    }
+
+    /**
+     * Run a benchmark: call batch until it has been measured for MIN_MILLIS and print the result.
+     * @param name   the benchmark's name
+     * @param batch  sets up and measures some operations, returning how many it measured
+     */
+    void run(const string &name, function<uint64_t(Meter &)> batch) {
+        if (!selects(name))
+            return;
+        Meter meter;
+        uint64_t ops = 0;
+        while (meter.nanos < MIN_MILLIS * 1000000)
+            ops += batch(meter);
+        cout << (this->count++ == 0 ? "" : ",") << endl << "    {\"name\": \"" << name << "\", \"ops\": " << ops
+             << ", \"ns_per_op\": " << fixed << setprecision(2) << (double) meter.nanos / ops
+             << ", \"allocs_per_op\": " << setprecision(3) << (double) meter.allocs / ops << "}" << flush;
+    }
+
+    /**
+     * Whether any benchmarks whose names start with the given group are to be run (so their setup is needed).
+     */
+    bool selects(const string &group) const {
+        size_t n = min(group.size(), this->prefix.size());
+        return group.compare(0, n, this->prefix, 0, n) == 0;
+    }
+
+protected:
+    string prefix;
+    uint count;
+};
+
+
+/*
+ * SlottedPage
+ */
+
+// page buffers for a batch of operations, each a copy of a model page
+class Pages {
+public:
+    explicit Pages(const char *model) : buffers(PAGES * DbBlock::BLOCK_SZ) {
+        for (uint i = 0; i < PAGES; i++)
+            memcpy(&this->buffers[i * DbBlock::BLOCK_SZ], model, DbBlock::BLOCK_SZ);
+        for (uint i = 0; i < PAGES; i++) {
+            Dbt block(&this->buffers[i * DbBlock::BLOCK_SZ], DbBlock::BLOCK_SZ);
+            this->pages.push_back(new SlottedPage(block, i + 1));
+        }
+    }
+
+    ~Pages() {
+        for (auto page : this->pages)
+            delete page;
+    }
+
+    vector<char> buffers;
+    vector<SlottedPage *> pages;
+};
+
+// records of a size that fit in a page, leaving room for one of them to grow by 16 bytes
+static uint capacity(uint record_size) {
+    return (DbBlock::BLOCK_SZ - 4 - 16) / (record_size + 4);
+}
+
+// a page holding records of the given size
+static void make_page(char *buffer, uint record_size, uint records) {
+    memset(buffer, 0, DbBlock::BLOCK_SZ);
+    Dbt block(buffer, DbBlock::BLOCK_SZ);
+    SlottedPage page(block, 1, true);
+    string bytes(record_size, 'r');
+    Dbt record(&bytes[0], record_size);
+    for (uint i = 0; i < records; i++)
+        page.add(&record);
+}
+
+static void slotted_page(Bench &bench) {
+    char model[DbBlock::BLOCK_SZ];
+    for (uint size : {16, 64, 256, 1024}) {
+        string bytes(size + 16, 'x');
+        Dbt record(&bytes[0], size), bigger(&bytes[0], size + 16);
+        string suffix = "/" + to_string(size) + "B";
+
+        make_page(model, size, 0);
+        bench.run("SlottedPage::add" + suffix, [&](Meter &meter) {
+            Pages pages(model);
+            uint records = capacity(size);
+            meter.start();
+            for (auto page : pages.pages)
+                for (uint i = 0; i < records; i++)
+                    page->add(&record);
+            meter.stop();
+            return (uint64_t) PAGES * records;
+        });
+
+        for (uint fill : {25, 50, 100}) {
+            uint records = max(1U, capacity(size) * fill / 100);
+            string name_suffix = suffix + "/fill" + to_string(fill);
+            make_page(model, size, records);
+            vector<RecordID> order;
+            for (RecordID id = 1; id <= records; id++)
+                order.push_back(id);
+            shuffle(order.begin(), order.end(), mt19937(size * 100 + fill));
+
+            bench.run("SlottedPage::get" + name_suffix, [&](Meter &meter) {
+                Pages pages(model);
+                meter.start();
+                for (auto page : pages.pages)
+                    for (RecordID id : order) {
+                        Dbt *data = page->get(id);
+                        keep(*(const char *) data->get_data());
+                        delete data;
+                    }
+                meter.stop();
+                return (uint64_t) PAGES * records;
+            });
+
+            bench.run("SlottedPage::put" + name_suffix, [&](Meter &meter) {
+                Pages pages(model);
+                meter.start();
+                for (auto page : pages.pages)
+                    for (RecordID id : order)
+                        page->put(id, record);
+                meter.stop();
+                return (uint64_t) PAGES * records;
+            });
+
+            // grow a record by 16 bytes and shrink it back, sliding the records below it each time
+            bench.run("SlottedPage::put_resize" + name_suffix, [&](Meter &meter) {
+                Pages pages(model);
+                meter.start();
+                for (auto page : pages.pages)
+                    for (RecordID id : order) {
+                        page->put(id, bigger);
+                        page->put(id, record);
+                    }
+                meter.stop();
+                return (uint64_t) PAGES * records * 2;
+            });
+
+            bench.run("SlottedPage::del" + name_suffix, [&](Meter &meter) {
+                Pages pages(model);
+                meter.start();
+                for (auto page : pages.pages)
+                    for (RecordID id : order)
+                        page->del(id);
+                meter.stop();
+                return (uint64_t) PAGES * records;
+            });
+        }
+    }
+}
+
+
+/*
+ * HeapTable
+ */
+
+// a HeapTable whose record encoding can be called directly
+class BenchTable : public HeapTable {
+public:
+    BenchTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes)
+            : HeapTable(table_name, column_names, column_attributes) {}
+
+    using HeapTable::marshal;
+    using HeapTable::unmarshal;
+};
+
+struct Schema {
+    string name;
+    vector<ColumnAttribute::DataType> types;
+    uint text_size;  // of each TEXT column's values
+};
+
+static void heap_table(Bench &bench) {
+    const uint BATCH = 1000;
+    vector<Schema> schemas = {
+            {"int",       {ColumnAttribute::INT},                                                 0},
+            {"int_text",  {ColumnAttribute::INT, ColumnAttribute::TEXT},                          20},
+            {"mixed8",    {ColumnAttribute::INT, ColumnAttribute::TEXT, ColumnAttribute::BOOLEAN,
+                           ColumnAttribute::INT, ColumnAttribute::TEXT, ColumnAttribute::INT,
+                           ColumnAttribute::TEXT, ColumnAttribute::INT},                          32},
+            {"text_1k",   {ColumnAttribute::TEXT},                                                1000}};
+    for (auto const &schema : schemas) {
+        ColumnNames names;
+        ColumnAttributes attributes;
+        ValueDict row;
+        for (uint i = 0; i < schema.types.size(); i++) {
+            names.push_back("c" + to_string(i));
+            attributes.push_back(ColumnAttribute(schema.types[i]));
+            if (schema.types[i] == ColumnAttribute::TEXT)
+                row[names.back()] = Value(string(schema.text_size, 't'));
+            else
+                row[names.back()] = Value((int32_t) i);
+            row[names.back()].data_type = schema.types[i];
+        }
+        BenchTable table("_bench_" + schema.name, names, attributes);
+
+        bench.run("HeapTable::marshal/" + schema.name, [&](Meter &meter) {
+            meter.start();
+            for (uint i = 0; i < BATCH; i++) {
+                Dbt *data = table.marshal(&row);
+                keep(*(const char *) data->get_data());
+                delete[] (char *) data->get_data();
+                delete data;
+            }
+            meter.stop();
+            return (uint64_t) BATCH;
+        });
+
+        Dbt *data = table.marshal(&row);
+        bench.run("HeapTable::unmarshal/" + schema.name, [&](Meter &meter) {
+            meter.start();
+            for (uint i = 0; i < BATCH; i++) {
+                ValueDict *values = table.unmarshal(data);
+                keep(values->size());
+                delete values;
+            }
+            meter.stop();
+            return (uint64_t) BATCH;
+        });
+        delete[] (char *) data->get_data();
+        delete data;
+    }
+}
+
+
+/*
+ * HeapFile
+ */
+
+static void heap_file(Bench &bench) {
+    const uint BATCH = 1000;
+    HeapFile file("_bench_storage");
+    try {
+        file.drop();
+    } catch (...) {
+        // left over from an earlier run, or not
+    }
+    file.create();
+    char model[DbBlock::BLOCK_SZ];
+    make_page(model, 64, capacity(64));
+    for (BlockID block_id = 1; block_id <= FILE_BLOCKS; block_id++) {
+        SlottedPage *page = block_id == 1 ? file.get(1) : file.get_new();
+        memcpy(page->get_block()->get_data(), model, DbBlock::BLOCK_SZ);
+        file.put(page);
+        delete page;
+    }
+
+    mt19937 random(FILE_BLOCKS);
+    vector<BlockID> order;
+    for (uint i = 0; i < BATCH; i++)
+        order.push_back(1 + random() % FILE_BLOCKS);
+
+    bench.run("HeapFile::get", [&](Meter &meter) {
+        meter.start();
+        for (BlockID block_id : order) {
+            SlottedPage *page = file.get(block_id);
+            keep(*(const char *) page->get_block()->get_data());
+            delete page;
+        }
+        meter.stop();
+        return (uint64_t) order.size();
+    });
+
+    Pages pages(model);
+    for (uint i = 0; i < PAGES; i++) {
+        delete pages.pages[i];
+        Dbt block(&pages.buffers[i * DbBlock::BLOCK_SZ], DbBlock::BLOCK_SZ);
+        pages.pages[i] = new SlottedPage(block, order[i]);
+    }
+    bench.run("HeapFile::put", [&](Meter &meter) {
+        meter.start();
+        for (auto page : pages.pages)
+            file.put(page);
+        meter.stop();
+        return (uint64_t) PAGES;
+    });
+
+    file.drop();
+}
+
+
+/*
+ * Value and ValueDict
+ */
+
+static void values(Bench &bench) {
+    const uint BATCH = 1000;
+    string short_text(8, 's'), long_text(64, 'l');
+
+    bench.run("Value/int", [&](Meter &meter) {
+        meter.start();
+        for (uint i = 0; i < BATCH; i++) {
+            Value value((int32_t) i);
+            keep(value);
+        }
+        meter.stop();
+        return (uint64_t) BATCH;
+    });
+
+    bench.run("Value/text8", [&](Meter &meter) {
+        meter.start();
+        for (uint i = 0; i < BATCH; i++) {
+            Value value(short_text);
+            keep(value);
+        }
+        meter.stop();
+        return (uint64_t) BATCH;
+    });
+
+    bench.run("Value/text64", [&](Meter &meter) {
+        meter.start();
+        for (uint i = 0; i < BATCH; i++) {
+            Value value(long_text);
+            keep(value);
+        }
+        meter.stop();
+        return (uint64_t) BATCH;
+    });
+
+    // a row as insert and unmarshal build it: two INT and two TEXT columns
+    bench.run("ValueDict/4_columns", [&](Meter &meter) {
+        meter.start();
+        for (uint i = 0; i < BATCH; i++) {
+            ValueDict row;
+            row["id"] = Value((int32_t) i);
+            row["count"] = Value((int32_t) i);
+            row["name"] = Value(short_text);
+            row["description"] = Value(long_text);
+            keep(row);
+        }
+        meter.stop();
+        return (uint64_t) BATCH;
+    });
+}
+
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || argc > 3) {
+        cerr << "Usage: bench_storage dbenvpath [name-prefix]" << endl;
+        return EXIT_FAILURE;
+    }
+    string prefix = argc > 2 ? argv[2] : "";
+
+    DbEnv env(0U);
+    env.set_cachesize(0, CACHE_MB * 1024 * 1024, 1);
+    try {
+        env.open(argv[1], DB_CREATE | DB_INIT_MPOOL | DB_THREAD, 0);
+    } catch (DbException &exc) {
+        cerr << "(bench_storage: " << exc.what() << ")" << endl;
+        return EXIT_FAILURE;
+    }
+    _DB_ENV = &env;
+
+    {
+        Bench bench(prefix);
+        slotted_page(bench);
+        heap_table(bench);
+        if (bench.selects("HeapFile::"))
+            heap_file(bench);
+        values(bench);
+    }
+    env.close(0U);
+    return EXIT_SUCCESS;
+}
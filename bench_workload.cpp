@@ -0,0 +1,461 @@
+/**
+ * @file bench_workload.cpp - YCSB-style workload driver, run against the engine in-process
+ *
+ * Usage: bench_workload dbenvpath [--workload a|b|c|d|e] [--mix op=weight,...]
+ *            [--distribution uniform|zipfian|latest] [--theta t] [--rows n] [--threads n]
+ *            [--seconds s] [--ops-per-txn n] [--value-bytes n] [--scan-length n] [--table name]
+ *
+ * Creates a table (key INT, value TEXT) with an index on its key through SQLExec, loads --rows
+ * rows (default 100000), and then has --threads threads (default one per core) run a mix of
+ * operations on it for --seconds (default 10), --ops-per-txn operations (default 1) to a
+ * transaction:
+ *   read    look a key up and project its row
+ *   update  look a key up and replace its row with a new value (delete and insert, keeping the
+ *           index up to date: DbRelation has no update)
+ *   insert  insert a row with the next new key
+ *   delete  look a key up and delete its row
+ *   scan    read the rows of up to --scan-length (default 100) keys from a key on
+ * Lookups go through the index, or, while it cannot look keys up, a select of the table. Keys are
+ * chosen uniformly, by a Zipfian distribution with skew --theta (default 0.99, popular keys
+ * scattered over the key space) or by a Zipfian distribution over the newest keys first (latest).
+ *
+ * The workloads are YCSB's core ones: a (read 50, update 50), b (read 95, update 5), c (read 100),
+ * d (read 95, insert 5, latest) and e (scan 95, insert 5). --mix and --distribution override the
+ * workload's (given after it). Prints throughput and, per operation and per transaction, the
+ * latency percentiles from histograms with buckets under 1% wide.
+ *
+ * $ ./bench_workload ~/cpsc5300/data --workload a --threads 8 --ops-per-txn 4
+ *
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "db_cxx.h"
+#include "SQLParser.h"
+#include "heap_storage.h"
+#include "SQLExec.h"
+#include "transaction.h"
+
+using namespace std;
+using namespace hsql;
+
+DbEnv *_DB_ENV;
+
+const uint CACHE_MB = 256;
+const uint LOAD_BATCH = 1000;  // rows loaded per transaction
+
+enum Op {
+    READ, UPDATE, INSERT, DELETE, SCAN, OPS
+};
+const char *OP_NAMES[] = {"read", "update", "insert", "delete", "scan"};
+
+enum Distribution {
+    UNIFORM, ZIPFIAN, LATEST
+};
+
+typedef BasicLatencyHistogram<7> Histogram;  // buckets under 1% wide
+
+struct Options {
+    uint weights[OPS] = {50, 50, 0, 0, 0};
+    Distribution distribution = ZIPFIAN;
+    double theta = 0.99;
+    uint64_t rows = 100000;
+    uint threads = thread::hardware_concurrency() > 0 ? thread::hardware_concurrency() : 1;
+    double seconds = 10;
+    uint ops_per_txn = 1;
+    uint value_bytes = 100;
+    uint scan_length = 100;
+    string table = "usertable";
+};
+
+/*
+ * Chooses keys below a bound that may grow as keys are inserted.
+ *
+ * The Zipfian distribution is generated as in YCSB (Gray et al., "Quickly Generating
+ * Billion-Record Synthetic Databases"), with zeta(n) extended as n grows.
+ */
+class KeyChooser {
+public:
+    KeyChooser(Distribution distribution, double theta, uint64_t seed)
+            : distribution(distribution), theta(theta), random(seed), unit(0.0, 1.0), n(0), zetan(0),
+              zeta2(1 + pow(0.5, theta)), alpha(1 / (1 - theta)), eta(0) {}
+
+    // a key below keys
+    uint64_t next(uint64_t keys) {
+        switch (this->distribution) {
+            case UNIFORM:
+                return this->random() % keys;
+            case ZIPFIAN:
+                return scramble(zipfian(keys)) % keys;  // so the popular keys aren't all together
+            default:
+                return keys - 1 - zipfian(keys);        // the newest keys are the most popular
+        }
+    }
+
+    mt19937_64 &get_random() { return random; }
+
+protected:
+    Distribution distribution;
+    double theta;
+    mt19937_64 random;
+    uniform_real_distribution<double> unit;
+    uint64_t n;    // number of items zetan is for
+    double zetan;
+    double zeta2;
+    double alpha;
+    double eta;
+
+    // a rank below keys, 0 the most likely
+    uint64_t zipfian(uint64_t keys) {
+        if (keys != this->n) {
+            for (uint64_t i = this->n; i < keys; i++)
+                this->zetan += 1 / pow((double) (i + 1), this->theta);
+            this->n = keys;
+            this->eta = (1 - pow(2.0 / keys, 1 - this->theta)) / (1 - this->zeta2 / this->zetan);
+        }
+        double u = this->unit(this->random);
+        double uz = u * this->zetan;
+        if (uz < 1)
+            return 0;
+        if (uz < 1 + pow(0.5, this->theta))
+            return min((uint64_t) 1, keys - 1);
+        uint64_t rank = (uint64_t) (keys * pow(this->eta * u - this->eta + 1, this->alpha));
+        return min(rank, keys - 1);
+    }
+
+    // FNV-1a of the rank's bytes
+    static uint64_t scramble(uint64_t rank) {
+        uint64_t hash = 14695981039346656037ULL;
+        for (int i = 0; i < 8; i++) {
+            hash ^= (rank >> (8 * i)) & 0xff;
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+};
+
+/*
+ * What one thread measured.
+ */
+struct Worker {
+    Histogram latencies[OPS + 1];  // per operation, then per transaction
+    uint64_t aborts = 0;           // transactions rolled back (deadlocks, conflicting deletes)
+    uint64_t misses = 0;           // lookups that found no row (deleted, or not committed yet)
+    string first_error;
+};
+
+/*
+ * The table, its index and the keys in it, shared by the threads.
+ */
+class Driver {
+public:
+    Driver(const Options &options) : options(options), keys(0) {}
+
+    void setup() {
+        execute("DROP TABLE " + this->options.table, true);
+        execute("CREATE TABLE " + this->options.table + " (ycsb_key INT, field0 TEXT)", false);
+        execute("CREATE INDEX " + this->options.table + "_key ON " + this->options.table + " (ycsb_key)", false);
+        this->table = Tables::get_table(this->options.table);
+        this->index = SQLExec::get_indices().get_index(this->options.table, this->options.table + "_key");
+
+        mt19937_64 random(1);
+        for (uint64_t loaded = 0; loaded < this->options.rows;) {
+            Autocommit autocommit;
+            for (uint i = 0; i < LOAD_BATCH && loaded < this->options.rows; i++, loaded++)
+                insert((int32_t) loaded, random);
+            autocommit.commit();
+        }
+        this->keys = this->options.rows;
+    }
+
+    void work(uint id, chrono::steady_clock::time_point deadline, Worker &worker) {
+        KeyChooser chooser(this->options.distribution, this->options.theta, id * 7919 + 1);
+        mt19937_64 &random = chooser.get_random();
+        uint total_weight = 0;
+        for (uint weight : this->options.weights)
+            total_weight += weight;
+        vector<pair<Op, uint64_t>> done;  // recorded once the transaction commits
+        while (chrono::steady_clock::now() < deadline) {
+            done.clear();
+            auto started = chrono::steady_clock::now();
+            try {
+                Autocommit autocommit;
+                for (uint i = 0; i < this->options.ops_per_txn; i++) {
+                    uint op = 0;
+                    for (uint choice = (uint) (random() % total_weight); choice >= this->options.weights[op]; op++)
+                        choice -= this->options.weights[op];
+                    auto start = chrono::steady_clock::now();
+                    run((Op) op, chooser, worker);
+                    done.push_back(make_pair((Op) op, nanos_since(start)));
+                }
+                autocommit.commit();
+            } catch (DbRelationError &e) {
+                if (worker.aborts++ == 0)
+                    worker.first_error = e.what();
+                continue;
+            }
+            for (auto const &op : done)
+                worker.latencies[op.first].add(op.second);
+            worker.latencies[OPS].add(nanos_since(started));
+        }
+    }
+
+    void teardown() {
+        this->index.reset();
+        this->table.reset();
+        execute("DROP TABLE " + this->options.table, false);
+    }
+
+protected:
+    const Options &options;
+    RelationRef table;
+    IndexRef index;
+    atomic<uint64_t> keys;  // keys handed out so far: the loaded ones and the inserted ones
+
+    static uint64_t nanos_since(chrono::steady_clock::time_point start) {
+        return (uint64_t) chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    }
+
+    static void execute(const string &sql, bool may_fail) {
+        unique_ptr<SQLParserResult> parse(SQLParser::parseSQLString(sql));
+        if (!parse->isValid())
+            throw SQLExecError("invalid SQL: " + sql);
+        try {
+            delete SQLExec::execute(parse->getStatement(0));
+        } catch (SQLExecError &e) {
+            if (!may_fail)
+                throw;
+        }
+    }
+
+    string value(mt19937_64 &random) const {
+        string value(this->options.value_bytes, ' ');
+        for (auto &c : value)
+            c = (char) ('a' + random() % 26);
+        return value;
+    }
+
+    void insert(int32_t key, mt19937_64 &random) {
+        ValueDict row;
+        row["ycsb_key"] = Value(key);
+        row["field0"] = Value(value(random));
+        this->index->insert(this->table->insert(&row));
+    }
+
+    // the rows holding a key (freed by caller)
+    Handles *lookup(int32_t key) {
+        ValueDict where;
+        where["ycsb_key"] = Value(key);
+        Handles *handles = this->index->lookup(&where);
+        return handles != nullptr ? handles : this->table->select(&where);
+    }
+
+    void run(Op op, KeyChooser &chooser, Worker &worker) {
+        mt19937_64 &random = chooser.get_random();
+        if (op == INSERT) {
+            insert((int32_t) this->keys++, random);
+            return;
+        }
+        int32_t key = (int32_t) chooser.next(this->keys.load());
+        if (op == SCAN) {
+            uint length = 1 + (uint) (random() % this->options.scan_length);
+            TableScan scan(this->table, this->options.table);
+            scan.filter(ColumnPredicate(0, ColumnPredicate::GE, Value(key)));
+            scan.filter(ColumnPredicate(0, ColumnPredicate::LT, Value((int32_t) (key + length))));
+            ValueRow row;
+            scan.open();
+            while (scan.next(row))
+                continue;
+            scan.close();
+            return;
+        }
+        unique_ptr<Handles> handles(lookup(key));
+        if (handles->empty())
+            worker.misses++;
+        for (auto const &handle : *handles) {
+            unique_ptr<ValueDict> row(this->table->project(handle));
+            if (op == READ)
+                continue;
+            this->index->del(handle);
+            this->table->del(handle);
+            if (op == UPDATE) {
+                (*row)["field0"] = Value(value(random));
+                this->index->insert(this->table->insert(row.get()));
+            }
+        }
+    }
+};
+
+static bool parse_mix(const string &text, Options &options) {
+    uint weights[OPS] = {0, 0, 0, 0, 0};
+    istringstream items(text);
+    string item;
+    while (getline(items, item, ',')) {
+        size_t equals = item.find('=');
+        if (equals == string::npos)
+            return false;
+        string name = item.substr(0, equals);
+        uint op = 0;
+        while (op < OPS && name != OP_NAMES[op])
+            op++;
+        if (op == OPS)
+            return false;
+        weights[op] = (uint) atoi(item.c_str() + equals + 1);
+    }
+    uint total = 0;
+    for (uint op = 0; op < OPS; op++)
+        total += options.weights[op] = weights[op];
+    return total > 0;
+}
+
+static bool set_workload(const string &name, Options &options) {
+    static const struct {
+        const char *name;
+        const char *mix;
+        Distribution distribution;
+    } WORKLOADS[] = {{"a", "read=50,update=50", ZIPFIAN},
+                     {"b", "read=95,update=5",  ZIPFIAN},
+                     {"c", "read=100",          ZIPFIAN},
+                     {"d", "read=95,insert=5",  LATEST},
+                     {"e", "scan=95,insert=5",  ZIPFIAN}};
+    for (auto const &workload : WORKLOADS)
+        if (name == workload.name) {
+            options.distribution = workload.distribution;
+            return parse_mix(workload.mix, options);
+        }
+    return false;
+}
+
+static void print_latencies(const string &name, const Histogram &histogram, double seconds) {
+    cout << setw(8) << name << setw(12) << histogram.count() << setw(12) << (uint64_t) (histogram.count() / seconds);
+    for (double fraction : {0.5, 0.9, 0.99, 0.999, 1.0})
+        cout << setw(10) << fixed << setprecision(1) << histogram.percentile(fraction) / 1000.0;
+    cout << endl;
+}
+
+int main(int argc, char *argv[]) {
+    Options options;
+    bool valid = argc > 1 && argv[1][0] != '-';
+    for (int i = 2; i < argc && valid; i++) {
+        string arg = argv[i];
+        if (i + 1 == argc) {
+            valid = false;
+            break;
+        }
+        string value = argv[++i];
+        if (arg == "--workload")
+            valid = set_workload(value, options);
+        else if (arg == "--mix")
+            valid = parse_mix(value, options);
+        else if (arg == "--distribution" && (value == "uniform" || value == "zipfian" || value == "latest"))
+            options.distribution = value == "uniform" ? UNIFORM : value == "zipfian" ? ZIPFIAN : LATEST;
+        else if (arg == "--theta")
+            options.theta = atof(value.c_str());
+        else if (arg == "--rows")
+            options.rows = strtoull(value.c_str(), nullptr, 10);
+        else if (arg == "--threads")
+            options.threads = (uint) atoi(value.c_str());
+        else if (arg == "--seconds")
+            options.seconds = atof(value.c_str());
+        else if (arg == "--ops-per-txn")
+            options.ops_per_txn = (uint) atoi(value.c_str());
+        else if (arg == "--value-bytes")
+            options.value_bytes = (uint) atoi(value.c_str());
+        else if (arg == "--scan-length")
+            options.scan_length = (uint) atoi(value.c_str());
+        else if (arg == "--table")
+            options.table = value;
+        else
+            valid = false;
+    }
+    valid = valid && options.rows > 0 && options.rows <= INT32_MAX && options.threads > 0 && options.seconds > 0
+            && options.ops_per_txn > 0 && options.scan_length > 0 && options.theta > 0 && options.theta != 1;
+    if (!valid) {
+        cerr << "Usage: bench_workload dbenvpath [--workload a|b|c|d|e] [--mix op=weight,...]" << endl
+             << "           [--distribution uniform|zipfian|latest] [--theta t] [--rows n] [--threads n]" << endl
+             << "           [--seconds s] [--ops-per-txn n] [--value-bytes n] [--scan-length n] [--table name]"
+             << endl << "       (op is read, update, insert, delete or scan)" << endl;
+        return EXIT_FAILURE;
+    }
+
+    DbEnv env(0U);
+    env.set_cachesize(0, CACHE_MB * 1024 * 1024, 1);
+    try {
+        env.open(argv[1], DB_CREATE | DB_INIT_MPOOL | DB_THREAD, 0);
+    } catch (DbException &exc) {
+        cerr << "(bench_workload: " << exc.what() << ")" << endl;
+        return EXIT_FAILURE;
+    }
+    _DB_ENV = &env;
+
+    Driver driver(options);
+    vector<unique_ptr<Worker>> workers;
+    double seconds;
+    try {
+        Transaction::open_log(argv[1]);
+        initialize_schema_tables();
+        Transaction::get_log()->checkpoint();
+
+        auto start = chrono::steady_clock::now();
+        driver.setup();
+        double load_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << "loaded " << options.rows << " rows in " << fixed << setprecision(1) << load_seconds << " s ("
+             << (uint64_t) (options.rows / load_seconds) << " rows/sec)" << endl;
+
+        vector<thread> threads;
+        start = chrono::steady_clock::now();
+        auto deadline = start + chrono::duration_cast<chrono::steady_clock::duration>(
+                chrono::duration<double>(options.seconds));
+        for (uint id = 0; id < options.threads; id++) {
+            workers.emplace_back(new Worker());
+            threads.emplace_back(&Driver::work, &driver, id, deadline, ref(*workers.back()));
+        }
+        for (auto &thread : threads)
+            thread.join();
+        seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        driver.teardown();
+        Transaction::close_log();
+    } catch (exception &e) {
+        cerr << "(bench_workload: " << e.what() << ")" << endl;
+        return EXIT_FAILURE;
+    }
+
+    Worker total;
+    for (auto const &worker : workers) {
+        for (uint i = 0; i <= OPS; i++)
+            total.latencies[i].add(worker->latencies[i]);
+        total.aborts += worker->aborts;
+        total.misses += worker->misses;
+        if (total.first_error.empty())
+            total.first_error = worker->first_error;
+    }
+    uint64_t ops = 0;
+    for (uint op = 0; op < OPS; op++)
+        ops += total.latencies[op].count();
+    static const char *DISTRIBUTIONS[] = {"uniform", "zipfian", "latest"};
+    cout << options.threads << " threads, " << DISTRIBUTIONS[options.distribution] << ", " << options.ops_per_txn
+         << " ops per transaction: " << ops << " ops in " << fixed << setprecision(1) << seconds << " s, "
+         << (uint64_t) (ops / seconds) << " ops/sec, " << total.aborts << " transactions rolled back, "
+         << total.misses << " keys not found" << endl;
+    if (!total.first_error.empty())
+        cout << "(first rollback: " << total.first_error << ")" << endl;
+    cout << setw(8) << "" << setw(12) << "count" << setw(12) << "per sec" << setw(10) << "p50 us" << setw(10)
+         << "p90" << setw(10) << "p99" << setw(10) << "p99.9" << setw(10) << "max" << endl;
+    for (uint op = 0; op < OPS; op++)
+        if (total.latencies[op].count() > 0)
+            print_latencies(OP_NAMES[op], total.latencies[op], seconds);
+    print_latencies("txn", total.latencies[OPS], seconds);
+
+    env.close(0U);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,402 @@
+/**
+ * @file bulk_load.cpp - implementation of the bulk loader
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "bulk_load.h"
+#include "heap_storage.h"
+#include "spill_file.h"
+
+using namespace std;
+
+BulkLoad::BulkLoad(DbRelation &table, const string &path, char delimiter, bool header, uint threads,
+                   size_t chunk_bytes)
+        : table(table), column_names(table.get_column_names()), delimiter(delimiter), header(header),
+          threads(max(1U, threads)), chunk_bytes(max<size_t>(1, chunk_bytes)), fd(-1), data(nullptr), size(0),
+          next_chunk(0), written(0), stopping(false) {
+    for (auto attribute: table.get_column_attributes())
+        this->types.push_back(attribute.get_data_type());
+    this->fd = open(path.c_str(), O_RDONLY);
+    if (this->fd < 0)
+        throw DbRelationError("cannot open " + path + ": " + strerror(errno));
+    struct stat status;
+    if (fstat(this->fd, &status) < 0 || !S_ISREG(status.st_mode)) {
+        close(this->fd);
+        throw DbRelationError("cannot read " + path + ": not a file");
+    }
+    this->size = (size_t) status.st_size;
+    if (this->size > 0) {
+        void *mapped = mmap(nullptr, this->size, PROT_READ, MAP_PRIVATE, this->fd, 0);
+        if (mapped == MAP_FAILED) {
+            close(this->fd);
+            throw DbRelationError("cannot map " + path + ": " + strerror(errno));
+        }
+        madvise(mapped, this->size, MADV_SEQUENTIAL);
+        this->data = (const char *) mapped;
+    }
+    this->chunks.resize((this->size + this->chunk_bytes - 1) / this->chunk_bytes);
+    this->odd_quotes.assign(this->chunks.size(), 0);
+}
+
+BulkLoad::~BulkLoad() {
+    if (this->data != nullptr)
+        munmap((void *) this->data, this->size);
+    close(this->fd);
+}
+
+uint64_t BulkLoad::run(Handles *handles) {
+    uint workers = (uint) min<size_t>(this->threads, this->chunks.size());
+    vector<thread> pool;
+    if (this->delimiter == ',') {
+        for (uint i = 0; i < workers; i++)
+            pool.emplace_back(&BulkLoad::count_quotes, this, i, workers);
+        for (auto &worker: pool)
+            worker.join();
+        pool.clear();
+        uint8_t odd = 0;  // turn each chunk's parity into the parity of everything before it
+        for (auto &chunk_odd: this->odd_quotes) {
+            uint8_t own = chunk_odd;
+            chunk_odd = odd;
+            odd ^= own;
+        }
+    }
+    for (uint i = 0; i < workers; i++)
+        pool.emplace_back(&BulkLoad::parse_chunks, this);
+
+    uint64_t rows = 0;
+    try {
+        for (uint i = 0; i < this->chunks.size(); i++) {
+            Chunk &chunk = this->chunks[i];
+            {
+                unique_lock<mutex> guard(this->lock);
+                this->parsed.wait(guard, [&chunk] { return chunk.ready; });
+            }
+            if (chunk.error)
+                rethrow_exception(chunk.error);
+            if (!chunk.sizes.empty())
+                this->table.load(chunk.records.data(), chunk.sizes, handles);
+            rows += chunk.sizes.size();
+            string().swap(chunk.records);
+            vector<uint16_t>().swap(chunk.sizes);
+            {
+                lock_guard<mutex> guard(this->lock);
+                this->written = i + 1;
+            }
+            this->loaded.notify_all();
+        }
+    } catch (...) {
+        stop(pool);
+        throw;
+    }
+    stop(pool);
+    return rows;
+}
+
+void BulkLoad::stop(vector<thread> &workers) {
+    {
+        lock_guard<mutex> guard(this->lock);
+        this->stopping = true;
+    }
+    this->loaded.notify_all();
+    for (auto &worker: workers)
+        worker.join();
+    workers.clear();
+}
+
+// Each worker counts the quotes of every workers'th chunk; only the parity matters.
+void BulkLoad::count_quotes(uint worker, uint workers) {
+    for (size_t i = worker; i < this->chunks.size(); i += workers) {
+        const char *begin = this->data + i * this->chunk_bytes;
+        const char *end = this->data + min(this->size, (i + 1) * this->chunk_bytes);
+        this->odd_quotes[i] = (uint8_t) (count(begin, end, '"') & 1);
+    }
+}
+
+// Where a chunk's first line starts: just after the first line break at or past its nominal
+// start that is outside quotes. Both chunks on either side of a boundary find the same one.
+size_t BulkLoad::boundary(uint chunk) const {
+    if (chunk >= this->chunks.size())
+        return this->size;
+    if (chunk == 0 && !this->header)
+        return 0;
+    bool quoted = this->odd_quotes[chunk] != 0;
+    for (size_t at = chunk * this->chunk_bytes; at < this->size; at++) {
+        char c = this->data[at];
+        if (c == '"' && this->delimiter == ',')
+            quoted = !quoted;
+        else if (c == '\n' && !quoted)
+            return at + 1;
+    }
+    return this->size;
+}
+
+void BulkLoad::parse_chunks() {
+    while (true) {
+        uint i = this->next_chunk.fetch_add(1);
+        if (i >= this->chunks.size())
+            return;
+        {
+            unique_lock<mutex> guard(this->lock);
+            this->loaded.wait(guard, [this, i] { return this->stopping || i < this->written + 2 * this->threads; });
+            if (this->stopping)
+                return;
+        }
+        Chunk &chunk = this->chunks[i];
+        try {
+            size_t begin = boundary(i), end = boundary(i + 1);
+            if (begin < end)
+                parse(begin, end, chunk);
+        } catch (...) {
+            chunk.error = current_exception();
+        }
+        {
+            lock_guard<mutex> guard(this->lock);
+            chunk.ready = true;
+        }
+        this->parsed.notify_all();
+    }
+}
+
+void BulkLoad::parse(size_t begin, size_t end, Chunk &chunk) const {
+    const char *p = this->data + begin;
+    const char *stop = this->data + end;
+    uint columns = (uint) this->types.size();
+    vector<Value> row(columns);
+    for (uint column = 0; column < columns; column++)
+        row[column].data_type = this->types[column];
+    string scratch;
+    while (p < stop) {
+        if (*p == '\n' || (*p == '\r' && p + 1 < stop && p[1] == '\n')) {
+            p += *p == '\n' ? 1 : 2;  // empty line
+            continue;
+        }
+        const char *line = p;
+        try {
+            for (uint column = 0; column < columns; column++) {
+                const char *value_begin, *value_end;
+                p = field(p, stop, value_begin, value_end, scratch);
+                convert(value_begin, value_end, column, row[column]);
+                if (column + 1 < columns) {
+                    if (p == stop || *p != this->delimiter)
+                        throw DbRelationError("expected " + to_string(columns) + " values");
+                    p++;
+                }
+            }
+            if (p < stop && *p == '\r')
+                p++;
+            if (p < stop && *p++ != '\n')
+                throw DbRelationError("expected " + to_string(columns) + " values");
+            chunk.sizes.push_back(this->table.encode(row, chunk.records));
+        } catch (DbRelationError &e) {
+            uint64_t number = 1 + (uint64_t) count(this->data, line, '\n');
+            throw DbRelationError("line " + to_string(number) + ": " + e.what());
+        }
+    }
+}
+
+// Find the end of the field starting at p. The field's value is [begin, finish): in the file,
+// or in scratch if it had to be unquoted or unescaped.
+const char *BulkLoad::field(const char *p, const char *end, const char *&begin, const char *&finish,
+                            string &scratch) const {
+    if (this->delimiter == ',' && p < end && *p == '"') {
+        scratch.clear();
+        p++;
+        while (true) {
+            const char *quote = (const char *) memchr(p, '"', (size_t) (end - p));
+            if (quote == nullptr)
+                throw DbRelationError("unterminated quoted value");
+            scratch.append(p, (size_t) (quote - p));
+            p = quote + 1;
+            if (p == end || *p != '"')
+                break;
+            scratch += '"';  // "" stands for a quote
+            p++;
+        }
+        begin = scratch.data();
+        finish = begin + scratch.size();
+        return p;
+    }
+    const char *q = p;
+    bool escaped = false;
+    while (q < end && *q != this->delimiter && *q != '\n') {
+        escaped = escaped || *q == '\\';
+        q++;
+    }
+    begin = p;
+    finish = q;
+    if (finish > begin && finish[-1] == '\r' && (q == end || *q == '\n'))
+        finish--;
+    if (escaped && this->delimiter == '\t') {
+        scratch.clear();
+        for (const char *c = begin; c < finish; c++) {
+            if (*c == '\\' && c + 1 < finish) {
+                c++;
+                scratch += *c == 't' ? '\t' : *c == 'n' ? '\n' : *c == 'r' ? '\r' : *c;
+            } else {
+                scratch += *c;
+            }
+        }
+        begin = scratch.data();
+        finish = begin + scratch.size();
+    }
+    return q;
+}
+
+void BulkLoad::convert(const char *begin, const char *end, uint column, Value &value) const {
+    switch (this->types[column]) {
+        case ColumnAttribute::INT: {
+            const char *p = begin;
+            bool negative = p < end && *p == '-';
+            if (p < end && (*p == '-' || *p == '+'))
+                p++;
+            int64_t n = 0;
+            bool valid = p < end;
+            for (; p < end && valid; p++) {
+                valid = *p >= '0' && *p <= '9';
+                n = n * 10 + (*p - '0');
+                valid = valid && n <= (int64_t) INT32_MAX + 1;
+            }
+            if (negative)
+                n = -n;
+            if (!valid || n > INT32_MAX)
+                throw DbRelationError("column " + this->column_names[column] + ": '" + string(begin, end)
+                                      + "' is not an INT");
+            value.n = (int32_t) n;
+            break;
+        }
+        case ColumnAttribute::BOOLEAN: {
+            string text(begin, end);
+            if (text == "true" || text == "t" || text == "1")
+                value.n = 1;
+            else if (text == "false" || text == "f" || text == "0")
+                value.n = 0;
+            else
+                throw DbRelationError("column " + this->column_names[column] + ": '" + text + "' is not a BOOLEAN");
+            break;
+        }
+        default:
+            value.s.assign(begin, (size_t) (end - begin));
+    }
+}
+
+// Load contents into a fresh (a INT, b TEXT) table and read the rows back, or the error.
+static bool test_load(const string &contents, char delimiter, bool header, size_t chunk_bytes,
+                      vector<pair<int32_t, string>> &rows, string &error) {
+    string path = TempFileManager::directory() + "/_test_bulk_load.txt";
+    {
+        ofstream file(path, ios::binary);
+        file << contents;
+    }
+    ColumnNames column_names = {"a", "b"};
+    ColumnAttributes column_attributes = {ColumnAttribute(ColumnAttribute::INT),
+                                          ColumnAttribute(ColumnAttribute::TEXT)};
+    HeapTable table("_test_bulk_load_cpp", column_names, column_attributes);
+    table.create_if_not_exists();
+    rows.clear();
+    error.clear();
+    try {
+        Handles handles;
+        BulkLoad(table, path, delimiter, header, 3, chunk_bytes).run(&handles);
+        for (auto &handle: handles) {
+            ValueDict *row = table.project(handle);
+            rows.emplace_back((*row)["a"].n, (*row)["b"].s);
+            delete row;
+        }
+    } catch (DbRelationError &e) {
+        error = e.what();
+    }
+    table.drop();
+    remove(path.c_str());
+    return error.empty();
+}
+
+// Every way of cutting the file into chunks gives the same rows: quoted line breaks and quotes,
+// CRLF line ends and empty lines, with chunk boundaries falling everywhere among them.
+static bool test_bulk_load_csv() {
+    const string csv = "a,b\r\n"
+                       "1,plain\r\n"
+                       "-2147483648,\"quoted, with comma\"\n"
+                       "2147483647,\"multi\nline\r\nvalue\"\n"
+                       "\r\n"
+                       "3,\"say \"\"hi\"\"\"\r\n"
+                       "\n"
+                       "4,\"\"\n"
+                       "5,\"\"\"\n\"\"\"\n"
+                       "6,last";
+    const vector<pair<int32_t, string>> expected = {
+            {1,          "plain"},
+            {INT32_MIN,  "quoted, with comma"},
+            {INT32_MAX,  "multi\nline\r\nvalue"},
+            {3,          "say \"hi\""},
+            {4,          ""},
+            {5,          "\"\n\""},
+            {6,          "last"}};
+    vector<pair<int32_t, string>> rows;
+    string error;
+    for (size_t chunk_bytes: {1, 2, 3, 5, 7, 11, 16, 23, 64, (int) BulkLoad::CHUNK_BYTES}) {
+        if (!test_load(csv, ',', true, chunk_bytes, rows, error))
+            return assertion_failure("csv load failed: " + error, chunk_bytes);
+        if (rows != expected)
+            return assertion_failure("csv rows differ", chunk_bytes, rows.size());
+    }
+    return true;
+}
+
+// Backslash escapes in TSV, which has no quoting: a quote is just a character.
+static bool test_bulk_load_tsv() {
+    const string tsv = "1\tback\\\\slash\n"
+                       "2\ttab\\there\r\n"
+                       "3\tnew\\nline\n"
+                       "-4\t\n"
+                       "5\t\"not quoted\n";
+    const vector<pair<int32_t, string>> expected = {
+            {1,  "back\\slash"},
+            {2,  "tab\there"},
+            {3,  "new\nline"},
+            {-4, ""},
+            {5,  "\"not quoted"}};
+    vector<pair<int32_t, string>> rows;
+    string error;
+    for (size_t chunk_bytes: {1, 4, 9, 64}) {
+        if (!test_load(tsv, '\t', false, chunk_bytes, rows, error))
+            return assertion_failure("tsv load failed: " + error, chunk_bytes);
+        if (rows != expected)
+            return assertion_failure("tsv rows differ", chunk_bytes, rows.size());
+    }
+    return true;
+}
+
+// Bad input fails the load with the number of the line it is on.
+static bool test_bulk_load_errors() {
+    const vector<pair<string, string>> cases = {
+            {"1,a\n2147483648,b\n",         "line 2: column a: '2147483648' is not an INT"},
+            {"1,a\n2,\"x\ny\"\n-2147483649,c\n", "line 4: column a: '-2147483649' is not an INT"},
+            {"1,a\n2,b\n-2147483649,c\n",   "line 3: column a: '-2147483649' is not an INT"},
+            {"1,a\n99999999999999999999,b\n", "line 2: column a: '99999999999999999999' is not an INT"},
+            {"1,a\n2,\"b\n",                "line 2: unterminated quoted value"},
+            {"1,a\n2\n",                    "line 2: expected 2 values"}};
+    vector<pair<int32_t, string>> rows;
+    string error;
+    for (auto &bad: cases) {
+        for (size_t chunk_bytes: {3, 64}) {
+            if (test_load(bad.first, ',', false, chunk_bytes, rows, error) || error != bad.second)
+                return assertion_failure("bad csv loaded: " + bad.first + " gave " + error, chunk_bytes);
+        }
+    }
+    return true;
+}
+
+/**
+ * Test CSV quoting and TSV escapes with chunk boundaries everywhere, and errors.
+ * @return true if the tests all succeeded
+ */
+bool test_bulk_load() {
+    return test_bulk_load_csv() && test_bulk_load_tsv() && test_bulk_load_errors();
+}
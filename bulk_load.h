@@ -0,0 +1,110 @@
+/**
+ * @file bulk_load.h - loading a table from a CSV or TSV file
+ * BulkLoad
+ *
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "storage_engine.h"
+
+/**
+ * @class BulkLoad - parses a CSV or TSV file on several threads and appends its rows to a table.
+ *
+ * The file is mapped into memory and cut into chunks of about chunk_bytes, each ending at a
+ * line break that is not inside a quoted CSV field (found from the number of quotes before it,
+ * which the workers count first, a chunk each). Workers take chunks in turn, split their lines
+ * into fields, convert the fields to the column types and encode each row as a record
+ * (DbRelation::encode). The calling thread is the only writer: it takes the chunks' records in
+ * file order and appends them with DbRelation::load, which fills each block before writing it.
+ * Workers stay at most a few chunks ahead of the writer, so memory does not grow with the file.
+ *
+ * The file is read as DelimitedWriter writes it: CSV fields may be quoted (with "" for a quote),
+ * TSV fields escape tabs, line breaks and backslashes with a backslash. Lines end with \n or \r\n.
+ * Empty lines are skipped.
+ */
+class BulkLoad {
+public:
+    /**
+     * Bytes of the file parsed as a unit, unless told otherwise.
+     */
+    static const size_t CHUNK_BYTES = 4 * 1024 * 1024;
+
+    /**
+     * @param table        table to load (its columns are the file's, in order)
+     * @param path         file to read
+     * @param delimiter    ',' for CSV or '\t' for TSV
+     * @param header       whether the first line holds column names (and is skipped)
+     * @param threads      number of parsing threads
+     * @param chunk_bytes  bytes of the file parsed as a unit
+     * @throws DbRelationError  if the file cannot be read
+     */
+    BulkLoad(DbRelation &table, const std::string &path, char delimiter, bool header, uint threads,
+             size_t chunk_bytes = CHUNK_BYTES);
+
+    virtual ~BulkLoad();
+
+    BulkLoad(const BulkLoad &other) = delete;
+
+    BulkLoad &operator=(const BulkLoad &other) = delete;
+
+    /**
+     * Load the whole file. If a line is bad, the chunks before its chunk have been loaded already.
+     * @param handles  if not null, returned by reference: the handles of the new rows are appended
+     * @returns        number of rows loaded
+     * @throws DbRelationError  naming the line of the first bad value found
+     */
+    virtual uint64_t run(Handles *handles);
+
+protected:
+    struct Chunk {
+        std::string records;          // encoded rows, back to back
+        std::vector<uint16_t> sizes;  // size of each
+        bool ready;
+        std::exception_ptr error;     // why the chunk could not be parsed
+    };
+
+    DbRelation &table;
+    ColumnNames column_names;
+    std::vector<ColumnAttribute::DataType> types;
+    char delimiter;
+    bool header;
+    uint threads;
+    size_t chunk_bytes;
+    int fd;
+    const char *data;  // the mapped file
+    size_t size;
+    std::vector<uint8_t> odd_quotes;  // per chunk: whether an odd number of quotes precedes it
+
+    std::vector<Chunk> chunks;
+    std::atomic<uint> next_chunk;
+    uint written;  // chunks handed to the table so far
+    bool stopping;
+    std::mutex lock;
+    std::condition_variable parsed;
+    std::condition_variable loaded;
+
+    size_t boundary(uint chunk) const;
+
+    void count_quotes(uint worker, uint workers);
+
+    void parse_chunks();
+
+    void parse(size_t begin, size_t end, Chunk &chunk) const;
+
+    const char *field(const char *p, const char *end, const char *&begin, const char *&finish,
+                      std::string &scratch) const;
+
+    void convert(const char *begin, const char *end, uint column, Value &value) const;
+
+    void stop(std::vector<std::thread> &workers);
+};
+
+bool test_bulk_load();
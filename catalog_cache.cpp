@@ -0,0 +1,230 @@
+/**
+ * @file catalog_cache.cpp - implementation of epoch-based reclamation for the catalog caches
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#include <chrono>
+#include <thread>
+#include "catalog_cache.h"
+#include "heap_storage.h"
+
+using namespace std;
+
+/*
+ * ************************************
+ * EpochReclaimer class implementation
+ * ************************************
+ */
+
+// which slots are in use by a thread (a slot's number is the same in every reclaimer)
+static atomic<bool> slot_taken[EpochReclaimer::SLOTS];
+
+// takes a free slot when the thread first reads and gives it back when the thread exits
+struct ThreadSlot {
+    int slot;
+
+    ThreadSlot() : slot(-1) {
+        for (uint i = 0; i < EpochReclaimer::SLOTS; i++) {
+            bool taken = false;
+            if (slot_taken[i].compare_exchange_strong(taken, true)) {
+                slot = (int) i;
+                break;
+            }
+        }
+    }
+
+    ~ThreadSlot() {
+        if (slot >= 0)
+            slot_taken[slot] = false;
+    }
+};
+
+int EpochReclaimer::thread_slot() {
+    static thread_local ThreadSlot thread;
+    return thread.slot;
+}
+
+EpochReclaimer::Reader::Reader(const EpochReclaimer &epochs) : epochs(epochs), slot(thread_slot()), nested(false) {
+    if (this->slot < 0) {
+        epochs.overflow++;
+        return;
+    }
+    atomic<uint64_t> &announced = epochs.slots[this->slot].epoch;
+    if (announced.load(memory_order_relaxed) != IDLE)
+        this->nested = true;
+    else
+        announced.store(epochs.epoch.load());
+}
+
+EpochReclaimer::Reader::~Reader() {
+    if (this->slot < 0)
+        this->epochs.overflow--;
+    else if (!this->nested)
+        this->epochs.slots[this->slot].epoch.store(IDLE, memory_order_release);
+}
+
+EpochReclaimer::EpochReclaimer() : overflow(0), epoch(0) {
+    for (auto &slot: this->slots)
+        slot.epoch = IDLE;
+}
+
+EpochReclaimer::~EpochReclaimer() {
+    for (auto &retired: this->retired)
+        retired.second();
+}
+
+// A reader that announced a later epoch than the one something was retired in started after it
+// was unlinked, so could not have reached it.
+void EpochReclaimer::retire(function<void()> free) {
+    uint64_t retired_at = this->epoch.fetch_add(1);
+    vector<function<void()>> frees;
+    {
+        lock_guard<mutex> guard(this->retired_lock);
+        this->retired.emplace_back(retired_at, move(free));
+        uint64_t oldest = this->overflow.load() > 0 ? 0 : IDLE;
+        for (auto &slot: this->slots)
+            oldest = min(oldest, slot.epoch.load());
+        auto kept = this->retired.begin();
+        for (auto &retired: this->retired) {
+            if (retired.first < oldest)
+                frees.push_back(move(retired.second));
+            else
+                *kept++ = move(retired);
+        }
+        this->retired.erase(kept, this->retired.end());
+    }
+    for (auto &freeing: frees)
+        freeing();
+}
+
+// Reader that lets the test see whether it got a slot
+class TestReader : public EpochReclaimer::Reader {
+public:
+    explicit TestReader(const EpochReclaimer &epochs) : Reader(epochs) {}
+
+    bool has_slot() const { return this->slot >= 0; }
+};
+
+// Something retired is freed only once the readers that started before it was retired are done,
+// however they nest; a reader that started after it doesn't hold it up.
+static bool test_epoch_order() {
+    EpochReclaimer epochs;
+    bool a = false, b = false, c = false;
+    {
+        EpochReclaimer::Reader outer(epochs);
+        {
+            EpochReclaimer::Reader inner(epochs);
+        }
+        epochs.retire([&a] { a = true; });
+        if (a)
+            return assertion_failure("retired freed under a nested reader");
+    }
+    {
+        EpochReclaimer::Reader later(epochs);
+        epochs.retire([&b] { b = true; });
+        if (!a || b)
+            return assertion_failure("retired freed out of order", a, b);
+    }
+    epochs.retire([&c] { c = true; });
+    if (!b || !c)
+        return assertion_failure("retired not freed", b, c);
+    return true;
+}
+
+// More threads read at once than there are slots: those with none still keep retired memory alive.
+static bool test_epoch_overflow() {
+    const uint THREADS = EpochReclaimer::SLOTS + 16;
+    EpochReclaimer epochs;
+    atomic<uint> reading(0), unslotted(0), slotted_done(0);
+    atomic<bool> release_slotted(false), release_unslotted(false);
+    vector<thread> threads;
+    for (uint i = 0; i < THREADS; i++) {
+        threads.emplace_back([&] {
+            bool slotted;
+            {
+                TestReader reader(epochs);
+                slotted = reader.has_slot();
+                if (!slotted)
+                    unslotted++;
+                reading++;
+                while (!(slotted ? release_slotted : release_unslotted))
+                    this_thread::sleep_for(chrono::milliseconds(1));
+            }
+            if (slotted)
+                slotted_done++;
+        });
+    }
+    while (reading < THREADS)
+        this_thread::sleep_for(chrono::milliseconds(1));
+    release_slotted = true;
+    while (slotted_done < THREADS - unslotted)
+        this_thread::sleep_for(chrono::milliseconds(1));
+    bool freed = false;
+    epochs.retire([&freed] { freed = true; });
+    bool early = freed;
+    release_unslotted = true;
+    for (auto &t: threads)
+        t.join();
+    epochs.retire([] {});
+    if (unslotted == 0 || early || !freed)
+        return assertion_failure("epoch overflow", unslotted, early);
+    return true;
+}
+
+// An object built from a catalog entry that is dropped meanwhile must not stay cached: threads
+// look up keys, building and inserting what is missing, while another "drops" them.
+static bool test_cache_generation() {
+    CatalogCache<int, int> cache;
+    uint64_t generation = cache.get_generation();
+    cache.erase(1);
+    shared_ptr<int> stale = make_shared<int>(0);
+    if (cache.insert(1, stale, generation) != stale || cache.find(1))
+        return assertion_failure("cached across an erase");
+    shared_ptr<int> fresh = make_shared<int>(1);
+    cache.insert(1, fresh, cache.get_generation());
+    if (cache.insert(1, make_shared<int>(2), cache.get_generation()) != fresh || cache.find(1) != fresh)
+        return assertion_failure("cached twice");
+    cache.erase(1);
+
+    const int KEYS = 4, DROPS = 4000;
+    atomic<int> versions[KEYS];
+    for (auto &version: versions)
+        version = 0;
+    atomic<bool> done(false);
+    vector<thread> finders;
+    for (int i = 0; i < 3; i++) {
+        finders.emplace_back([&] {
+            while (!done) {
+                for (int key = 0; key < KEYS; key++) {
+                    if (cache.find(key))
+                        continue;
+                    uint64_t generation = cache.get_generation();
+                    int version = versions[key].load();
+                    cache.insert(key, make_shared<int>(version), generation);
+                }
+            }
+        });
+    }
+    for (int drop = 0; drop < DROPS; drop++) {
+        versions[drop % KEYS]++;
+        cache.erase(drop % KEYS);
+        if (drop % 16 == 0)
+            this_thread::yield();
+    }
+    done = true;
+    for (auto &t: finders)
+        t.join();
+    for (int key = 0; key < KEYS; key++) {
+        CatalogCache<int, int>::Ref cached = cache.find(key);
+        if (cached && *cached != versions[key])
+            return assertion_failure("stale object cached", *cached, versions[key]);
+    }
+    return true;
+}
+
+/**
+ * Test the order retired memory is freed in, readers without a slot, and lookups racing erasures.
+ * @return true if the tests all succeeded
+ */
+bool test_catalog_cache() {
+    return test_epoch_order() && test_epoch_overflow() && test_cache_generation();
+}
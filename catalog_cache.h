@@ -0,0 +1,198 @@
+/**
+ * @file catalog_cache.h - caches of catalog objects that many threads look up at once
+ * EpochReclaimer
+ * CatalogCache
+ *
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <sys/types.h>
+
+/**
+ * @class EpochReclaimer - frees memory that readers may still be looking at, once they have all
+ * finished (epoch-based reclamation).
+ *
+ * A reader announces the epoch it started in while it reads (see Reader); announcing costs a
+ * load and a store to a slot no other thread writes. A writer unlinks what it replaces so that
+ * later readers can't reach it, then retires it: the epoch advances, and the retired memory is
+ * freed once no reader that announced the epoch it was retired in, or an earlier one, is left.
+ * Retired memory is looked at again each time something is retired.
+ *
+ * Each thread gets one of SLOTS slots the first time it reads and gives it back when it exits. A
+ * reader in a thread that found none free is counted instead, and nothing is freed while any is.
+ */
+class EpochReclaimer {
+public:
+    static const uint SLOTS = 128;
+
+    /**
+     * @class Reader - the calling thread reads while this is in scope. Readers may nest.
+     */
+    class Reader {
+    public:
+        explicit Reader(const EpochReclaimer &epochs);
+
+        virtual ~Reader();
+
+        Reader(const Reader &other) = delete;
+
+        Reader &operator=(const Reader &other) = delete;
+
+    protected:
+        const EpochReclaimer &epochs;
+        int slot;     // the thread's slot, or -1 if it has none
+        bool nested;  // whether the thread was already reading
+    };
+
+    EpochReclaimer();
+
+    /**
+     * Frees everything retired (no reader may be left).
+     */
+    virtual ~EpochReclaimer();
+
+    EpochReclaimer(const EpochReclaimer &other) = delete;
+
+    EpochReclaimer &operator=(const EpochReclaimer &other) = delete;
+
+    /**
+     * Free something once every reader that could have reached it has finished.
+     * @param free  frees it
+     */
+    virtual void retire(std::function<void()> free);
+
+protected:
+    static const uint64_t IDLE = ~(uint64_t) 0;
+
+    // a cache line of its own, so readers in different threads don't share one
+    struct Slot {
+        std::atomic<uint64_t> epoch;
+        char padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    mutable Slot slots[SLOTS];
+    mutable std::atomic<uint> overflow;  // readers with no slot
+    std::atomic<uint64_t> epoch;
+    std::mutex retired_lock;
+    std::vector<std::pair<uint64_t, std::function<void()>>> retired;
+
+    /**
+     * The calling thread's slot, or -1.
+     */
+    static int thread_slot();
+};
+
+
+/**
+ * @class CatalogCache - a map of shared objects looked up by many threads, changed rarely.
+ *
+ * Lookups take no lock: the map is never changed in place. A change copies it, changes the copy
+ * and publishes that (read-copy-update); the old map is freed once no lookup can still be reading
+ * it (EpochReclaimer). Lookups return a reference-counted pointer, so an object erased from the
+ * cache lives on until the last thread using it lets go.
+ *
+ * Changes are made one at a time and copy the whole map, which suits catalog objects: each is
+ * added once, when first looked up, and erased when dropped.
+ */
+template<typename Key, typename Object>
+class CatalogCache {
+public:
+    typedef std::shared_ptr<Object> Ref;
+
+    CatalogCache() : current(new Map()), generation(0) {}
+
+    virtual ~CatalogCache() {
+        delete this->current.load();
+    }
+
+    CatalogCache(const CatalogCache &other) = delete;
+
+    CatalogCache &operator=(const CatalogCache &other) = delete;
+
+    /**
+     * Look up an object, without locking.
+     * @returns  the object, or null if it isn't cached
+     */
+    Ref find(const Key &key) const {
+        EpochReclaimer::Reader reader(this->epochs);
+        const Map *map = this->current.load();
+        auto found = map->find(key);
+        return found == map->end() ? Ref() : found->second;
+    }
+
+    /**
+     * Number of erasures so far. An object built after reading this is only cached if nothing
+     * has been erased since (it may have been built from a catalog entry being dropped).
+     */
+    uint64_t get_generation() const {
+        return this->generation.load();
+    }
+
+    /**
+     * Cache an object, unless another thread has cached one under the key meanwhile.
+     * @param key         the object's key
+     * @param object      the object
+     * @param generation  get_generation() from before the object was built
+     * @returns           the object cached under the key (or the object, if it wasn't cached)
+     */
+    Ref insert(const Key &key, const Ref &object, uint64_t generation) {
+        std::lock_guard<std::mutex> guard(this->writer_lock);
+        const Map *map = this->current.load();
+        auto found = map->find(key);
+        if (found != map->end())
+            return found->second;
+        if (generation != this->generation.load())
+            return object;
+        Map *copy = new Map(*map);
+        (*copy)[key] = object;
+        publish(copy);
+        return object;
+    }
+
+    /**
+     * Cache an object, replacing any cached under the key.
+     */
+    void put(const Key &key, const Ref &object) {
+        std::lock_guard<std::mutex> guard(this->writer_lock);
+        Map *copy = new Map(*this->current.load());
+        (*copy)[key] = object;
+        publish(copy);
+    }
+
+    /**
+     * Forget an object. Threads holding it keep it until they let go.
+     */
+    void erase(const Key &key) {
+        std::lock_guard<std::mutex> guard(this->writer_lock);
+        this->generation++;
+        const Map *map = this->current.load();
+        if (map->find(key) == map->end())
+            return;
+        Map *copy = new Map(*map);
+        copy->erase(key);
+        publish(copy);
+    }
+
+protected:
+    typedef std::map<Key, Ref> Map;
+
+    std::atomic<const Map *> current;
+    std::atomic<uint64_t> generation;
+    std::mutex writer_lock;
+    mutable EpochReclaimer epochs;
+
+    // replace the map (call with writer_lock held)
+    void publish(const Map *map) {
+        const Map *old = this->current.exchange(map);
+        this->epochs.retire([old] { delete old; });
+    }
+};
+
+bool test_catalog_cache();
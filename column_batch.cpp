@@ -0,0 +1,301 @@
+/**
+ * @file column_batch.cpp - implementation of columnar batches and their filter kernels
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#include <cstring>
+#include "column_batch.h"
+#include "heap_storage.h"
+
+using namespace std;
+
+typedef u_int16_t u16;
+
+/*
+ * Filter kernels. Each one compacts the selection vector in place: every candidate is written to the
+ * output slot unconditionally and the output cursor only advances when the predicate holds, so there
+ * is no data-dependent branch in the loop.
+ */
+template<typename Compare>
+static uint filter_ints(const int32_t *column, int32_t constant, SelectionIndex *selection, uint n,
+                        Compare compare) {
+    uint k = 0;
+    for (uint i = 0; i < n; i++) {
+        SelectionIndex row = selection[i];
+        selection[k] = row;
+        k += compare(column[row], constant) ? 1 : 0;
+    }
+    return k;
+}
+
+static uint filter_texts(const TextRef *column, const string &constant, bool equal, SelectionIndex *selection,
+                         uint n) {
+    u16 size = (u16) constant.size();
+    const char *data = constant.data();
+    uint k = 0;
+    for (uint i = 0; i < n; i++) {
+        SelectionIndex row = selection[i];
+        const TextRef &text = column[row];
+        bool same = text.size == size && memcmp(text.data, data, size) == 0;
+        selection[k] = row;
+        k += same == equal ? 1 : 0;
+    }
+    return k;
+}
+
+static int compare_texts(const TextRef &text, const string &constant) {
+    size_t n = min((size_t) text.size, constant.size());
+    int cmp = memcmp(text.data, constant.data(), n);
+    if (cmp != 0)
+        return cmp;
+    return (int) text.size - (int) constant.size();
+}
+
+/**
+ * Constructor
+ * @param column_attributes  types of the columns in each record, in order
+ */
+ColumnBatch::ColumnBatch(const ColumnAttributes &column_attributes) : column_attributes(column_attributes),
+                                                                      block_id(0), num_rows(0), bytes(0) {
+    int offset = 0;
+    for (auto ca: this->column_attributes) {
+        this->fixed_offsets.push_back(offset);
+        ColumnAttribute::DataType data_type = ca.get_data_type();
+        if (data_type == ColumnAttribute::TEXT) {
+            this->ints.push_back(vector<int32_t>());
+            this->texts.push_back(vector<TextRef>(BATCH_SZ));
+            offset = -1;
+        } else {
+            this->ints.push_back(vector<int32_t>(BATCH_SZ));
+            this->texts.push_back(vector<TextRef>());
+            if (offset >= 0)
+                offset += data_type == ColumnAttribute::INT ? sizeof(int32_t) : sizeof(uint8_t);
+        }
+    }
+    this->selection.reserve(BATCH_SZ);
+}
+
+/**
+ * Decode a block. Columns at a fixed offset (those not preceded by a TEXT) are decoded one whole column
+ * at a time; the rest are picked up walking each record from its first variable-length field.
+ * @param block  block to decode
+ */
+void ColumnBatch::decode(SlottedPage &block) {
+    memcpy(this->page, block.get_data(), DbBlock::BLOCK_SZ);
+    this->block_id = block.get_block_id();
+    Dbt dbt(this->page, DbBlock::BLOCK_SZ);
+    SlottedPage copy(dbt, this->block_id);
+
+    this->num_rows = 0;
+    this->bytes = 0;
+    RecordIDs *ids = copy.ids();
+    for (auto const &record_id: *ids) {
+        u16 size;
+        this->records[this->num_rows] = (const char *) copy.peek(record_id, size);
+        this->record_ids[this->num_rows++] = record_id;
+        this->bytes += size;
+    }
+    delete ids;
+
+    uint n = this->num_rows;
+    uint first_variable = (uint) this->column_attributes.size();
+    for (uint col = 0; col < this->column_attributes.size(); col++) {
+        int offset = this->fixed_offsets[col];
+        if (offset < 0) {
+            first_variable = col;
+            break;
+        }
+        ColumnAttribute::DataType data_type = this->column_attributes[col].get_data_type();
+        if (data_type == ColumnAttribute::INT) {
+            int32_t *out = this->ints[col].data();
+            for (uint i = 0; i < n; i++)
+                memcpy(&out[i], this->records[i] + offset, sizeof(int32_t));
+        } else if (data_type == ColumnAttribute::BOOLEAN) {
+            int32_t *out = this->ints[col].data();
+            for (uint i = 0; i < n; i++)
+                out[i] = *(const uint8_t *) (this->records[i] + offset);
+        } else {
+            u16 size;
+            for (uint i = 0; i < n; i++) {
+                memcpy(&size, this->records[i] + offset, sizeof(u16));
+                this->texts[col][i] = TextRef(this->records[i] + offset + sizeof(u16), size);
+            }
+            first_variable = col + 1;
+            break;
+        }
+    }
+
+    if (first_variable < this->column_attributes.size()) {
+        for (uint i = 0; i < n; i++) {
+            const char *bytes = this->records[i];
+            uint offset = 0;
+            for (uint col = 0; col < this->column_attributes.size(); col++) {
+                ColumnAttribute::DataType data_type = this->column_attributes[col].get_data_type();
+                if (data_type == ColumnAttribute::INT) {
+                    if (col >= first_variable)
+                        memcpy(&this->ints[col][i], bytes + offset, sizeof(int32_t));
+                    offset += sizeof(int32_t);
+                } else if (data_type == ColumnAttribute::BOOLEAN) {
+                    if (col >= first_variable)
+                        this->ints[col][i] = *(const uint8_t *) (bytes + offset);
+                    offset += sizeof(uint8_t);
+                } else {
+                    u16 size;
+                    memcpy(&size, bytes + offset, sizeof(u16));
+                    if (col >= first_variable)
+                        this->texts[col][i] = TextRef(bytes + offset + sizeof(u16), size);
+                    offset += sizeof(u16) + size;
+                }
+            }
+        }
+    }
+
+    this->selection.resize(n);
+    for (uint i = 0; i < n; i++)
+        this->selection[i] = (SelectionIndex) i;
+}
+
+/**
+ * Shrink the selection to the rows satisfying the predicate.
+ * @param predicate  comparison to apply
+ */
+void ColumnBatch::filter(const ColumnPredicate &predicate) {
+    uint n = (uint) this->selection.size();
+    if (n == 0)
+        return;
+    SelectionIndex *sel = this->selection.data();
+    uint col = predicate.column;
+    ColumnAttribute::DataType data_type = this->column_attributes[col].get_data_type();
+    if (data_type != ColumnAttribute::TEXT) {
+        const int32_t *column = this->ints[col].data();
+        int32_t constant = predicate.value.n;
+        switch (predicate.comparison) {
+            case ColumnPredicate::EQ:
+                n = filter_ints(column, constant, sel, n, [](int32_t a, int32_t b) { return a == b; });
+                break;
+            case ColumnPredicate::NE:
+                n = filter_ints(column, constant, sel, n, [](int32_t a, int32_t b) { return a != b; });
+                break;
+            case ColumnPredicate::LT:
+                n = filter_ints(column, constant, sel, n, [](int32_t a, int32_t b) { return a < b; });
+                break;
+            case ColumnPredicate::LE:
+                n = filter_ints(column, constant, sel, n, [](int32_t a, int32_t b) { return a <= b; });
+                break;
+            case ColumnPredicate::GT:
+                n = filter_ints(column, constant, sel, n, [](int32_t a, int32_t b) { return a > b; });
+                break;
+            case ColumnPredicate::GE:
+                n = filter_ints(column, constant, sel, n, [](int32_t a, int32_t b) { return a >= b; });
+                break;
+        }
+    } else {
+        const TextRef *column = this->texts[col].data();
+        const string &constant = predicate.value.s;
+        switch (predicate.comparison) {
+            case ColumnPredicate::EQ:
+                n = filter_texts(column, constant, true, sel, n);
+                break;
+            case ColumnPredicate::NE:
+                n = filter_texts(column, constant, false, sel, n);
+                break;
+            default: {
+                uint k = 0;
+                for (uint i = 0; i < n; i++) {
+                    int cmp = compare_texts(column[sel[i]], constant);
+                    bool keep = (predicate.comparison == ColumnPredicate::LT && cmp < 0)
+                                || (predicate.comparison == ColumnPredicate::LE && cmp <= 0)
+                                || (predicate.comparison == ColumnPredicate::GT && cmp > 0)
+                                || (predicate.comparison == ColumnPredicate::GE && cmp >= 0);
+                    sel[k] = sel[i];
+                    k += keep ? 1 : 0;
+                }
+                n = k;
+            }
+        }
+    }
+    this->selection.resize(n);
+}
+
+/**
+ * Apply a conjunction of predicates.
+ * @param predicates  comparisons to apply
+ */
+void ColumnBatch::filter(const ColumnPredicates &predicates) {
+    for (auto const &predicate: predicates) {
+        if (this->selection.empty())
+            return;
+        filter(predicate);
+    }
+}
+
+/**
+ * Materialize one value.
+ * @param column  column ordinal
+ * @param row     row within the batch
+ * @return        the value, typed as the column
+ */
+Value ColumnBatch::value(uint column, SelectionIndex row) const {
+    ColumnAttribute ca = this->column_attributes[column];
+    Value value;
+    value.data_type = ca.get_data_type();
+    if (value.data_type == ColumnAttribute::TEXT)
+        value.s = this->texts[column][row].str();
+    else
+        value.n = this->ints[column][row];
+    return value;
+}
+
+/**
+ * Testing function for ColumnBatch.
+ * @return true if testing succeeded, false otherwise
+ */
+bool test_column_batch() {
+    char blank_space[DbBlock::BLOCK_SZ];
+    Dbt block_dbt(blank_space, sizeof(blank_space));
+    SlottedPage block(block_dbt, 1, true);
+
+    // records of (INT, TEXT, BOOLEAN) marshaled the same way as HeapTable does
+    string texts[] = {"apple", "banana", "cherry"};
+    for (int32_t i = 0; i < 200; i++) {
+        char record[64];
+        string s = texts[i % 3];
+        u16 size = (u16) s.size();
+        memcpy(record, &i, sizeof(int32_t));
+        memcpy(record + 4, &size, sizeof(u16));
+        memcpy(record + 6, s.data(), size);
+        record[6 + size] = (char) (i % 2 == 0);
+        Dbt dbt(record, 7 + size);
+        block.add(&dbt);
+    }
+    block.del(5);  // record id 5 holds a == 4
+
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::BOOLEAN));
+    ColumnBatch batch(column_attributes);
+    batch.decode(block);
+    if (batch.size() != 199)
+        return assertion_failure("batch decode size", batch.size());
+    if (batch.value(1, 4).s != "cherry" || batch.value(0, 4).n != 5 || batch.value(2, 4).n != 0)
+        return assertion_failure("batch decode values");
+    if (batch.handle(4) != Handle(1, 6))
+        return assertion_failure("batch handle");
+
+    ColumnPredicates predicates;
+    predicates.push_back(ColumnPredicate(0, ColumnPredicate::LT, Value(100)));
+    predicates.push_back(ColumnPredicate(1, ColumnPredicate::EQ, Value("banana")));
+    batch.filter(predicates);
+    const SelectionVector &selection = batch.get_selection();
+    if (selection.size() != 32)
+        return assertion_failure("batch filter count", selection.size());
+    for (auto const &row: selection)
+        if (batch.value(0, row).n % 3 != 1 || batch.value(0, row).n >= 100)
+            return assertion_failure("batch filter row", batch.value(0, row).n);
+
+    batch.decode(block);
+    batch.filter(ColumnPredicate(2, ColumnPredicate::NE, Value(0)));
+    if (batch.get_selection().size() != 99)
+        return assertion_failure("batch filter boolean", batch.get_selection().size());
+    return true;
+}
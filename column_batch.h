@@ -0,0 +1,145 @@
+/**
+ * @file column_batch.h - columnar batches for vectorized scans
+ * TextRef
+ * ColumnPredicate
+ * ColumnBatch
+ *
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#pragma once
+
+#include "storage_engine.h"
+
+class SlottedPage;  // forward declare
+
+/**
+ * @class TextRef - non-owning view of a TEXT value inside a batch's copy of a block
+ */
+class TextRef {
+public:
+    const char *data;
+    u_int16_t size;
+
+    TextRef() : data(nullptr), size(0) {}
+
+    TextRef(const char *data, u_int16_t size) : data(data), size(size) {}
+
+    std::string str() const { return std::string(data, size); }
+};
+
+/**
+ * Indices of the rows of a batch that are still qualifying.
+ */
+typedef u_int16_t SelectionIndex;
+typedef std::vector<SelectionIndex> SelectionVector;
+
+
+/**
+ * @class ColumnPredicate - comparison of one column against a constant, evaluated a whole batch at a time
+ */
+class ColumnPredicate {
+public:
+    enum Comparison {
+        EQ, NE, LT, LE, GT, GE
+    };
+
+    ColumnPredicate(uint column, Comparison comparison, Value value, int parameter = -1)
+            : column(column), comparison(comparison), value(value), parameter(parameter) {}
+
+    uint column;  // ordinal of the column in the relation
+    Comparison comparison;
+    Value value;
+    int parameter;  // number of the statement parameter the value comes from (-1 if it is fixed)
+};
+
+typedef std::vector<ColumnPredicate> ColumnPredicates;
+
+
+/**
+ * @class ColumnBatch - the records of one block decoded column-by-column.
+ *
+ * INT and BOOLEAN columns are decoded into int32_t arrays and TEXT columns into TextRefs pointing
+ * into the batch's own copy of the block, so the batch stays valid after the block is released.
+ * A selection vector tracks which rows still qualify; filter kernels shrink it in place without
+ * branching on the data so the compiler can vectorize them.
+ */
+class ColumnBatch {
+public:
+    /**
+     * Capacity of a batch. A block can never hold more records than this since every record
+     * costs at least 4 bytes of header.
+     */
+    static const uint BATCH_SZ = DbBlock::BLOCK_SZ / 4;
+
+    ColumnBatch(const ColumnAttributes &column_attributes);
+
+    virtual ~ColumnBatch() {}
+
+    ColumnBatch(const ColumnBatch &other) = delete;
+
+    ColumnBatch &operator=(const ColumnBatch &other) = delete;
+
+    /**
+     * Decode the live records of the given block into this batch, replacing its contents.
+     * All rows start out selected.
+     * @param block  block to decode (copied, so the caller may free it right after)
+     */
+    virtual void decode(SlottedPage &block);
+
+    /**
+     * Shrink the selection to the rows satisfying the predicate.
+     * @param predicate  comparison to apply
+     */
+    virtual void filter(const ColumnPredicate &predicate);
+
+    /**
+     * Apply a conjunction of predicates, stopping early once nothing is left.
+     * @param predicates  comparisons to apply
+     */
+    virtual void filter(const ColumnPredicates &predicates);
+
+    /**
+     * Materialize one value.
+     * @param column  column ordinal
+     * @param row     row within the batch (an entry from the selection vector)
+     * @returns       value of that field
+     */
+    virtual Value value(uint column, SelectionIndex row) const;
+
+    /**
+     * Get the handle of a row in the batch.
+     * @param row  row within the batch (an entry from the selection vector)
+     * @returns    handle of the record
+     */
+    Handle handle(SelectionIndex row) const { return Handle(block_id, record_ids[row]); }
+
+    /**
+     * Rows still qualifying after filtering, in record id order.
+     */
+    const SelectionVector &get_selection() const { return selection; }
+
+    /**
+     * Number of records decoded.
+     */
+    uint size() const { return num_rows; }
+
+    /**
+     * Number of record bytes decoded.
+     */
+    uint get_bytes() const { return bytes; }
+
+protected:
+    ColumnAttributes column_attributes;
+    std::vector<int> fixed_offsets;  // byte offset of each column within a record, or -1 if it follows a TEXT
+    char page[DbBlock::BLOCK_SZ];
+    BlockID block_id;
+    uint num_rows;
+    uint bytes;
+    RecordID record_ids[BATCH_SZ];
+    const char *records[BATCH_SZ];
+    std::vector<std::vector<int32_t> > ints;  // per column, used for INT and BOOLEAN
+    std::vector<std::vector<TextRef> > texts;  // per column, used for TEXT
+    SelectionVector selection;
+};
+
+bool test_column_batch();
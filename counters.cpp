@@ -0,0 +1,72 @@
+/**
+ * @file counters.cpp - implementation of the engine-wide counters
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#include "counters.h"
+
+using namespace std;
+
+/*
+ * ******************************
+ * Counters class implementation
+ * ******************************
+ */
+
+Counters::Shard Counters::shards[Counters::SHARDS + 1];
+thread_local Counters::Shard *Counters::mine = nullptr;
+thread_local PageTally *PageTally::current_tally = nullptr;
+
+// which shards are claimed by a thread
+static atomic<bool> shard_taken[Counters::SHARDS];
+
+// whether the calling thread has given its shard back (it is exiting)
+static thread_local bool shard_returned = false;
+
+// claims a free shard when the thread first counts and gives it back when the thread exits
+struct Counters::ThreadShard {
+    int shard;
+
+    ThreadShard() : shard(-1) {
+        for (uint i = 0; i < SHARDS; i++) {
+            bool taken = false;
+            if (shard_taken[i].compare_exchange_strong(taken, true)) {
+                shard = (int) i;
+                mine = &shards[i];
+                break;
+            }
+        }
+    }
+
+    ~ThreadShard() {
+        mine = nullptr;
+        shard_returned = true;
+        if (shard >= 0)
+            shard_taken[shard].store(false, memory_order_release);
+    }
+};
+
+void Counters::add_shared(Counter counter, uint64_t n) {
+    if (!shard_returned) {
+        static thread_local ThreadShard thread;
+        if (mine != nullptr) {
+            add(counter, n);
+            return;
+        }
+    }
+    shards[SHARDS].counts[counter].fetch_add(n, memory_order_relaxed);
+}
+
+uint64_t Counters::get(Counter counter) {
+    uint64_t total = 0;
+    for (auto const &shard: shards)
+        total += shard.counts[counter].load(memory_order_relaxed);
+    return total;
+}
+
+const char *Counters::name(Counter counter) {
+    static const char *names[COUNTERS] = {"pages_read", "pages_written", "pages_flushed", "pages_allocated",
+                                          "slides", "bytes_slid", "records_marshaled", "records_unmarshaled",
+                                          "index_lookups", "index_inserts", "index_deletes", "spill_files",
+                                          "spill_bytes"};
+    return names[counter];
+}
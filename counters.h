@@ -0,0 +1,135 @@
+/**
+ * @file counters.h - counts of what the storage engine has done since the program started
+ * Counters
+ * PageTally
+ *
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <sys/types.h>
+
+/**
+ * @class Counters - engine-wide counters cheap enough for the hottest paths (see SHOW STATUS).
+ *
+ * Each thread counts into a shard of its own, a cache line or two no other thread writes, so
+ * counting is a load and a store with no locked instruction and no cache line bouncing between
+ * cores. Reading a counter sums it over all the shards, so it may miss counts being made as it
+ * reads. A thread claims one of SHARDS shards the first time it counts and gives it back when it
+ * exits; the counts stay in the shard for the next thread to add to. A thread that found none
+ * free (or counts after giving its shard back) counts into a shared shard with atomic adds.
+ */
+class Counters {
+public:
+    enum Counter {
+        PAGES_READ,           // blocks read by HeapFile::get and the block scanners
+        PAGES_WRITTEN,        // blocks handed to HeapFile::put (kept in the transaction until it commits)
+        PAGES_FLUSHED,        // blocks written to Berkeley DB
+        PAGES_ALLOCATED,      // blocks added by HeapFile::get_new
+        SLIDES,               // times records were moved in a page to open or close a gap (SlottedPage::slide)
+        BYTES_SLID,
+        RECORDS_MARSHALED,    // rows encoded by HeapTable::marshal
+        RECORDS_UNMARSHALED,  // records decoded by HeapTable::unmarshal
+        INDEX_LOOKUPS,
+        INDEX_INSERTS,
+        INDEX_DELETES,
+        SPILL_FILES,          // temporary files created by operators that ran out of memory (TempFileManager)
+        SPILL_BYTES,          // bytes written to them
+        COUNTERS              // number of counters
+    };
+
+    static const uint SHARDS = 128;
+
+    /**
+     * Count something the calling thread did.
+     * @param counter  what it did
+     * @param n        how many times
+     */
+    static void add(Counter counter, uint64_t n = 1) {
+        Shard *shard = mine;
+        if (shard == nullptr) {
+            add_shared(counter, n);
+            return;
+        }
+        std::atomic<uint64_t> &count = shard->counts[counter];
+        count.store(count.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    /**
+     * A counter's total over all threads so far.
+     */
+    static uint64_t get(Counter counter);
+
+    /**
+     * A counter's name as SHOW STATUS prints it, e.g. "pages_read".
+     */
+    static const char *name(Counter counter);
+
+protected:
+    // only ever written by the thread that claimed it (except the shared one)
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> counts[COUNTERS];
+    };
+
+    static Shard shards[SHARDS + 1];  // the last one is shared
+    static thread_local Shard *mine;  // the calling thread's shard, or nullptr if it has none
+
+    // the calling thread's claim on its shard
+    struct ThreadShard;
+
+    // claim a shard for the calling thread if it can, and count
+    static void add_shared(Counter counter, uint64_t n);
+};
+
+
+/**
+ * @class PageTally - the pages read for one statement (see SHOW STATEMENT STATS), unlike
+ * Counters::PAGES_READ, which other sessions' statements add to as well.
+ *
+ * The thread running the statement counts into the tally a Scope makes current in it. A block
+ * scanner counts into the tally that was current where it was made, so the pages parallel scan
+ * workers read are charged to the statement that started them.
+ */
+class PageTally {
+public:
+    PageTally() : pages(0) {}
+
+    PageTally(const PageTally &other) = delete;
+
+    PageTally &operator=(const PageTally &other) = delete;
+
+    /**
+     * @class Scope - the calling thread counts into a tally while this is in scope.
+     */
+    class Scope {
+    public:
+        explicit Scope(PageTally *tally) : previous(current_tally) { current_tally = tally; }
+
+        virtual ~Scope() { current_tally = previous; }
+
+        Scope(const Scope &other) = delete;
+
+        Scope &operator=(const Scope &other) = delete;
+
+    protected:
+        PageTally *previous;
+    };
+
+    /**
+     * The tally the calling thread counts into, or null.
+     */
+    static PageTally *current() { return current_tally; }
+
+    /**
+     * Count pages read.
+     */
+    void add(uint64_t n = 1) { pages.fetch_add(n, std::memory_order_relaxed); }
+
+    uint64_t get() const { return pages.load(std::memory_order_relaxed); }
+
+protected:
+    std::atomic<uint64_t> pages;
+    static thread_local PageTally *current_tally;
+};
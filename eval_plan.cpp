@@ -0,0 +1,460 @@
+/**
+ * @file eval_plan.cpp - implementation of query evaluation plans
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <typeinfo>
+#include "eval_plan.h"
+
+using namespace std;
+
+typedef u_int16_t u16;
+
+void encode_row(const ValueRow &row, string &bytes) {
+    for (auto const &value: row)
+        encode_value(value, bytes);
+}
+
+void encode_value(const Value &value, string &bytes) {
+    bytes.push_back((char) value.data_type);
+    if (value.data_type == ColumnAttribute::TEXT) {
+        u16 size = (u16) value.s.size();
+        bytes.append((const char *) &size, sizeof(size));
+        bytes.append(value.s);
+    } else {
+        bytes.append((const char *) &value.n, sizeof(value.n));
+    }
+}
+
+void decode_row(const string &bytes, ValueRow &row) {
+    decode_row(bytes.data(), bytes.size(), row);
+}
+
+void decode_row(const char *bytes, size_t size, ValueRow &row) {
+    row.clear();
+    const char *end = bytes + size;
+    while (bytes < end) {
+        row.push_back(Value());
+        decode_value(bytes, row.back());
+    }
+}
+
+void decode_value(const char *&bytes, Value &value) {
+    value.data_type = (ColumnAttribute::DataType) *bytes++;
+    if (value.data_type == ColumnAttribute::TEXT) {
+        u16 size;
+        memcpy(&size, bytes, sizeof(size));
+        bytes += sizeof(size);
+        value.s.assign(bytes, size);
+        bytes += size;
+    } else {
+        memcpy(&value.n, bytes, sizeof(value.n));
+        bytes += sizeof(value.n);
+    }
+}
+
+size_t row_bytes(const ValueRow &row) {
+    size_t bytes = sizeof(ValueRow) + row.capacity() * sizeof(Value);
+    for (auto const &value: row)
+        bytes += value.s.size();
+    return bytes;
+}
+
+/*
+ * ***************************
+ * EvalPlan class implementation
+ * ***************************
+ */
+size_t EvalPlan::memory_budget = 64 * 1024 * 1024;
+
+// Find the column a (possibly qualified) reference is talking about.
+int EvalPlan::column_index(const Identifier &table_name, const Identifier &column_name) const {
+    int found = -1;
+    for (uint i = 0; i < this->column_names.size(); i++) {
+        if (this->column_names[i] != column_name)
+            continue;
+        if (!table_name.empty() && this->table_names[i] != table_name)
+            continue;
+        if (found >= 0)
+            throw DbRelationError("column reference '" + column_name + "' is ambiguous");
+        found = (int) i;
+    }
+    return found;
+}
+
+// Drain the plan into dictionaries keyed by column name (what QueryResult wants).
+ValueDicts *EvalPlan::evaluate() {
+    ValueDicts *rows = new ValueDicts();
+    ValueRow row;
+    open();
+    while (next(row)) {
+        ValueDict *dict = new ValueDict();
+        for (uint i = 0; i < this->column_names.size(); i++)
+            (*dict)[this->column_names[i]] = row[i];
+        rows->push_back(dict);
+    }
+    close();
+    return rows;
+}
+
+// "Name details  (estimated rows=...)  (actual rows in=... out=... time=... ms ...)"
+void EvalPlan::explain(vector<string> &lines, uint depth) const {
+    ostringstream line;
+    if (depth > 0)
+        line << string(4 * depth - 4, ' ') << "->  ";
+    line << describe();
+    if (this->estimated_rows >= 0)
+        line << "  (estimated rows=" << llround(this->estimated_rows) << ")";
+    vector<EvalPlan *> inputs = get_inputs();
+    if (this->profile != nullptr) {
+        uint64_t in = this->profile->records;
+        for (auto const &input: inputs)
+            if (input->profile != nullptr)
+                in += input->profile->rows;
+        line << "  (actual rows in=" << in << " out=" << this->profile->rows << " time=" << fixed
+             << setprecision(3) << this->profile->nanos / 1e6 << " ms";
+        if (inputs.empty())
+            line << " pages=" << this->profile->pages << " hits=" << this->profile->cache_hits << " bytes="
+                 << this->profile->bytes;
+        line << ")";
+    }
+    lines.push_back(line.str());
+    for (auto const &input: inputs)
+        input->explain(lines, depth + 1);
+}
+
+void EvalPlan::instrument() {
+    if (this->profile == nullptr)
+        this->profile = new PlanProfile();
+    for (auto const &input: get_inputs())
+        input->instrument();
+}
+
+void EvalPlan::bind(const ValueRow &values) {
+    for (auto const &input: get_inputs())
+        input->bind(values);
+}
+
+string EvalPlan::column_label(uint column) const {
+    if (this->table_names[column].empty())
+        return this->column_names[column];
+    return this->table_names[column] + "." + this->column_names[column];
+}
+
+// Each call is a span named for the operator's class (see Trace::dump).
+void EvalPlan::measured_open() {
+    Trace::Span span(typeid(*this).name(), "open");
+    if (this->profile == nullptr) {
+        do_open();
+    } else {
+        Stopwatch watch(this->profile->nanos);
+        do_open();
+    }
+}
+
+bool EvalPlan::measured_next(ValueRow &row) {
+    Trace::Span span(typeid(*this).name(), "next");
+    if (this->profile == nullptr)
+        return do_next(row);
+    Stopwatch watch(this->profile->nanos);
+    if (!do_next(row))
+        return false;
+    this->profile->rows++;
+    return true;
+}
+
+void EvalPlan::measured_close() {
+    Trace::Span span(typeid(*this).name(), "close");
+    if (this->profile == nullptr) {
+        do_close();
+    } else {
+        Stopwatch watch(this->profile->nanos);
+        do_close();
+    }
+}
+
+string value_label(const Value &value) {
+    switch (value.data_type) {
+        case ColumnAttribute::INT:
+            return to_string(value.n);
+        case ColumnAttribute::BOOLEAN:
+            return value.n ? "true" : "false";
+        default:
+            return "'" + value.s + "'";
+    }
+}
+
+
+/*
+ * ****************************
+ * TableScan class implementation
+ * ****************************
+ */
+
+// ctor - output every column of the relation until told otherwise
+TableScan::TableScan(DbRelation &table, Identifier table_name) : table(table), batch(nullptr), block_ids(nullptr),
+                                                                 next_block(0), next_row(0), hits_at_open(-1) {
+    this->column_names = table.get_column_names();
+    this->column_attributes = table.get_column_attributes();
+    for (uint i = 0; i < this->column_names.size(); i++) {
+        this->table_names.push_back(table_name);
+        this->projection.push_back(i);
+    }
+}
+
+// ctor - the same, holding on to the relation
+TableScan::TableScan(RelationRef table, Identifier table_name) : TableScan(*table, table_name) {
+    this->held = table;
+}
+
+TableScan::~TableScan() {
+    close();
+}
+
+void TableScan::filter(const ColumnPredicate &predicate) {
+    this->predicates.push_back(predicate);
+}
+
+// The value keeps the column's type (a parameter compared with a BOOLEAN column is an INT).
+void TableScan::bind(const ValueRow &values) {
+    for (auto &predicate: this->predicates) {
+        if (predicate.parameter < 0)
+            continue;
+        const Value &value = values[predicate.parameter];
+        predicate.value.n = value.n;
+        predicate.value.s = value.s;
+    }
+    EvalPlan::bind(values);
+}
+
+void TableScan::project(const vector<uint> &ordinals) {
+    ColumnNames all_names = this->table.get_column_names();
+    ColumnAttributes all_attributes = this->table.get_column_attributes();
+    Identifier table_name = this->table_names.empty() ? "" : this->table_names[0];
+    this->projection = ordinals;
+    this->column_names.clear();
+    this->column_attributes.clear();
+    this->table_names.clear();
+    for (auto const &ordinal: ordinals) {
+        this->column_names.push_back(all_names[ordinal]);
+        this->column_attributes.push_back(all_attributes[ordinal]);
+        this->table_names.push_back(table_name);
+    }
+}
+
+void TableScan::do_open() {
+    do_close();
+    this->batch = new ColumnBatch(this->table.get_column_attributes());
+    this->block_ids = this->table.block_ids();
+    this->next_block = 0;
+    count_cache_hits();
+}
+
+bool TableScan::do_next(ValueRow &row) {
+    while (this->next_row >= this->rows.size())
+        if (!next_batch())
+            return false;
+    row.swap(this->rows[this->next_row++]);
+    return true;
+}
+
+void TableScan::do_close() {
+    delete this->batch;
+    this->batch = nullptr;
+    delete this->block_ids;
+    this->block_ids = nullptr;
+    this->rows.clear();
+    this->next_row = 0;
+    if (this->profile != nullptr && this->hits_at_open >= 0)
+        this->profile->cache_hits += this->table.cache_hits() - (uint64_t) this->hits_at_open;
+    this->hits_at_open = -1;
+}
+
+// "TableScan foo as f where a = 1 and b < 'x'"
+string TableScan::describe() const {
+    return "TableScan " + this->table.get_table_name() + describe_scan();
+}
+
+string TableScan::describe_scan() const {
+    static const char *const symbols[] = {"=", "<>", "<", "<=", ">", ">="};
+    ostringstream out;
+    Identifier alias = this->table_names.empty() ? this->table.get_table_name() : this->table_names[0];
+    if (alias != this->table.get_table_name())
+        out << " as " << alias;
+    const char *connective = " where ";
+    for (auto const &predicate: this->predicates) {
+        out << connective << this->table.get_column_names()[predicate.column] << " "
+            << symbols[predicate.comparison] << " " << value_label(predicate.value);
+        connective = " and ";
+    }
+    return out.str();
+}
+
+void TableScan::count_cache_hits() {
+    if (this->profile != nullptr)
+        this->hits_at_open = (int64_t) this->table.cache_hits();
+}
+
+// Decode the next block, filter it, then gather the projected columns.
+bool TableScan::next_batch() {
+    if (this->block_ids == nullptr || this->next_block >= this->block_ids->size())
+        return false;
+    this->table.scan_block((*this->block_ids)[this->next_block++], *this->batch);
+    if (this->profile != nullptr) {
+        this->profile->pages++;
+        this->profile->records += this->batch->size();
+        this->profile->bytes += this->batch->get_bytes();
+    }
+    this->batch->filter(this->predicates);
+    gather(*this->batch, this->rows);
+    this->next_row = 0;
+    return true;
+}
+
+// Gather the projected columns of the selected rows one column at a time.
+void TableScan::gather(const ColumnBatch &batch, ValueRows &rows) const {
+    const SelectionVector &selection = batch.get_selection();
+    rows.resize(selection.size());
+    for (auto &row: rows)
+        row.resize(this->projection.size());
+    for (uint col = 0; col < this->projection.size(); col++) {
+        uint ordinal = this->projection[col];
+        for (uint i = 0; i < selection.size(); i++)
+            rows[i][col] = batch.value(ordinal, selection[i]);
+    }
+}
+
+
+/*
+ * **************************
+ * Project class implementation
+ * **************************
+ */
+
+// ctor - names that collide are qualified with the table they came from
+Project::Project(EvalPlan *relation, const vector<uint> &ordinals, bool qualify)
+        : relation(relation), ordinals(ordinals) {
+    const ColumnNames &input_names = relation->get_column_names();
+    for (auto const &ordinal: ordinals) {
+        this->column_names.push_back(input_names[ordinal]);
+        this->column_attributes.push_back(relation->get_column_attributes()[ordinal]);
+        this->table_names.push_back(relation->get_table_names()[ordinal]);
+    }
+    if (!qualify)
+        return;
+    ColumnNames names = this->column_names;
+    for (uint i = 0; i < names.size(); i++) {
+        uint same = (uint) count(names.begin(), names.end(), names[i]);
+        if (same > 1 && !this->table_names[i].empty())
+            this->column_names[i] = this->table_names[i] + "." + names[i];
+    }
+}
+
+Project::~Project() {
+    delete this->relation;
+}
+
+void Project::do_open() {
+    this->relation->open();
+}
+
+bool Project::do_next(ValueRow &row) {
+    if (!this->relation->next(this->input))
+        return false;
+    row.resize(this->ordinals.size());
+    for (uint i = 0; i < this->ordinals.size(); i++)
+        row[i] = this->input[this->ordinals[i]];
+    return true;
+}
+
+void Project::do_close() {
+    this->relation->close();
+}
+
+string Project::describe() const {
+    string description = "Project";
+    const char *separator = " ";
+    for (auto const &ordinal: this->ordinals) {
+        description += separator + this->relation->column_label(ordinal);
+        separator = ", ";
+    }
+    return description;
+}
+
+
+/*
+ * ************************
+ * Limit class implementation
+ * ************************
+ */
+
+Limit::Limit(EvalPlan *relation, int64_t limit, int64_t offset) : relation(relation), limit(limit),
+                                                                  offset(offset), produced(0) {
+    this->column_names = relation->get_column_names();
+    this->column_attributes = relation->get_column_attributes();
+    this->table_names = relation->get_table_names();
+}
+
+Limit::~Limit() {
+    delete this->relation;
+}
+
+void Limit::do_open() {
+    this->produced = 0;
+    this->relation->open();
+    for (int64_t i = 0; i < this->offset; i++)
+        if (!this->relation->next(this->skipped))
+            break;
+}
+
+bool Limit::do_next(ValueRow &row) {
+    if (this->limit >= 0 && this->produced >= this->limit)
+        return false;
+    if (!this->relation->next(row))
+        return false;
+    this->produced++;
+    return true;
+}
+
+void Limit::do_close() {
+    this->relation->close();
+}
+
+string Limit::describe() const {
+    string description = "Limit";
+    if (this->limit >= 0)
+        description += " " + to_string(this->limit);
+    if (this->offset > 0)
+        description += " offset " + to_string(this->offset);
+    return description;
+}
+
+
+/*
+ * ***************************
+ * RowsScan class implementation
+ * ***************************
+ */
+
+RowsScan::RowsScan(const ColumnNames &column_names, const ColumnAttributes &column_attributes, const ValueRows &rows)
+        : rows(rows), next_row(0) {
+    this->column_names = column_names;
+    this->column_attributes = column_attributes;
+    this->table_names.resize(column_names.size());
+}
+
+bool RowsScan::do_next(ValueRow &row) {
+    if (this->next_row >= this->rows.size())
+        return false;
+    row = this->rows[this->next_row++];
+    return true;
+}
+
+// "RowsScan (3 rows)"
+string RowsScan::describe() const {
+    return "RowsScan (" + to_string(this->rows.size()) + " rows)";
+}
@@ -0,0 +1,419 @@
+/**
+ * @file eval_plan.h - query evaluation plans
+ * EvalPlan
+ * TableScan
+ * Project
+ * Limit
+ *
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#pragma once
+
+#include <chrono>
+#include "storage_engine.h"
+#include "column_batch.h"
+#include "trace.h"
+
+/*
+ * A row flowing between plan operators: values in the order of the producing plan's columns.
+ */
+typedef std::vector<Value> ValueRow;
+typedef std::vector<ValueRow> ValueRows;
+
+/**
+ * Serialize a row (self-describing, so it can be read back without a schema).
+ * @param row    row to serialize
+ * @param bytes  returned by reference: the row's bytes are appended here
+ */
+void encode_row(const ValueRow &row, std::string &bytes);
+
+/**
+ * Serialize one value the way encode_row does.
+ * @param value  value to serialize
+ * @param bytes  returned by reference: the value's bytes are appended here
+ */
+void encode_value(const Value &value, std::string &bytes);
+
+/**
+ * Read back a row written by encode_row.
+ * @param bytes  serialized row
+ * @param row    returned by reference: the row
+ */
+void decode_row(const std::string &bytes, ValueRow &row);
+
+/**
+ * Read back a row written by encode_row from part of a buffer.
+ * @param bytes  start of the serialized row
+ * @param size   length of the serialized row
+ * @param row    returned by reference: the row
+ */
+void decode_row(const char *bytes, size_t size, ValueRow &row);
+
+/**
+ * Read back one value of a row written by encode_row.
+ * @param bytes  start of the value; returned by reference: just past the value
+ * @param value  returned by reference: the value
+ */
+void decode_value(const char *&bytes, Value &value);
+
+/**
+ * Approximate number of bytes of memory a row occupies.
+ */
+size_t row_bytes(const ValueRow &row);
+
+/**
+ * A constant as EXPLAIN shows it: 42, true, 'text'.
+ */
+std::string value_label(const Value &value);
+
+
+/**
+ * What EXPLAIN ANALYZE measured for one operator of a plan.
+ */
+struct PlanProfile {
+    uint64_t rows;        // rows produced
+    uint64_t nanos;       // wall time in open(), next() and close(), including the time of the inputs
+    uint64_t records;     // records decoded (scans only)
+    uint64_t pages;       // blocks read (scans only)
+    uint64_t cache_hits;  // block reads the buffer pool had in memory (scans only)
+    uint64_t bytes;       // record bytes decoded (scans only)
+};
+
+
+/**
+ * @class Stopwatch - adds the time from its construction to its destruction to a counter.
+ */
+class Stopwatch {
+public:
+    explicit Stopwatch(uint64_t &nanos) : nanos(nanos), started(std::chrono::steady_clock::now()) {}
+
+    ~Stopwatch() {
+        this->nanos += (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - this->started).count();
+    }
+
+protected:
+    uint64_t &nanos;
+    std::chrono::steady_clock::time_point started;
+};
+
+
+/**
+ * @class EvalPlan - abstract base class for the operators of a query evaluation plan.
+ *
+ * Plans are pull-based: open() once, call next() until it returns false, then close().
+ * Each plan knows its output columns and the table (or alias) each column came from, so
+ * column references can be bound to ordinals when the plan is built instead of per row.
+ *
+ * Operators implement do_open(), do_next() and do_close(). The public calls wrap them so that
+ * an instrumented plan (EXPLAIN ANALYZE) counts rows and time per operator, and so that each call
+ * is a span while tracing is on (see Trace); otherwise the wrapping is one test of a null pointer
+ * and one of the tracing flag.
+ */
+class EvalPlan {
+public:
+    EvalPlan() : estimated_rows(-1), profile(nullptr) {}
+
+    virtual ~EvalPlan() { delete profile; }
+
+    EvalPlan(const EvalPlan &other) = delete;
+
+    EvalPlan &operator=(const EvalPlan &other) = delete;
+
+    /**
+     * Get ready to produce rows.
+     */
+    void open() {
+        if (this->profile == nullptr && !Trace::on())
+            do_open();
+        else
+            measured_open();
+    }
+
+    /**
+     * Produce the next row.
+     * @param row  returned by reference: the next row, in column order
+     * @returns    false if there are no more rows
+     */
+    bool next(ValueRow &row) {
+        if (this->profile == nullptr && !Trace::on())
+            return do_next(row);
+        return measured_next(row);
+    }
+
+    /**
+     * Release anything held since open(). Safe to call more than once.
+     */
+    void close() {
+        if (this->profile == nullptr && !Trace::on())
+            do_close();
+        else
+            measured_close();
+    }
+
+    const ColumnNames &get_column_names() const { return column_names; }
+
+    const ColumnAttributes &get_column_attributes() const { return column_attributes; }
+
+    const std::vector<Identifier> &get_table_names() const { return table_names; }
+
+    /**
+     * Bind a column reference to one of this plan's output columns.
+     * @param table_name   table name or alias qualifying the reference ("" if unqualified)
+     * @param column_name  column referenced
+     * @returns            ordinal of the column, or -1 if there is no such column
+     * @throws DbRelationError if an unqualified reference matches more than one column
+     */
+    virtual int column_index(const Identifier &table_name, const Identifier &column_name) const;
+
+    /**
+     * One of this plan's output columns as EXPLAIN shows it: "table.column", or "column" if it has no table.
+     */
+    std::string column_label(uint column) const;
+
+    /**
+     * Run the whole plan and collect its rows keyed by column name.
+     * @returns  all the rows (freed by caller)
+     */
+    virtual ValueDicts *evaluate();
+
+    /**
+     * The plans this one takes its rows from.
+     */
+    virtual std::vector<EvalPlan *> get_inputs() const { return std::vector<EvalPlan *>(); }
+
+    /**
+     * One line saying what this operator does, for EXPLAIN.
+     */
+    virtual std::string describe() const = 0;
+
+    /**
+     * Render the plan for EXPLAIN: one line per operator, its inputs indented below it, with the
+     * planner's row estimate and, if the plan was instrumented and run, what was measured.
+     * @param lines  returned by reference: the lines are appended here
+     * @param depth  how deep this operator is in the whole plan
+     */
+    virtual void explain(std::vector<std::string> &lines, uint depth = 0) const;
+
+    /**
+     * Start measuring this operator and all the operators below it. Call before open().
+     */
+    virtual void instrument();
+
+    /**
+     * Give the parameters of the statement this plan was built for new values, so that the plan
+     * can be run again without being rebuilt. Call while the plan is closed.
+     * @param values  value of each parameter (of the same types as the plan was built with)
+     */
+    virtual void bind(const ValueRow &values);
+
+    /**
+     * What was measured (nullptr unless instrumented).
+     */
+    const PlanProfile *get_profile() const { return profile; }
+
+    /**
+     * Record the number of rows the planner expects this operator to produce.
+     */
+    void set_estimated_rows(double rows) { estimated_rows = rows; }
+
+    /**
+     * Bytes of memory an operator may hold (hash tables, sort runs, ...) before it spills to temp files.
+     */
+    static size_t memory_budget;
+
+protected:
+    ColumnNames column_names;
+    ColumnAttributes column_attributes;
+    std::vector<Identifier> table_names;  // table name or alias each column came from
+    double estimated_rows;                // negative if the planner made no estimate
+    PlanProfile *profile;
+
+    virtual void do_open() = 0;
+
+    virtual bool do_next(ValueRow &row) = 0;
+
+    virtual void do_close() = 0;
+
+private:
+    // the calls when measured or traced
+    void measured_open();
+
+    bool measured_next(ValueRow &row);
+
+    void measured_close();
+};
+
+
+/**
+ * @class TableScan - scan of a relation a block at a time.
+ *
+ * Each block is decoded into a ColumnBatch, the pushed-down predicates are run over the
+ * batch's columns, and the projected columns are gathered for the surviving rows.
+ */
+class TableScan : public EvalPlan {
+public:
+    /**
+     * @param table       relation to scan (kept alive by the caller)
+     * @param table_name  name (or alias) used to qualify the relation's columns
+     */
+    TableScan(DbRelation &table, Identifier table_name);
+
+    /**
+     * @param table       relation to scan, held by the scan (so a plan can outlive a DROP)
+     * @param table_name  name (or alias) used to qualify the relation's columns
+     */
+    TableScan(RelationRef table, Identifier table_name);
+
+    virtual ~TableScan();
+
+    /**
+     * Push a comparison down into the scan. Must be called before project().
+     * @param predicate  comparison on one of the relation's column ordinals
+     */
+    virtual void filter(const ColumnPredicate &predicate);
+
+    /**
+     * Restrict the output to the given columns of the relation.
+     * @param ordinals  relation column ordinals, in output order
+     */
+    virtual void project(const std::vector<uint> &ordinals);
+
+    /**
+     * The relation being scanned.
+     */
+    DbRelation &get_relation() const { return table; }
+
+    virtual std::string describe() const;
+
+    virtual void bind(const ValueRow &values);
+
+protected:
+    RelationRef held;  // null if the caller keeps the relation alive
+    DbRelation &table;
+    ColumnPredicates predicates;
+    std::vector<uint> projection;
+    ColumnBatch *batch;
+    BlockIDs *block_ids;
+    uint next_block;
+    ValueRows rows;  // projected rows of the current batch
+    uint next_row;
+    int64_t hits_at_open;  // the relation's buffer pool hits when an instrumented scan started (-1 if none)
+
+    virtual void do_open();
+
+    virtual bool do_next(ValueRow &row);
+
+    virtual void do_close();
+
+    virtual bool next_batch();
+
+    /**
+     * The alias and pushed-down predicates, for describe().
+     */
+    std::string describe_scan() const;
+
+    /**
+     * Note where the buffer pool hit count stands, if the scan is being measured.
+     */
+    void count_cache_hits();
+
+    void gather(const ColumnBatch &batch, ValueRows &rows) const;
+};
+
+
+/**
+ * @class Project - pick (and reorder) columns from its input.
+ *
+ * Column names that would come out more than once are qualified with their table name
+ * ("a.id", "b.id") so the result can still be keyed by column name, unless the Project only
+ * reorders columns for operators further up the plan.
+ */
+class Project : public EvalPlan {
+public:
+    /**
+     * @param relation  input plan (owned by the Project from now on)
+     * @param ordinals  input column ordinals, in output order
+     * @param qualify   whether to qualify repeated column names
+     */
+    Project(EvalPlan *relation, const std::vector<uint> &ordinals, bool qualify = true);
+
+    virtual ~Project();
+
+    virtual std::vector<EvalPlan *> get_inputs() const { return std::vector<EvalPlan *>{relation}; }
+
+    virtual std::string describe() const;
+
+protected:
+    EvalPlan *relation;
+    std::vector<uint> ordinals;
+    ValueRow input;
+
+    virtual void do_open();
+
+    virtual bool do_next(ValueRow &row);
+
+    virtual void do_close();
+};
+
+
+/**
+ * @class Limit - LIMIT ... OFFSET: pass through a slice of its input's rows.
+ *
+ * Stops pulling from its input once it has produced enough rows, so a scan underneath it
+ * reads only as many blocks as it needs.
+ */
+class Limit : public EvalPlan {
+public:
+    /**
+     * @param relation  input plan (owned by the Limit from now on)
+     * @param limit     most rows to produce (negative for no limit)
+     * @param offset    number of leading rows to skip
+     */
+    Limit(EvalPlan *relation, int64_t limit, int64_t offset);
+
+    virtual ~Limit();
+
+    virtual std::vector<EvalPlan *> get_inputs() const { return std::vector<EvalPlan *>{relation}; }
+
+    virtual std::string describe() const;
+
+protected:
+    EvalPlan *relation;
+    int64_t limit;
+    int64_t offset;
+    int64_t produced;
+    ValueRow skipped;
+
+    virtual void do_open();
+
+    virtual bool do_next(ValueRow &row);
+
+    virtual void do_close();
+};
+
+
+/**
+ * @class RowsScan - rows held in memory (e.g. the input of an operator under test).
+ */
+class RowsScan : public EvalPlan {
+public:
+    /**
+     * @param column_names       output column names
+     * @param column_attributes  their types
+     * @param rows               the rows, in column order
+     */
+    RowsScan(const ColumnNames &column_names, const ColumnAttributes &column_attributes, const ValueRows &rows);
+
+    virtual std::string describe() const;
+
+protected:
+    ValueRows rows;
+    size_t next_row;
+
+    virtual void do_open() { next_row = 0; }
+
+    virtual bool do_next(ValueRow &row);
+
+    virtual void do_close() {}
+};
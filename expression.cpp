@@ -0,0 +1,353 @@
+/**
+ * @file expression.cpp - implementation of compiled expressions
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#include "expression.h"
+
+using namespace std;
+
+// outcome bits (less, equal, greater) each comparison passes on, indexed by ColumnPredicate::Comparison
+static const uint OUTCOMES[] = {2, 5, 1, 3, 4, 6};
+
+// the outcome of comparing a with b: 0, 1 or 2 for less, equal or greater
+static inline uint outcome(int64_t a, int64_t b) {
+    return (uint) ((a > b) - (a < b) + 1);
+}
+
+static inline uint outcome(const string &a, const string &b) {
+    int cmp = a.compare(b);
+    return (uint) ((cmp > 0) - (cmp < 0) + 1);
+}
+
+
+/*
+ * ******************************
+ * Expression class implementation
+ * ******************************
+ */
+
+Expression::Expression(const string &label) : label(label), result(0), data_type(ColumnAttribute::INT) {
+}
+
+Expression::Operand Expression::column(uint ordinal, ColumnAttribute::DataType data_type) {
+    return Operand{Operand::COLUMN, ordinal, data_type};
+}
+
+Expression::Operand Expression::constant(const Value &value) {
+    uint r = new_register();
+    if (value.data_type == ColumnAttribute::TEXT) {
+        this->texts.push_back(value.s);
+        this->registers[r].s = &this->texts.back();
+    } else {
+        this->registers[r].n = value.n;
+    }
+    return Operand{Operand::REGISTER, r, value.data_type};
+}
+
+Expression::Operand Expression::parameter(uint number, const Value &value) {
+    Operand operand = constant(value);
+    string *text = value.data_type == ColumnAttribute::TEXT ? &this->texts.back() : nullptr;
+    this->parameters.push_back(Parameter{number, operand.index, text});
+    return operand;
+}
+
+// A column on either side is compared straight out of the row (swapping the sides if need be).
+Expression::Operand Expression::compare(ColumnPredicate::Comparison comparison, Operand left, Operand right) {
+    bool text = left.data_type == ColumnAttribute::TEXT;
+    if (text != (right.data_type == ColumnAttribute::TEXT))
+        throw DbRelationError("cannot compare TEXT with a number in " + this->label);
+    uint outcomes = OUTCOMES[comparison];
+    if (left.kind != Operand::COLUMN && right.kind == Operand::COLUMN) {
+        swap(left, right);
+        outcomes = (outcomes & 2) | ((outcomes & 1) << 2) | ((outcomes & 4) >> 2);
+    }
+    if (left.kind == Operand::COLUMN) {
+        right = load(right);
+        return emit(text ? COMPARE_TEXT_COLUMN : COMPARE_INT_COLUMN, left.index, right.index,
+                    ColumnAttribute::BOOLEAN, outcomes);
+    }
+    return emit(text ? COMPARE_TEXT : COMPARE_INT, left.index, right.index, ColumnAttribute::BOOLEAN, outcomes);
+}
+
+Expression::Operand Expression::arithmetic(char op, Operand left, Operand right) {
+    if (left.data_type == ColumnAttribute::TEXT || right.data_type == ColumnAttribute::TEXT)
+        throw DbRelationError(string("cannot apply '") + op + "' to TEXT in " + this->label);
+    Opcode opcode;
+    switch (op) {
+        case '+':
+            opcode = ADD;
+            break;
+        case '-':
+            opcode = SUBTRACT;
+            break;
+        case '*':
+            opcode = MULTIPLY;
+            break;
+        case '/':
+            opcode = DIVIDE;
+            break;
+        case '%':
+            opcode = MODULO;
+            break;
+        default:
+            throw DbRelationError(string("unsupported operator '") + op + "'");
+    }
+    left = load(left);
+    right = load(right);
+    return emit(opcode, left.index, right.index, ColumnAttribute::INT);
+}
+
+Expression::Operand Expression::negate(Operand operand) {
+    if (operand.data_type == ColumnAttribute::TEXT)
+        throw DbRelationError("cannot negate TEXT in " + this->label);
+    operand = load(operand);
+    return emit(NEGATE, operand.index, 0, ColumnAttribute::INT);
+}
+
+Expression::Operand Expression::logical_not(Operand operand) {
+    if (operand.data_type == ColumnAttribute::TEXT)
+        throw DbRelationError("NOT of TEXT in " + this->label);
+    operand = load(operand);
+    return emit(NOT, operand.index, 0, ColumnAttribute::BOOLEAN);
+}
+
+// The left operand is copied into the result register, then the jump skips the right operand if it decides.
+uint Expression::begin_logical(bool conjunction, Operand left) {
+    if (left.data_type == ColumnAttribute::TEXT)
+        throw DbRelationError(string(conjunction ? "AND" : "OR") + " of TEXT in " + this->label);
+    left = load(left);
+    Operand result = emit(MOVE, left.index, 0, ColumnAttribute::BOOLEAN);
+    uint jump = (uint) this->code.size();
+    this->code.push_back(Instruction{conjunction ? JUMP_IF_FALSE : JUMP_IF_TRUE, 0, result.index, 0, 0});
+    return jump;
+}
+
+Expression::Operand Expression::end_logical(uint jump, Operand right) {
+    if (right.data_type == ColumnAttribute::TEXT)
+        throw DbRelationError("AND/OR of TEXT in " + this->label);
+    right = load(right);
+    uint result = this->code[jump].a;
+    this->code.push_back(Instruction{MOVE, result, right.index, 0, 0});
+    this->code[jump].b = (uint) this->code.size();
+    return Operand{Operand::REGISTER, result, ColumnAttribute::BOOLEAN};
+}
+
+void Expression::finish(Operand result) {
+    result = load(result);
+    this->result = result.index;
+    this->data_type = result.data_type;
+}
+
+Value Expression::evaluate(const ValueRow &row) {
+    run(row);
+    const Register &r = this->registers[this->result];
+    if (this->data_type == ColumnAttribute::TEXT)
+        return Value(*r.s);
+    Value value((int32_t) r.n);
+    if (this->data_type == ColumnAttribute::BOOLEAN)
+        value.n = r.n != 0;
+    value.data_type = this->data_type;
+    return value;
+}
+
+void Expression::bind(const ValueRow &values) {
+    for (auto const &parameter: this->parameters) {
+        if (parameter.text != nullptr)
+            *parameter.text = values[parameter.number].s;
+        else
+            this->registers[parameter.index].n = values[parameter.number].n;
+    }
+}
+
+// The interpreter: one switch per instruction, with every operand already where it is needed.
+void Expression::run(const ValueRow &row) {
+    Register *r = this->registers.data();
+    const Instruction *code = this->code.data();
+    uint end = (uint) this->code.size();
+    for (uint pc = 0; pc < end; pc++) {
+        const Instruction &in = code[pc];
+        switch (in.opcode) {
+            case LOAD_INT:
+                r[in.dst].n = row[in.a].n;
+                break;
+            case LOAD_TEXT:
+                r[in.dst].s = &row[in.a].s;
+                break;
+            case COMPARE_INT:
+                r[in.dst].n = (in.outcomes >> outcome(r[in.a].n, r[in.b].n)) & 1;
+                break;
+            case COMPARE_TEXT:
+                r[in.dst].n = (in.outcomes >> outcome(*r[in.a].s, *r[in.b].s)) & 1;
+                break;
+            case COMPARE_INT_COLUMN:
+                r[in.dst].n = (in.outcomes >> outcome(row[in.a].n, r[in.b].n)) & 1;
+                break;
+            case COMPARE_TEXT_COLUMN:
+                r[in.dst].n = (in.outcomes >> outcome(row[in.a].s, *r[in.b].s)) & 1;
+                break;
+            case ADD:
+                r[in.dst].n = r[in.a].n + r[in.b].n;
+                break;
+            case SUBTRACT:
+                r[in.dst].n = r[in.a].n - r[in.b].n;
+                break;
+            case MULTIPLY:
+                r[in.dst].n = r[in.a].n * r[in.b].n;
+                break;
+            case DIVIDE:
+                if (r[in.b].n == 0)
+                    throw DbRelationError("division by zero in " + this->label);
+                r[in.dst].n = r[in.a].n / r[in.b].n;
+                break;
+            case MODULO:
+                if (r[in.b].n == 0)
+                    throw DbRelationError("division by zero in " + this->label);
+                r[in.dst].n = r[in.a].n % r[in.b].n;
+                break;
+            case NEGATE:
+                r[in.dst].n = -r[in.a].n;
+                break;
+            case NOT:
+                r[in.dst].n = r[in.a].n == 0;
+                break;
+            case JUMP_IF_FALSE:
+                if (r[in.a].n == 0)
+                    pc = in.b - 1;
+                break;
+            case JUMP_IF_TRUE:
+                if (r[in.a].n != 0)
+                    pc = in.b - 1;
+                break;
+            case MOVE:
+                r[in.dst] = r[in.a];
+                break;
+        }
+    }
+}
+
+Expression::Operand Expression::emit(Opcode opcode, uint a, uint b, ColumnAttribute::DataType data_type,
+                                     uint outcomes) {
+    uint dst = new_register();
+    this->code.push_back(Instruction{opcode, dst, a, b, outcomes});
+    return Operand{Operand::REGISTER, dst, data_type};
+}
+
+// Columns are only loaded into a register when an instruction cannot read them from the row itself.
+Expression::Operand Expression::load(Operand operand) {
+    if (operand.kind == Operand::REGISTER)
+        return operand;
+    return emit(operand.data_type == ColumnAttribute::TEXT ? LOAD_TEXT : LOAD_INT, operand.index, 0,
+                operand.data_type);
+}
+
+uint Expression::new_register() {
+    Register r;
+    r.n = 0;
+    this->registers.push_back(r);
+    return (uint) this->registers.size() - 1;
+}
+
+
+/*
+ * **************************
+ * Filter class implementation
+ * **************************
+ */
+
+Filter::Filter(EvalPlan *relation, const Expressions &conditions) : relation(relation), conditions(conditions) {
+    this->column_names = relation->get_column_names();
+    this->column_attributes = relation->get_column_attributes();
+    this->table_names = relation->get_table_names();
+}
+
+Filter::~Filter() {
+    close();
+    for (auto const &condition: this->conditions)
+        delete condition;
+    delete this->relation;
+}
+
+void Filter::do_open() {
+    this->relation->open();
+}
+
+bool Filter::do_next(ValueRow &row) {
+    while (this->relation->next(row)) {
+        bool pass = true;
+        for (uint i = 0; pass && i < this->conditions.size(); i++)
+            pass = this->conditions[i]->test(row);
+        if (pass)
+            return true;
+    }
+    return false;
+}
+
+void Filter::do_close() {
+    this->relation->close();
+}
+
+void Filter::bind(const ValueRow &values) {
+    for (auto const &condition: this->conditions)
+        condition->bind(values);
+    EvalPlan::bind(values);
+}
+
+string Filter::describe() const {
+    string description = "Filter";
+    for (uint i = 0; i < this->conditions.size(); i++)
+        description += (i == 0 ? " " : " and ") + this->conditions[i]->get_label();
+    return description;
+}
+
+
+/*
+ * ***************************
+ * Compute class implementation
+ * ***************************
+ */
+
+Compute::Compute(EvalPlan *relation, const Expressions &expressions, const ColumnNames &column_names)
+        : relation(relation), expressions(expressions) {
+    this->column_names = column_names;
+    for (auto const &expression: expressions) {
+        this->column_attributes.push_back(ColumnAttribute(expression->get_data_type()));
+        this->table_names.push_back("");
+    }
+}
+
+Compute::~Compute() {
+    close();
+    for (auto const &expression: this->expressions)
+        delete expression;
+    delete this->relation;
+}
+
+void Compute::do_open() {
+    this->relation->open();
+}
+
+bool Compute::do_next(ValueRow &row) {
+    if (!this->relation->next(this->input))
+        return false;
+    row.resize(this->expressions.size());
+    for (uint i = 0; i < this->expressions.size(); i++)
+        row[i] = this->expressions[i]->evaluate(this->input);
+    return true;
+}
+
+void Compute::do_close() {
+    this->relation->close();
+}
+
+void Compute::bind(const ValueRow &values) {
+    for (auto const &expression: this->expressions)
+        expression->bind(values);
+    EvalPlan::bind(values);
+}
+
+string Compute::describe() const {
+    string description = "Compute";
+    for (uint i = 0; i < this->expressions.size(); i++)
+        description += (i == 0 ? " " : ", ") + this->expressions[i]->get_label();
+    return description;
+}
@@ -0,0 +1,261 @@
+/**
+ * @file expression.h - compiled expressions over plan rows
+ * Expression
+ * Filter
+ * Compute
+ *
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#pragma once
+
+#include <deque>
+#include "eval_plan.h"
+
+/**
+ * @class Expression - a condition or select list expression compiled into a flat program.
+ *
+ * The planner builds the program bottom-up, one operator at a time, with column references
+ * already bound to ordinals of the input rows and every operand's type known. Each instruction
+ * is specialized to the types it works on and writes one register (an int, or a pointer to a
+ * string in the row or in the program's constants), so evaluating a row is a single pass over an
+ * array of instructions: no walk of the parse tree, no Value comparisons and no type checks.
+ * Constants are loaded into their registers once, a comparison of a column with anything else
+ * reads the column straight out of the row, and AND/OR skip their right operand once the left
+ * one decides.
+ *
+ * A compiled expression keeps its registers between rows, so it must not be shared between threads.
+ */
+class Expression {
+public:
+    /**
+     * Something the program can compute with: a register, or a column of the input row not yet
+     * loaded into one.
+     */
+    struct Operand {
+        enum Kind {
+            REGISTER,
+            COLUMN
+        };
+        Kind kind;
+        uint index;  // register number or column ordinal
+        ColumnAttribute::DataType data_type;
+    };
+
+    /**
+     * @param label  the expression as it was written, for EXPLAIN
+     */
+    explicit Expression(const std::string &label);
+
+    virtual ~Expression() {}
+
+    /**
+     * A column of the input rows.
+     * @param ordinal    position of the column in the row
+     * @param data_type  type of the column
+     */
+    Operand column(uint ordinal, ColumnAttribute::DataType data_type);
+
+    /**
+     * A constant.
+     */
+    Operand constant(const Value &value);
+
+    /**
+     * A parameter of the statement: a constant that bind() can change.
+     * @param number  number of the parameter
+     * @param value   its value for now
+     */
+    Operand parameter(uint number, const Value &value);
+
+    /**
+     * Compare two operands of the same kind of type (both TEXT, or both INT/BOOLEAN).
+     * @returns  a BOOLEAN operand
+     * @throws DbRelationError if the types cannot be compared
+     */
+    Operand compare(ColumnPredicate::Comparison comparison, Operand left, Operand right);
+
+    /**
+     * Integer arithmetic: one of + - * / %.
+     * @returns  an INT operand
+     * @throws DbRelationError if either operand is TEXT or the operator is unknown
+     */
+    Operand arithmetic(char op, Operand left, Operand right);
+
+    /**
+     * Unary minus of an integer.
+     */
+    Operand negate(Operand operand);
+
+    /**
+     * NOT of a condition.
+     */
+    Operand logical_not(Operand operand);
+
+    /**
+     * Start an AND (or OR) whose left operand is done: emits the jump taken when it decides the result.
+     * @param conjunction  true for AND, false for OR
+     * @param left         the left operand
+     * @returns            the jump, to be passed to end_logical once the right operand is compiled
+     */
+    uint begin_logical(bool conjunction, Operand left);
+
+    /**
+     * Finish an AND (or OR).
+     * @param jump   what begin_logical returned
+     * @param right  the right operand
+     * @returns      a BOOLEAN operand
+     */
+    Operand end_logical(uint jump, Operand right);
+
+    /**
+     * Make an operand the value of the whole expression. Call once, when the program is complete.
+     */
+    void finish(Operand result);
+
+    /**
+     * Evaluate a condition for a row.
+     */
+    bool test(const ValueRow &row) {
+        run(row);
+        return this->registers[this->result].n != 0;
+    }
+
+    /**
+     * Evaluate the expression for a row.
+     */
+    Value evaluate(const ValueRow &row);
+
+    /**
+     * Load new values of the statement's parameters into their registers.
+     * @param values  value of each parameter (of the same types as the program was compiled with)
+     */
+    void bind(const ValueRow &values);
+
+    ColumnAttribute::DataType get_data_type() const { return data_type; }
+
+    const std::string &get_label() const { return label; }
+
+protected:
+    enum Opcode {
+        LOAD_INT,             // r[dst] = row[a] (INT or BOOLEAN)
+        LOAD_TEXT,            // r[dst] = &row[a]
+        COMPARE_INT,          // r[dst] = r[a] ? r[b]
+        COMPARE_TEXT,
+        COMPARE_INT_COLUMN,   // r[dst] = row[a] ? r[b]
+        COMPARE_TEXT_COLUMN,
+        ADD,                  // r[dst] = r[a] + r[b]
+        SUBTRACT,
+        MULTIPLY,
+        DIVIDE,
+        MODULO,
+        NEGATE,               // r[dst] = -r[a]
+        NOT,                  // r[dst] = !r[a]
+        JUMP_IF_FALSE,        // if !r[a] continue at instruction b
+        JUMP_IF_TRUE,
+        MOVE                  // r[dst] = r[a]
+    };
+
+    struct Instruction {
+        Opcode opcode;
+        uint dst;
+        uint a;
+        uint b;
+        uint outcomes;  // comparisons: bit 0, 1 or 2 set if less, equal or greater passes
+    };
+
+    union Register {
+        int64_t n;
+        const std::string *s;
+    };
+
+    struct Parameter {
+        uint number;
+        uint index;         // register holding it
+        std::string *text;  // the constant a TEXT register points at (nullptr for an INT)
+    };
+
+    std::string label;
+    std::vector<Instruction> code;
+    std::vector<Register> registers;
+    std::deque<std::string> texts;  // TEXT constants (registers point at them, so they must not move)
+    std::vector<Parameter> parameters;
+    uint result;
+    ColumnAttribute::DataType data_type;
+
+    void run(const ValueRow &row);
+
+    Operand emit(Opcode opcode, uint a, uint b, ColumnAttribute::DataType data_type, uint outcomes = 0);
+
+    Operand load(Operand operand);
+
+    uint new_register();
+};
+
+typedef std::vector<Expression *> Expressions;
+
+
+/**
+ * @class Filter - pass through the rows of its input that satisfy all of some conditions.
+ *
+ * For conditions the planner cannot push into a table scan: ORs, NOTs, comparisons between
+ * columns of one table or across tables other than join equalities, and arithmetic.
+ */
+class Filter : public EvalPlan {
+public:
+    /**
+     * @param relation    input plan (owned by the Filter from now on)
+     * @param conditions  compiled against the input's rows (owned by the Filter from now on)
+     */
+    Filter(EvalPlan *relation, const Expressions &conditions);
+
+    virtual ~Filter();
+
+    virtual std::vector<EvalPlan *> get_inputs() const { return std::vector<EvalPlan *>{relation}; }
+
+    virtual std::string describe() const;
+
+    virtual void bind(const ValueRow &values);
+
+protected:
+    EvalPlan *relation;
+    Expressions conditions;
+
+    virtual void do_open();
+
+    virtual bool do_next(ValueRow &row);
+
+    virtual void do_close();
+};
+
+
+/**
+ * @class Compute - a select list with expressions in it: one output column per expression.
+ */
+class Compute : public EvalPlan {
+public:
+    /**
+     * @param relation      input plan (owned by the Compute from now on)
+     * @param expressions   compiled against the input's rows (owned by the Compute from now on)
+     * @param column_names  name of each output column
+     */
+    Compute(EvalPlan *relation, const Expressions &expressions, const ColumnNames &column_names);
+
+    virtual ~Compute();
+
+    virtual std::vector<EvalPlan *> get_inputs() const { return std::vector<EvalPlan *>{relation}; }
+
+    virtual std::string describe() const;
+
+    virtual void bind(const ValueRow &values);
+
+protected:
+    EvalPlan *relation;
+    Expressions expressions;
+    ValueRow input;
+
+    virtual void do_open();
+
+    virtual bool do_next(ValueRow &row);
+
+    virtual void do_close();
+};
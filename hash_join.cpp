@@ -0,0 +1,404 @@
+/**
+ * @file hash_join.cpp - implementation of HashJoin
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#include <map>
+#include <set>
+#include "hash_join.h"
+#include "heap_storage.h"
+
+using namespace std;
+
+// finalizer from MurmurHash3, spreads the bits so both the low (slot) and high (partition) bits are usable
+static uint64_t mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+uint64_t hash_key(const ValueRow &row, const vector<uint> &keys) {
+    uint64_t h = 0x9e3779b97f4a7c15ULL;
+    for (auto const &key: keys) {
+        const Value &value = row[key];
+        uint64_t x;
+        if (value.data_type == ColumnAttribute::TEXT) {
+            x = 0xcbf29ce484222325ULL;  // FNV-1a
+            for (auto const &c: value.s)
+                x = (x ^ (unsigned char) c) * 0x100000001b3ULL;
+        } else {
+            x = (uint32_t) value.n;
+        }
+        h = mix(h ^ (x + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2)));
+    }
+    return h;
+}
+
+// ctor - output columns are the left input's followed by the right input's
+HashJoin::HashJoin(EvalPlan *left, EvalPlan *right, const vector<uint> &left_keys, const vector<uint> &right_keys)
+        : left(left), right(right), left_keys(left_keys), right_keys(right_keys), build_bytes(0), mask(0),
+          partitioned(false), current{nullptr, nullptr, 0}, probe_next(0) {
+    for (auto const &input: {left, right}) {
+        this->column_names.insert(this->column_names.end(), input->get_column_names().begin(),
+                                  input->get_column_names().end());
+        this->column_attributes.insert(this->column_attributes.end(), input->get_column_attributes().begin(),
+                                       input->get_column_attributes().end());
+        this->table_names.insert(this->table_names.end(), input->get_table_names().begin(),
+                                 input->get_table_names().end());
+    }
+}
+
+HashJoin::~HashJoin() {
+    close();
+    delete this->left;
+    delete this->right;
+}
+
+// Build phase: read the right input into memory, switching to partitions if it gets too big.
+void HashJoin::do_open() {
+    do_close();
+    ValueRow row;
+    this->right->open();
+    while (this->right->next(row)) {
+        uint64_t hash = hash_key(row, this->right_keys);
+        if (this->partitioned) {
+            spill(this->build_partitions, row, hash, 0);
+            continue;
+        }
+        this->build_bytes += row_bytes(row) + sizeof(uint64_t) + sizeof(uint32_t) + 2 * sizeof(Slot);
+        this->build_rows.push_back(move(row));
+        this->build_hashes.push_back(hash);
+        if (this->build_bytes > memory_budget)
+            start_partitions();
+    }
+    this->right->close();
+
+    if (this->partitioned) {
+        this->left->open();
+        while (this->left->next(row))
+            spill(this->probe_partitions, row, hash_key(row, this->left_keys), 0);
+        this->left->close();
+        add_partitions(0);
+        load_partition();
+    } else {
+        build_table();
+        this->left->open();
+    }
+}
+
+// Probe phase: follow the chain of build rows with the probe row's hash, emitting each match.
+bool HashJoin::do_next(ValueRow &row) {
+    while (true) {
+        while (this->probe_next != 0) {
+            const ValueRow &build_row = this->build_rows[this->probe_next - 1];
+            this->probe_next = this->next_rows[this->probe_next - 1];
+            if (!keys_match(build_row))
+                continue;
+            row = this->probe_row;
+            row.insert(row.end(), build_row.begin(), build_row.end());
+            return true;
+        }
+        if (!next_probe_row())
+            return false;
+        uint64_t hash = hash_key(this->probe_row, this->left_keys);
+        uint64_t pos = hash & this->mask;
+        while (this->slots[pos].row != 0 && this->slots[pos].hash != hash)
+            pos = (pos + 1) & this->mask;
+        this->probe_next = this->slots[pos].row;
+    }
+}
+
+void HashJoin::do_close() {
+    this->left->close();
+    this->right->close();
+    this->build_rows.clear();
+    this->build_hashes.clear();
+    this->next_rows.clear();
+    this->slots.clear();
+    this->build_bytes = 0;
+    for (auto const &file: this->build_partitions)
+        delete file;
+    for (auto const &file: this->probe_partitions)
+        delete file;
+    this->build_partitions.clear();
+    this->probe_partitions.clear();
+    for (auto const &partition: this->pending) {
+        delete partition.build;
+        delete partition.probe;
+    }
+    this->pending.clear();
+    delete this->current.build;
+    delete this->current.probe;
+    this->current = Partition{nullptr, nullptr, 0};
+    this->partitioned = false;
+    this->probe_next = 0;
+}
+
+// "HashJoin a.id = b.id", the build side being b
+string HashJoin::describe() const {
+    if (this->left_keys.empty())
+        return "HashJoin (cross join)";
+    string description = "HashJoin";
+    for (uint i = 0; i < this->left_keys.size(); i++)
+        description += (i == 0 ? " " : " and ") + this->left->column_label(this->left_keys[i]) + " = " +
+                       this->right->column_label(this->right_keys[i]);
+    return description;
+}
+
+// Lay out the slots for build_rows, with at most half of them in use. Rows are added last to first,
+// each at the head of its hash's chain, so every chain lists its rows in build order.
+void HashJoin::build_table() {
+    uint64_t capacity = 16;
+    while (capacity < 2 * this->build_rows.size())
+        capacity <<= 1;
+    this->mask = capacity - 1;
+    Slot empty = {0, 0};
+    this->slots.assign(capacity, empty);
+    this->next_rows.assign(this->build_rows.size(), 0);
+    for (uint32_t i = (uint32_t) this->build_rows.size(); i > 0; i--) {
+        uint64_t hash = this->build_hashes[i - 1];
+        uint64_t pos = hash & this->mask;
+        while (this->slots[pos].row != 0 && this->slots[pos].hash != hash)
+            pos = (pos + 1) & this->mask;
+        this->next_rows[i - 1] = this->slots[pos].row;
+        this->slots[pos].hash = hash;
+        this->slots[pos].row = i;
+    }
+}
+
+// Move what we have built so far out to the partition files.
+void HashJoin::start_partitions() {
+    this->partitioned = true;
+    for (uint i = 0; i < NUM_PARTITIONS; i++) {
+        this->build_partitions.push_back(TempFileManager::create());
+        this->probe_partitions.push_back(TempFileManager::create());
+    }
+    for (uint i = 0; i < this->build_rows.size(); i++)
+        spill(this->build_partitions, this->build_rows[i], this->build_hashes[i], 0);
+    this->build_rows.clear();
+    this->build_hashes.clear();
+    this->build_bytes = 0;
+}
+
+// Partition on the hash remixed for the level (the hash table uses its low bits as they are), so
+// the rows of a partition split again spread over all the new partitions.
+void HashJoin::spill(vector<SpillFile *> &partitions, const ValueRow &row, uint64_t hash, uint level) {
+    string bytes;
+    encode_row(row, bytes);
+    partitions[(mix(hash + level * 0x9e3779b97f4a7c15ULL) >> 32) % NUM_PARTITIONS]->write(bytes);
+}
+
+// Queue up the pairs of partitions just written, dropping those with nothing to join.
+void HashJoin::add_partitions(uint level) {
+    for (uint i = 0; i < this->build_partitions.size(); i++) {
+        SpillFile *build = this->build_partitions[i];
+        SpillFile *probe = this->probe_partitions[i];
+        this->build_partitions[i] = this->probe_partitions[i] = nullptr;
+        if (build->get_count() == 0 || probe->get_count() == 0) {
+            delete build;
+            delete probe;
+            continue;
+        }
+        build->rewind();
+        probe->rewind();
+        this->pending.push_back(Partition{build, probe, level});
+    }
+    this->build_partitions.clear();
+    this->probe_partitions.clear();
+}
+
+// Put the next piece of build rows into the hash table: the next partition, or the next memory_budget's
+// worth of the current one if it could not be split any further. Too big a partition is split first.
+bool HashJoin::load_partition() {
+    while (true) {
+        if (this->current.build == nullptr) {
+            delete this->current.probe;
+            this->current.probe = nullptr;
+            if (this->pending.empty()) {
+                this->build_rows.clear();
+                this->build_hashes.clear();
+                return false;
+            }
+            this->current = this->pending.back();
+            this->pending.pop_back();
+        } else {
+            this->current.probe->rewind();
+        }
+        if (load_rows(this->current.build)) {
+            delete this->current.build;
+            this->current.build = nullptr;
+        } else if (this->current.level < MAX_LEVELS) {
+            split_partition();
+            continue;
+        }
+        build_table();
+        return true;
+    }
+}
+
+// Read build rows from a partition until they outgrow memory_budget.
+// Returns true if the whole rest of the file was read.
+bool HashJoin::load_rows(SpillFile *file) {
+    this->build_rows.clear();
+    this->build_hashes.clear();
+    this->build_bytes = 0;
+    string bytes;
+    ValueRow row;
+    while (this->build_bytes <= memory_budget) {
+        if (!file->read(bytes))
+            return true;
+        decode_row(bytes, row);
+        this->build_bytes += row_bytes(row) + sizeof(uint64_t) + sizeof(uint32_t) + 2 * sizeof(Slot);
+        this->build_hashes.push_back(hash_key(row, this->right_keys));
+        this->build_rows.push_back(move(row));
+    }
+    return false;
+}
+
+// Partition the current pair of partitions again, one level down: the build rows read so far, the rest
+// of the build file and the whole probe file.
+void HashJoin::split_partition() {
+    uint level = this->current.level + 1;
+    for (uint i = 0; i < NUM_PARTITIONS; i++) {
+        this->build_partitions.push_back(TempFileManager::create());
+        this->probe_partitions.push_back(TempFileManager::create());
+    }
+    for (uint i = 0; i < this->build_rows.size(); i++)
+        spill(this->build_partitions, this->build_rows[i], this->build_hashes[i], level);
+    this->build_rows.clear();
+    this->build_hashes.clear();
+    this->build_bytes = 0;
+    string bytes;
+    ValueRow row;
+    while (this->current.build->read(bytes)) {
+        decode_row(bytes, row);
+        spill(this->build_partitions, row, hash_key(row, this->right_keys), level);
+    }
+    while (this->current.probe->read(bytes)) {
+        decode_row(bytes, row);
+        spill(this->probe_partitions, row, hash_key(row, this->left_keys), level);
+    }
+    delete this->current.build;
+    delete this->current.probe;
+    this->current = Partition{nullptr, nullptr, 0};
+    add_partitions(level);
+}
+
+// Next left row: straight from the left input, or from the probe partitions one after another.
+bool HashJoin::next_probe_row() {
+    if (!this->partitioned)
+        return !this->build_rows.empty() && this->left->next(this->probe_row);
+    string bytes;
+    while (true) {
+        if (this->current.probe != nullptr && !this->build_rows.empty() && this->current.probe->read(bytes)) {
+            decode_row(bytes, this->probe_row);
+            return true;
+        }
+        if (!load_partition())
+            return false;
+    }
+}
+
+bool HashJoin::keys_match(const ValueRow &build_row) const {
+    for (uint i = 0; i < this->left_keys.size(); i++)
+        if (this->probe_row[this->left_keys[i]] != build_row[this->right_keys[i]])
+            return false;
+    return true;
+}
+
+// HashJoin that lets the test see how much of the build side it holds
+class TestHashJoin : public HashJoin {
+public:
+    TestHashJoin(EvalPlan *left, EvalPlan *right, const vector<uint> &left_keys, const vector<uint> &right_keys)
+            : HashJoin(left, right, left_keys, right_keys) {}
+
+    size_t held() const { return this->build_bytes; }
+};
+
+// Join rows of (key, id) on key (or, with keyed false, every pair) and check that each matching pair
+// comes out exactly once, a left row's matches in the order of the right rows.
+static bool test_join(const char *name, const ValueRows &left, const ValueRows &right, bool keyed,
+                      size_t budget) {
+    ColumnAttributes attributes(2, ColumnAttribute(ColumnAttribute::INT));
+    map<int32_t, int32_t> right_keys;
+    for (auto const &row: right)
+        right_keys[row[0].n]++;
+    uint64_t expected = 0;
+    for (auto const &row: left)
+        expected += keyed ? right_keys[row[0].n] : right.size();
+
+    size_t saved = EvalPlan::memory_budget;
+    EvalPlan::memory_budget = budget;
+    vector<uint> keys;
+    if (keyed)
+        keys.push_back(0);
+    TestHashJoin join(new RowsScan(ColumnNames{"k", "l"}, attributes, left),
+                      new RowsScan(ColumnNames{"k", "r"}, attributes, right), keys, keys);
+    set<pair<int32_t, int32_t>> seen;
+    uint64_t count = 0;
+    size_t held = 0;
+    int32_t last_left = -1, last_right = -1;
+    bool ok = true;
+    ValueRow row;
+    join.open();
+    while (ok && join.next(row)) {
+        held = max(held, join.held());
+        count++;
+        ok = (!keyed || row[0].n == row[2].n) && seen.insert(make_pair(row[1].n, row[3].n)).second
+             && (row[1].n != last_left || row[3].n > last_right);
+        last_left = row[1].n;
+        last_right = row[3].n;
+    }
+    join.close();
+    EvalPlan::memory_budget = saved;
+    if (!ok)
+        return assertion_failure(string(name) + " join row", row[1].n, row[3].n);
+    if (count != expected)
+        return assertion_failure(string(name) + " join rows", (int) count, (int) expected);
+    if (held > budget + 1024)
+        return assertion_failure(string(name) + " join held", (int) held);
+    return true;
+}
+
+/**
+ * Test joins with many duplicate keys, both in memory and partitioned, including partitions
+ * too skewed to be split.
+ * @return true if the tests all succeeded
+ */
+bool test_hash_join() {
+    ValueRows left, right;
+    for (int32_t i = 0; i < 2000; i++)
+        right.push_back(ValueRow{Value(7), Value(i)});
+    for (int32_t i = 0; i < 100; i++)
+        right.push_back(ValueRow{Value(i), Value(2000 + i)});
+    for (int32_t i = 0; i < 100; i++)
+        left.push_back(ValueRow{Value(i % 3 == 0 ? 7 : i), Value(i)});
+    if (!test_join("duplicate keys", left, right, true, 1024 * 1024))
+        return false;
+
+    left.clear();
+    right.clear();
+    for (int32_t i = 0; i < 3000; i++)
+        right.push_back(ValueRow{Value(i % 500), Value(i)});
+    for (int32_t i = 0; i < 1000; i++)
+        left.push_back(ValueRow{Value(i), Value(i)});
+    if (!test_join("partitioned", left, right, true, 4096))
+        return false;
+
+    left.clear();
+    right.clear();
+    for (int32_t i = 0; i < 2000; i++)
+        right.push_back(ValueRow{Value(1), Value(i)});
+    for (int32_t i = 0; i < 10; i++)
+        left.push_back(ValueRow{Value(i % 2 + 1), Value(i)});
+    if (!test_join("skewed", left, right, true, 4096))
+        return false;
+
+    left.clear();
+    for (int32_t i = 0; i < 20; i++)
+        left.push_back(ValueRow{Value(i), Value(i)});
+    right.resize(300);
+    return test_join("cross", left, right, false, 4096);
+}
@@ -0,0 +1,129 @@
+/**
+ * @file hash_join.h - equi-join by hashing
+ * HashJoin
+ *
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#pragma once
+
+#include "eval_plan.h"
+#include "spill_file.h"
+
+/**
+ * Hash of the key columns of a row.
+ * @param row   row to hash
+ * @param keys  ordinals of the key columns
+ * @returns     64-bit hash
+ */
+uint64_t hash_key(const ValueRow &row, const std::vector<uint> &keys);
+
+
+/**
+ * @class HashJoin - inner equi-join of two plans.
+ *
+ * The right input is the build side: its rows go into an open-addressing hash table (a flat
+ * array of hash/row-number slots probed linearly, one per distinct hash, with the build rows
+ * sharing a hash chained through next_rows), then the left input streams through and probes it.
+ * Output rows are the left row's columns followed by the right row's.
+ *
+ * If the build side outgrows EvalPlan::memory_budget, both sides are hash partitioned into
+ * spill files (Grace hash join) and each pair of partitions is joined in memory in turn. A build
+ * partition that is still too big is partitioned again, on other bits of the hash, up to
+ * MAX_LEVELS times; past that (its rows mostly share a key) it is loaded a memory_budget's
+ * worth at a time and its probe partition is read once for each piece.
+ * With no key columns every pair of rows matches (a cross join).
+ */
+class HashJoin : public EvalPlan {
+public:
+    /**
+     * Number of partitions each side is split into when the build side spills.
+     */
+    static const uint NUM_PARTITIONS = 32;
+
+    /**
+     * Most times a partition's rows are partitioned again.
+     */
+    static const uint MAX_LEVELS = 4;
+
+    /**
+     * @param left        probe input (owned by the join from now on)
+     * @param right       build input (owned by the join from now on)
+     * @param left_keys   ordinals of the join columns in the left input
+     * @param right_keys  ordinals of the matching join columns in the right input
+     */
+    HashJoin(EvalPlan *left, EvalPlan *right, const std::vector<uint> &left_keys,
+             const std::vector<uint> &right_keys);
+
+    virtual ~HashJoin();
+
+    virtual std::vector<EvalPlan *> get_inputs() const { return std::vector<EvalPlan *>{left, right}; }
+
+    virtual std::string describe() const;
+
+protected:
+    /*
+     * One slot of the hash table: a hash and the position in build_rows plus one (so that zero
+     * marks an empty slot) of the first build row with that hash.
+     */
+    struct Slot {
+        uint64_t hash;
+        uint32_t row;
+    };
+
+    /*
+     * A build partition and the probe partition to join with it. If the build file is still
+     * open once its rows are in the hash table, they were only the first piece of it.
+     */
+    struct Partition {
+        SpillFile *build;
+        SpillFile *probe;
+        uint level;
+    };
+
+    EvalPlan *left;
+    EvalPlan *right;
+    std::vector<uint> left_keys;
+    std::vector<uint> right_keys;
+
+    ValueRows build_rows;
+    std::vector<uint64_t> build_hashes;
+    std::vector<uint32_t> next_rows;
+    size_t build_bytes;
+    std::vector<Slot> slots;
+    uint64_t mask;
+
+    bool partitioned;
+    std::vector<SpillFile *> build_partitions;
+    std::vector<SpillFile *> probe_partitions;
+    std::vector<Partition> pending;
+    Partition current;
+
+    ValueRow probe_row;
+    uint32_t probe_next;
+
+    virtual void do_open();
+
+    virtual bool do_next(ValueRow &row);
+
+    virtual void do_close();
+
+    virtual void build_table();
+
+    virtual void start_partitions();
+
+    virtual void spill(std::vector<SpillFile *> &partitions, const ValueRow &row, uint64_t hash, uint level);
+
+    virtual void add_partitions(uint level);
+
+    virtual bool load_partition();
+
+    virtual bool load_rows(SpillFile *file);
+
+    virtual void split_partition();
+
+    virtual bool next_probe_row();
+
+    bool keys_match(const ValueRow &build_row) const;
+};
+
+bool test_hash_join();
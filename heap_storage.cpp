@@ -1,6 +1,9 @@
 #include "heap_storage.h"
 #include "storage_engine.h"
+#include "counters.h"
+#include "trace.h"
 #include "db_cxx.h"
+#include <cstdlib>
 #include <cstring>
 #include <vector>
 #include <exception>
@@ -190,7 +193,7 @@ SlottedPage::SlottedPage(Dbt &block, BlockID block_id, bool is_new) : DbBlock(bl
  * @return the new block's id
  */
 RecordID SlottedPage::add(const Dbt *data) {
-    if (!has_room((u16) data->get_size()))
+    if (!has_room((u16) (data->get_size() + 4)))  // new record also needs its 4-byte header
         throw DbBlockNoRoomError("not enough room for new record");
     u16 id = ++this->num_records;
     u16 size = (u16) data->get_size();
@@ -341,6 +344,22 @@ void SlottedPage::slide(u_int16_t start, u_int16_t end) {
     delete record_ids;
     this->end_free += shift;
     put_header();
+    Counters::add(Counters::SLIDES);
+    Counters::add(Counters::BYTES_SLID, (uint64_t) bytes);
+}
+
+/**
+ * Look at a record in place.
+ * @param record_id  record to look at
+ * @param size       set to the size of the record
+ * @return           address of the record within the block, or nullptr if it has been deleted
+ */
+const void *SlottedPage::peek(RecordID record_id, u16 &size) const {
+    u16 loc;
+    get_header(size, loc, record_id);
+    if (loc == 0)
+        return nullptr;
+    return this->address(loc);
 }
 
 /**
@@ -369,28 +388,60 @@ void *SlottedPage::address(u16 offset) const {
 }
 
 
+// the block get() or get_new() last returned in this thread
+static thread_local char block_buffer[DbBlock::BLOCK_SZ];
+
 /**
  * Constructor
  * @param name
  */
-HeapFile::HeapFile(string name) : DbFile(name), dbfilename(""), last(0), closed(true), db(_DB_ENV, 0) {
+HeapFile::HeapFile(string name) : DbFile(name), dbfilename(""), last(0), allocated(0), closed(true), db(_DB_ENV, 0),
+                                  kept_count(0), committed(0), records(-1) {
     this->dbfilename = this->name + ".db";
 }
 
+HeapFile::~HeapFile() {
+    Snapshot::forget(this);  // also waits for the version collector, which may be dropping its last version
+}
+
 /**
  * Create physical file.
  */
 void HeapFile::create(void) {
     db_open(DB_CREATE | DB_EXCL);
+    Transaction *transaction = Transaction::current();
+    if (transaction != nullptr)
+        transaction->created(this);
     SlottedPage *page = get_new(); // force one page to exist
     delete page;
+    lock_guard<mutex> guard(this->versions_lock);
+    this->records = 0;
 }
 
 /**
- * Delete the physical file.
+ * Delete the physical file. In a transaction, that is left to its commit (unless it created the file).
  */
 void HeapFile::drop(void) {
+    Transaction *transaction = Transaction::current();
+    if (transaction != nullptr && !transaction->dropping(this)) {
+        close();
+        return;
+    }
+    remove();
+}
+
+/**
+ * Delete the physical file now.
+ */
+void HeapFile::remove(void) {
     close();
+    {
+        lock_guard<mutex> guard(this->versions_lock);
+        this->kept.clear();
+        this->records = -1;
+    }
+    if (this->kept_count.exchange(0) > 0)
+        Snapshot::forget(this);
     Db db(_DB_ENV, 0);
     db.remove(this->dbfilename.c_str(), nullptr, 0);
 }
@@ -406,6 +457,8 @@ void HeapFile::open(void) {
  * Close the physical file.
  */
 void HeapFile::close(void) {
+    lock_guard<mutex> guard(this->open_lock);
+    wait_applied();
     this->db.close(0);
     this->closed = true;
 }
@@ -415,19 +468,40 @@ void HeapFile::close(void) {
  * @return the new empty DbBlock that is managing the records in this block and its block id.
  */
 SlottedPage *HeapFile::get_new(void) {
+    Transaction *transaction = Transaction::current();
+    if (transaction != nullptr) {
+        Transaction::FileChanges &changes = transaction->changes(this);
+        BlockID block_id = ++this->allocated;
+        transaction->lock(LockName(this->name, block_id), LockManager::X);  // no one else knows of it yet
+        if (block_id > changes.last)
+            changes.last = block_id;
+        memset(block_buffer, 0, sizeof(block_buffer));
+        Dbt data(block_buffer, sizeof(block_buffer));
+        SlottedPage *page = new SlottedPage(data, block_id, true);
+        changes.blocks[block_id].assign(block_buffer, sizeof(block_buffer));
+        Counters::add(Counters::PAGES_ALLOCATED);
+        return page;
+    }
+
     char block[DbBlock::BLOCK_SZ];
     memset(block, 0, sizeof(block));
     Dbt data(block, sizeof(block));
 
-    int block_id = ++this->last;
+    int block_id = ++this->allocated;
     Dbt key(&block_id, sizeof(block_id));
 
-    // write out an empty block and read it back in so Berkeley DB is managing the memory
-    SlottedPage *page = new SlottedPage(data, this->last, true);
+    // write out an empty block and read it back in
+    SlottedPage *page = new SlottedPage(data, block_id, true);
     this->db.put(nullptr, &key, &data, 0); // write it out with initialization done to it
     delete page;
-    this->db.get(nullptr, &key, &data, 0);
-    return new SlottedPage(data, this->last);
+    this->last = block_id;
+    Counters::add(Counters::PAGES_ALLOCATED);
+    Counters::add(Counters::PAGES_FLUSHED);
+    Dbt copy(block_buffer, sizeof(block_buffer));
+    copy.set_ulen(sizeof(block_buffer));
+    copy.set_flags(DB_DBT_USERMEM);
+    this->db.get(nullptr, &key, &copy, 0);
+    return new SlottedPage(copy, block_id);
 }
 
 /**
@@ -436,9 +510,19 @@ SlottedPage *HeapFile::get_new(void) {
  * @return          the given slotted page (freed by caller)
  */
 SlottedPage *HeapFile::get(BlockID block_id) {
-    Dbt key(&block_id, sizeof(block_id));
-    Dbt data;
-    this->db.get(nullptr, &key, &data, 0);
+    const Transaction *transaction = Transaction::current();
+    Dbt data(block_buffer, sizeof(block_buffer));
+    data.set_ulen(sizeof(block_buffer));
+    data.set_flags(DB_DBT_USERMEM);
+    if (transaction == nullptr)
+        read(this->db, nullptr, nullptr, block_id, data, block_buffer);
+    else if (transaction->holds(LockName(this->name, block_id), LockManager::IX))
+        read(this->db, transaction->find(this), nullptr, block_id, data, block_buffer);
+    else
+        read(this->db, transaction->find(this), transaction->get_snapshot().get(), block_id, data, block_buffer);
+    Counters::add(Counters::PAGES_READ);
+    if (PageTally::current() != nullptr)
+        PageTally::current()->add();
     return new SlottedPage(data, block_id, false);
 }
 
@@ -447,9 +531,80 @@ SlottedPage *HeapFile::get(BlockID block_id) {
  * @param block
  */
 void HeapFile::put(DbBlock *block) {
+    Counters::add(Counters::PAGES_WRITTEN);
+    Transaction *transaction = Transaction::current();
+    if (transaction != nullptr) {
+        Transaction::FileChanges &changes = transaction->changes(this);
+        changes.blocks[block->get_block_id()].assign((const char *) block->get_block()->get_data(),
+                                                     DbBlock::BLOCK_SZ);
+        return;
+    }
     int block_id = block->get_block_id();
     Dbt key(&block_id, sizeof(block_id));
     this->db.put(nullptr, &key, block->get_block(), 0);
+    Counters::add(Counters::PAGES_FLUSHED);
+}
+
+/**
+ * Get the block to add records to, locked X in a transaction.
+ * @return the block (freed by caller)
+ */
+SlottedPage *HeapFile::get_insert_block() {
+    Transaction *transaction = Transaction::current();
+    if (transaction == nullptr)
+        return get(this->last);
+    const Transaction::FileChanges *changes = transaction->find(this);
+    if (changes != nullptr && changes->last != 0)
+        return get(changes->last);
+    BlockID last = this->last;
+    if (lock_block(last, false))
+        return get(last);
+    return get_new();
+}
+
+/**
+ * Delete a record, locking it X (and its block IX) in a transaction. Unless the transaction has its
+ * block locked X, the delete is noted so that it can be applied again to the block as last committed
+ * when the transaction commits.
+ * @param handle  the record
+ */
+void HeapFile::del_record(Handle handle) {
+    BlockID block_id = handle.first;
+    RecordID record_id = handle.second;
+    Transaction *transaction = Transaction::current();
+    Transaction::FileChanges *changes = nullptr;
+    if (transaction != nullptr) {
+        transaction->lock(LockName(this->name, block_id, record_id), LockManager::X);
+        changes = &transaction->changes(this);
+    }
+    SlottedPage *block = get(block_id);
+    u16 size;
+    bool deleted = block->peek(record_id, size) == nullptr;
+    if (!deleted) {
+        block->del(record_id);
+        put(block);
+    }
+    delete block;
+    if (deleted)
+        throw DbRelationError("row was deleted by a concurrent transaction");
+    if (changes != nullptr && !transaction->holds(LockName(this->name, block_id), LockManager::X))
+        changes->merged[block_id].push_back(record_id);
+}
+
+/**
+ * Write a new block after the last one.
+ * @param block  the block, numbered get_last_block_id() + 1
+ */
+void HeapFile::append(DbBlock *block) {
+    put(block);
+    BlockID block_id = block->get_block_id();
+    BlockID allocated = this->allocated;
+    while (allocated < block_id && !this->allocated.compare_exchange_weak(allocated, block_id)) {}
+    Transaction *transaction = Transaction::current();
+    if (transaction != nullptr)
+        transaction->changes(this).last = block_id;
+    else
+        this->last = block_id;
 }
 
 /**
@@ -458,11 +613,321 @@ void HeapFile::put(DbBlock *block) {
  */
 BlockIDs *HeapFile::block_ids() const {
     BlockIDs *vec = new BlockIDs();
-    for (BlockID block_id = 1; block_id <= this->last; block_id++)
+    BlockID last = get_last_block_id();
+    for (BlockID block_id = 1; block_id <= last; block_id++)
         vec->push_back(block_id);
     return vec;
 }
 
+/**
+ * Id of the last block, counting blocks the current transaction has added.
+ * @return block id of last block
+ */
+uint32_t HeapFile::get_last_block_id() const {
+    const Transaction *transaction = Transaction::current();
+    const Transaction::FileChanges *changes = transaction == nullptr ? nullptr : transaction->find(this);
+    BlockID last = this->last;
+    return changes == nullptr ? last : max(last, changes->last);
+}
+
+/**
+ * Get ready to change blocks: lock the table, in a transaction.
+ * @param mode  IX, or X to have every block read as last committed
+ */
+void HeapFile::begin_write(LockManager::Mode mode) {
+    Transaction *transaction = Transaction::current();
+    if (transaction == nullptr)
+        return;
+    transaction->lock(LockName(this->name), mode);
+    transaction->changes(this);
+}
+
+/**
+ * Lock a block X in a transaction, bringing the transaction's copy of it up to date if it has
+ * only deleted records from it so far.
+ * @param block_id  the block
+ * @param wait      whether to wait for the lock
+ * @return          whether the block is locked
+ */
+bool HeapFile::lock_block(BlockID block_id, bool wait) {
+    Transaction *transaction = Transaction::current();
+    if (transaction == nullptr)
+        return true;
+    LockName name(this->name, block_id);
+    if (wait)
+        transaction->lock(name, LockManager::X);
+    else if (!transaction->try_lock(name, LockManager::X))
+        return false;
+    Transaction::FileChanges &changes = transaction->changes(this);
+    auto merged = changes.merged.find(block_id);
+    if (merged != changes.merged.end()) {
+        // no one else can commit changes to it now
+        rebase(block_id, merged->second, changes.blocks[block_id]);
+        changes.merged.erase(merged);
+    }
+    return true;
+}
+
+/**
+ * Rebuild a block from the block as last committed, less the records a transaction deleted.
+ * @param block_id  the block
+ * @param deleted   the records deleted
+ * @param bytes     returned by reference: the block
+ */
+void HeapFile::rebase(BlockID block_id, const vector<RecordID> &deleted, string &bytes) {
+    char buffer[DbBlock::BLOCK_SZ];
+    Dbt data(buffer, sizeof(buffer));
+    data.set_ulen(sizeof(buffer));
+    data.set_flags(DB_DBT_USERMEM);
+    read(this->db, nullptr, nullptr, block_id, data, buffer);
+    SlottedPage block(data, block_id, false);
+    for (RecordID record_id: deleted)
+        block.del(record_id);
+    bytes.assign((const char *) data.get_data(), DbBlock::BLOCK_SZ);
+}
+
+/**
+ * Read the version of a block a reader sees. The file is read with no lock held; a commit that
+ * replaced the block meanwhile will have kept what it replaced, which is looked for again after.
+ * @param db        handle to read the file through
+ * @param changes   the reader's transaction's changes to the file (may be null)
+ * @param snapshot  the committed state it reads (null for the latest)
+ * @param block_id  block to read
+ * @param data      returned by reference: the block
+ * @param buffer    where a version is copied
+ */
+void HeapFile::read(Db &db, const Transaction::FileChanges *changes, const Snapshot *snapshot, BlockID block_id,
+                    Dbt &data, char *buffer) const {
+    Trace::Span span("read block", "storage", "block", block_id);
+    if (changes != nullptr) {
+        auto found = changes->blocks.find(block_id);
+        if (found != changes->blocks.end()) {
+            memcpy(buffer, found->second.data(), DbBlock::BLOCK_SZ);
+            data.set_data(buffer);
+            data.set_size(DbBlock::BLOCK_SZ);
+            return;
+        }
+    }
+    shared_ptr<const string> block;
+    bool found;
+    {
+        lock_guard<mutex> guard(this->versions_lock);
+        found = find_kept(snapshot, block_id, block);
+        if (!found) {
+            auto published = this->unapplied.find(block_id);
+            found = published != this->unapplied.end();
+            if (found)
+                block = published->second;
+        }
+    }
+    if (!found) {
+        Dbt key(&block_id, sizeof(block_id));
+        if (db.get(nullptr, &key, &data, 0) != 0) {
+            // a gap left by a transaction that rolled back, or one not yet written back
+            memset(buffer, 0, DbBlock::BLOCK_SZ);
+            data.set_data(buffer);
+            data.set_size(DbBlock::BLOCK_SZ);
+            return;
+        }
+        if (snapshot == nullptr || this->kept_count == 0)
+            return;
+        lock_guard<mutex> guard(this->versions_lock);
+        if (!find_kept(snapshot, block_id, block))
+            return;
+    }
+    if (block)
+        memcpy(buffer, block->data(), DbBlock::BLOCK_SZ);
+    else
+        memset(buffer, 0, DbBlock::BLOCK_SZ);
+    data.set_data(buffer);
+    data.set_size(DbBlock::BLOCK_SZ);
+}
+
+/**
+ * Look for the version of a block a snapshot sees among those kept (call with versions_lock held).
+ * @param snapshot  the snapshot (if null, nothing is found)
+ * @param block_id  block to look for
+ * @param block     returned by reference: the version (null if the block did not exist)
+ * @return whether a kept version is the one the snapshot sees
+ */
+bool HeapFile::find_kept(const Snapshot *snapshot, BlockID block_id, shared_ptr<const string> &block) const {
+    if (snapshot == nullptr || this->kept.empty())
+        return false;
+    auto found = this->kept.find(block_id);
+    if (found == this->kept.end())
+        return false;
+    for (auto const &version: found->second) {
+        if (version.until > snapshot->get_commit()) {
+            block = version.block;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Make a committed transaction's blocks visible to every reader until they are written back,
+ * keeping the versions they replace if asked to.
+ * @param commit   the commit's number
+ * @param changes  the transaction's changes to the file
+ * @param blocks   the blocks it wrote
+ * @param keep     whether to keep the replaced versions
+ */
+void HeapFile::publish(uint64_t commit, const Transaction::FileChanges &changes, const Blocks &blocks, bool keep) {
+    Blocks replaced;
+    if (keep) {
+        vector<BlockID> in_file;
+        {
+            lock_guard<mutex> guard(this->versions_lock);
+            for (auto const &block: blocks) {
+                auto published = this->unapplied.find(block.first);
+                if (published != this->unapplied.end())
+                    replaced[block.first] = published->second;
+                else if (block.first > this->last)
+                    replaced[block.first] = nullptr;
+                else
+                    in_file.push_back(block.first);
+            }
+        }
+        // only this commit publishes, so the file's version of these can't change meanwhile
+        for (BlockID block_id: in_file) {
+            string *block = new string(DbBlock::BLOCK_SZ, '\0');
+            replaced[block_id] = shared_ptr<const string>(block);
+            Dbt key(&block_id, sizeof(block_id));
+            Dbt data(&(*block)[0], DbBlock::BLOCK_SZ);
+            data.set_ulen(DbBlock::BLOCK_SZ);
+            data.set_flags(DB_DBT_USERMEM);
+            this->db.get(nullptr, &key, &data, 0);  // a gap is left as zeros
+        }
+    }
+    lock_guard<mutex> guard(this->versions_lock);
+    for (auto const &block: replaced)
+        this->kept[block.first].push_back(Version{commit, block.second});
+    this->kept_count += replaced.size();
+    for (auto const &block: blocks)
+        this->unapplied[block.first] = block.second;
+    if (changes.last > this->last)
+        this->last = changes.last;
+    this->committed = commit;
+    if (this->records >= 0)
+        this->records += changes.records;
+}
+
+/**
+ * Write published blocks to Berkeley DB, skipping any published again since.
+ * @param blocks  the blocks, as published
+ */
+void HeapFile::write_back(const Blocks &blocks) {
+    lock_guard<mutex> guard(this->versions_lock);
+    for (auto const &block: blocks) {
+        auto found = this->unapplied.find(block.first);
+        if (found == this->unapplied.end() || found->second != block.second)
+            continue;
+        BlockID block_id = block.first;
+        Dbt key(&block_id, sizeof(block_id));
+        Dbt data((void *) block.second->data(), DbBlock::BLOCK_SZ);
+        this->db.put(nullptr, &key, &data, 0);
+        this->unapplied.erase(found);
+        Counters::add(Counters::PAGES_FLUSHED);
+    }
+    if (this->unapplied.empty())
+        this->all_applied.notify_all();
+}
+
+/**
+ * Drop the kept versions that only snapshots older than the oldest one held could read.
+ * @param oldest  commit number of the oldest snapshot held
+ * @return whether any versions are still kept
+ */
+bool HeapFile::collect(uint64_t oldest) {
+    lock_guard<mutex> guard(this->versions_lock);
+    for (auto block = this->kept.begin(); block != this->kept.end();) {
+        vector<Version> &versions = block->second;
+        size_t dead = 0;
+        while (dead < versions.size() && versions[dead].until <= oldest)
+            dead++;
+        versions.erase(versions.begin(), versions.begin() + dead);
+        this->kept_count -= dead;
+        if (versions.empty())
+            block = this->kept.erase(block);
+        else
+            ++block;
+    }
+    return !this->kept.empty();
+}
+
+/**
+ * Number of records in the file as the current transaction sees it: the count as of the last
+ * commit, if that is what the transaction reads (whether or not it has changed the file since),
+ * plus the records it has added itself.
+ * @param count  returned by reference
+ * @return whether the count is known
+ */
+bool HeapFile::get_record_count(uint64_t &count) const {
+    const Transaction *transaction = Transaction::current();
+    const Transaction::FileChanges *changes = transaction == nullptr ? nullptr : transaction->find(this);
+    lock_guard<mutex> guard(this->versions_lock);
+    if (this->records < 0)
+        return false;
+    if (transaction != nullptr && transaction->get_snapshot()->get_commit() < this->committed)
+        return false;
+    count = (uint64_t) (this->records + (changes == nullptr ? 0 : changes->records));
+    return true;
+}
+
+/**
+ * Remember a count of the file's records, unless it was made from an older snapshot.
+ * @param count  records the current transaction counted
+ */
+void HeapFile::set_record_count(uint64_t count) {
+    const Transaction *transaction = Transaction::current();
+    const Transaction::FileChanges *changes = transaction == nullptr ? nullptr : transaction->find(this);
+    lock_guard<mutex> guard(this->versions_lock);
+    if (transaction != nullptr && transaction->get_snapshot()->get_commit() < this->committed)
+        return;
+    this->records = (int64_t) count - (changes == nullptr ? 0 : changes->records);
+}
+
+/**
+ * Note records added or deleted: by the current transaction, counted once it commits, or else right away.
+ * @param count  records added (negative for deleted)
+ */
+void HeapFile::add_records(int64_t count) {
+    Transaction *transaction = Transaction::current();
+    if (transaction != nullptr) {
+        transaction->changes(this).records += count;
+        return;
+    }
+    lock_guard<mutex> guard(this->versions_lock);
+    if (this->records >= 0)
+        this->records += count;
+}
+
+/**
+ * Wait until all published blocks have been written back (before the handle is closed).
+ */
+void HeapFile::wait_applied() {
+    unique_lock<mutex> guard(this->versions_lock);
+    this->all_applied.wait(guard, [this] { return this->unapplied.empty(); });
+}
+
+/**
+ * Buffer pool hits on this file's pages, from the environment's per-file statistics.
+ * @return hit count since the environment was opened
+ */
+uint64_t HeapFile::cache_hits() const {
+    DB_MPOOL_STAT *pool = nullptr;
+    DB_MPOOL_FSTAT **files = nullptr;
+    _DB_ENV->memp_stat(&pool, &files, 0);
+    uint64_t hits = 0;
+    for (DB_MPOOL_FSTAT **file = files; file != nullptr && *file != nullptr; file++)
+        if (this->dbfilename == (*file)->file_name)
+            hits += (*file)->st_cache_hit;
+    free(pool);
+    free(files);
+    return hits;
+}
+
 /**
  * Ask BerkDb how many blocks we are currently using in the file.
  * @return number of blocks
@@ -480,15 +945,56 @@ uint32_t HeapFile::get_block_count() {
  * @param flags BerkDb flags
  */
 void HeapFile::db_open(uint flags) {
+    if (!this->closed)
+        return;
+    lock_guard<mutex> guard(this->open_lock);
     if (!this->closed)
         return;
     this->db.set_re_len(DbBlock::BLOCK_SZ); // record length - will be ignored if file already exists
-    this->db.open(nullptr, this->dbfilename.c_str(), nullptr, DB_RECNO, flags, 0644);
+    this->db.open(nullptr, this->dbfilename.c_str(), nullptr, DB_RECNO, flags | DB_THREAD, 0644);
 
     this->last = flags ? 0 : get_block_count();
+    this->allocated = this->last.load();
     this->closed = false;
 }
 
+/**
+ * Constructor: opens a read-only handle on the file
+ * @param file         heap file to read (must exist)
+ * @param transaction  transaction whose changes are read instead of the file's blocks (may be null)
+ */
+HeapBlockScanner::HeapBlockScanner(const HeapFile &file, const Transaction *transaction)
+        : file(file), changes(nullptr), tally(PageTally::current()), db(_DB_ENV, 0) {
+    if (transaction != nullptr) {
+        this->changes = transaction->find(&file);
+        this->snapshot = transaction->get_snapshot();
+    }
+    this->db.set_re_len(DbBlock::BLOCK_SZ);
+    this->db.open(nullptr, file.get_dbfilename().c_str(), nullptr, DB_RECNO, DB_RDONLY | DB_THREAD, 0644);
+}
+
+HeapBlockScanner::~HeapBlockScanner() {
+    this->db.close(0);
+}
+
+/**
+ * Decode one block into a column batch.
+ * @param block_id  block to decode
+ * @param batch     batch to fill
+ */
+void HeapBlockScanner::scan_block(BlockID block_id, ColumnBatch &batch) {
+    Dbt data(this->buffer, sizeof(this->buffer));
+    data.set_ulen(sizeof(this->buffer));
+    data.set_flags(DB_DBT_USERMEM);
+    this->file.read(this->db, this->changes, this->snapshot.get(), block_id, data, this->buffer);
+    Counters::add(Counters::PAGES_READ);
+    if (this->tally != nullptr)
+        this->tally->add();
+    SlottedPage block(data, block_id, false);
+    batch.decode(block);
+}
+
+
 /**
  * Constructor
  * @param table_name
@@ -550,6 +1056,7 @@ Handle HeapTable::insert(const ValueDict *row) {
     ValueDict *full_row = validate(row);
     Handle handle = append(full_row);
     delete full_row;
+    this->file.add_records(1);
     return handle;
 }
 
@@ -572,12 +1079,8 @@ void HeapTable::update(const Handle handle, const ValueDict *new_values) {
  */
 void HeapTable::del(const Handle handle) {
     open();
-    BlockID block_id = handle.first;
-    RecordID record_id = handle.second;
-    SlottedPage *block = this->file.get(block_id);
-    block->del(record_id);
-    this->file.put(block);
-    delete block;
+    this->file.del_record(handle);
+    this->file.add_records(-1);
 }
 
 /**
@@ -589,24 +1092,24 @@ Handles *HeapTable::select() {
 }
 
 /**
- * The select command
+ * The select command. Blocks are decoded into a column batch and the where clause is applied to
+ * the batch as a conjunction of equality predicates.
  * @param where predicates to match
  * @return list of handles of the selected rows
  */
 Handles *HeapTable::select(const ValueDict *where) {
     open();
     Handles *handles = new Handles();
+    ColumnPredicates conjunction;
+    if (!predicates(where, conjunction))
+        return handles;
+    ColumnBatch batch(this->column_attributes);
     BlockIDs *block_ids = file.block_ids();
     for (auto const &block_id: *block_ids) {
-        SlottedPage *block = file.get(block_id);
-        RecordIDs *record_ids = block->ids();
-        for (auto const &record_id: *record_ids) {
-            Handle handle(block_id, record_id);
-            if (selected(handle, where))
-                handles->push_back(Handle(block_id, record_id));
-        }
-        delete record_ids;
-        delete block;
+        scan_block(block_id, batch);
+        batch.filter(conjunction);
+        for (auto const &row: batch.get_selection())
+            handles->push_back(batch.handle(row));
     }
     delete block_ids;
     return handles;
@@ -674,7 +1177,8 @@ ValueDict *HeapTable::validate(const ValueDict *row) const {
  */
 Handle HeapTable::append(const ValueDict *row) {
     Dbt *data = marshal(row);
-    SlottedPage *block = this->file.get(this->file.get_last_block_id());
+    this->file.begin_write();
+    SlottedPage *block = this->file.get_insert_block();
     RecordID record_id;
     try {
         record_id = block->add(data);
@@ -685,10 +1189,111 @@ Handle HeapTable::append(const ValueDict *row) {
         record_id = block->add(data);
     }
     this->file.put(block);
+    BlockID block_id = block->get_block_id();
     delete block;
     delete[] (char *) data->get_data();
     delete data;
-    return Handle(this->file.get_last_block_id(), record_id);
+    return Handle(block_id, record_id);
+}
+
+/**
+ * Append records in bulk. The last block is topped up first; after that each block is built in
+ * memory and written once it is full (or the records run out).
+ * @param records  encoded records, back to back
+ * @param sizes    size of each record
+ * @param handles  if not null, the handles of the new records are appended here
+ */
+void HeapTable::load(const char *records, const vector<u16> &sizes, Handles *handles) {
+    open();
+    this->file.begin_write(LockManager::X);
+    char fresh[DbBlock::BLOCK_SZ];
+    bool in_fresh = false;  // whether block is built in fresh (so not yet in the file)
+    SlottedPage *block = this->file.get(this->file.get_last_block_id());
+    try {
+        for (u16 size: sizes) {
+            Dbt data((void *) records, size);
+            RecordID record_id;
+            try {
+                record_id = block->add(&data);
+            } catch (DbBlockNoRoomError &e) {
+                if (in_fresh)
+                    this->file.append(block);
+                else
+                    this->file.put(block);
+                delete block;
+                block = nullptr;
+                memset(fresh, 0, sizeof(fresh));
+                Dbt empty(fresh, sizeof(fresh));
+                block = new SlottedPage(empty, this->file.get_last_block_id() + 1, true);
+                in_fresh = true;
+                record_id = block->add(&data);
+            }
+            if (handles != nullptr)
+                handles->push_back(Handle(block->get_block_id(), record_id));
+            records += size;
+        }
+        if (in_fresh)
+            this->file.append(block);
+        else
+            this->file.put(block);
+    } catch (...) {
+        delete block;
+        throw;
+    }
+    delete block;
+    this->file.add_records((int64_t) sizes.size());
+}
+
+/**
+ * Copy a block as it is stored.
+ * @param block_id  block to copy
+ * @param bytes     where to copy its DbBlock::BLOCK_SZ bytes
+ */
+void HeapTable::read_block(BlockID block_id, char *bytes) {
+    open();
+    SlottedPage *block = this->file.get(block_id);
+    memcpy(bytes, block->get_block()->get_data(), DbBlock::BLOCK_SZ);
+    delete block;
+}
+
+/**
+ * Append blocks copied from a table with the same columns. If the last block holds no records
+ * (as in a table just created), the first of them takes its place instead of following it.
+ * @param bytes    the blocks
+ * @param count    number of blocks
+ * @param handles  if not null, the handles of their records are appended here
+ * @return number of records in the blocks
+ */
+uint64_t HeapTable::load_blocks(const char *bytes, uint count, Handles *handles) {
+    open();
+    if (count == 0)
+        return 0;
+    this->file.begin_write(LockManager::X);
+    BlockID last = this->file.get_last_block_id();
+    SlottedPage *block = this->file.get(last);
+    RecordIDs *record_ids = block->ids();
+    bool reuse_last = record_ids->empty();
+    delete record_ids;
+    delete block;
+
+    uint64_t records = 0;
+    for (uint i = 0; i < count; i++) {
+        Dbt data((void *) (bytes + i * DbBlock::BLOCK_SZ), DbBlock::BLOCK_SZ);
+        BlockID block_id = reuse_last && i == 0 ? last : this->file.get_last_block_id() + 1;
+        SlottedPage page(data, block_id);
+        record_ids = page.ids();
+        records += record_ids->size();
+        if (handles != nullptr)
+            for (auto const &record_id: *record_ids)
+                handles->push_back(Handle(block_id, record_id));
+        delete record_ids;
+        if (block_id == last)
+            this->file.put(&page);
+        else
+            this->file.append(&page);
+    }
+    this->file.add_records((int64_t) records);
+    return records;
 }
 
 /**
@@ -698,43 +1303,53 @@ Handle HeapTable::append(const ValueDict *row) {
  * @return bits of the record as it should appear on disk
  */
 Dbt *HeapTable::marshal(const ValueDict *row) const {
-    char *bytes = new char[DbBlock::BLOCK_SZ]; // more than we need (we insist that one row fits into DbBlock::BLOCK_SZ)
-    uint offset = 0;
-    uint col_num = 0;
-    for (auto const &column_name: this->column_names) {
-        ColumnAttribute ca = this->column_attributes[col_num++];
-        ValueDict::const_iterator column = row->find(column_name);
-        Value value = column->second;
+    vector<Value> values;
+    for (auto const &column_name: this->column_names)
+        values.push_back(row->find(column_name)->second);
+    string bytes;
+    u16 size = encode(values, bytes);
+    char *right_size_bytes = new char[size];
+    memcpy(right_size_bytes, bytes.data(), size);
+    Dbt *data = new Dbt(right_size_bytes, size);
+    Counters::add(Counters::RECORDS_MARSHALED);
+    return data;
+}
+
+/**
+ * Figure out the bits of a record, as marshal does, from the row's values in column order.
+ * @param row    values of the tuple
+ * @param bytes  the record is appended here
+ * @return size of the record
+ */
+u16 HeapTable::encode(const vector<Value> &row, string &bytes) const {
+    size_t start = bytes.size();
+    for (uint col_num = 0; col_num < this->column_attributes.size(); col_num++) {
+        ColumnAttribute ca = this->column_attributes[col_num];
+        const Value &value = row[col_num];
+        size_t offset = bytes.size() - start;
 
         if (ca.get_data_type() == ColumnAttribute::DataType::INT) {
             if (offset + 4 > DbBlock::BLOCK_SZ - 4)
                 throw DbRelationError("row too big to marshal");
-            *(int32_t *) (bytes + offset) = value.n;
-            offset += sizeof(int32_t);
+            bytes.append((const char *) &value.n, sizeof(int32_t));
         } else if (ca.get_data_type() == ColumnAttribute::DataType::TEXT) {
             u_long size = value.s.length();
             if (size > UINT16_MAX)
                 throw DbRelationError("text field too long to marshal");
             if (offset + 2 + size > DbBlock::BLOCK_SZ)
                 throw DbRelationError("row too big to marshal");
-            *(u16 *) (bytes + offset) = size;
-            offset += sizeof(u16);
-            memcpy(bytes + offset, value.s.c_str(), size); // assume ascii for now
-            offset += size;
+            u16 n = (u16) size;
+            bytes.append((const char *) &n, sizeof(u16));
+            bytes.append(value.s);  // assume ascii for now
         } else if (ca.get_data_type() == ColumnAttribute::DataType::BOOLEAN) {
             if (offset + 1 > DbBlock::BLOCK_SZ - 1)
                 throw DbRelationError("row too big to marshal");
-            *(uint8_t *) (bytes + offset) = (uint8_t) value.n;
-            offset += sizeof(uint8_t);
+            bytes += (char) (uint8_t) value.n;
         } else {
             throw DbRelationError("Only know how to marshal INT, TEXT, and BOOLEAN");
         }
     }
-    char *right_size_bytes = new char[offset];
-    memcpy(right_size_bytes, bytes, offset);
-    delete[] bytes;
-    Dbt *data = new Dbt(right_size_bytes, offset);
-    return data;
+    return (u16) (bytes.size() - start);
 }
 
 /**
@@ -757,10 +1372,7 @@ ValueDict *HeapTable::unmarshal(Dbt *data) const {
         } else if (ca.get_data_type() == ColumnAttribute::DataType::TEXT) {
             u16 size = *(u16 *) (bytes + offset);
             offset += sizeof(u16);
-            char buffer[DbBlock::BLOCK_SZ];
-            memcpy(buffer, bytes + offset, size);
-            buffer[size] = '\0';
-            value.s = string(buffer);  // assume ascii for now
+            value.s.assign(bytes + offset, size);  // may hold zero bytes (e.g. _statistics histograms)
             offset += size;
         } else if (ca.get_data_type() == ColumnAttribute::DataType::BOOLEAN) {
             value.n = *(uint8_t *) (bytes + offset);
@@ -770,22 +1382,93 @@ ValueDict *HeapTable::unmarshal(Dbt *data) const {
         }
         (*row)[column_name] = value;
     }
+    Counters::add(Counters::RECORDS_UNMARSHALED);
     return row;
 }
 
 /**
- * See if the row at the given handle satisfies the given where clause
- * @param handle  row to check
- * @param where   conditions to check
- * @return        true if conditions met, false otherwise
+ * Number of rows in the table. The first call counts the live records in each block's header;
+ * after that the count is maintained by insert and del, so no blocks are read (unless the reader's
+ * snapshot is older than the count).
+ * @return row count
+ */
+uint64_t HeapTable::row_count() {
+    open();
+    uint64_t count = 0;
+    if (this->file.get_record_count(count))
+        return count;
+    BlockIDs *ids = this->file.block_ids();
+    for (auto const &block_id: *ids) {
+        SlottedPage *block = this->file.get(block_id);
+        RecordIDs *record_ids = block->ids();
+        count += record_ids->size();
+        delete record_ids;
+        delete block;
+    }
+    delete ids;
+    this->file.set_record_count(count);
+    return count;
+}
+
+/**
+ * Sequence of all the block ids in the table.
+ * @return block ids (freed by caller)
+ */
+BlockIDs *HeapTable::block_ids() {
+    open();
+    return this->file.block_ids();
+}
+
+/**
+ * Decode one block of the table into a column batch.
+ * @param block_id  block to decode
+ * @param batch     batch to fill (built with this table's column attributes)
+ */
+void HeapTable::scan_block(BlockID block_id, ColumnBatch &batch) {
+    SlottedPage *block = this->file.get(block_id);
+    batch.decode(*block);
+    delete block;
+}
+
+/**
+ * Get a scanner with its own handle on the table's file, for one thread of a parallel scan.
+ * @return the scanner (freed by caller)
+ */
+DbBlockScanner *HeapTable::block_scanner() {
+    open();
+    return new HeapBlockScanner(this->file, Transaction::current());
+}
+
+/**
+ * Buffer pool hits on the table's blocks.
+ * @return hit count since the environment was opened
+ */
+uint64_t HeapTable::cache_hits() {
+    return this->file.cache_hits();
+}
+
+/**
+ * Turn a where clause into equality predicates on column ordinals.
+ * @param where       conditions to check (nullptr for none)
+ * @param predicates  returned by reference: one predicate per condition
+ * @return            false if no row could possibly match (a value of the wrong type), true otherwise
+ * @throws DbRelationError if a condition is on a column the table does not have
  */
-bool HeapTable::selected(Handle handle, const ValueDict *where) {
+bool HeapTable::predicates(const ValueDict *where, ColumnPredicates &predicates) const {
     if (where == nullptr)
         return true;
-    ValueDict *row = this->project(handle, where);
-    bool res = (*row == *where);
-    delete row;
-    return res;
+    for (auto const &condition: *where) {
+        uint col_num = 0;
+        while (col_num < this->column_names.size() && this->column_names[col_num] != condition.first)
+            col_num++;
+        if (col_num == this->column_names.size())
+            throw DbRelationError("table does not have column named '" + condition.first + "'");
+        ColumnAttribute ca = this->column_attributes[col_num];
+        if (ca.get_data_type() != condition.second.data_type)
+            return false;
+        predicates.push_back(ColumnPredicate(col_num, ColumnPredicate::EQ, condition.second));
+    }
+    return true;
 }
 
 /**
@@ -833,6 +1516,9 @@ bool test_heap_storage() {
     if (!test_slotted_page())
         return assertion_failure("slotted page tests failed");
     cout << endl << "slotted page tests ok" << endl;
+    if (!test_column_batch())
+        return assertion_failure("column batch tests failed");
+    cout << "column batch tests ok" << endl;
 
     ColumnNames column_names;
     column_names.push_back("a");
@@ -883,6 +1569,20 @@ bool test_heap_storage() {
     cout << "many inserts/select/projects ok" << endl;
     delete handles;
 
+    ValueDict where;
+    where["a"] = Value(500);
+    where["b"] = Value(b);
+    handles = table.select(&where);
+    if (handles->size() != 1 || !test_compare(table, (*handles)[0], 500, b))
+        return false;
+    where["b"] = Value("no such text");
+    delete handles;
+    handles = table.select(&where);
+    if (!handles->empty())
+        return false;
+    cout << "select where ok" << endl;
+    delete handles;
+
     table.del(last_handle);
     handles = table.select();
     if (handles->size() != 1000)
@@ -893,7 +1593,114 @@ bool test_heap_storage() {
             return false;
     }
     cout << "del ok" << endl;
-    table.drop();
     delete handles;
+
+    string records;
+    vector<u16> sizes;
+    for (int j = 1000; j < 2000; j++) {
+        test_set_row(row, j, b);
+        sizes.push_back(table.encode({row["a"], row["b"], row["c"]}, records));
+    }
+    Handles loaded;
+    table.load(records.data(), sizes, &loaded);
+    handles = table.select();
+    if (loaded.size() != 1000 || handles->size() != 2000 || table.row_count() != 2000)
+        return false;
+    for (uint j = 0; j < loaded.size(); j++) {
+        if (!test_compare(table, loaded[j], 1000 + (int) j, b))
+            return false;
+    }
+    cout << "load ok" << endl;
+    delete handles;
+
+    HeapTable copy("_test_copy_cpp", column_names, column_attributes);
+    copy.create_if_not_exists();
+    BlockIDs *block_ids = table.block_ids();
+    string blocks(block_ids->size() * DbBlock::BLOCK_SZ, '\0');
+    for (uint j = 0; j < block_ids->size(); j++)
+        table.read_block((*block_ids)[j], &blocks[j * DbBlock::BLOCK_SZ]);
+    loaded.clear();
+    uint64_t copied = copy.load_blocks(blocks.data(), (uint) block_ids->size(), &loaded);
+    BlockIDs *copy_block_ids = copy.block_ids();
+    bool same_blocks = copy_block_ids->size() == block_ids->size();
+    delete copy_block_ids;
+    delete block_ids;
+    handles = copy.select();
+    bool ok = same_blocks && copied == 2000 && loaded.size() == 2000 && handles->size() == 2000
+              && test_compare(copy, loaded[0], -1, b) && test_compare(copy, loaded.back(), 1999, b);
+    delete handles;
+    if (!ok) {
+        copy.drop();
+        table.drop();
+        return false;
+    }
+    cout << "load blocks ok" << endl;
+
+    test_set_row(row, 5000, b);
+    {
+        Transaction transaction;
+        Transaction::set_current(&transaction);
+        copy.insert(&row);
+        ok = copy.row_count() == 2001;
+        transaction.rollback();
+        Transaction::set_current(nullptr);
+    }
+    ok = ok && copy.row_count() == 2000;
+    {
+        Transaction reader;  // its snapshot is taken before the commit
+        {
+            Transaction transaction;
+            Transaction::set_current(&transaction);
+            copy.insert(&row);
+            transaction.commit();
+        }
+        Transaction::set_current(&reader);
+        handles = copy.select();
+        ok = ok && copy.row_count() == 2000 && handles->size() == 2000;
+        delete handles;
+        Transaction::set_current(nullptr);
+    }
+    handles = copy.select();
+    ok = ok && handles->size() == 2001 && test_compare(copy, handles->back(), 5000, b);
+    delete handles;
+    {
+        // concurrent writers: inserts into different blocks, deletes of different rows of one block
+        Transaction first, second;
+        Transaction::set_current(&first);
+        Handle added = copy.insert(&row);
+        copy.del(loaded[0]);
+        Transaction::set_current(&second);
+        Handle other = copy.insert(&row);
+        copy.del(loaded[1]);
+        ok = ok && added.first != other.first;
+        Transaction::set_current(nullptr);
+        first.commit();
+        second.commit();
+    }
+    handles = copy.select();
+    ok = ok && handles->size() == 2001 && copy.row_count() == 2001 && (*handles)[0] == loaded[2];
+    delete handles;
+    {
+        // a writer's count leaves out what others committed after its snapshot, like its scans do
+        Transaction writer, other;
+        Transaction::set_current(&writer);
+        copy.insert(&row);
+        Transaction::set_current(&other);
+        for (int j = 0; j < 5; j++)
+            copy.insert(&row);
+        other.commit();
+        Transaction::set_current(&writer);
+        handles = copy.select();
+        ok = ok && handles->size() == 2002 && copy.row_count() == 2002;
+        delete handles;
+        writer.rollback();
+        Transaction::set_current(nullptr);
+    }
+    ok = ok && copy.row_count() == 2006;
+    copy.drop();
+    table.drop();
+    if (!ok)
+        return false;
+    cout << "transaction ok" << endl;
     return true;
 }
\ No newline at end of file
@@ -9,8 +9,16 @@
  */
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
 #include "db_cxx.h"
 #include "storage_engine.h"
+#include "column_batch.h"
+#include "counters.h"
+#include "transaction.h"
 
 /**
  * @class SlottedPage - heap file implementation of DbBlock.
@@ -43,6 +51,14 @@ public:
 
     virtual RecordIDs *ids(void) const;
 
+    /**
+     * Look at a record where it sits in the block, without copying it.
+     * @param record_id  which record to look at
+     * @param size       returned by reference: size of the record
+     * @returns          address of the record in the block, or nullptr if it has been deleted
+     */
+    virtual const void *peek(RecordID record_id, uint16_t &size) const;
+
 protected:
     uint16_t num_records;
     uint16_t end_free;
@@ -71,12 +87,26 @@ protected:
         database blocks for each Berkeley DB record in the RecNo file. In this way we are using Berkeley DB
         for buffer management and file management.
         Uses SlottedPage for storing records within blocks.
+ *
+ * Inside a transaction, blocks written are kept by the transaction until it commits (see
+ * Transaction), and blocks committed but not yet written back are kept here; reads look in both
+ * before the file. A block returned by get() or get_new() is only good until the calling thread's
+ * next call of either (on any file). Threads may share a HeapFile.
+ *
+ * Writers lock the blocks they change. A block a transaction has locked is read as last committed,
+ * any other as of its snapshot. New blocks are numbered as they are allocated, so a block allocated
+ * by a transaction that rolled back leaves a gap, read as a block with no records.
+ *
+ * When a commit replaces blocks that a held Snapshot may still read, the versions it replaced are
+ * kept here too, each marked with the commit that replaced it. A reader whose snapshot predates
+ * that commit is given the replaced version (or a block with no records, if the commit added the
+ * block). The version collector drops them once no snapshot that old is left.
  */
 class HeapFile : public DbFile {
 public:
     HeapFile(std::string name);
 
-    virtual ~HeapFile() {}
+    virtual ~HeapFile();
 
     HeapFile(const HeapFile &other) = delete;
 
@@ -100,19 +130,158 @@ public:
 
     virtual void put(DbBlock *block);
 
+    /**
+     * Get the block to add records to: in a transaction, the last block it added, else the last
+     * block committed if no other transaction has it locked, else a new block (so concurrent
+     * inserts don't queue up behind one block); otherwise the last block.
+     */
+    virtual SlottedPage *get_insert_block();
+
+    /**
+     * Delete a record. In a transaction, the record is locked X and its block only IX, so that
+     * transactions deleting other records of the block go on at the same time.
+     * @param handle  the record
+     * @throws DbRelationError  if a transaction committed since the reader's snapshot deleted it
+     */
+    virtual void del_record(Handle handle);
+
+    /**
+     * Write a block built in the caller's memory as the new last block, without the write and
+     * read back of an empty block that get_new() does.
+     * @param block  block whose id is get_last_block_id() + 1
+     */
+    virtual void append(DbBlock *block);
+
     virtual BlockIDs *block_ids() const;
 
+    /**
+     * Number of times the environment's buffer pool has found one of this file's pages in memory.
+     */
+    virtual uint64_t cache_hits() const;
+
     /**
      * Get the id of the current final block in the heap file.
      * @return block id of last block
      */
-    virtual uint32_t get_last_block_id() { return last; }
+    virtual uint32_t get_last_block_id() const;
+
+    /**
+     * Name of the Berkeley DB file holding the heap file.
+     */
+    const std::string &get_dbfilename() const { return dbfilename; }
+
+    /**
+     * Read the version of a block a reader sees: one its transaction wrote, else the one committed
+     * as of its snapshot, else the one in the file.
+     * @param db        handle to read the file through
+     * @param changes   the reader's transaction's changes to the file (may be null)
+     * @param snapshot  the committed state it reads (null for the latest)
+     * @param block_id  block to read
+     * @param data      returned by reference: the block, in buffer or in memory owned by db
+     * @param buffer    DbBlock::BLOCK_SZ bytes to copy a version into
+     */
+    virtual void read(Db &db, const Transaction::FileChanges *changes, const Snapshot *snapshot, BlockID block_id,
+                      Dbt &data, char *buffer) const;
+
+    /**
+     * Get ready to change blocks: in a transaction, lock the table (waiting for any incompatible
+     * lock to be released).
+     * @param mode  IX to change some blocks, X to change any of them
+     */
+    virtual void begin_write(LockManager::Mode mode = LockManager::IX);
+
+    /**
+     * In a transaction, lock a block X to add records to it. A block the transaction has deleted
+     * records from under an IX lock is first rebuilt from the block as last committed.
+     * @param block_id  the block
+     * @param wait      whether to wait for the lock
+     * @return          whether the block is locked
+     */
+    virtual bool lock_block(BlockID block_id, bool wait = true);
+
+    /**
+     * Number of records in the file as the current transaction sees it, if known.
+     * @param count  returned by reference: the count
+     * @return       whether it is known (if not, count them and call set_record_count)
+     */
+    virtual bool get_record_count(uint64_t &count) const;
+
+    /**
+     * Remember the number of records the current transaction counted.
+     */
+    virtual void set_record_count(uint64_t count);
+
+    /**
+     * Note records added to the file (or deleted, if negative).
+     */
+    virtual void add_records(int64_t count);
+
+    /**
+     * Delete the physical file now, in a transaction or not (drop() leaves that to the commit).
+     */
+    virtual void remove();
+
+    // for Transaction
+    typedef std::map<BlockID, std::shared_ptr<const std::string>> Blocks;
+
+    /**
+     * Rebuild a block a transaction deleted records from under an IX lock: the block as last
+     * committed, less those records (call while commits are serialized, see Snapshot::make_visible).
+     * @param block_id  the block
+     * @param deleted   the records the transaction deleted
+     * @param bytes     returned by reference: the block
+     */
+    virtual void rebase(BlockID block_id, const std::vector<RecordID> &deleted, std::string &bytes);
+
+    /**
+     * Make a transaction's blocks visible to all readers, its commit having been logged.
+     * @param commit   the commit's number
+     * @param changes  what the transaction changed in the file (but for its blocks)
+     * @param blocks   the blocks it wrote
+     * @param keep     whether to keep the versions they replace for older snapshots
+     */
+    virtual void publish(uint64_t commit, const Transaction::FileChanges &changes, const Blocks &blocks, bool keep);
+
+    /**
+     * Write published blocks to the file, once the log is durable. A block published again by a
+     * later transaction in the meantime is left to that transaction.
+     * @param blocks  as published
+     */
+    virtual void write_back(const Blocks &blocks);
+
+    /**
+     * Drop the kept versions no snapshot can read any more.
+     * @param oldest  commit number of the oldest snapshot held
+     * @return        whether any versions are still kept
+     */
+    virtual bool collect(uint64_t oldest);
 
 protected:
+    /**
+     * A block as it was before the commit that replaced it.
+     */
+    struct Version {
+        uint64_t until;                            // number of the commit that replaced it
+        std::shared_ptr<const std::string> block;  // null if the block did not exist
+    };
+
     std::string dbfilename;
-    uint32_t last;
-    bool closed;
+    std::atomic<BlockID> last;          // last block committed
+    std::atomic<BlockID> allocated;     // last block id handed out
+    std::atomic<bool> closed;
+    std::mutex open_lock;
     Db db;
+    mutable std::mutex versions_lock;
+    std::condition_variable all_applied;
+    Blocks unapplied;                   // published but not yet written back
+    std::map<BlockID, std::vector<Version>> kept;  // replaced versions, oldest first
+    std::atomic<uint64_t> kept_count;
+    uint64_t committed;                 // number of the last commit that changed the file
+    int64_t records;                    // records as of that commit (-1 until counted)
+
+    bool find_kept(const Snapshot *snapshot, BlockID block_id, std::shared_ptr<const std::string> &block) const;
+
+    virtual void wait_applied();
 
     virtual void db_open(uint flags = 0);
 
@@ -120,6 +289,41 @@ protected:
 };
 
 
+/**
+ * @class HeapBlockScanner - reads a heap file's blocks through a Berkeley DB handle of its own.
+ *
+ * Blocks are copied into the scanner's buffer rather than left in memory owned by the handle,
+ * so scanners in different threads never share anything but the environment's buffer pool.
+ */
+class HeapBlockScanner : public DbBlockScanner {
+public:
+    /**
+     * @param file         file to scan
+     * @param transaction  transaction whose changes and snapshot the scan sees (may be null); the
+     *                     scanner holds on to the snapshot, so it may outlive the transaction
+     *                     unless the transaction has changed the file
+     * The pages it reads are counted into the calling thread's PageTally, which must outlive it.
+     */
+    HeapBlockScanner(const HeapFile &file, const Transaction *transaction);
+
+    virtual ~HeapBlockScanner();
+
+    HeapBlockScanner(const HeapBlockScanner &other) = delete;
+
+    HeapBlockScanner &operator=(const HeapBlockScanner &other) = delete;
+
+    virtual void scan_block(BlockID block_id, ColumnBatch &batch);
+
+protected:
+    const HeapFile &file;
+    const Transaction::FileChanges *changes;
+    std::shared_ptr<const Snapshot> snapshot;
+    PageTally *tally;
+    Db db;
+    char buffer[DbBlock::BLOCK_SZ];
+};
+
+
 /**
  * @class HeapTable - Heap storage engine (implementation of DbRelation)
  */
@@ -164,6 +368,24 @@ public:
 
     using DbRelation::project;
 
+    virtual uint64_t row_count();
+
+    virtual BlockIDs *block_ids();
+
+    virtual void scan_block(BlockID block_id, ColumnBatch &batch);
+
+    virtual DbBlockScanner *block_scanner();
+
+    virtual uint64_t cache_hits();
+
+    virtual uint16_t encode(const std::vector<Value> &row, std::string &bytes) const;
+
+    virtual void load(const char *records, const std::vector<uint16_t> &sizes, Handles *handles);
+
+    virtual void read_block(BlockID block_id, char *bytes);
+
+    virtual uint64_t load_blocks(const char *bytes, uint count, Handles *handles);
+
 protected:
     HeapFile file;
 
@@ -175,7 +397,7 @@ protected:
 
     virtual ValueDict *unmarshal(Dbt *data) const;
 
-    virtual bool selected(Handle handle, const ValueDict *where);
+    virtual bool predicates(const ValueDict *where, ColumnPredicates &predicates) const;
 };
 
 
@@ -0,0 +1,311 @@
+/**
+ * @file lock_manager.cpp - implementation of the lock manager
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#include <chrono>
+#include <set>
+#include <thread>
+#include "lock_manager.h"
+#include "heap_storage.h"
+
+using namespace std;
+
+/*
+ * *********************************
+ * LockManager class implementation
+ * *********************************
+ */
+
+LockManager::LockManager() : waits(0), deadlocks(0) {
+}
+
+bool LockManager::compatible(Mode a, Mode b) {
+    static const bool matrix[4][4] = {
+            //          IS     IX     S      X
+            /* IS */ {true,  true,  true,  false},
+            /* IX */ {true,  true,  false, false},
+            /* S  */ {true,  false, true,  false},
+            /* X  */ {false, false, false, false},
+    };
+    return matrix[a][b];
+}
+
+LockManager::Mode LockManager::combine(Mode a, Mode b) {
+    if (a == b)
+        return a;
+    if (a == X || b == X)
+        return X;
+    if (a == IS)
+        return b;
+    if (b == IS)
+        return a;
+    return X;  // IX and S
+}
+
+void LockManager::lock(uint64_t owner, const LockName &name, Mode mode) {
+    Partition &part = partition(name);
+    unique_lock<mutex> guard(part.lock);
+    Queue &queue = part.queues[name];
+    Queue::iterator request;
+    if (acquire(owner, queue, mode, request))
+        return;
+
+    this->waits++;
+    for (;;) {
+        vector<uint64_t> blockers;
+        if (grantable(queue, request, &blockers))
+            break;
+        if (closes_cycle(owner, blockers)) {
+            if (request->granted)
+                request->wanted = request->mode;  // keep the lock as it was
+            else
+                queue.erase(request);
+            if (queue.empty())
+                part.queues.erase(name);
+            part.changed.notify_all();  // requests queued behind this one may go on
+            this->deadlocks++;
+            throw DbRelationError("deadlock detected");
+        }
+        part.changed.wait(guard);
+    }
+    {
+        lock_guard<mutex> graph_guard(this->graph_lock);
+        this->waits_for.erase(owner);
+    }
+    request->mode = request->wanted;
+    request->granted = true;
+}
+
+bool LockManager::try_lock(uint64_t owner, const LockName &name, Mode mode) {
+    Partition &part = partition(name);
+    lock_guard<mutex> guard(part.lock);
+    Queue &queue = part.queues[name];
+    Queue::iterator request;
+    if (acquire(owner, queue, mode, request))
+        return true;
+    if (request->granted)
+        request->wanted = request->mode;
+    else
+        queue.erase(request);
+    if (queue.empty())
+        part.queues.erase(name);
+    return false;
+}
+
+void LockManager::unlock(uint64_t owner, const LockName &name) {
+    Partition &part = partition(name);
+    lock_guard<mutex> guard(part.lock);
+    auto found = part.queues.find(name);
+    if (found == part.queues.end())
+        return;
+    Queue &queue = found->second;
+    for (auto request = queue.begin(); request != queue.end(); ++request) {
+        if (request->owner == owner) {
+            queue.erase(request);
+            break;
+        }
+    }
+    if (queue.empty())
+        part.queues.erase(found);
+    part.changed.notify_all();
+}
+
+LockManager::Partition &LockManager::partition(const LockName &name) {
+    return this->partitions[LockNameHash()(name) % PARTITIONS];
+}
+
+// Find or queue the owner's request and grant it if nothing stands in its way. A transaction
+// waits for one lock at a time, so a request of its own found in the queue has been granted.
+bool LockManager::acquire(uint64_t owner, Queue &queue, Mode mode, Queue::iterator &request) {
+    for (request = queue.begin(); request != queue.end(); ++request)
+        if (request->owner == owner)
+            break;
+    if (request != queue.end()) {
+        request->wanted = combine(request->mode, mode);
+        if (request->wanted == request->mode)
+            return true;
+    } else {
+        request = queue.insert(queue.end(), Request{owner, mode, mode, false});
+    }
+    if (!grantable(queue, request, nullptr))
+        return false;
+    request->mode = request->wanted;
+    request->granted = true;
+    return true;
+}
+
+// A granted lock being strengthened waits only for other holders; a new request also waits for
+// every request queued ahead of it.
+bool LockManager::grantable(const Queue &queue, Queue::const_iterator request, vector<uint64_t> *blockers) const {
+    bool grantable = true;
+    for (auto other = queue.begin(); other != queue.end(); ++other) {
+        if (other == request) {
+            if (!request->granted)
+                break;
+            continue;
+        }
+        bool blocks = other->granted ? !compatible(other->mode, request->wanted) : !request->granted;
+        if (blocks) {
+            grantable = false;
+            if (blockers == nullptr)
+                break;
+            blockers->push_back(other->owner);
+        }
+    }
+    return grantable;
+}
+
+// Record what the owner waits for, then look for a path from those transactions back to it.
+bool LockManager::closes_cycle(uint64_t owner, const vector<uint64_t> &blockers) {
+    lock_guard<mutex> guard(this->graph_lock);
+    this->waits_for[owner] = blockers;
+    vector<uint64_t> stack(blockers);
+    set<uint64_t> seen;
+    while (!stack.empty()) {
+        uint64_t waiter = stack.back();
+        stack.pop_back();
+        if (waiter == owner) {
+            this->waits_for.erase(owner);
+            return true;
+        }
+        if (!seen.insert(waiter).second)
+            continue;
+        auto found = this->waits_for.find(waiter);
+        if (found != this->waits_for.end())
+            stack.insert(stack.end(), found->second.begin(), found->second.end());
+    }
+    return false;
+}
+
+// wait until the lock manager has seen that many requests have to wait
+static void wait_for_waiters(const LockManager &locks, uint64_t waits) {
+    while (locks.get_waits() < waits)
+        this_thread::sleep_for(chrono::milliseconds(1));
+}
+
+// Each pair of modes held at once by two transactions, as the textbook matrix has it, and what a
+// holder of both is left with.
+static bool test_lock_modes() {
+    const LockManager::Mode modes[] = {LockManager::IS, LockManager::IX, LockManager::S, LockManager::X};
+    const bool expected[4][4] = {{true, true, true, false},
+                                 {true, true, false, false},
+                                 {true, false, true, false},
+                                 {false, false, false, false}};
+    LockManager locks;
+    LockName name("t");
+    for (uint a = 0; a < 4; a++) {
+        for (uint b = 0; b < 4; b++) {
+            locks.lock(1, name, modes[a]);
+            bool granted = locks.try_lock(2, name, modes[b]);
+            if (granted != expected[a][b] || LockManager::compatible(modes[a], modes[b]) != expected[a][b])
+                return assertion_failure("lock compatibility", a, b);
+            locks.unlock(1, name);
+            locks.unlock(2, name);
+        }
+    }
+    locks.lock(1, name, LockManager::IX);
+    locks.lock(1, name, LockManager::S);  // IX and S make X
+    if (locks.try_lock(2, name, LockManager::IS))
+        return assertion_failure("IX and S combined");
+    locks.unlock(1, name);
+    return locks.get_waits() == 0;
+}
+
+// Waiters are granted in the order they came: a shared request behind an exclusive one waits for
+// it even though it is compatible with the shared lock held.
+static bool test_lock_fifo() {
+    LockManager locks;
+    LockName name("t", 1);
+    mutex order_lock;
+    vector<uint64_t> order;
+    atomic<bool> release(false);
+    auto locker = [&](uint64_t owner, LockManager::Mode mode, bool hold) {
+        locks.lock(owner, name, mode);
+        {
+            lock_guard<mutex> guard(order_lock);
+            order.push_back(owner);
+        }
+        while (hold && !release)
+            this_thread::sleep_for(chrono::milliseconds(1));
+        locks.unlock(owner, name);
+    };
+    locks.lock(1, name, LockManager::X);
+    vector<thread> threads;
+    threads.emplace_back(locker, 2, LockManager::S, true);
+    wait_for_waiters(locks, 1);
+    threads.emplace_back(locker, 3, LockManager::X, false);
+    wait_for_waiters(locks, 2);
+    threads.emplace_back(locker, 4, LockManager::S, false);
+    wait_for_waiters(locks, 3);
+    locks.unlock(1, name);
+    this_thread::sleep_for(chrono::milliseconds(50));  // time for 4 to be granted, were it not waiting for 3
+    release = true;
+    for (auto &t: threads)
+        t.join();
+    if (order != vector<uint64_t>{2, 3, 4})
+        return assertion_failure("lock order", (double) order[0], (double) order[1]);
+    return true;
+}
+
+// A holder strengthening its lock waits only for the other holders, not for requests queued since.
+static bool test_lock_upgrade() {
+    LockManager locks;
+    LockName name("t", 1, 1);
+    mutex order_lock;
+    vector<uint64_t> order;
+    auto locker = [&](uint64_t owner) {
+        locks.lock(owner, name, LockManager::X);
+        {
+            lock_guard<mutex> guard(order_lock);
+            order.push_back(owner);
+        }
+        locks.unlock(owner, name);
+    };
+    locks.lock(1, name, LockManager::S);
+    locks.lock(2, name, LockManager::S);
+    thread waiter(locker, 3);
+    wait_for_waiters(locks, 1);
+    thread upgrader(locker, 1);
+    wait_for_waiters(locks, 2);
+    locks.unlock(2, name);
+    upgrader.join();
+    waiter.join();
+    if (order != vector<uint64_t>{1, 3})
+        return assertion_failure("lock upgrade order", (double) order[0], (double) order[1]);
+    return true;
+}
+
+// Two transactions each wait for the other: exactly one of them is refused, and once it lets go of
+// its lock the other gets through.
+static bool test_lock_deadlock() {
+    LockManager locks;
+    LockName a("a"), b("b");
+    atomic<uint> refused(0), granted(0);
+    auto locker = [&](uint64_t owner, const LockName &held, const LockName &wanted) {
+        try {
+            locks.lock(owner, wanted, LockManager::X);
+            granted++;
+            locks.unlock(owner, wanted);
+        } catch (DbRelationError &e) {
+            refused++;
+        }
+        locks.unlock(owner, held);
+    };
+    locks.lock(1, a, LockManager::X);
+    locks.lock(2, b, LockManager::X);
+    thread first(locker, 1, a, b);
+    thread second(locker, 2, b, a);
+    first.join();
+    second.join();
+    if (refused != 1 || granted != 1 || locks.get_deadlocks() != 1)
+        return assertion_failure("deadlock", refused, granted);
+    return true;
+}
+
+/**
+ * Test lock modes, the order waiters are granted in, and deadlock detection.
+ * @return true if the tests all succeeded
+ */
+bool test_lock_manager() {
+    return test_lock_modes() && test_lock_fifo() && test_lock_upgrade() && test_lock_deadlock();
+}
@@ -0,0 +1,157 @@
+/**
+ * @file lock_manager.h - locks on tables, blocks and rows held by transactions
+ * LockName
+ * LockManager
+ *
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "storage_engine.h"
+
+/**
+ * @class LockName - what a lock is on: a table, one of its blocks, or one of its rows.
+ *
+ * Blocks and rows are both locked under their table: whoever locks one holds an intention lock
+ * (IS or IX) on the table too.
+ */
+class LockName {
+public:
+    Identifier table;
+    BlockID block;    // 0 for the table itself
+    RecordID record;  // 0 for the whole block
+
+    explicit LockName(Identifier table, BlockID block = 0, RecordID record = 0)
+            : table(table), block(block), record(record) {}
+
+    bool is_table() const { return block == 0; }
+
+    bool operator==(const LockName &other) const {
+        return block == other.block && record == other.record && table == other.table;
+    }
+
+    bool operator<(const LockName &other) const {
+        if (table != other.table)
+            return table < other.table;
+        return block != other.block ? block < other.block : record < other.record;
+    }
+};
+
+struct LockNameHash {
+    size_t operator()(const LockName &name) const {
+        return std::hash<Identifier>()(name.table) ^ ((size_t) name.block * 0x9E3779B97F4A7C15ULL) ^
+               ((size_t) name.record << 17);
+    }
+};
+
+
+/**
+ * @class LockManager - grants locks to transactions (identified by their ids), making them wait
+ * for incompatible locks others hold.
+ *
+ * A table is locked IS or IX by a transaction that will read or change some of its blocks or rows,
+ * S or X to read or change all of it; a block or row is locked S or X. A transaction asking again
+ * for a lock it holds gets the stronger of the two modes (IX and S together make X).
+ *
+ * The lock table is split into PARTITIONS parts by a hash of the lock's name, each with a mutex of
+ * its own, so transactions locking different things rarely meet. Requests for a lock are granted
+ * in the order they came, except that a holder strengthening its lock goes first.
+ *
+ * A transaction that has to wait adds edges from itself to the transactions it waits for to a
+ * wait-for graph. If that closes a cycle, the transaction is refused the lock instead of waiting,
+ * with a DbRelationError; it should then roll back, releasing its locks so the others can go on.
+ */
+class LockManager {
+public:
+    enum Mode {
+        IS, IX, S, X
+    };
+
+    static const uint PARTITIONS = 64;
+
+    LockManager();
+
+    virtual ~LockManager() {}
+
+    LockManager(const LockManager &other) = delete;
+
+    LockManager &operator=(const LockManager &other) = delete;
+
+    /**
+     * Acquire a lock, or strengthen one already held, waiting until no other transaction holds
+     * an incompatible one.
+     * @param owner  the transaction's id
+     * @param name   what to lock
+     * @param mode   how
+     * @throws DbRelationError  if waiting would deadlock
+     */
+    virtual void lock(uint64_t owner, const LockName &name, Mode mode);
+
+    /**
+     * Acquire or strengthen a lock only if that can be done without waiting.
+     * @return whether the lock is held in (at least) the mode asked for
+     */
+    virtual bool try_lock(uint64_t owner, const LockName &name, Mode mode);
+
+    /**
+     * Release a lock, letting waiting transactions that can now have it go on.
+     */
+    virtual void unlock(uint64_t owner, const LockName &name);
+
+    /**
+     * Whether two transactions can hold a lock in these modes at once.
+     */
+    static bool compatible(Mode a, Mode b);
+
+    /**
+     * The weakest mode at least as strong as both.
+     */
+    static Mode combine(Mode a, Mode b);
+
+    /**
+     * Number of requests that had to wait, and of those refused as deadlocks.
+     */
+    uint64_t get_waits() const { return waits; }
+
+    uint64_t get_deadlocks() const { return deadlocks; }
+
+protected:
+    struct Request {
+        uint64_t owner;
+        Mode mode;      // held, if granted
+        Mode wanted;    // mode waited for (differs from mode while a granted lock is strengthened)
+        bool granted;
+    };
+
+    // granted requests first, then those waiting in the order they came
+    typedef std::list<Request> Queue;
+
+    struct Partition {
+        std::mutex lock;
+        std::condition_variable changed;
+        std::unordered_map<LockName, Queue, LockNameHash> queues;
+    };
+
+    Partition partitions[PARTITIONS];
+    std::mutex graph_lock;
+    std::map<uint64_t, std::vector<uint64_t>> waits_for;  // the wait-for graph
+    std::atomic<uint64_t> waits;
+    std::atomic<uint64_t> deadlocks;
+
+    Partition &partition(const LockName &name);
+
+    bool acquire(uint64_t owner, Queue &queue, Mode mode, Queue::iterator &request);
+
+    bool grantable(const Queue &queue, Queue::const_iterator request, std::vector<uint64_t> *blockers) const;
+
+    bool closes_cycle(uint64_t owner, const std::vector<uint64_t> &blockers);
+};
+
+bool test_lock_manager();
@@ -0,0 +1,111 @@
+/**
+ * @file merge_join.cpp - implementation of MergeJoin
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#include "merge_join.h"
+
+using namespace std;
+
+static SortKeys ascending(const vector<uint> &columns) {
+    SortKeys keys;
+    for (auto const &column: columns)
+        keys.push_back(SortKey{column, false});
+    return keys;
+}
+
+// ctor - output columns are the left input's followed by the right input's
+MergeJoin::MergeJoin(EvalPlan *left, EvalPlan *right, const vector<uint> &left_keys,
+                     const vector<uint> &right_keys)
+        : left(new Sort(left, ascending(left_keys))), right(new Sort(right, ascending(right_keys))),
+          left_keys(ascending(left_keys)), right_keys(ascending(right_keys)), have_left(false),
+          have_right(false), group_pos(0), matching(false) {
+    for (auto const &input: {left, right}) {
+        this->column_names.insert(this->column_names.end(), input->get_column_names().begin(),
+                                  input->get_column_names().end());
+        this->column_attributes.insert(this->column_attributes.end(), input->get_column_attributes().begin(),
+                                       input->get_column_attributes().end());
+        this->table_names.insert(this->table_names.end(), input->get_table_names().begin(),
+                                 input->get_table_names().end());
+    }
+}
+
+MergeJoin::~MergeJoin() {
+    close();
+    delete this->left;
+    delete this->right;
+}
+
+void MergeJoin::do_open() {
+    do_close();
+    this->left->open();
+    this->right->open();
+    advance_left();
+    advance_right();
+}
+
+bool MergeJoin::do_next(ValueRow &row) {
+    while (true) {
+        if (this->matching) {
+            if (this->group_pos < this->group.size()) {
+                const ValueRow &right_row = this->group[this->group_pos++];
+                row = this->left_row;
+                row.insert(row.end(), right_row.begin(), right_row.end());
+                return true;
+            }
+            // same group again for the next left row if it has the same key
+            advance_left();
+            this->group_pos = 0;
+            if (this->have_left && this->left_key == this->group_key)
+                continue;
+            this->matching = false;
+        }
+        if (!this->have_left || !this->have_right)
+            return false;
+        int cmp = this->left_key.compare(this->right_key);
+        if (cmp < 0) {
+            advance_left();
+        } else if (cmp > 0) {
+            advance_right();
+        } else {
+            this->group.clear();
+            this->group_key = this->right_key;
+            while (this->have_right && this->right_key == this->group_key) {
+                this->group.push_back(move(this->right_row));
+                advance_right();
+            }
+            this->group_pos = 0;
+            this->matching = true;
+        }
+    }
+}
+
+void MergeJoin::do_close() {
+    this->left->close();
+    this->right->close();
+    this->group.clear();
+    this->have_left = this->have_right = false;
+    this->matching = false;
+}
+
+// "MergeJoin a.id = b.id"
+string MergeJoin::describe() const {
+    string description = "MergeJoin";
+    for (uint i = 0; i < this->left_keys.size(); i++)
+        description += (i == 0 ? " " : " and ") + this->left->column_label(this->left_keys[i].column) + " = " +
+                       this->right->column_label(this->right_keys[i].column);
+    return description;
+}
+
+void MergeJoin::advance_left() {
+    this->have_left = this->left->next(this->left_row);
+    this->left_key.clear();
+    if (this->have_left)
+        sort_key(this->left_row, this->left_keys, this->left_key);
+}
+
+void MergeJoin::advance_right() {
+    this->have_right = this->right->next(this->right_row);
+    this->right_key.clear();
+    if (this->have_right)
+        sort_key(this->right_row, this->right_keys, this->right_key);
+}
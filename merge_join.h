@@ -0,0 +1,60 @@
+/**
+ * @file merge_join.h - equi-join by sorting
+ * MergeJoin
+ *
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#pragma once
+
+#include "sort.h"
+
+/**
+ * @class MergeJoin - inner equi-join of two plans by sorting both on the join columns.
+ *
+ * Each input goes through a Sort (so either may be larger than memory), then the two sorted
+ * streams are merged comparing normalized sort keys. All the right rows sharing a key are held
+ * while the left rows with that key pass by. Output rows are the left row's columns followed by
+ * the right row's, as with HashJoin, and come out ordered by the join columns.
+ */
+class MergeJoin : public EvalPlan {
+public:
+    /**
+     * @param left        left input (owned by the join from now on)
+     * @param right       right input (owned by the join from now on)
+     * @param left_keys   ordinals of the join columns in the left input
+     * @param right_keys  ordinals of the matching join columns in the right input
+     */
+    MergeJoin(EvalPlan *left, EvalPlan *right, const std::vector<uint> &left_keys,
+              const std::vector<uint> &right_keys);
+
+    virtual ~MergeJoin();
+
+    virtual std::vector<EvalPlan *> get_inputs() const { return std::vector<EvalPlan *>{left, right}; }
+
+    virtual std::string describe() const;
+
+protected:
+    Sort *left;
+    Sort *right;
+    SortKeys left_keys;
+    SortKeys right_keys;
+
+    ValueRow left_row, right_row;
+    std::string left_key, right_key;
+    bool have_left, have_right;
+
+    ValueRows group;  // right rows whose key is group_key
+    std::string group_key;
+    uint group_pos;
+    bool matching;
+
+    virtual void do_open();
+
+    virtual bool do_next(ValueRow &row);
+
+    virtual void do_close();
+
+    virtual void advance_left();
+
+    virtual void advance_right();
+};
@@ -0,0 +1,62 @@
+/**
+ * @file output_buffer.cpp - implementation of the output buffer
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#include <cstring>
+#include "output_buffer.h"
+
+using namespace std;
+
+void OutputBuffer::append(const char *bytes, size_t length) {
+    if (length > CAPACITY - this->size) {
+        flush();
+        if (length >= CAPACITY) {
+            this->out.write(bytes, (streamsize) length);  // too big to be worth copying
+            return;
+        }
+    }
+    memcpy(this->buffer.get() + this->size, bytes, length);
+    this->size += length;
+}
+
+static const char DIGIT_PAIRS[] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+
+// Digits are produced from the right, two per division.
+void OutputBuffer::append_integer(int64_t n) {
+    char digits[24];
+    char *end = digits + sizeof(digits);
+    char *p = end;
+    uint64_t u = n < 0 ? 0 - (uint64_t) n : (uint64_t) n;
+    while (u >= 100) {
+        const char *pair = DIGIT_PAIRS + (u % 100) * 2;
+        u /= 100;
+        *--p = pair[1];
+        *--p = pair[0];
+    }
+    if (u >= 10) {
+        const char *pair = DIGIT_PAIRS + u * 2;
+        *--p = pair[1];
+        *--p = pair[0];
+    } else {
+        *--p = (char) ('0' + u);
+    }
+    if (n < 0)
+        *--p = '-';
+    append(p, (size_t) (end - p));
+}
+
+void OutputBuffer::flush() {
+    if (this->size > 0)
+        this->out.write(this->buffer.get(), (streamsize) this->size);
+    this->size = 0;
+}
@@ -0,0 +1,60 @@
+/**
+ * @file output_buffer.h - batching small writes to a stream
+ * OutputBuffer
+ *
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+
+/**
+ * @class OutputBuffer - collects output in a fixed-size buffer and writes it to a stream in big chunks.
+ *
+ * Printing a result value by value through an ostream costs a virtual call and a sentry per value;
+ * here a value is a copy into the buffer (integers formatted in place), and the stream only sees
+ * one write() per CAPACITY bytes. Whatever is left is written when the buffer is flushed or destroyed.
+ */
+class OutputBuffer {
+public:
+    /**
+     * Bytes collected before they are written.
+     */
+    static const size_t CAPACITY = 64 * 1024;
+
+    explicit OutputBuffer(std::ostream &out) : out(out), buffer(new char[CAPACITY]), size(0) {}
+
+    virtual ~OutputBuffer() { flush(); }
+
+    OutputBuffer(const OutputBuffer &other) = delete;
+
+    OutputBuffer &operator=(const OutputBuffer &other) = delete;
+
+    void put(char c) {
+        if (this->size == CAPACITY)
+            flush();
+        this->buffer[this->size++] = c;
+    }
+
+    void append(const char *bytes, size_t length);
+
+    void append(const std::string &text) { append(text.data(), text.size()); }
+
+    /**
+     * Append an integer in decimal, formatted two digits at a time from a table.
+     */
+    void append_integer(int64_t n);
+
+    /**
+     * Write out everything collected so far.
+     */
+    void flush();
+
+protected:
+    std::ostream &out;
+    std::unique_ptr<char[]> buffer;
+    size_t size;
+};
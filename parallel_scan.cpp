@@ -0,0 +1,236 @@
+/**
+ * @file parallel_scan.cpp - implementation of morsel-driven parallel table scans
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#include "parallel_scan.h"
+
+using namespace std;
+
+/*
+ * ******************************
+ * MorselQueue class implementation
+ * ******************************
+ */
+
+// ctor - cut the blocks into morsels and deal each worker a contiguous share
+MorselQueue::MorselQueue(uint blocks, uint workers) : steals(0) {
+    for (uint worker = 0; worker < workers; worker++)
+        this->shares.emplace_back(new Share());
+    uint count = (blocks + MORSEL_BLOCKS - 1) / MORSEL_BLOCKS;
+    for (uint i = 0; i < count; i++) {
+        uint owner = (uint) ((uint64_t) i * workers / count);
+        this->shares[owner]->morsels.push_back(Morsel{i * MORSEL_BLOCKS, min(blocks, (i + 1) * MORSEL_BLOCKS)});
+    }
+}
+
+bool MorselQueue::next(uint worker, Morsel &morsel) {
+    {
+        Share &own = *this->shares[worker];
+        lock_guard<mutex> guard(own.lock);
+        if (!own.morsels.empty()) {
+            morsel = own.morsels.front();
+            own.morsels.pop_front();
+            return true;
+        }
+    }
+    for (uint i = 1; i < this->shares.size(); i++) {
+        Share &victim = *this->shares[(worker + i) % this->shares.size()];
+        lock_guard<mutex> guard(victim.lock);
+        if (!victim.morsels.empty()) {
+            morsel = victim.morsels.back();
+            victim.morsels.pop_back();
+            this->steals++;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/*
+ * *******************************
+ * ParallelScan class implementation
+ * *******************************
+ */
+uint ParallelScan::default_threads = max(1U, thread::hardware_concurrency());
+
+ParallelScan::ParallelScan(DbRelation &table, Identifier table_name, uint threads)
+        : TableScan(table, table_name), threads(max(1U, threads)), serial(true), running(0), stopping(false) {
+}
+
+ParallelScan::ParallelScan(RelationRef table, Identifier table_name, uint threads)
+        : TableScan(table, table_name), threads(max(1U, threads)), serial(true), running(0), stopping(false) {
+}
+
+ParallelScan::~ParallelScan() {
+    close();
+}
+
+// Workers push batches into a bounded queue that next() drains.
+void ParallelScan::do_open() {
+    do_close();
+    this->serial = get_threads() <= 1;
+    if (this->serial) {
+        TableScan::do_open();
+        return;
+    }
+    count_cache_hits();
+    start([this](uint worker, ValueRows &rows) {
+        unique_lock<mutex> guard(this->lock);
+        this->not_full.wait(guard, [this] { return this->stopping || this->batches.size() < 2 * this->threads; });
+        if (this->stopping)
+            return false;
+        this->batches.push_back(move(rows));
+        rows = ValueRows();
+        this->not_empty.notify_one();
+        return true;
+    });
+}
+
+bool ParallelScan::do_next(ValueRow &row) {
+    if (this->serial)
+        return TableScan::do_next(row);
+    while (this->next_row >= this->rows.size()) {
+        unique_lock<mutex> guard(this->lock);
+        this->not_empty.wait(guard, [this] { return !this->batches.empty() || this->running == 0; });
+        if (this->batches.empty()) {
+            guard.unlock();
+            finish();
+            return false;
+        }
+        this->rows = move(this->batches.front());
+        this->batches.pop_front();
+        this->next_row = 0;
+        this->not_full.notify_one();
+    }
+    row.swap(this->rows[this->next_row++]);
+    return true;
+}
+
+void ParallelScan::do_close() {
+    {
+        lock_guard<mutex> guard(this->lock);
+        this->stopping = true;
+    }
+    this->not_full.notify_all();
+    try {
+        finish();
+    } catch (...) {
+        // the scan is being abandoned, so nobody wants to hear why it failed
+    }
+    this->batches.clear();
+    this->morsels.reset();
+    this->serial = true;
+    TableScan::do_close();
+}
+
+uint ParallelScan::run(const Consumer &consume) {
+    do_close();
+    if (this->profile == nullptr) {
+        start(consume);
+        uint used = (uint) this->workers.size();
+        finish();
+        TableScan::do_close();
+        return used;
+    }
+
+    // the rows go straight to the consumer rather than through next(), so count them (and the time) here
+    Stopwatch watch(this->profile->nanos);
+    atomic<uint64_t> rows(0);
+    count_cache_hits();
+    start([&rows, &consume](uint worker, ValueRows &batch) {
+        rows += batch.size();
+        return consume(worker, batch);
+    });
+    uint used = (uint) this->workers.size();
+    finish();
+    TableScan::do_close();
+    this->profile->rows += rows;
+    return used;
+}
+
+// As many workers as asked for, but no more than there are morsels.
+uint ParallelScan::get_threads() {
+    BlockIDs *ids = this->table.block_ids();
+    uint morsel_count = (uint) ((ids->size() + MorselQueue::MORSEL_BLOCKS - 1) / MorselQueue::MORSEL_BLOCKS);
+    delete ids;
+    return max(1U, min(this->threads, morsel_count));
+}
+
+string ParallelScan::describe() const {
+    return "ParallelScan " + this->table.get_table_name() + describe_scan() + " (threads=" +
+           to_string(this->threads) + ")";
+}
+
+void ParallelScan::start(const Consumer &consume) {
+    uint count = get_threads();
+    this->block_ids = this->table.block_ids();
+    this->morsels.reset(new MorselQueue((uint) this->block_ids->size(), count));
+
+    // handles are opened here so a failure to open one is reported before any thread starts
+    vector<DbBlockScanner *> scanners;
+    try {
+        for (uint worker = 0; worker < count; worker++)
+            scanners.push_back(this->table.block_scanner());
+    } catch (...) {
+        for (auto const &scanner: scanners)
+            delete scanner;
+        throw;
+    }
+    this->error = nullptr;
+    this->stopping = false;
+    this->running = count;
+    for (uint worker = 0; worker < count; worker++)
+        this->workers.emplace_back(&ParallelScan::work, this, worker, scanners[worker], consume);
+}
+
+// Wait for the workers, then pass on the first thing that went wrong in any of them.
+void ParallelScan::finish() {
+    for (auto &worker: this->workers)
+        worker.join();
+    this->workers.clear();
+    if (this->error) {
+        exception_ptr error = this->error;
+        this->error = nullptr;
+        rethrow_exception(error);
+    }
+}
+
+// One worker: scan morsels until there are none left, running each block through filter and projection.
+void ParallelScan::work(uint worker, DbBlockScanner *scanner, const Consumer &consume) {
+    unique_ptr<DbBlockScanner> owned(scanner);
+    uint64_t pages = 0, records = 0, bytes = 0;
+    try {
+        ColumnBatch batch(this->table.get_column_attributes());
+        ValueRows rows;
+        Morsel morsel;
+        while (!this->stopping && this->morsels->next(worker, morsel)) {
+            for (uint i = morsel.begin; i < morsel.end && !this->stopping; i++) {
+                scanner->scan_block((*this->block_ids)[i], batch);
+                pages++;
+                records += batch.size();
+                bytes += batch.get_bytes();
+                batch.filter(this->predicates);
+                gather(batch, rows);
+                if (!rows.empty() && !consume(worker, rows))
+                    this->stopping = true;
+            }
+        }
+    } catch (...) {
+        lock_guard<mutex> guard(this->lock);
+        if (!this->error)
+            this->error = current_exception();
+        this->stopping = true;
+    }
+    {
+        lock_guard<mutex> guard(this->lock);
+        this->running--;
+        if (this->profile != nullptr) {
+            this->profile->pages += pages;
+            this->profile->records += records;
+            this->profile->bytes += bytes;
+        }
+    }
+    this->not_empty.notify_all();
+    this->not_full.notify_all();
+}
@@ -0,0 +1,160 @@
+/**
+ * @file parallel_scan.h - morsel-driven parallel table scans
+ * Morsel
+ * MorselQueue
+ * ParallelScan
+ *
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "eval_plan.h"
+
+/**
+ * A run of consecutive blocks of a relation: positions [begin, end) in its list of block ids.
+ */
+struct Morsel {
+    uint begin;
+    uint end;
+};
+
+
+/**
+ * @class MorselQueue - hands out the morsels of a scan to worker threads.
+ *
+ * Each worker starts with its own contiguous share of the morsels and takes them from the
+ * front, so it reads its blocks in order. A worker that runs out steals from the back of
+ * another worker's share (the blocks that worker would have reached last).
+ */
+class MorselQueue {
+public:
+    /**
+     * Number of blocks in a morsel.
+     */
+    static const uint MORSEL_BLOCKS = 16;
+
+    /**
+     * @param blocks   number of blocks to scan
+     * @param workers  number of worker threads
+     */
+    MorselQueue(uint blocks, uint workers);
+
+    /**
+     * Get the next morsel for a worker.
+     * @param worker  which worker is asking
+     * @param morsel  returned by reference: the morsel to scan
+     * @returns       false if the whole scan has been handed out
+     */
+    virtual bool next(uint worker, Morsel &morsel);
+
+    /**
+     * Number of morsels taken from another worker's share.
+     */
+    uint get_steals() const { return steals; }
+
+protected:
+    struct Share {
+        std::mutex lock;
+        std::deque<Morsel> morsels;
+    };
+
+    std::vector<std::unique_ptr<Share>> shares;
+    std::atomic<uint> steals;
+};
+
+
+/**
+ * @class ParallelScan - TableScan that decodes, filters and projects blocks on several threads.
+ *
+ * Workers take morsels from a MorselQueue and run the scan's pipeline over each block with their
+ * own DbBlockScanner. The projected rows of each block go to a sink: either a consumer given to
+ * run(), called concurrently from the workers (for instance to fill per-thread aggregate tables),
+ * or, through open()/next(), a bounded queue of batches that next() takes rows from. Rows come
+ * out in no particular order. Relations too small to be worth it are scanned like TableScan.
+ */
+class ParallelScan : public TableScan {
+public:
+    /**
+     * Function a worker hands each batch of rows to.
+     * @param worker  which worker produced the rows
+     * @param rows    the projected rows of one block (the consumer may take them)
+     * @returns       false to stop the scan early
+     */
+    typedef std::function<bool(uint worker, ValueRows &rows)> Consumer;
+
+    /**
+     * Number of workers scans use unless told otherwise.
+     */
+    static uint default_threads;
+
+    /**
+     * @param table       relation to scan
+     * @param table_name  name (or alias) used to qualify the relation's columns
+     * @param threads     number of worker threads
+     */
+    ParallelScan(DbRelation &table, Identifier table_name, uint threads = default_threads);
+
+    /**
+     * @param table       relation to scan, held by the scan
+     * @param table_name  name (or alias) used to qualify the relation's columns
+     * @param threads     number of worker threads
+     */
+    ParallelScan(RelationRef table, Identifier table_name, uint threads = default_threads);
+
+    virtual ~ParallelScan();
+
+    /**
+     * Scan the whole relation, feeding every batch of rows to consume.
+     * @param consume  called from the worker threads, concurrently
+     * @returns        number of workers used (consume's worker argument is below this)
+     */
+    virtual uint run(const Consumer &consume);
+
+    /**
+     * Number of workers the scan would use if it started now (it grows with the relation).
+     */
+    virtual uint get_threads();
+
+    /**
+     * Most workers the scan ever uses, whatever the size of the relation: what to size state
+     * kept per worker by, since the relation may grow before run() starts.
+     */
+    uint get_max_threads() const { return threads; }
+
+    virtual std::string describe() const;
+
+protected:
+    uint threads;
+    std::vector<std::thread> workers;
+    std::unique_ptr<MorselQueue> morsels;
+    std::exception_ptr error;
+    bool serial;
+
+    // the queue of batches between the workers and next()
+    std::mutex lock;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    std::deque<ValueRows> batches;
+    uint running;
+    std::atomic<bool> stopping;
+
+    virtual void do_open();
+
+    virtual bool do_next(ValueRow &row);
+
+    virtual void do_close();
+
+    virtual void start(const Consumer &consume);
+
+    virtual void finish();
+
+    virtual void work(uint worker, DbBlockScanner *scanner, const Consumer &consume);
+};
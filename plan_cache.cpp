@@ -0,0 +1,63 @@
+/**
+ * @file plan_cache.cpp - implementation of the plan cache
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#include <algorithm>
+#include "plan_cache.h"
+
+using namespace std;
+
+// A plan built for TEXT parameters cannot take integers and vice versa (BOOLEAN and INT mix freely).
+static bool same_types(const vector<ColumnAttribute::DataType> &a, const vector<ColumnAttribute::DataType> &b) {
+    if (a.size() != b.size())
+        return false;
+    for (uint i = 0; i < a.size(); i++)
+        if ((a[i] == ColumnAttribute::TEXT) != (b[i] == ColumnAttribute::TEXT))
+            return false;
+    return true;
+}
+
+EvalPlan *PlanCache::take(const string &fingerprint, const vector<ColumnAttribute::DataType> &types,
+                          uint64_t schema_version) {
+    auto found = this->index.find(fingerprint);
+    if (found == this->index.end())
+        return nullptr;
+    Entries::iterator entry = found->second;
+    if (entry->schema_version != schema_version || !same_types(entry->types, types)) {
+        remove(fingerprint);
+        return nullptr;
+    }
+    EvalPlan *plan = entry->plan;
+    this->entries.erase(entry);
+    this->index.erase(found);
+    return plan;
+}
+
+void PlanCache::put(const string &fingerprint, EvalPlan *plan, const vector<ColumnAttribute::DataType> &types,
+                    uint64_t schema_version) {
+    remove(fingerprint);
+    this->entries.push_front(Entry{fingerprint, plan, types, schema_version});
+    this->index[fingerprint] = this->entries.begin();
+    while (this->entries.size() > max(this->capacity, 1U)) {
+        Entry &victim = this->entries.back();
+        this->index.erase(victim.fingerprint);
+        delete victim.plan;
+        this->entries.pop_back();
+    }
+}
+
+void PlanCache::remove(const string &fingerprint) {
+    auto found = this->index.find(fingerprint);
+    if (found == this->index.end())
+        return;
+    delete found->second->plan;
+    this->entries.erase(found->second);
+    this->index.erase(found);
+}
+
+void PlanCache::clear() {
+    for (auto &entry: this->entries)
+        delete entry.plan;
+    this->entries.clear();
+    this->index.clear();
+}
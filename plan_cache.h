@@ -0,0 +1,89 @@
+/**
+ * @file plan_cache.h - cache of built query plans
+ * PlanCache
+ *
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#pragma once
+
+#include <list>
+#include <unordered_map>
+#include "eval_plan.h"
+
+/**
+ * @class PlanCache - the most recently used plans, keyed by statement fingerprint.
+ *
+ * A fingerprint is the statement with the literals of its conditions replaced by parameters
+ * (see ParseTreeToString::fingerprint), so statements that differ only in those literals share
+ * a plan: the plan is built once with the first statement's values and after that just has the
+ * new values bound into it (EvalPlan::bind). A plan is only reused for parameters of the same
+ * types as it was built with, and only while the schema version it was built under is current.
+ * A plan is taken out of the cache while it runs and put back when it is done, so nothing else
+ * binds, opens or deletes it under a result that is still being read; a statement with the same
+ * fingerprint run meanwhile builds a plan of its own. Once the cache is full, adding a plan
+ * deletes the least recently used one.
+ */
+class PlanCache {
+public:
+    /**
+     * Number of plans kept by default.
+     */
+    static const uint DEFAULT_CAPACITY = 128;
+
+    explicit PlanCache(uint capacity = DEFAULT_CAPACITY) : capacity(capacity) {}
+
+    virtual ~PlanCache() { clear(); }
+
+    PlanCache(const PlanCache &other) = delete;
+
+    PlanCache &operator=(const PlanCache &other) = delete;
+
+    /**
+     * Take the plan for a fingerprint out of the cache to run it (put() it back when done).
+     * @param fingerprint     fingerprint of the statement
+     * @param types           data type of each parameter the plan will be run with
+     * @param schema_version  current schema version
+     * @returns               the plan (owned by the caller from now on), or nullptr if there is no usable one
+     */
+    virtual EvalPlan *take(const std::string &fingerprint, const std::vector<ColumnAttribute::DataType> &types,
+                           uint64_t schema_version);
+
+    /**
+     * Add a plan as the most recently used, replacing any other plan for the same fingerprint.
+     * @param fingerprint     fingerprint of the statement
+     * @param plan            the plan (owned by the cache from now on)
+     * @param types           data type of each parameter the plan was built with
+     * @param schema_version  schema version the plan was built under
+     */
+    virtual void put(const std::string &fingerprint, EvalPlan *plan,
+                     const std::vector<ColumnAttribute::DataType> &types, uint64_t schema_version);
+
+    /**
+     * Delete the plan for a fingerprint (if any).
+     */
+    virtual void remove(const std::string &fingerprint);
+
+    /**
+     * Delete all the plans.
+     */
+    virtual void clear();
+
+    /**
+     * Number of plans in the cache.
+     */
+    uint size() const { return (uint) entries.size(); }
+
+protected:
+    struct Entry {
+        std::string fingerprint;
+        EvalPlan *plan;
+        std::vector<ColumnAttribute::DataType> types;
+        uint64_t schema_version;
+    };
+
+    typedef std::list<Entry> Entries;
+
+    uint capacity;
+    Entries entries;  // most recently used first
+    std::unordered_map<std::string, Entries::iterator> index;
+};
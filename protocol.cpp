@@ -0,0 +1,229 @@
+/**
+ * @file protocol.cpp - implementation of the sql5300 server's wire protocol
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "protocol.h"
+
+using namespace std;
+
+static void put_u32(uint32_t n, string &buffer) {
+    for (int i = 0; i < 4; i++)
+        buffer += (char) ((n >> (8 * i)) & 0xff);
+}
+
+static uint32_t get_u32(const char *data) {
+    uint32_t n = 0;
+    for (int i = 3; i >= 0; i--)
+        n = (n << 8) | (unsigned char) data[i];
+    return n;
+}
+
+static bool is_port(const string &address) {
+    return !address.empty() && address.size() <= 5 && address.find_first_not_of("0123456789") == string::npos;
+}
+
+// fill in the socket address for a port on localhost or a Unix socket path
+static socklen_t socket_address(const string &address, sockaddr_storage &storage) {
+    memset(&storage, 0, sizeof(storage));
+    if (is_port(address)) {
+        unsigned long port = stoul(address);
+        if (port == 0 || port > 65535)
+            throw ProtocolError("invalid port " + address);
+        sockaddr_in *in = (sockaddr_in *) &storage;
+        in->sin_family = AF_INET;
+        in->sin_port = htons((uint16_t) port);
+        in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        return sizeof(sockaddr_in);
+    }
+    sockaddr_un *un = (sockaddr_un *) &storage;
+    if (address.empty() || address.size() >= sizeof(un->sun_path))
+        throw ProtocolError("invalid socket path " + address);
+    un->sun_family = AF_UNIX;
+    strcpy(un->sun_path, address.c_str());
+    return sizeof(sockaddr_un);
+}
+
+int listen_on(const string &address) {
+    sockaddr_storage storage;
+    socklen_t length = socket_address(address, storage);
+    int fd = socket(storage.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        throw ProtocolError(string("socket: ") + strerror(errno));
+    if (storage.ss_family == AF_INET) {
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    } else {
+        unlink(address.c_str());
+    }
+    if (bind(fd, (sockaddr *) &storage, length) < 0 || listen(fd, SOMAXCONN) < 0) {
+        string message = address + ": " + strerror(errno);
+        close(fd);
+        throw ProtocolError(message);
+    }
+    return fd;
+}
+
+void encode_request(const string &line, string &buffer) {
+    if (line.size() > MAX_FRAME)
+        throw ProtocolError("request of " + to_string(line.size()) + " bytes is too long");
+    put_u32((uint32_t) line.size(), buffer);
+    buffer += line;
+}
+
+bool request_complete(const string &buffer) {
+    if (buffer.size() < 4)
+        return false;
+    uint32_t length = get_u32(buffer.data());
+    return length > MAX_FRAME || buffer.size() >= 4 + (size_t) length;
+}
+
+bool decode_request(string &buffer, string &line) {
+    if (buffer.size() < 4)
+        return false;
+    uint32_t length = get_u32(buffer.data());
+    if (length > MAX_FRAME)
+        throw ProtocolError("request of " + to_string(length) + " bytes is too long");
+    if (buffer.size() < 4 + (size_t) length)
+        return false;
+    line.assign(buffer, 4, length);
+    buffer.erase(0, 4 + (size_t) length);
+    return true;
+}
+
+void encode_chunk(FrameKind kind, const string &bytes, string &buffer) {
+    const size_t most = MAX_FRAME - 1;
+    for (size_t at = 0; at < bytes.size(); at += most) {
+        size_t size = min(most, bytes.size() - at);
+        put_u32((uint32_t) (1 + size), buffer);
+        buffer += (char) kind;
+        buffer.append(bytes, at, size);
+    }
+}
+
+void encode_response(const Response &response, string &buffer) {
+    bool fits = 1 + 4 + response.messages.size() + response.output.size() <= MAX_FRAME;
+    if (!fits) {
+        encode_chunk(FRAME_OUTPUT, response.output, buffer);
+        encode_chunk(FRAME_MESSAGES, response.messages, buffer);
+    }
+    size_t messages = fits ? response.messages.size() : 0;
+    size_t output = fits ? response.output.size() : 0;
+    put_u32((uint32_t) (1 + 4 + messages + output), buffer);
+    buffer += (char) (response.ok ? FRAME_OK : FRAME_FAILED);
+    put_u32((uint32_t) messages, buffer);
+    buffer.append(response.messages, 0, messages);
+    buffer.append(response.output, 0, output);
+}
+
+
+/*
+ * ********************************
+ * Connection class implementation
+ * ********************************
+ */
+
+Connection::Connection(const string &address) {
+    sockaddr_storage storage;
+    socklen_t length = socket_address(address, storage);
+    this->fd = socket(storage.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (this->fd < 0)
+        throw ProtocolError(string("socket: ") + strerror(errno));
+    if (connect(this->fd, (sockaddr *) &storage, length) < 0) {
+        string message = address + ": " + strerror(errno);
+        close(this->fd);
+        throw ProtocolError(message);
+    }
+    if (storage.ss_family == AF_INET) {
+        int on = 1;
+        setsockopt(this->fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+}
+
+Connection::~Connection() {
+    close(this->fd);
+}
+
+Response Connection::request(const string &line) {
+    send(line);
+    return receive();
+}
+
+void Connection::send(const string &line) {
+    string buffer;
+    encode_request(line, buffer);
+    size_t sent = 0;
+    while (sent < buffer.size()) {
+        ssize_t n = ::send(this->fd, buffer.data() + sent, buffer.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            throw ProtocolError(string("send: ") + strerror(errno));
+        sent += (size_t) n;
+    }
+}
+
+Response Connection::receive() {
+    ostringstream output, messages;
+    Response response;
+    response.ok = receive(output, messages);
+    response.output = output.str();
+    response.messages = messages.str();
+    return response;
+}
+
+// Chunks are written out as they arrive, so a response is never held whole.
+bool Connection::receive(ostream &output, ostream &messages) {
+    string bytes;
+    for (;;) {
+        char header[9];
+        read_fully(header, 5);
+        uint32_t length = get_u32(header);
+        if (length < 1 || length > MAX_FRAME)
+            throw ProtocolError("invalid response frame of " + to_string(length) + " bytes");
+        uint8_t kind = (uint8_t) header[4];
+        if (kind == FRAME_OUTPUT || kind == FRAME_MESSAGES) {
+            bytes.resize(length - 1);
+            read_fully(&bytes[0], bytes.size());
+            (kind == FRAME_OUTPUT ? output : messages) << bytes;
+            continue;
+        }
+        if ((kind != FRAME_OK && kind != FRAME_FAILED) || length < 5)
+            throw ProtocolError("invalid response");
+        read_fully(header + 5, 4);
+        uint32_t message_bytes = get_u32(header + 5);
+        if (message_bytes > length - 5)
+            throw ProtocolError("invalid response");
+        bytes.resize(message_bytes);
+        read_fully(&bytes[0], bytes.size());
+        messages << bytes;
+        bytes.resize(length - 5 - message_bytes);
+        read_fully(&bytes[0], bytes.size());
+        output << bytes;
+        return kind == FRAME_OK;
+    }
+}
+
+void Connection::read_fully(char *data, size_t size) {
+    size_t got = 0;
+    while (got < size) {
+        ssize_t n = recv(this->fd, data + got, size - got, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            throw ProtocolError(string("recv: ") + strerror(errno));
+        if (n == 0)
+            throw ProtocolError("server closed the connection");
+        got += (size_t) n;
+    }
+}
@@ -0,0 +1,163 @@
+/**
+ * @file protocol.h - how clients talk to the sql5300 server
+ * ProtocolError
+ * Response
+ * Connection
+ *
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+
+/*
+ * A client sends lines, as typed at the sql5300 prompt, and gets a response to each, in order.
+ * Integers are little-endian.
+ *
+ * request:   u32 length of the line, then the line
+ * response:  any number of chunks, then the end frame
+ * chunk:     u32 length of the rest, u8 2 for a piece of the output or 3 for a piece of the
+ *            messages, then the piece
+ * end:       u32 length of the rest, u8 status (0 if everything in the line succeeded, 1 if
+ *            something failed), u32 length of the messages, the messages, then the output
+ *
+ * The output is what the shell printed to stdout: the query results in the session's output
+ * format, and in the table format its messages and errors too. The messages are what it printed
+ * to stderr (in the other formats). Each is its chunks followed by what is in the end frame: the
+ * server sends them in chunks as the shell prints them, so a big result is never held whole, and
+ * no frame is longer than MAX_FRAME. A client may send several lines without waiting for their
+ * responses.
+ */
+
+/**
+ * @class ProtocolError - a connection or a frame went wrong
+ */
+class ProtocolError : public std::runtime_error {
+public:
+    explicit ProtocolError(std::string s) : runtime_error(s) {}
+};
+
+/**
+ * Longest frame accepted: a longer request closes the connection, a longer response is an error.
+ */
+const uint32_t MAX_FRAME = 64 * 1024 * 1024;
+
+/**
+ * Output (or messages) the server gathers before sending them on as a chunk.
+ */
+const uint32_t CHUNK_BYTES = 64 * 1024;
+
+/**
+ * Kinds of response frame, in the byte after the length.
+ */
+enum FrameKind : uint8_t {
+    FRAME_OK = 0,
+    FRAME_FAILED = 1,
+    FRAME_OUTPUT = 2,
+    FRAME_MESSAGES = 3
+};
+
+/**
+ * The server's answer to a line.
+ */
+struct Response {
+    bool ok;
+    std::string messages;
+    std::string output;
+};
+
+/**
+ * Open a socket listening for clients.
+ * @param address  a port number for a TCP port on localhost, otherwise the path of a Unix
+ *                 domain socket (replacing any file already there)
+ * @returns        the socket, non-blocking
+ * @throws ProtocolError
+ */
+int listen_on(const std::string &address);
+
+/**
+ * Add a request for a line to a buffer being sent.
+ * @throws ProtocolError  if the line is longer than MAX_FRAME
+ */
+void encode_request(const std::string &line, std::string &buffer);
+
+/**
+ * Whether the bytes received so far start with a whole request (or one too long to accept).
+ */
+bool request_complete(const std::string &buffer);
+
+/**
+ * Take the first request out of the bytes received so far, if all of it has arrived.
+ * @param buffer  bytes received
+ * @param line    returned by reference: the request's line
+ * @returns       false if the request is incomplete
+ * @throws ProtocolError  if it is longer than MAX_FRAME
+ */
+bool decode_request(std::string &buffer, std::string &line);
+
+/**
+ * Add chunks of a response's output or messages to a buffer being sent.
+ * @param kind    FRAME_OUTPUT or FRAME_MESSAGES
+ * @param bytes   the piece of output or messages (split over as many chunks as it takes)
+ * @param buffer  the buffer
+ */
+void encode_chunk(FrameKind kind, const std::string &bytes, std::string &buffer);
+
+/**
+ * Add the end of a response to a buffer being sent, preceded by chunks if it is too long for one frame.
+ */
+void encode_response(const Response &response, std::string &buffer);
+
+
+/**
+ * @class Connection - a client's connection to the server. Calls wait for the server.
+ */
+class Connection {
+public:
+    /**
+     * @param address  the server's address, as given to listen_on
+     * @throws ProtocolError
+     */
+    explicit Connection(const std::string &address);
+
+    virtual ~Connection();
+
+    Connection(const Connection &other) = delete;
+
+    Connection &operator=(const Connection &other) = delete;
+
+    /**
+     * Send a line and wait for the response to it.
+     * @throws ProtocolError  if the server has gone away
+     */
+    virtual Response request(const std::string &line);
+
+    /**
+     * Send a line without waiting (see receive).
+     */
+    virtual void send(const std::string &line);
+
+    /**
+     * Wait for the response to the oldest line sent but not yet answered.
+     * @throws ProtocolError  if the server has gone away or sent a frame longer than MAX_FRAME
+     */
+    virtual Response receive();
+
+    /**
+     * Wait for the response to the oldest line sent but not yet answered, writing its output and
+     * messages as their chunks arrive.
+     * @param output    where the output goes
+     * @param messages  where the messages go
+     * @returns         whether everything in the line succeeded
+     * @throws ProtocolError  if the server has gone away or sent a frame longer than MAX_FRAME
+     */
+    virtual bool receive(std::ostream &output, std::ostream &messages);
+
+protected:
+    int fd;
+
+    void read_fully(char *data, size_t size);
+};
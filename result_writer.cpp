@@ -0,0 +1,222 @@
+/**
+ * @file result_writer.cpp - implementation of the result writers
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#include <algorithm>
+#include "result_writer.h"
+
+using namespace std;
+
+/*
+ * *********************************
+ * ResultWriter class implementation
+ * *********************************
+ */
+
+ResultWriter *ResultWriter::create(Format format, ostream &out) {
+    switch (format) {
+        case CSV:
+            return new DelimitedWriter(out, ',');
+        case TSV:
+            return new DelimitedWriter(out, '\t');
+        case BINARY:
+            return new BinaryWriter(out);
+        default:
+            return new TableWriter(out);
+    }
+}
+
+bool ResultWriter::get_format(const string &name, Format &format) {
+    string lower = name;
+    transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    if (lower == "table")
+        format = TABLE;
+    else if (lower == "csv")
+        format = CSV;
+    else if (lower == "tsv")
+        format = TSV;
+    else if (lower == "binary")
+        format = BINARY;
+    else
+        return false;
+    return true;
+}
+
+void ResultWriter::end(const string &message) {
+    this->buffer.flush();
+}
+
+
+/*
+ * ********************************
+ * TableWriter class implementation
+ * ********************************
+ */
+
+void TableWriter::begin(const ColumnNames &column_names, const ColumnAttributes &column_attributes) {
+    for (auto const &column_name: column_names) {
+        this->buffer.append(column_name);
+        this->buffer.put(' ');
+    }
+    this->buffer.append("\n+");
+    for (uint i = 0; i < column_names.size(); i++)
+        this->buffer.append("----------+");
+    this->buffer.put('\n');
+}
+
+void TableWriter::row(const ValueRow &row) {
+    for (auto const &value: row) {
+        switch (value.data_type) {
+            case ColumnAttribute::INT:
+                this->buffer.append_integer(value.n);
+                break;
+            case ColumnAttribute::TEXT:
+                this->buffer.put('"');
+                this->buffer.append(value.s);
+                this->buffer.put('"');
+                break;
+            case ColumnAttribute::BOOLEAN:
+                this->buffer.append(value.n == 0 ? "false" : "true");
+                break;
+            default:
+                this->buffer.append("???");
+        }
+        this->buffer.put(' ');
+    }
+    this->buffer.put('\n');
+}
+
+void TableWriter::end(const string &message) {
+    this->buffer.append(message);
+    this->buffer.flush();
+}
+
+
+/*
+ * ************************************
+ * DelimitedWriter class implementation
+ * ************************************
+ */
+
+void DelimitedWriter::begin(const ColumnNames &column_names, const ColumnAttributes &column_attributes) {
+    if (!this->header)
+        return;
+    for (uint i = 0; i < column_names.size(); i++) {
+        if (i > 0)
+            this->buffer.put(this->delimiter);
+        text(column_names[i]);
+    }
+    this->buffer.put('\n');
+}
+
+void DelimitedWriter::row(const ValueRow &row) {
+    for (uint i = 0; i < row.size(); i++) {
+        if (i > 0)
+            this->buffer.put(this->delimiter);
+        const Value &value = row[i];
+        switch (value.data_type) {
+            case ColumnAttribute::TEXT:
+                text(value.s);
+                break;
+            case ColumnAttribute::BOOLEAN:
+                this->buffer.append(value.n == 0 ? "false" : "true");
+                break;
+            default:
+                this->buffer.append_integer(value.n);
+        }
+    }
+    this->buffer.put('\n');
+}
+
+void DelimitedWriter::text(const string &text) {
+    if (this->delimiter == ',') {
+        if (text.find_first_of(",\"\r\n") == string::npos) {
+            this->buffer.append(text);
+            return;
+        }
+        this->buffer.put('"');
+        for (char c: text) {
+            if (c == '"')
+                this->buffer.put('"');
+            this->buffer.put(c);
+        }
+        this->buffer.put('"');
+        return;
+    }
+    size_t done = 0;
+    for (size_t i = text.find_first_of("\t\r\n\\"); i != string::npos; i = text.find_first_of("\t\r\n\\", done)) {
+        this->buffer.append(text.data() + done, i - done);
+        this->buffer.put('\\');
+        this->buffer.put(text[i] == '\t' ? 't' : text[i] == '\r' ? 'r' : text[i] == '\n' ? 'n' : '\\');
+        done = i + 1;
+    }
+    this->buffer.append(text.data() + done, text.size() - done);
+}
+
+
+/*
+ * *********************************
+ * BinaryWriter class implementation
+ * *********************************
+ */
+
+static void put_uint16(string &bytes, uint16_t n) {
+    bytes += (char) (n & 0xFF);
+    bytes += (char) (n >> 8);
+}
+
+static void put_uint32(string &bytes, uint32_t n) {
+    for (int shift = 0; shift < 32; shift += 8)
+        bytes += (char) ((n >> shift) & 0xFF);
+}
+
+void BinaryWriter::begin(const ColumnNames &column_names, const ColumnAttributes &column_attributes) {
+    this->types.clear();
+    this->bytes = "K5RB";
+    put_uint16(this->bytes, 1);
+    put_uint16(this->bytes, (uint16_t) column_names.size());
+    for (uint i = 0; i < column_names.size(); i++) {
+        ColumnAttribute attribute = i < column_attributes.size() ? column_attributes[i] : ColumnAttribute::TEXT;
+        this->types.push_back(attribute.get_data_type());
+        this->bytes += (char) this->types.back();
+        put_uint16(this->bytes, (uint16_t) column_names[i].size());
+        this->bytes += column_names[i];
+    }
+    this->buffer.append(this->bytes);
+}
+
+// Values are written as their column's type says, so readers can rely on the header.
+void BinaryWriter::row(const ValueRow &row) {
+    this->bytes.assign(4, '\0');  // room for the length
+    for (uint i = 0; i < this->types.size(); i++) {
+        const Value &value = row[i];
+        switch (this->types[i]) {
+            case ColumnAttribute::TEXT:
+                if (value.data_type == ColumnAttribute::TEXT) {
+                    put_uint32(this->bytes, (uint32_t) value.s.size());
+                    this->bytes += value.s;
+                } else {
+                    string text = to_string(value.n);
+                    put_uint32(this->bytes, (uint32_t) text.size());
+                    this->bytes += text;
+                }
+                break;
+            case ColumnAttribute::BOOLEAN:
+                this->bytes += (char) (value.n != 0);
+                break;
+            default:
+                put_uint32(this->bytes, (uint32_t) value.n);
+        }
+    }
+    uint32_t length = (uint32_t) this->bytes.size() - 4;
+    for (int i = 0; i < 4; i++)
+        this->bytes[i] = (char) ((length >> (8 * i)) & 0xFF);
+    this->buffer.append(this->bytes);
+}
+
+void BinaryWriter::end(const string &message) {
+    this->bytes.clear();
+    put_uint32(this->bytes, END);
+    this->buffer.append(this->bytes);
+    this->buffer.flush();
+}
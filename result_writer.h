@@ -0,0 +1,137 @@
+/**
+ * @file result_writer.h - printing query results in the shell's output formats
+ * ResultWriter
+ * TableWriter
+ * DelimitedWriter
+ * BinaryWriter
+ *
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#pragma once
+
+#include "eval_plan.h"
+#include "output_buffer.h"
+
+/**
+ * @class ResultWriter - abstract base class for writing the columns and rows of a result to a stream.
+ *
+ * A writer is given the result's columns, then its rows one at a time (so a streamed result is
+ * written as it is read), then its message. Output is collected in an OutputBuffer, so the stream
+ * sees large writes, and integers are formatted without iostreams.
+ */
+class ResultWriter {
+public:
+    enum Format {
+        TABLE, CSV, TSV, BINARY
+    };
+
+    /**
+     * Make a writer for a format.
+     * @param format  output format
+     * @param out     stream to write to
+     * @returns       the writer (freed by caller)
+     */
+    static ResultWriter *create(Format format, std::ostream &out);
+
+    /**
+     * Look up a format by its name: table, csv, tsv or binary (in any case).
+     * @param name    the name
+     * @param format  returned by reference: the format
+     * @returns       false if there is no such format
+     */
+    static bool get_format(const std::string &name, Format &format);
+
+    explicit ResultWriter(std::ostream &out) : buffer(out) {}
+
+    virtual ~ResultWriter() {}
+
+    ResultWriter(const ResultWriter &other) = delete;
+
+    ResultWriter &operator=(const ResultWriter &other) = delete;
+
+    virtual void begin(const ColumnNames &column_names, const ColumnAttributes &column_attributes) = 0;
+
+    virtual void row(const ValueRow &row) = 0;
+
+    /**
+     * Finish the result, writing out everything buffered.
+     * @param message  the result's message (only the table format shows it)
+     */
+    virtual void end(const std::string &message);
+
+protected:
+    OutputBuffer buffer;
+};
+
+
+/**
+ * @class TableWriter - the shell's traditional format, for people: a header, quoted strings and the message.
+ */
+class TableWriter : public ResultWriter {
+public:
+    explicit TableWriter(std::ostream &out) : ResultWriter(out) {}
+
+    void begin(const ColumnNames &column_names, const ColumnAttributes &column_attributes) override;
+
+    void row(const ValueRow &row) override;
+
+    void end(const std::string &message) override;
+};
+
+
+/**
+ * @class DelimitedWriter - one line of column names (unless left out), then one line per row.
+ *
+ * CSV (RFC 4180) quotes a text value only if it holds a comma, a quote or a line break, doubling
+ * its quotes. TSV never quotes; tabs, line breaks and backslashes in text are escaped as \t, \n, \r
+ * and \\.
+ */
+class DelimitedWriter : public ResultWriter {
+public:
+    /**
+     * @param out        stream to write to
+     * @param delimiter  ',' for CSV or '\t' for TSV
+     * @param header     whether to write the line of column names
+     */
+    DelimitedWriter(std::ostream &out, char delimiter, bool header = true)
+            : ResultWriter(out), delimiter(delimiter), header(header) {}
+
+    void begin(const ColumnNames &column_names, const ColumnAttributes &column_attributes) override;
+
+    void row(const ValueRow &row) override;
+
+protected:
+    char delimiter;
+    bool header;
+
+    void text(const std::string &text);
+};
+
+
+/**
+ * @class BinaryWriter - length-prefixed rows after a schema header, for programs.
+ *
+ * All integers are little-endian.
+ *   header:  "K5RB", uint16 version (1), uint16 number of columns,
+ *            then per column: uint8 data type (0 INT, 1 TEXT, 2 BOOLEAN), uint16 name length, name
+ *   row:     uint32 length of what follows, then per column in its header type:
+ *            INT int32, BOOLEAN uint8 (0 or 1), TEXT uint32 length and bytes
+ *   end:     uint32 0xFFFFFFFF
+ * Several results written to the same stream simply follow each other.
+ */
+class BinaryWriter : public ResultWriter {
+public:
+    static const uint32_t END = 0xFFFFFFFF;
+
+    explicit BinaryWriter(std::ostream &out) : ResultWriter(out) {}
+
+    void begin(const ColumnNames &column_names, const ColumnAttributes &column_attributes) override;
+
+    void row(const ValueRow &row) override;
+
+    void end(const std::string &message) override;
+
+protected:
+    std::vector<ColumnAttribute::DataType> types;
+    std::string bytes;  // the row being encoded, reused
+};
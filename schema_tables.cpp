@@ -5,6 +5,8 @@
  */
 #include "schema_tables.h"
 #include "ParseTreeToString.h"
+#include "counters.h"
+#include "trace.h"
 
 
 void initialize_schema_tables() {
@@ -17,6 +19,9 @@ void initialize_schema_tables() {
     Indices indices;
     indices.create_if_not_exists();
     indices.close();
+    Statistics statistics;
+    statistics.create_if_not_exists();
+    statistics.close();
 }
 
 // Not terribly useful since the parser weeds most of these out
@@ -47,7 +52,7 @@ bool is_acceptable_data_type(std::string dt) {
  */
 const Identifier Tables::TABLE_NAME = "_tables";
 Columns *Tables::columns_table = nullptr;
-std::map<Identifier, DbRelation *> Tables::table_cache;
+CatalogCache<Identifier, DbRelation> Tables::table_cache;
 
 // get the column name for _tables column
 ColumnNames &Tables::COLUMN_NAMES() {
@@ -68,11 +73,12 @@ ColumnAttributes &Tables::COLUMN_ATTRIBUTES() {
 }
 
 // ctor - we have a fixed table structure of just one column: table_name
+// (the cache does not own the schema tables)
 Tables::Tables() : HeapTable(TABLE_NAME, COLUMN_NAMES(), COLUMN_ATTRIBUTES()) {
-    Tables::table_cache[TABLE_NAME] = this;
+    Tables::table_cache.put(TABLE_NAME, RelationRef(this, [](DbRelation *) {}));
     if (Tables::columns_table == nullptr)
         columns_table = new Columns();
-    Tables::table_cache[columns_table->TABLE_NAME] = columns_table;
+    Tables::table_cache.put(columns_table->TABLE_NAME, RelationRef(columns_table, [](DbRelation *) {}));
 }
 
 // Create the file and also, manually add schema tables.
@@ -85,6 +91,8 @@ void Tables::create() {
     insert(&row);
     row["table_name"] = Value("_indices");
     insert(&row);
+    row["table_name"] = Value("_statistics");
+    insert(&row);
 }
 
 // Manually check that table_name is unique.
@@ -99,22 +107,21 @@ Handle Tables::insert(const ValueDict *row) {
 }
 
 // Remove a row, but first remove from table cache if there
-// NOTE: once the row is deleted, any reference to the table (from get_table() below) is gone! So drop the table first.
+// NOTE: the table object (from get_table() below) is freed once the last reference to it is released, so drop the
+// table first.
 void Tables::del(Handle handle) {
     // remove from cache, if there
     ValueDict *row = project(handle);
     Identifier table_name = row->at("table_name").s;
-    if (Tables::table_cache.find(table_name) != Tables::table_cache.end()) {
-        DbRelation *table = Tables::table_cache.at(table_name);
-        Tables::table_cache.erase(table_name);
-        delete table;
-    }
+    delete row;
+    Tables::table_cache.erase(table_name);
 
     HeapTable::del(handle);
 }
 
 // Return a list of column names and column attributes for given table.
 void Tables::get_columns(Identifier table_name, ColumnNames &column_names, ColumnAttributes &column_attributes) {
+    Trace::Span span("get_columns", "catalog");
     // SELECT * FROM _columns WHERE table_name = <table_name>
     ValueDict where;
     where["table_name"] = table_name;
@@ -146,18 +153,21 @@ void Tables::get_columns(Identifier table_name, ColumnNames &column_names, Colum
 }
 
 // Return a table for given table_name.
-DbRelation &Tables::get_table(Identifier table_name) {
+RelationRef Tables::get_table(Identifier table_name) {
     // if they are asking about a table we've once constructed, then just return that one
-    if (Tables::table_cache.find(table_name) != Tables::table_cache.end())
-        return *Tables::table_cache[table_name];
+    RelationRef table = Tables::table_cache.find(table_name);
+    if (table)
+        return table;
 
-    // otherwise assume it is a HeapTable (for now)
+    // otherwise assume it is a HeapTable (for now); if another thread got there first, use its one
+    uint64_t generation = Tables::table_cache.get_generation();
     ColumnNames column_names;
     ColumnAttributes column_attributes;
     get_columns(table_name, column_names, column_attributes);
-    DbRelation *table = new HeapTable(table_name, column_names, column_attributes);
-    Tables::table_cache[table_name] = table;
-    return *table;
+    table = RelationRef(new HeapTable(table_name, column_names, column_attributes));
+    if (column_names.empty())
+        return table;  // no such table (yet): don't cache it, or creating it would find this one
+    return Tables::table_cache.insert(table_name, table, generation);
 }
 
 
@@ -227,6 +237,23 @@ void Columns::create() {
     row["column_name"] = Value("is_unique");
     row["data_type"] = Value("BOOLEAN");
     insert(&row);
+
+    row["table_name"] = Value("_statistics");
+    row["data_type"] = Value("TEXT");
+    for (auto const &column_name: {"table_name", "column_name"}) {
+        row["column_name"] = Value(column_name);
+        insert(&row);
+    }
+    row["data_type"] = Value("INT");
+    for (auto const &column_name: {"row_count", "page_count", "row_width", "distinct_count"}) {
+        row["column_name"] = Value(column_name);
+        insert(&row);
+    }
+    row["data_type"] = Value("TEXT");
+    for (auto const &column_name: {"min_value", "max_value", "histogram"}) {
+        row["column_name"] = Value(column_name);
+        insert(&row);
+    }
 }
 
 // Manually check that (table_name, column_name) is unique.
@@ -259,7 +286,7 @@ Handle Columns::insert(const ValueDict *row) {
  * ****************************
  */
 const Identifier Indices::TABLE_NAME = "_indices";
-std::map<std::pair<Identifier, Identifier>, DbIndex *> Indices::index_cache;
+CatalogCache<std::pair<Identifier, Identifier>, DbIndex> Indices::index_cache;
 
 // get the column name for _indices column
 ColumnNames &Indices::COLUMN_NAMES() {
@@ -320,18 +347,15 @@ Handle Indices::insert(const ValueDict *row) {
 }
 
 // Remove a row, but first remove from index cache if there
-// NOTE: once the row is deleted, any reference to the index (from get_index() below) is gone! So drop the index
+// NOTE: the index object (from get_index() below) is freed once the last reference to it is released, so drop the
+// index first
 void Indices::del(Handle handle) {
     // remove from cache, if there
     ValueDict *row = project(handle);
     Identifier table_name = row->at("table_name").s;
     Identifier index_name = row->at("index_name").s;
-    std::pair<Identifier, Identifier> cache_key(table_name, index_name);
-    if (Indices::index_cache.find(cache_key) != Indices::index_cache.end()) {
-        DbIndex *index = Indices::index_cache.at(cache_key);
-        Indices::index_cache.erase(cache_key);
-        delete index;
-    }
+    delete row;
+    Indices::index_cache.erase(std::pair<Identifier, Identifier>(table_name, index_name));
     HeapTable::del(handle);
 }
 
@@ -376,34 +400,40 @@ public:
 
     void close() {}
 
-    Handles *lookup(ValueDict *key_values) const { return nullptr; }
+    Handles *lookup(ValueDict *key_values) const {
+        Counters::add(Counters::INDEX_LOOKUPS);
+        return nullptr;
+    }
 
-    void insert(Handle handle) {}
+    void insert(Handle handle) { Counters::add(Counters::INDEX_INSERTS); }
 
-    void del(Handle handle) {}
+    void del(Handle handle) { Counters::add(Counters::INDEX_DELETES); }
 };
 
 
 // Return a table for given table_name.
-DbIndex &Indices::get_index(Identifier table_name, Identifier index_name) {
+IndexRef Indices::get_index(Identifier table_name, Identifier index_name) {
     // if they are asking about an index we've once constructed, then just return that one
     std::pair<Identifier, Identifier> cache_key(table_name, index_name);
-    if (Indices::index_cache.find(cache_key) != Indices::index_cache.end())
-        return *Indices::index_cache[cache_key];
+    IndexRef cached = Indices::index_cache.find(cache_key);
+    if (cached)
+        return cached;
 
     // otherwise assume it is a DummyIndex (for now)
+    uint64_t generation = Indices::index_cache.get_generation();
     ColumnNames column_names;
     bool is_hash, is_unique;
     get_columns(table_name, index_name, column_names, is_hash, is_unique);
-    DbRelation &table = Tables::get_table(table_name);
+    RelationRef table = Tables::get_table(table_name);
     DbIndex *index;
     if (is_hash) {
-        index = new DummyIndex(table, index_name, column_names, is_unique);  // FIXME - change to HashIndex
+        index = new DummyIndex(*table, index_name, column_names, is_unique);  // FIXME - change to HashIndex
     } else {
-        index = new DummyIndex(table, index_name, column_names, is_unique);  // FIXME - change to BTreeIndex
+        index = new DummyIndex(*table, index_name, column_names, is_unique);  // FIXME - change to BTreeIndex
     }
-    Indices::index_cache[cache_key] = index;
-    return *index;
+    // the index refers to its table, so it holds on to it until it is freed
+    return Indices::index_cache.insert(cache_key, IndexRef(index, [table](DbIndex *index) { delete index; }),
+                                       generation);
 }
 
 IndexNames Indices::get_index_names(Identifier table_name) {
@@ -419,4 +449,128 @@ IndexNames Indices::get_index_names(Identifier table_name) {
     }
     delete handles;
     return ret;
-}
\ No newline at end of file
+}
+
+/*
+ * *******************************
+ * Statistics class implementation
+ * *******************************
+ */
+const Identifier Statistics::TABLE_NAME = "_statistics";
+std::map<Identifier, StatisticsRef> Statistics::statistics_cache;
+std::mutex Statistics::statistics_lock;
+
+// get the column name for _statistics column
+ColumnNames &Statistics::COLUMN_NAMES() {
+    static ColumnNames cn;
+    if (cn.empty()) {
+        cn.push_back("table_name");
+        cn.push_back("column_name");
+        cn.push_back("row_count");
+        cn.push_back("page_count");
+        cn.push_back("row_width");
+        cn.push_back("distinct_count");
+        cn.push_back("min_value");
+        cn.push_back("max_value");
+        cn.push_back("histogram");
+    }
+    return cn;
+}
+
+// get the column attribute for _statistics column
+ColumnAttributes &Statistics::COLUMN_ATTRIBUTES() {
+    static ColumnAttributes cas;
+    if (cas.empty()) {
+        ColumnAttribute ca(ColumnAttribute::TEXT);
+        cas.push_back(ca);  // table_name
+        cas.push_back(ca);  // column_name
+        ca.set_data_type(ColumnAttribute::INT);
+        cas.push_back(ca);  // row_count
+        cas.push_back(ca);  // page_count
+        cas.push_back(ca);  // row_width
+        cas.push_back(ca);  // distinct_count
+        ca.set_data_type(ColumnAttribute::TEXT);
+        cas.push_back(ca);  // min_value
+        cas.push_back(ca);  // max_value
+        cas.push_back(ca);  // histogram
+    }
+    return cas;
+}
+
+// ctor - we have a fixed table structure
+Statistics::Statistics() : HeapTable(TABLE_NAME, COLUMN_NAMES(), COLUMN_ATTRIBUTES()) {
+}
+
+// counts are stored as INT, so big ones are capped
+static Value count_value(uint64_t count) {
+    return Value((int32_t) std::min<uint64_t>(count, INT32_MAX));
+}
+
+// how a histogram bound reads in min_value and max_value
+static Value readable(const Value &value) {
+    return Value(value.data_type == ColumnAttribute::TEXT ? value.s : std::to_string(value.n));
+}
+
+// SELECT * FROM _statistics WHERE table_name = <table_name>, remembered until the table is analyzed again or dropped
+StatisticsRef Statistics::get_statistics(Identifier table_name) {
+    std::lock_guard<std::mutex> guard(Statistics::statistics_lock);
+    if (Statistics::statistics_cache.find(table_name) != Statistics::statistics_cache.end())
+        return Statistics::statistics_cache[table_name];
+
+    ValueDict where;
+    where["table_name"] = Value(table_name);
+    Handles *handles = select(&where);
+    TableStatistics *statistics = nullptr;
+    for (auto const &handle: *handles) {
+        ValueDict *row = project(handle);
+        if (statistics == nullptr)
+            statistics = new TableStatistics();
+        statistics->rows = (uint64_t) (*row)["row_count"].n;
+        statistics->pages = (uint64_t) (*row)["page_count"].n;
+        statistics->row_width = (uint64_t) (*row)["row_width"].n;
+        ColumnStatistics &column = statistics->columns[(*row)["column_name"].s];
+        column.distinct = (uint64_t) (*row)["distinct_count"].n;
+        decode_row((*row)["histogram"].s, column.bounds);
+        delete row;
+    }
+    delete handles;
+    StatisticsRef ref(statistics);
+    Statistics::statistics_cache[table_name] = ref;
+    return ref;
+}
+
+// Replace any rows for the table with a row per column.
+void Statistics::put_statistics(Identifier table_name, const TableStatistics &statistics) {
+    del_statistics(table_name);
+    ValueDict row;
+    row["table_name"] = Value(table_name);
+    row["row_count"] = count_value(statistics.rows);
+    row["page_count"] = count_value(statistics.pages);
+    row["row_width"] = count_value(statistics.row_width);
+    for (auto const &column: statistics.columns) {
+        row["column_name"] = Value(column.first);
+        row["distinct_count"] = count_value(column.second.distinct);
+        const ValueRow &bounds = column.second.bounds;
+        row["min_value"] = bounds.empty() ? Value("") : readable(bounds.front());
+        row["max_value"] = bounds.empty() ? Value("") : readable(bounds.back());
+        std::string histogram;
+        encode_row(bounds, histogram);
+        row["histogram"] = Value(histogram);
+        insert(&row);
+    }
+    std::lock_guard<std::mutex> guard(Statistics::statistics_lock);
+    Statistics::statistics_cache[table_name] = StatisticsRef(new TableStatistics(statistics));
+}
+
+void Statistics::del_statistics(Identifier table_name) {
+    {
+        std::lock_guard<std::mutex> guard(Statistics::statistics_lock);
+        Statistics::statistics_cache.erase(table_name);
+    }
+    ValueDict where;
+    where["table_name"] = Value(table_name);
+    Handles *handles = select(&where);
+    for (auto const &handle: *handles)
+        del(handle);
+    delete handles;
+}
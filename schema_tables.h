@@ -2,12 +2,16 @@
  * @file schema_tables.h - schema table classes:
  * 		Columns
  * 		Tables
+ * 		Indices
+ * 		Statistics
  * @author Kevin Lundeen
  * @see "Seattle University, CPSC5300, Spring 2020"
  */
 #pragma once
 
+#include "catalog_cache.h"
 #include "heap_storage.h"
+#include "statistics.h"
 
 /**
  * Initialize access to the schema tables.
@@ -54,11 +58,13 @@ public:
     static void get_columns(Identifier table_name, ColumnNames &column_names, ColumnAttributes &column_attributes);
 
     /**
-     * Get the correctly instantiated DbRelation for a given table.
+     * Get the correctly instantiated DbRelation for a given table. Any number of threads may
+     * look tables up at once, without locking (see CatalogCache).
      * @param table_name  table to get
-     * @returns           instantiated DbRelation of the correct type
+     * @returns           instantiated DbRelation of the correct type, good for as long as it is
+     *                    held (even if the table is dropped meanwhile)
      */
-    static DbRelation &get_table(Identifier table_name);
+    static RelationRef get_table(Identifier table_name);
 
 protected:
     // hard-coded columns for _tables table
@@ -71,7 +77,7 @@ protected:
 
 private:
     // keep a cache of all the tables we've instantiated so far
-    static std::map<Identifier, DbRelation *> table_cache;
+    static CatalogCache<Identifier, DbRelation> table_cache;
 };
 
 
@@ -131,12 +137,12 @@ public:
                              bool &is_unique);
 
     /**
-     * Get the instantiated DbIndex for the given index.
+     * Get the instantiated DbIndex for the given index, looked up as tables are (see get_table).
      * @param table_name  what table the requested index is on
      * @param index_name  name of index (unique by table)
-     * @returns           DbIndex for requested index
+     * @returns           DbIndex for requested index, holding on to its table
      */
-    virtual DbIndex &get_index(Identifier table_name, Identifier index_name);
+    virtual IndexRef get_index(Identifier table_name, Identifier index_name);
 
     /**
      * Get the list of indices on a given table.
@@ -156,5 +162,58 @@ protected:
     static ColumnAttributes &COLUMN_ATTRIBUTES();
 
 private:
-    static std::map<std::pair<Identifier, Identifier>, DbIndex *> index_cache;
+    static CatalogCache<std::pair<Identifier, Identifier>, DbIndex> index_cache;
+};
+
+
+typedef std::shared_ptr<const TableStatistics> StatisticsRef;
+
+/**
+ * @class Statistics - The singleton table holding what ANALYZE found out about each table.
+ * There is a row per column of an analyzed table, with the table's row count, page count and
+ * average row width repeated in each, then the column's distinct count, its min and max (as
+ * text, for people to read) and its histogram bounds (encoded with encode_row, for the planner).
+ */
+class Statistics : public HeapTable {
+public:
+    /**
+     * Name of the statistics table ("_statistics")
+     */
+    static const Identifier TABLE_NAME;
+
+    // ctor/dtor
+    Statistics();
+
+    virtual ~Statistics() {}
+
+    /**
+     * Get the statistics gathered for a table.
+     * @param table_name  table to look up
+     * @returns           its statistics (good for as long as they are held, even if the table is
+     *                    analyzed again meanwhile), or null if it has never been analyzed
+     */
+    virtual StatisticsRef get_statistics(Identifier table_name);
+
+    /**
+     * Replace the statistics of a table.
+     * @param table_name  table the statistics are for
+     * @param statistics  what ANALYZE found
+     */
+    virtual void put_statistics(Identifier table_name, const TableStatistics &statistics);
+
+    /**
+     * Forget the statistics of a table (when it is dropped).
+     * @param table_name  table to forget
+     */
+    virtual void del_statistics(Identifier table_name);
+
+protected:
+    static ColumnNames &COLUMN_NAMES();
+
+    static ColumnAttributes &COLUMN_ATTRIBUTES();
+
+private:
+    // tables looked up so far (null for tables that have not been analyzed)
+    static std::map<Identifier, StatisticsRef> statistics_cache;
+    static std::mutex statistics_lock;
 };
@@ -0,0 +1,254 @@
+/**
+ * @file server.cpp - implementation of the sql5300 server
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "server.h"
+
+using namespace std;
+
+/*
+ * ****************************
+ * Server class implementation
+ * ****************************
+ */
+
+uint Server::default_workers() {
+    return max(1u, thread::hardware_concurrency());
+}
+
+Server::Server(const string &address, uint workers)
+        : address(address), listener(-1), epoll(-1), wakeup(-1), workers(max(1u, workers)), stopping(false),
+          connections(0), requests(0) {
+    this->listener = listen_on(address);
+    this->epoll = epoll_create1(EPOLL_CLOEXEC);
+    this->wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (this->epoll < 0 || this->wakeup < 0)
+        throw ProtocolError(string("epoll: ") + strerror(errno));
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = &this->listener;
+    epoll_ctl(this->epoll, EPOLL_CTL_ADD, this->listener, &event);
+    event.data.ptr = &this->wakeup;
+    epoll_ctl(this->epoll, EPOLL_CTL_ADD, this->wakeup, &event);
+}
+
+Server::~Server() {
+    for (Client *client : this->clients) {
+        close(client->fd);
+        delete client;
+    }
+    close(this->listener);
+    close(this->epoll);
+    close(this->wakeup);
+    if (this->address.find_first_not_of("0123456789") != string::npos)
+        unlink(this->address.c_str());  // the Unix socket
+}
+
+void Server::run() {
+    for (uint i = 0; i < this->workers; i++)
+        this->threads.emplace_back(&Server::work, this);
+
+    const int MAX_EVENTS = 64;
+    epoll_event events[MAX_EVENTS];
+    bool running = true;
+    while (running) {
+        int n = epoll_wait(this->epoll, events, MAX_EVENTS, -1);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            break;
+        for (int i = 0; i < n; i++) {
+            void *source = events[i].data.ptr;
+            if (source == &this->wakeup) {
+                running = false;
+            } else if (source == &this->listener) {
+                accept_clients();
+            } else {
+                Client *client = (Client *) source;
+                client->lock.lock();  // its last worker may not have let go of it quite yet
+                if (!client->pending.empty()) {
+                    // there is room for more of the responses its worker left behind
+                    bool open = send_pending(client, false);
+                    client->lock.unlock();
+                    if (open)
+                        watch(client);
+                    else
+                        close_client(client);
+                    continue;
+                }
+                bool open = receive(client);
+                client->lock.unlock();
+                if (!open) {
+                    close_client(client);
+                    continue;
+                }
+                if (!request_complete(client->input)) {
+                    watch(client);
+                    continue;
+                }
+                {
+                    lock_guard<mutex> guard(this->queue_lock);
+                    this->queue.push_back(client);
+                }
+                this->queue_changed.notify_one();
+            }
+        }
+    }
+
+    {
+        lock_guard<mutex> guard(this->queue_lock);
+        this->stopping = true;
+    }
+    this->queue_changed.notify_all();
+    for (auto &thread : this->threads)
+        thread.join();
+    this->threads.clear();
+}
+
+void Server::stop() {
+    uint64_t one = 1;
+    ssize_t written = write(this->wakeup, &one, sizeof(one));
+    (void) written;
+}
+
+void Server::accept_clients() {
+    for (;;) {
+        int fd = accept4(this->listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;  // none left waiting (or out of descriptors: the rest wait for the next event)
+        Client *client = new Client(fd);
+        this->clients.insert(client);
+        this->connections++;
+        watch(client, true);
+    }
+}
+
+bool Server::receive(Client *client) {
+    char buffer[64 * 1024];
+    for (;;) {
+        ssize_t n = recv(client->fd, buffer, sizeof(buffer), 0);
+        if (n > 0) {
+            client->input.append(buffer, (size_t) n);
+            if (client->input.size() > MAX_FRAME + 4)
+                return false;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return true;
+        } else {
+            return false;  // closed by the client, or broken
+        }
+    }
+}
+
+void Server::close_client(Client *client) {
+    this->clients.erase(client);
+    close(client->fd);
+    delete client;  // its session's transaction, if any, is rolled back
+}
+
+void Server::watch(Client *client, bool add) {
+    epoll_event event;
+    event.events = (client->pending.empty() ? EPOLLIN | EPOLLRDHUP : EPOLLOUT) | EPOLLONESHOT;
+    event.data.ptr = client;
+    epoll_ctl(this->epoll, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, client->fd, &event);
+}
+
+void Server::work() {
+    for (;;) {
+        Client *client;
+        {
+            unique_lock<mutex> guard(this->queue_lock);
+            this->queue_changed.wait(guard, [this] { return this->stopping || !this->queue.empty(); });
+            if (this->queue.empty())
+                return;
+            client = this->queue.front();
+            this->queue.pop_front();
+        }
+        lock_guard<mutex> client_guard(client->lock);
+        if (!serve(client))
+            shutdown(client->fd, SHUT_RDWR);  // the event loop will find it closed
+        watch(client);
+    }
+}
+
+bool Server::serve(Client *client) {
+    string line;
+    try {
+        while (!client->broken && decode_request(client->input, line)) {
+            Response response;
+            try {
+                response.ok = client->shell.run(line);
+            } catch (exception &e) {
+                client->shell.console() << "Error: " << e.what() << endl;
+                response.ok = false;
+            }
+            response.output = client->output_buffer.take();
+            response.messages = client->messages_buffer.take();
+            encode_response(response, client->pending);
+            this->requests++;
+        }
+    } catch (ProtocolError &e) {
+        return false;
+    }
+    return send_pending(client, false);
+}
+
+bool Server::send_pending(Client *client, bool wait) {
+    size_t sent = 0;
+    while (!client->broken && sent < client->pending.size()) {
+        ssize_t n = send(client->fd, client->pending.data() + sent, client->pending.size() - sent, MSG_NOSIGNAL);
+        if (n > 0) {
+            sent += (size_t) n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (!wait)
+                break;
+            pollfd writable{client->fd, POLLOUT, 0};
+            if (poll(&writable, 1, SEND_TIMEOUT_MS) == 0)
+                client->broken = true;  // not reading: don't keep the worker (and the session's locks) for it
+        } else {
+            client->broken = true;
+        }
+    }
+    if (client->broken)
+        client->pending.clear();
+    else
+        client->pending.erase(0, sent);
+    return !client->broken;
+}
+
+
+/*
+ * *********************************
+ * ChunkBuffer class implementation
+ * *********************************
+ */
+
+Server::ChunkBuffer::ChunkBuffer(Client &client, FrameKind kind) : client(client), kind(kind), bytes(CHUNK_BYTES) {
+    setp(this->bytes.data(), this->bytes.data() + this->bytes.size());
+}
+
+string Server::ChunkBuffer::take() {
+    string gathered(pbase(), pptr());
+    setp(this->bytes.data(), this->bytes.data() + this->bytes.size());
+    return gathered;
+}
+
+// The buffer is full: queue it up as a chunk, sending the client's frames once there is a chunk's worth.
+Server::ChunkBuffer::int_type Server::ChunkBuffer::overflow(int_type c) {
+    encode_chunk(this->kind, take(), this->client.pending);
+    if (this->client.pending.size() >= CHUNK_BYTES)
+        send_pending(&this->client, true);
+    if (!traits_type::eq_int_type(c, traits_type::eof()))
+        sputc(traits_type::to_char_type(c));
+    return traits_type::not_eof(c);
+}
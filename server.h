@@ -0,0 +1,155 @@
+/**
+ * @file server.h - sql5300 as a server for many clients at once
+ * Server
+ *
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+#include "protocol.h"
+#include "shell.h"
+
+/**
+ * @class Server - runs the lines clients send (see protocol.h) as the sql5300 shell would.
+ *
+ * One thread waits on all the connections at once with epoll and reads what arrives. A
+ * connection whose buffer holds a whole request is handed to a pool of worker threads, which run
+ * its requests in its own Shell (so each client has its own transaction, prepared statements and
+ * output format) and send back the responses, a chunk at a time as the shell prints them. A
+ * connection is watched for one event at a time (EPOLLONESHOT) and is not watched again until its
+ * worker is done with it, so its requests run one at a time and in order, while requests from
+ * different clients run in parallel.
+ *
+ * A worker never waits long on a client that is slow to read. What is left of the responses when
+ * its requests are done is sent by the event loop as the connection becomes writable (EPOLLOUT),
+ * and the worker moves on. While a statement is still printing, its worker waits for the client to
+ * make room, but gives up on the client (and lets the statement finish unheard) if it makes none
+ * for SEND_TIMEOUT_MS.
+ */
+class Server {
+public:
+    /**
+     * Number of worker threads by default: one per core.
+     */
+    static uint default_workers();
+
+    /**
+     * Longest a worker waits for a client to take any of a response while a statement is running.
+     */
+    static const int SEND_TIMEOUT_MS = 30 * 1000;
+
+    /**
+     * Start listening.
+     * @param address  a port number on localhost or a Unix socket path (see listen_on)
+     * @param workers  number of worker threads
+     * @throws ProtocolError
+     */
+    Server(const std::string &address, uint workers = default_workers());
+
+    /**
+     * Closes the connections, rolling back their transactions.
+     */
+    virtual ~Server();
+
+    Server(const Server &other) = delete;
+
+    Server &operator=(const Server &other) = delete;
+
+    /**
+     * Serve clients until stop is called.
+     */
+    virtual void run();
+
+    /**
+     * Make run return once the requests being run are done. Safe to call from a signal handler.
+     */
+    virtual void stop();
+
+    /**
+     * Number of connections accepted and of requests answered so far.
+     */
+    uint64_t get_connections() const { return connections; }
+
+    uint64_t get_requests() const { return requests; }
+
+protected:
+    struct Client;
+
+    /*
+     * What a client's shell prints to its output or messages: once CHUNK_BYTES have gathered
+     * they are queued up for the client as a chunk (see protocol.h).
+     */
+    class ChunkBuffer : public std::streambuf {
+    public:
+        ChunkBuffer(Client &client, FrameKind kind);
+
+        // what has gathered since the last chunk, for the end of the response
+        std::string take();
+
+    protected:
+        Client &client;
+        FrameKind kind;
+        std::vector<char> bytes;
+
+        virtual int_type overflow(int_type c);
+    };
+
+    struct Client {
+        int fd;
+        std::string input;    // bytes received but not yet run
+        std::string pending;  // frames not yet sent (the event loop sends them once its worker is done)
+        bool broken;          // a send failed
+        ChunkBuffer output_buffer;
+        ChunkBuffer messages_buffer;
+        std::ostream output;
+        std::ostream messages;
+        Shell shell;
+        std::mutex lock;  // held by its worker until it is watched again
+
+        explicit Client(int fd)
+                : fd(fd), broken(false), output_buffer(*this, FRAME_OUTPUT), messages_buffer(*this, FRAME_MESSAGES),
+                  output(&output_buffer), messages(&messages_buffer), shell(output, messages, false) {}
+    };
+
+    std::string address;
+    int listener;
+    int epoll;
+    int wakeup;  // eventfd written by stop
+    uint workers;
+    std::set<Client *> clients;  // only touched by the thread in run
+    std::vector<std::thread> threads;
+    std::mutex queue_lock;
+    std::condition_variable queue_changed;
+    std::deque<Client *> queue;  // clients with whole requests, waiting for a worker
+    bool stopping;
+    std::atomic<uint64_t> connections;
+    std::atomic<uint64_t> requests;
+
+    void accept_clients();
+
+    // read what the client sent; returns false if it is gone
+    bool receive(Client *client);
+
+    void close_client(Client *client);
+
+    // watch the client (a new one, if add) for its next request, or for room to send what is pending
+    void watch(Client *client, bool add = false);
+
+    void work();
+
+    // run the client's whole requests and send the responses; returns false if it is gone
+    bool serve(Client *client);
+
+    // send the frames queued up for the client, waiting for it to take them all (up to
+    // SEND_TIMEOUT_MS at a time), or if not wait, as many as it takes now; returns false if it is gone
+    static bool send_pending(Client *client, bool wait);
+};
@@ -0,0 +1,645 @@
+/**
+ * @file shell.cpp - implementation of the sql5300 command language
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include "shell.h"
+#include "SQLParser.h"
+#include "ParseTreeToString.h"
+#include "trace.h"
+
+using namespace std;
+using namespace hsql;
+
+/*
+ * ***************************
+ * Shell class implementation
+ * ***************************
+ */
+
+Shell::Shell(ostream &output, ostream &console, bool echo)
+        : output(output), messages(console), echo(echo), format(ResultWriter::TABLE), failed(false), timing(false),
+          totals() {
+}
+
+/**
+ * Where everything but query results goes: prompts, messages and errors. In the table format
+ * that is the output stream; in the others it is the console stream, so the output holds nothing
+ * but the results' data.
+ */
+ostream &Shell::console() {
+    return this->format == ResultWriter::TABLE ? this->output : this->messages;
+}
+
+ostream &Shell::error() {
+    this->failed = true;
+    return console();
+}
+
+/**
+ * Run a line in the shell's session: a statement the SQL parser does not know about, or else
+ * one or more SQL statements, each printed (if echoing) and run in turn.
+ * @param query  the line
+ * @returns      false if anything in it failed
+ */
+bool Shell::run(const string &query) {
+    SQLSession::Scope scope(this->session);
+    this->failed = false;
+    uint64_t plan_nanos = this->session.get_plan_nanos();
+    uint64_t nanos = 0;
+    bool handled;
+    {
+        Stopwatch watch(nanos);
+        handled = execute_command(query);
+    }
+    if (handled) {
+        size_t start = query.find_first_not_of(" \t");
+        if (start == string::npos || query[start] != '\\')  // shell commands aren't timed
+            print_time(0, this->session.get_plan_nanos() - plan_nanos, nanos);
+        return !this->failed;
+    }
+
+    // parse and execute
+    uint64_t parse_nanos = 0;
+    SQLParserResult *parse;
+    {
+        Stopwatch watch(parse_nanos);
+        Trace::Span span("parse", "sql");
+        parse = SQLParser::parseSQLString(query);
+    }
+    if (!parse->isValid()) {
+        error() << "invalid SQL: " << query << endl;
+        console() << parse->errorMsg() << endl;
+    } else {
+        for (uint i = 0; i < parse->size(); ++i) {
+            const SQLStatement *statement = parse->getStatement(i);
+            plan_nanos = this->session.get_plan_nanos();
+            nanos = 0;
+            try {
+                if (this->echo)
+                    console() << ParseTreeToString::statement(statement) << endl;
+                Stopwatch watch(nanos);
+                Trace::Span span("execute", "sql");
+                print_result(SQLExec::execute(statement));
+            } catch (SQLExecError &e) {
+                error() << "Error: " << e.what() << endl;
+            }
+            print_time(i == 0 ? parse_nanos : 0, this->session.get_plan_nanos() - plan_nanos, nanos);
+        }
+    }
+    delete parse;
+    return !this->failed;
+}
+
+bool Shell::run_script(istream &input) {
+    StatementReader reader(input);
+    bool ok = true;
+    string statement;
+    while (reader.next(statement) && statement != "quit")
+        ok = run(statement) && ok;
+    return ok;
+}
+
+/**
+ * Print a query result in the output format and delete it, also when reading its streamed rows
+ * fails part way. Except in the table format, the result's message goes to the console.
+ * @param result  the result to print
+ */
+void Shell::print_result(QueryResult *result) {
+    unique_ptr<QueryResult> owner(result);
+    if (this->format == ResultWriter::TABLE) {
+        this->output << *result << endl;
+        return;
+    }
+    if (result->get_column_names() != nullptr) {
+        unique_ptr<ResultWriter> writer(ResultWriter::create(this->format, this->output));
+        result->write(*writer);
+        this->output.flush();
+    }
+    this->messages << result->get_message() << endl;
+}
+
+static string milliseconds(uint64_t nanos) {
+    ostringstream text;
+    text << fixed << setprecision(3) << nanos / 1e6 << " ms";
+    return text.str();
+}
+
+void Shell::print_time(uint64_t parse_nanos, uint64_t plan_nanos, uint64_t total_nanos) {
+    if (!this->timing)
+        return;
+    uint64_t execute_nanos = total_nanos - min(plan_nanos, total_nanos);
+    this->totals.statements++;
+    this->totals.parse += parse_nanos;
+    this->totals.plan += plan_nanos;
+    this->totals.execute += execute_nanos;
+    console() << "Time: parse " << milliseconds(parse_nanos) << ", plan " << milliseconds(plan_nanos)
+              << ", execute " << milliseconds(execute_nanos) << endl;
+}
+
+/**
+ * Print the number of statements timed and their total parse, plan and execute times, for
+ * comparing runs of a script.
+ */
+void Shell::print_timing_totals() {
+    if (!this->timing || this->totals.statements == 0)
+        return;
+    console() << "Total time: " << this->totals.statements << " statements, parse "
+              << milliseconds(this->totals.parse) << ", plan " << milliseconds(this->totals.plan) << ", execute "
+              << milliseconds(this->totals.execute) << ", total "
+              << milliseconds(this->totals.parse + this->totals.plan + this->totals.execute) << endl;
+}
+
+/**
+ * ANALYZE <table>
+ * @param query  the line typed in
+ * @param words  the rest of the line after ANALYZE
+ */
+void Shell::analyze_command(const string &query, istringstream &words) {
+    string table_name, extra;
+    words >> table_name;
+    if (!table_name.empty() && table_name.back() == ';')
+        table_name.pop_back();
+    if (table_name.empty() || words >> extra) {
+        error() << "invalid SQL: " << query << endl << "usage: ANALYZE <table>" << endl;
+        return;
+    }
+    try {
+        print_result(SQLExec::analyze(table_name));
+    } catch (SQLExecError &e) {
+        error() << "Error: " << e.what() << endl;
+    }
+}
+
+/**
+ * COPY <table> FROM '<file>' [CSV | TSV] [HEADER], COPY <table> TO '<file>' [CSV | TSV] [HEADER]
+ * or, for a dump of the table's blocks, COPY <table> {FROM | TO} '<file>' RAW
+ * @param query  the line typed in
+ * @param words  the rest of the line after COPY
+ */
+void Shell::copy_command(const string &query, istringstream &words) {
+    string table_name, direction, rest;
+    words >> table_name >> direction;
+    transform(direction.begin(), direction.end(), direction.begin(), ::tolower);
+    getline(words, rest);
+    rest.erase(0, rest.find_first_not_of(" \t"));
+    size_t close = rest.size() > 1 && rest[0] == '\'' ? rest.find('\'', 1) : string::npos;
+    bool valid = !table_name.empty() && (direction == "from" || direction == "to") && close != string::npos;
+    char delimiter = ',';
+    bool header = false, raw = false, text = false;
+    if (valid) {
+        istringstream options(rest.substr(close + 1));
+        string option;
+        while (options >> option) {
+            transform(option.begin(), option.end(), option.begin(), ::tolower);
+            if (option.back() == ';')
+                option.pop_back();
+            if (option == "csv" || option == "tsv")
+                delimiter = option == "csv" ? ',' : '\t';
+            else if (option == "header")
+                header = true;
+            else if (option == "raw")
+                raw = true;
+            else if (!option.empty())
+                valid = false;
+            text = text || option == "csv" || option == "tsv" || option == "header";
+        }
+        valid = valid && !(raw && text);
+    }
+    if (!valid) {
+        error() << "invalid SQL: " << query << endl
+                  << "usage: COPY <table> {FROM | TO} '<file>' [CSV | TSV] [HEADER]" << endl
+                  << "       COPY <table> {FROM | TO} '<file>' RAW" << endl;
+        return;
+    }
+    string path = rest.substr(1, close - 1);
+    try {
+        if (raw)
+            print_result(direction == "from" ? SQLExec::restore(table_name, path) : SQLExec::dump(table_name, path));
+        else if (direction == "from")
+            print_result(SQLExec::copy_from(table_name, path, delimiter, header));
+        else
+            print_result(SQLExec::copy_to(table_name, path, delimiter, header));
+    } catch (SQLExecError &e) {
+        error() << "Error: " << e.what() << endl;
+    }
+}
+
+/**
+ * EXPLAIN [ANALYZE] <select>
+ * @param query  the line typed in
+ * @param words  the rest of the line after EXPLAIN
+ */
+void Shell::explain_command(const string &query, istringstream &words) {
+    bool analyze = false;
+    streampos start = words.tellg();
+    string word;
+    words >> word;
+    transform(word.begin(), word.end(), word.begin(), ::tolower);
+    if (word == "analyze")
+        analyze = true;
+    else
+        words.seekg(start);
+    string sql;
+    getline(words, sql);
+
+    SQLParserResult *parse = SQLParser::parseSQLString(sql);
+    if (!parse->isValid()) {
+        error() << "invalid SQL: " << query << endl;
+        console() << parse->errorMsg() << endl;
+    } else {
+        for (uint i = 0; i < parse->size(); ++i) {
+            try {
+                print_result(SQLExec::explain(parse->getStatement(i), analyze));
+            } catch (SQLExecError &e) {
+                error() << "Error: " << e.what() << endl;
+            }
+        }
+    }
+    delete parse;
+}
+
+/**
+ * PREPARE <name> AS <select or insert>
+ * @param query  the line typed in
+ * @param words  the rest of the line after PREPARE
+ */
+void Shell::prepare_command(const string &query, istringstream &words) {
+    string name, as, sql;
+    words >> name >> as;
+    transform(as.begin(), as.end(), as.begin(), ::tolower);
+    getline(words, sql);
+    if (name.empty() || (as != "as" && as != "from") || sql.find_first_not_of(" \t") == string::npos) {
+        error() << "invalid SQL: " << query << endl << "usage: PREPARE <name> AS <statement>" << endl;
+        return;
+    }
+
+    SQLParserResult *parse = SQLParser::parseSQLString(sql);
+    if (!parse->isValid()) {
+        error() << "invalid SQL: " << query << endl;
+        console() << parse->errorMsg() << endl;
+        delete parse;
+        return;
+    }
+    try {
+        print_result(SQLExec::prepare(name, parse));
+    } catch (SQLExecError &e) {
+        error() << "Error: " << e.what() << endl;
+    }
+}
+
+/**
+ * Read the values given to EXECUTE: integers and quoted strings separated by commas.
+ * @param text    the values (without the parentheses)
+ * @param values  returned by reference: the values
+ * @returns       false if the text is not such a list
+ */
+bool Shell::parse_values(const string &text, ValueRow &values) {
+    size_t i = 0;
+    auto skip_spaces = [&]() {
+        while (i < text.size() && isspace((unsigned char) text[i]))
+            i++;
+    };
+    skip_spaces();
+    if (i == text.size())
+        return true;
+    while (true) {
+        skip_spaces();
+        if (i == text.size())
+            return false;
+        if (text[i] == '\'' || text[i] == '"') {
+            char quote = text[i++];
+            string s;
+            while (true) {
+                if (i == text.size())
+                    return false;
+                if (text[i] == quote) {
+                    if (i + 1 < text.size() && text[i + 1] == quote) {  // doubled quote
+                        s += quote;
+                        i += 2;
+                        continue;
+                    }
+                    i++;
+                    break;
+                }
+                s += text[i++];
+            }
+            values.push_back(Value(s));
+        } else {
+            size_t start = i;
+            if (text[i] == '-' || text[i] == '+')
+                i++;
+            size_t digits = i;
+            while (i < text.size() && isdigit((unsigned char) text[i]))
+                i++;
+            if (i == digits || i - digits > 10)
+                return false;
+            long long n = stoll(text.substr(start, i - start));
+            if (n < INT32_MIN || n > INT32_MAX)
+                return false;
+            values.push_back(Value((int32_t) n));
+        }
+        skip_spaces();
+        if (i == text.size())
+            return true;
+        if (text[i++] != ',')
+            return false;
+    }
+}
+
+/**
+ * EXECUTE <name> [(<value>, ...)]
+ * @param query  the line typed in
+ * @param words  the rest of the line after EXECUTE
+ */
+void Shell::execute_prepared_command(const string &query, istringstream &words) {
+    string rest;
+    getline(words, rest);
+    while (!rest.empty() && (rest.back() == ';' || isspace((unsigned char) rest.back())))
+        rest.pop_back();
+    size_t open = rest.find('(');
+    string name = rest.substr(0, open);
+    name.erase(0, min(name.find_first_not_of(" \t"), name.size()));
+    name.erase(name.find_last_not_of(" \t") + 1);
+    ValueRow arguments;
+    bool valid = !name.empty() && name.find_first_of(" \t") == string::npos;
+    if (open != string::npos)
+        valid = valid && rest.back() == ')' && parse_values(rest.substr(open + 1, rest.size() - open - 2), arguments);
+    if (!valid) {
+        error() << "invalid SQL: " << query << endl << "usage: EXECUTE <name> [(<value>, ...)]" << endl;
+        return;
+    }
+    try {
+        print_result(SQLExec::execute_prepared(name, arguments));
+    } catch (SQLExecError &e) {
+        error() << "Error: " << e.what() << endl;
+    }
+}
+
+/**
+ * DEALLOCATE [PREPARE] <name>
+ * @param query  the line typed in
+ * @param words  the rest of the line after DEALLOCATE
+ */
+void Shell::deallocate_command(const string &query, istringstream &words) {
+    string name, extra;
+    words >> name;
+    string lower = name;
+    transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    if (lower == "prepare")
+        words >> name;
+    if (!name.empty() && name.back() == ';')
+        name.pop_back();
+    if (name.empty() || words >> extra) {
+        error() << "invalid SQL: " << query << endl << "usage: DEALLOCATE <name>" << endl;
+        return;
+    }
+    try {
+        print_result(SQLExec::deallocate(name));
+    } catch (SQLExecError &e) {
+        error() << "Error: " << e.what() << endl;
+    }
+}
+
+/**
+ * BEGIN, COMMIT or ROLLBACK, optionally followed by TRANSACTION or WORK
+ * @param command  begin, commit or rollback
+ * @param query    the line typed in
+ * @param words    the rest of the line after the command
+ */
+void Shell::transaction_command(const string &command, const string &query, istringstream &words) {
+    string noise, extra;
+    words >> noise;
+    transform(noise.begin(), noise.end(), noise.begin(), ::tolower);
+    if (!noise.empty() && noise.back() == ';')
+        noise.pop_back();
+    if ((!noise.empty() && noise != "transaction" && noise != "work") || words >> extra) {
+        error() << "invalid SQL: " << query << endl << "usage: {BEGIN | COMMIT | ROLLBACK} [TRANSACTION | WORK]"
+                  << endl;
+        return;
+    }
+    try {
+        if (command == "begin")
+            print_result(SQLExec::begin());
+        else if (command == "commit")
+            print_result(SQLExec::commit());
+        else
+            print_result(SQLExec::rollback());
+    } catch (SQLExecError &e) {
+        error() << "Error: " << e.what() << endl;
+    }
+}
+
+/**
+ * SHOW STATEMENT STATS or SHOW STATUS (other SHOW statements go to the SQL parser)
+ * @param words  the rest of the line after SHOW
+ * @returns      false if the line is some other SHOW statement
+ */
+bool Shell::show_command(istringstream &words) {
+    string what, which, extra;
+    words >> what >> which;
+    transform(what.begin(), what.end(), what.begin(), ::tolower);
+    transform(which.begin(), which.end(), which.begin(), ::tolower);
+    if (!what.empty() && what.back() == ';')
+        what.pop_back();
+    if (!which.empty() && which.back() == ';')
+        which.pop_back();
+    if (what == "status" && which.empty()) {
+        print_result(SQLExec::show_status());
+        return true;
+    }
+    if (what != "statement" || which != "stats" || words >> extra)
+        return false;
+    print_result(SQLExec::show_statement_stats());
+    return true;
+}
+
+/**
+ * \format [table | csv | tsv | binary]
+ * @param query  the line typed in
+ * @param words  the rest of the line after \format
+ */
+void Shell::format_command(const string &query, istringstream &words) {
+    string name, extra;
+    words >> name;
+    if (name.empty()) {
+        static const char *names[] = {"table", "csv", "tsv", "binary"};
+        console() << "output format is " << names[this->format] << endl;
+        return;
+    }
+    ResultWriter::Format format;
+    if (words >> extra || !ResultWriter::get_format(name, format)) {
+        error() << "invalid command: " << query << endl << "usage: \\format [table | csv | tsv | binary]" << endl;
+        return;
+    }
+    this->format = format;
+}
+
+/**
+ * \timing [on | off]: print how long each statement takes to parse, plan and execute (on its own, toggle)
+ * @param query  the line typed in
+ * @param words  the rest of the line after \timing
+ */
+void Shell::timing_command(const string &query, istringstream &words) {
+    string setting, extra;
+    words >> setting;
+    transform(setting.begin(), setting.end(), setting.begin(), ::tolower);
+    if ((!setting.empty() && setting != "on" && setting != "off") || words >> extra) {
+        error() << "invalid command: " << query << endl << "usage: \\timing [on | off]" << endl;
+        return;
+    }
+    this->timing = setting.empty() ? !this->timing : setting == "on";
+    console() << "timing is " << (this->timing ? "on" : "off") << endl;
+}
+
+/**
+ * \trace [on | off]: record spans of parsing, planning, operator calls, block reads and catalog
+ * lookups in all sessions (on its own, toggle); \trace dump <file>: write those recorded since
+ * tracing was turned on as Chrome trace JSON
+ * @param query  the line typed in
+ * @param words  the rest of the line after \trace
+ */
+void Shell::trace_command(const string &query, istringstream &words) {
+    string setting, path, extra;
+    words >> setting >> path;
+    transform(setting.begin(), setting.end(), setting.begin(), ::tolower);
+    if (setting == "dump" && !path.empty() && !(words >> extra)) {
+        ofstream file(path);
+        uint64_t events = file ? Trace::dump(file) : 0;
+        if (!file)
+            error() << "Error: can't write " << path << endl;
+        else
+            console() << "wrote " << events << " trace events to " << path << endl;
+        return;
+    }
+    if ((!setting.empty() && setting != "on" && setting != "off") || !path.empty()) {
+        error() << "invalid command: " << query << endl << "usage: \\trace [on | off | dump <file>]" << endl;
+        return;
+    }
+    if (setting.empty() ? !Trace::on() : setting == "on")
+        Trace::start();
+    else
+        Trace::stop();
+    console() << "tracing is " << (Trace::on() ? "on" : "off") << endl;
+}
+
+/**
+ * Run a statement the SQL parser does not know about: ANALYZE <table>, BEGIN, COMMIT, ROLLBACK, COPY,
+ * EXPLAIN [ANALYZE] <select>, PREPARE, EXECUTE, DEALLOCATE, SHOW STATEMENT STATS or SHOW STATUS, or the shell
+ * commands \format, \timing and \trace
+ * @param query  the line typed in
+ * @returns      false if the line is not one of these statements (so it should be parsed as SQL)
+ */
+bool Shell::execute_command(const string &query) {
+    istringstream words(query);
+    string command;
+    words >> command;
+    transform(command.begin(), command.end(), command.begin(), ::tolower);
+    if (!command.empty() && command.back() == ';')
+        command.pop_back();
+    if (command == "analyze")
+        analyze_command(query, words);
+    else if (command == "begin" || command == "commit" || command == "rollback")
+        transaction_command(command, query, words);
+    else if (command == "copy")
+        copy_command(query, words);
+    else if (command == "explain")
+        explain_command(query, words);
+    else if (command == "prepare")
+        prepare_command(query, words);
+    else if (command == "execute")
+        execute_prepared_command(query, words);
+    else if (command == "deallocate")
+        deallocate_command(query, words);
+    else if (command == "show")
+        return show_command(words);
+    else if (command == "\\format")
+        format_command(query, words);
+    else if (command == "\\timing")
+        timing_command(query, words);
+    else if (command == "\\trace")
+        trace_command(query, words);
+    else
+        return false;
+    return true;
+}
+
+
+/*
+ * *************************************
+ * StatementReader class implementation
+ * *************************************
+ */
+
+static bool is_blank(const string &text) {
+    return text.find_first_not_of(" \t\r\n") == string::npos;
+}
+
+static void trim(string &text) {
+    text.erase(0, min(text.find_first_not_of(" \t\r\n"), text.size()));
+    text.erase(text.find_last_not_of(" \t\r\n") + 1);
+}
+
+bool StatementReader::next(string &statement) {
+    statement.clear();
+    char quote = 0;  // the quote the statement is inside of, if any
+    while (true) {
+        if (this->rest.empty()) {
+            string line;
+            if (!getline(this->input, line))
+                break;
+            size_t start = line.find_first_not_of(" \t\r");
+            if (start == string::npos) {
+                if (quote == 0 && !is_blank(statement))
+                    break;  // a blank line ends the statement
+                if (quote != 0)
+                    statement += '\n';
+                continue;
+            }
+            if (quote == 0 && is_blank(statement) && line[start] == '\\') {
+                statement = line;
+                trim(statement);
+                return true;
+            }
+            if (!is_blank(statement))
+                statement += '\n';
+            this->rest = line;
+        }
+
+        size_t i = 0;
+        bool ended = false;
+        while (i < this->rest.size() && !ended) {
+            char c = this->rest[i++];
+            if (quote != 0) {
+                if (c == quote)
+                    quote = 0;
+            } else if (c == '\'' || c == '"') {
+                quote = c;
+            } else if (c == '-' && i < this->rest.size() && this->rest[i] == '-') {
+                i = this->rest.size();  // a comment
+                continue;
+            } else if (c == ';') {
+                ended = true;
+                continue;
+            }
+            statement += c;
+        }
+        this->rest.erase(0, i);
+        if (is_blank(this->rest))
+            this->rest.clear();
+        if (ended) {
+            if (is_blank(statement)) {
+                statement.clear();
+                continue;  // an empty statement
+            }
+            trim(statement);
+            return true;
+        }
+    }
+    trim(statement);
+    return !statement.empty();
+}
@@ -0,0 +1,146 @@
+/**
+ * @file shell.h - the sql5300 command language
+ * Shell
+ *
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#pragma once
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "SQLExec.h"
+#include "result_writer.h"
+
+/**
+ * @class StatementReader - splits a script into statements. A statement ends with a semicolon
+ * (outside quotes), a blank line or the end of the script, so it may span lines; a line starting
+ * with a backslash is a shell command of its own. Comments (from -- to the end of the line) are
+ * dropped. Reads a line at a time, so a script can be piped in as it is written.
+ */
+class StatementReader {
+public:
+    explicit StatementReader(std::istream &input) : input(input) {}
+
+    /**
+     * Read the next statement.
+     * @param statement  returned by reference: the statement, without its semicolon
+     * @returns          false at the end of the script
+     */
+    bool next(std::string &statement);
+
+protected:
+    std::istream &input;
+    std::string rest;  // what is left of the last line read, after a semicolon
+};
+
+
+/**
+ * @class Shell - runs the lines typed at the sql5300 prompt, or sent by a client of the server:
+ * SQL statements, the statements the SQL parser does not know about (ANALYZE, BEGIN, COMMIT,
+ * ROLLBACK, COPY, EXPLAIN, PREPARE, EXECUTE, DEALLOCATE, SHOW STATEMENT STATS and SHOW STATUS) and
+ * the shell commands \format, \timing and \trace. A script of such statements can also be run as a
+ * whole.
+ *
+ * Each shell has a session of its own (SQLSession): its transaction, prepared statements and
+ * output format carry over from one line to the next. Query results are printed to the output
+ * stream; prompts, messages and errors go to the console stream, which in the table format is
+ * the output stream too.
+ */
+class Shell {
+public:
+    /**
+     * @param output   where query results are printed
+     * @param console  where messages and errors are printed when the output format is not table
+     * @param echo     whether to print each SQL statement's parse tree before running it
+     */
+    Shell(std::ostream &output, std::ostream &console, bool echo = true);
+
+    virtual ~Shell() {}
+
+    Shell(const Shell &other) = delete;
+
+    Shell &operator=(const Shell &other) = delete;
+
+    /**
+     * Run a line: one or more SQL statements, or one of the other statements or commands.
+     * @param line  the line
+     * @returns     false if it, or any of its statements, failed
+     */
+    virtual bool run(const std::string &line);
+
+    /**
+     * Run the statements of a script (see StatementReader) one at a time until its end or a line "quit".
+     * @param input  the script
+     * @returns      false if any of its statements failed
+     */
+    virtual bool run_script(std::istream &input);
+
+    /**
+     * If \timing is on, print the totals of the times printed so far.
+     */
+    void print_timing_totals();
+
+    /**
+     * Where prompts, messages and errors go in the current output format.
+     */
+    std::ostream &console();
+
+    ResultWriter::Format get_format() const { return format; }
+
+    /**
+     * Whether a transaction begun with BEGIN is in progress.
+     */
+    bool in_transaction() const { return session.in_transaction(); }
+
+protected:
+    SQLSession session;
+    std::ostream &output;
+    std::ostream &messages;
+    bool echo;
+    ResultWriter::Format format;  // how query results are printed, set by \format
+    bool failed;                  // whether the line being run has failed
+    bool timing;                  // whether to print each statement's times, set by \timing
+
+    // times printed so far, in nanoseconds
+    struct TimingTotals {
+        uint64_t statements;
+        uint64_t parse;
+        uint64_t plan;
+        uint64_t execute;
+    } totals;
+
+    // console(), noting that the line failed
+    std::ostream &error();
+
+    void print_result(QueryResult *result);
+
+    // if \timing is on, print (and add to the totals) how long a statement took to parse, plan and execute
+    void print_time(uint64_t parse_nanos, uint64_t plan_nanos, uint64_t total_nanos);
+
+    bool execute_command(const std::string &query);
+
+    void analyze_command(const std::string &query, std::istringstream &words);
+
+    void copy_command(const std::string &query, std::istringstream &words);
+
+    void explain_command(const std::string &query, std::istringstream &words);
+
+    void prepare_command(const std::string &query, std::istringstream &words);
+
+    void execute_prepared_command(const std::string &query, std::istringstream &words);
+
+    void deallocate_command(const std::string &query, std::istringstream &words);
+
+    void transaction_command(const std::string &command, const std::string &query, std::istringstream &words);
+
+    bool show_command(std::istringstream &words);
+
+    void format_command(const std::string &query, std::istringstream &words);
+
+    void timing_command(const std::string &query, std::istringstream &words);
+
+    void trace_command(const std::string &query, std::istringstream &words);
+
+    static bool parse_values(const std::string &text, ValueRow &values);
+};
@@ -0,0 +1,466 @@
+/**
+ * @file sort.cpp - implementation of external merge sort
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include "sort.h"
+#include "heap_storage.h"
+
+using namespace std;
+
+void sort_key(const ValueRow &row, const SortKeys &keys, string &key) {
+    for (auto const &sort_key: keys) {
+        const Value &value = row[sort_key.column];
+        size_t start = key.size();
+        if (value.data_type == ColumnAttribute::TEXT) {
+            for (auto const &c: value.s) {
+                key.push_back(c);
+                if (c == '\0')
+                    key.push_back('\xff');
+            }
+            key.append(2, '\0');
+        } else {
+            uint32_t x = (uint32_t) value.n ^ 0x80000000U;
+            for (int shift = 24; shift >= 0; shift -= 8)
+                key.push_back((char) (x >> shift));
+        }
+        if (sort_key.descending)
+            for (size_t i = start; i < key.size(); i++)
+                key[i] = (char) ~key[i];
+    }
+}
+
+// Compare the normalized keys at the front of two records.
+static int compare_records(const string &a, const string &b) {
+    uint32_t a_size, b_size;
+    memcpy(&a_size, a.data(), sizeof(a_size));
+    memcpy(&b_size, b.data(), sizeof(b_size));
+    int cmp = memcmp(a.data() + sizeof(a_size), b.data() + sizeof(b_size), min(a_size, b_size));
+    if (cmp != 0)
+        return cmp;
+    return a_size < b_size ? -1 : a_size > b_size ? 1 : 0;
+}
+
+
+/*
+ * ****************************
+ * LoserTree class implementation
+ * ****************************
+ */
+
+// ctor - play the initial tournament
+LoserTree::LoserTree(const vector<SpillFile *> &runs) : runs(runs), heads(runs.size()),
+                                                        exhausted(runs.size(), false), tree(runs.size(), 0) {
+    for (uint i = 0; i < this->runs.size(); i++)
+        this->exhausted[i] = !this->runs[i]->read(this->heads[i]);
+    if (!this->runs.empty())
+        this->tree[0] = play(1);
+}
+
+LoserTree::~LoserTree() {
+    for (auto const &run: this->runs)
+        delete run;
+}
+
+// Winner of the subtree at node; leaves are nodes k..2k-1 and stand for the runs.
+uint LoserTree::play(uint node) {
+    uint k = (uint) this->runs.size();
+    if (node >= k)
+        return node - k;
+    uint a = play(2 * node);
+    uint b = play(2 * node + 1);
+    if (less(b, a))
+        swap(a, b);
+    this->tree[node] = b;
+    return a;
+}
+
+bool LoserTree::less(uint a, uint b) const {
+    if (this->exhausted[a] || this->exhausted[b])
+        return !this->exhausted[a] && this->exhausted[b];
+    int cmp = compare_records(this->heads[a], this->heads[b]);
+    return cmp < 0 || (cmp == 0 && a < b);
+}
+
+bool LoserTree::next(string &record) {
+    if (this->runs.empty())
+        return false;
+    uint winner = this->tree[0];
+    if (this->exhausted[winner])
+        return false;
+    record.swap(this->heads[winner]);
+    this->exhausted[winner] = !this->runs[winner]->read(this->heads[winner]);
+
+    // replay the matches from the winner's leaf up to the root
+    uint k = (uint) this->runs.size();
+    for (uint node = (winner + k) / 2; node > 0; node /= 2)
+        if (less(this->tree[node], winner))
+            swap(this->tree[node], winner);
+    this->tree[0] = winner;
+    return true;
+}
+
+
+/*
+ * *************************
+ * Sorter class implementation
+ * *************************
+ */
+
+Sorter::Sorter(const SortKeys &keys) : keys(keys), records_bytes(0), next_record(0), spilled_runs(0),
+                                       merge(nullptr) {
+}
+
+Sorter::~Sorter() {
+    clear();
+}
+
+// Each record is the key's length, the normalized key, then the encoded row.
+void Sorter::add(const ValueRow &row) {
+    string record(sizeof(uint32_t), '\0');
+    sort_key(row, this->keys, record);
+    uint32_t key_size = (uint32_t) (record.size() - sizeof(uint32_t));
+    memcpy(&record[0], &key_size, sizeof(key_size));
+    encode_row(row, record);
+    this->records_bytes += sizeof(string) + record.capacity();
+    this->records.push_back(move(record));
+    if (this->records_bytes > EvalPlan::memory_budget)
+        spill_records();
+}
+
+void Sorter::sort() {
+    if (this->runs.empty()) {
+        sort_records();
+        this->next_record = 0;
+        return;
+    }
+    if (!this->records.empty())
+        spill_records();
+
+    // merge groups of neighbouring runs until a single merge can take them all
+    while (this->runs.size() > MERGE_FAN_IN) {
+        vector<SpillFile *> merged;
+        for (uint i = 0; i < this->runs.size(); i += MERGE_FAN_IN) {
+            vector<SpillFile *> group(this->runs.begin() + i,
+                                      this->runs.begin() + min<size_t>(i + MERGE_FAN_IN, this->runs.size()));
+            for (uint j = i; j < i + group.size(); j++)
+                this->runs[j] = nullptr;
+            merged.push_back(merge_runs(group));
+        }
+        this->runs = merged;
+    }
+    for (auto const &run: this->runs)
+        run->rewind();
+    this->merge = new LoserTree(this->runs);
+    this->runs.clear();
+}
+
+bool Sorter::next(ValueRow &row) {
+    if (this->merge != nullptr) {
+        if (!this->merge->next(this->record))
+            return false;
+        unpack(this->record, row);
+        return true;
+    }
+    if (this->next_record >= this->records.size())
+        return false;
+    unpack(this->records[this->next_record++], row);
+    return true;
+}
+
+void Sorter::clear() {
+    this->records.clear();
+    this->records_bytes = 0;
+    this->next_record = 0;
+    for (auto const &run: this->runs)
+        delete run;
+    this->runs.clear();
+    this->spilled_runs = 0;
+    delete this->merge;
+    this->merge = nullptr;
+}
+
+void Sorter::sort_records() {
+    stable_sort(this->records.begin(), this->records.end(),
+                [](const string &a, const string &b) { return compare_records(a, b) < 0; });
+}
+
+// Write out the in-memory run, sorted, as a new spill file.
+void Sorter::spill_records() {
+    sort_records();
+    SpillFile *run = TempFileManager::create();
+    this->runs.push_back(run);
+    for (auto const &record: this->records)
+        run->write(record);
+    this->records.clear();
+    this->records_bytes = 0;
+    this->spilled_runs++;
+}
+
+// Merge some runs into one new run (takes ownership of the runs).
+SpillFile *Sorter::merge_runs(const vector<SpillFile *> &runs) {
+    for (auto const &run: runs)
+        run->rewind();
+    LoserTree tree(runs);
+    SpillFile *merged = TempFileManager::create();
+    try {
+        while (tree.next(this->record))
+            merged->write(this->record);
+    } catch (...) {
+        delete merged;
+        throw;
+    }
+    return merged;
+}
+
+void Sorter::unpack(const string &record, ValueRow &row) {
+    uint32_t key_size;
+    memcpy(&key_size, record.data(), sizeof(key_size));
+    size_t offset = sizeof(key_size) + key_size;
+    decode_row(record.data() + offset, record.size() - offset, row);
+}
+
+
+/*
+ * ***********************
+ * Sort class implementation
+ * ***********************
+ */
+
+Sort::Sort(EvalPlan *relation, const SortKeys &keys) : relation(relation), keys(keys), sorter(keys) {
+    this->column_names = relation->get_column_names();
+    this->column_attributes = relation->get_column_attributes();
+    this->table_names = relation->get_table_names();
+}
+
+Sort::~Sort() {
+    close();
+    delete this->relation;
+}
+
+void Sort::do_open() {
+    do_close();
+    ValueRow row;
+    this->relation->open();
+    while (this->relation->next(row))
+        this->sorter.add(row);
+    this->relation->close();
+    this->sorter.sort();
+}
+
+// "a.x desc, b.y"
+static string describe_keys(const EvalPlan &plan, const SortKeys &keys) {
+    string description;
+    for (auto const &key: keys) {
+        if (!description.empty())
+            description += ", ";
+        description += plan.column_label(key.column) + (key.descending ? " desc" : "");
+    }
+    return description;
+}
+
+bool Sort::do_next(ValueRow &row) {
+    return this->sorter.next(row);
+}
+
+void Sort::do_close() {
+    this->sorter.clear();
+    this->relation->close();
+}
+
+string Sort::describe() const {
+    return "Sort " + describe_keys(*this->relation, this->keys);
+}
+
+
+/*
+ * ***********************
+ * TopN class implementation
+ * ***********************
+ */
+
+TopN::TopN(EvalPlan *relation, const SortKeys &keys, uint64_t limit, uint64_t offset)
+        : relation(relation), keys(keys), limit(limit), offset(offset), next_entry(0) {
+    this->column_names = relation->get_column_names();
+    this->column_attributes = relation->get_column_attributes();
+    this->table_names = relation->get_table_names();
+}
+
+TopN::~TopN() {
+    close();
+    delete this->relation;
+}
+
+// One pass over the input, keeping the best rows in a heap with the worst of them on top.
+void TopN::do_open() {
+    do_close();
+    uint64_t capacity = this->limit + this->offset;
+    if (capacity == 0)
+        return;
+    ValueRow row;
+    string key;
+    uint64_t sequence = 0;
+    this->relation->open();
+    while (this->relation->next(row)) {
+        key.clear();
+        sort_key(row, this->keys, key);
+        if (this->heap.size() < capacity) {
+            this->heap.push_back(Entry{key, sequence++, ""});
+        } else {
+            // replace the worst row kept (ties keep the earlier row), reusing its strings
+            if (key.compare(this->heap.front().key) >= 0) {
+                sequence++;
+                continue;
+            }
+            pop_heap(this->heap.begin(), this->heap.end(), less);
+            Entry &entry = this->heap.back();
+            entry.key.swap(key);
+            entry.sequence = sequence++;
+            entry.row.clear();
+        }
+        encode_row(row, this->heap.back().row);
+        push_heap(this->heap.begin(), this->heap.end(), less);
+    }
+    this->relation->close();
+    sort_heap(this->heap.begin(), this->heap.end(), less);
+    this->next_entry = this->offset;
+}
+
+bool TopN::do_next(ValueRow &row) {
+    if (this->next_entry >= this->heap.size())
+        return false;
+    decode_row(this->heap[this->next_entry++].row, row);
+    return true;
+}
+
+void TopN::do_close() {
+    this->heap.clear();
+    this->next_entry = 0;
+    this->relation->close();
+}
+
+string TopN::describe() const {
+    string description = "TopN " + to_string(this->limit);
+    if (this->offset > 0)
+        description += " offset " + to_string(this->offset);
+    return description + " by " + describe_keys(*this->relation, this->keys);
+}
+
+bool TopN::less(const Entry &a, const Entry &b) {
+    int cmp = a.key.compare(b.key);
+    return cmp < 0 || (cmp == 0 && a.sequence < b.sequence);
+}
+
+// Rows listed in the order they should sort in must have keys in increasing byte order.
+static bool test_keys_increase(const char *what, const ValueRows &rows, const SortKeys &keys) {
+    string previous;
+    for (uint i = 0; i < rows.size(); i++) {
+        string key;
+        sort_key(rows[i], keys, key);
+        if (i > 0 && !(previous < key))
+            return assertion_failure(string("sort key order of ") + what, i);
+        previous = key;
+    }
+    return true;
+}
+
+// Ints across the sign bit, text with embedded zero bytes, descending columns, and a text column
+// followed by another (so a shorter text must not run on into the next column).
+static bool test_sort_keys() {
+    ValueRows ints;
+    for (int32_t n: {INT32_MIN, -100000, -256, -1, 0, 1, 255, 256, 100000, INT32_MAX})
+        ints.push_back(ValueRow{Value(n)});
+    ValueRows texts;
+    for (auto const &s: {string(""), string("\0", 1), string("a"), string("a\0", 2), string("a\0b", 3),
+                         string("a\x01"), string("ab"), string("b")})
+        texts.push_back(ValueRow{Value(s)});
+    if (!test_keys_increase("ints", ints, SortKeys{SortKey{0, false}}) ||
+        !test_keys_increase("texts", texts, SortKeys{SortKey{0, false}}))
+        return false;
+    reverse(ints.begin(), ints.end());
+    reverse(texts.begin(), texts.end());
+    if (!test_keys_increase("descending ints", ints, SortKeys{SortKey{0, true}}) ||
+        !test_keys_increase("descending texts", texts, SortKeys{SortKey{0, true}}))
+        return false;
+    ValueRows pairs{ValueRow{Value("a"), Value(2)}, ValueRow{Value(string("a\0", 2)), Value(1)},
+                    ValueRow{Value("b"), Value(-1)}, ValueRow{Value("b"), Value(-2)}};
+    return test_keys_increase("pairs", pairs, SortKeys{SortKey{0, false}, SortKey{1, true}});
+}
+
+// key of row i: a few repeated values on either side of zero
+static int32_t test_sort_value(int32_t i) {
+    return (i * 7919) % 13 - 6;
+}
+
+// Sort rows with a memory budget small enough for more runs than one merge takes, and check that
+// rows with equal keys keep their input order.
+static bool test_sorter(bool descending) {
+    const int32_t ROWS = 3000;
+    size_t budget = EvalPlan::memory_budget;
+    EvalPlan::memory_budget = 1024;
+    Sorter sorter(SortKeys{SortKey{0, descending}});
+    for (int32_t i = 0; i < ROWS; i++)
+        sorter.add(ValueRow{Value(test_sort_value(i)), Value(i)});
+    sorter.sort();
+    EvalPlan::memory_budget = budget;
+    ValueRow row, previous;
+    int32_t count = 0;
+    while (sorter.next(row)) {
+        if (count > 0) {
+            int32_t a = previous[0].n, b = row[0].n;
+            if (descending ? a < b : a > b)
+                return assertion_failure("sorted order", a, b);
+            if (a == b && previous[1].n >= row[1].n)
+                return assertion_failure("sort stability", previous[1].n, row[1].n);
+        }
+        previous = row;
+        count++;
+    }
+    if (count != ROWS)
+        return assertion_failure("sorted rows", count);
+    if (sorter.get_spilled_runs() <= Sorter::MERGE_FAN_IN)
+        return assertion_failure("sorted runs", sorter.get_spilled_runs());
+    return true;
+}
+
+// TopN against a stable sort of the whole input, over ties, offsets and an offset past the end.
+static bool test_top_n() {
+    const int32_t ROWS = 100;
+    ValueRows rows;
+    for (int32_t i = 0; i < ROWS; i++)
+        rows.push_back(ValueRow{Value(i % 5), Value(i)});
+    ColumnAttributes attributes(2, ColumnAttribute(ColumnAttribute::INT));
+    for (bool descending: {false, true}) {
+        ValueRows sorted(rows);
+        stable_sort(sorted.begin(), sorted.end(), [descending](const ValueRow &a, const ValueRow &b) {
+            return descending ? a[0].n > b[0].n : a[0].n < b[0].n;
+        });
+        for (auto const &window: vector<pair<uint64_t, uint64_t>>{{7, 18}, {5, 0}, {10, 95}, {3, 200}, {0, 4}}) {
+            uint64_t limit = window.first, offset = window.second;
+            TopN top(new RowsScan(ColumnNames{"k", "i"}, attributes, rows), SortKeys{SortKey{0, descending}}, limit,
+                     offset);
+            ValueRow row;
+            uint64_t position = offset;
+            top.open();
+            while (top.next(row)) {
+                if (position >= sorted.size() || position >= offset + limit || row[1].n != sorted[position][1].n)
+                    return assertion_failure("top n row", (double) position, row[1].n);
+                position++;
+            }
+            top.close();
+            if (position != min<uint64_t>(sorted.size(), offset + limit) && offset < sorted.size())
+                return assertion_failure("top n rows", (double) position, (double) offset);
+        }
+    }
+    return true;
+}
+
+/**
+ * Test normalized sort keys, a sort that spills and merges in several passes, and TopN.
+ * @return true if the tests all succeeded
+ */
+bool test_sort() {
+    return test_sort_keys() && test_sorter(false) && test_sorter(true) && test_top_n();
+}
@@ -0,0 +1,228 @@
+/**
+ * @file sort.h - external merge sort
+ * SortKey
+ * LoserTree
+ * Sorter
+ * Sort
+ * TopN
+ *
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#pragma once
+
+#include "eval_plan.h"
+#include "spill_file.h"
+
+/**
+ * One column to sort on.
+ */
+struct SortKey {
+    uint column;      // ordinal in the row
+    bool descending;
+};
+typedef std::vector<SortKey> SortKeys;
+
+/**
+ * Normalized sort key of a row: bytes that compare with memcmp in the same order as the rows
+ * compare on the key columns. Ints are big-endian with the sign bit flipped, text has its zero
+ * bytes escaped and is zero-terminated, and descending columns have every byte inverted.
+ * @param row   row to make the key for
+ * @param keys  columns to sort on, most significant first
+ * @param key   returned by reference: the key's bytes are appended here
+ */
+void sort_key(const ValueRow &row, const SortKeys &keys, std::string &key);
+
+
+/**
+ * @class LoserTree - k-way merge of sorted runs.
+ *
+ * A tournament tree over the head record of each run: the internal nodes remember the loser of
+ * the match played there, so replacing the winner only replays the matches on its path to the
+ * root (log k comparisons). Ties go to the earlier run, which keeps the merge stable.
+ * Records are as written by Sorter: a 32-bit key length, the normalized key, then the row.
+ */
+class LoserTree {
+public:
+    /**
+     * @param runs  sorted runs, rewound for reading (owned by the tree from now on)
+     */
+    LoserTree(const std::vector<SpillFile *> &runs);
+
+    virtual ~LoserTree();
+
+    LoserTree(const LoserTree &other) = delete;
+
+    LoserTree &operator=(const LoserTree &other) = delete;
+
+    /**
+     * Take the smallest remaining record.
+     * @param record  returned by reference: the record
+     * @returns       false if all the runs are exhausted
+     */
+    virtual bool next(std::string &record);
+
+protected:
+    std::vector<SpillFile *> runs;
+    std::vector<std::string> heads;
+    std::vector<bool> exhausted;
+    std::vector<uint> tree;  // tree[0] is the winner, tree[1..k-1] the losers at each internal node
+
+    bool less(uint a, uint b) const;
+
+    uint play(uint node);
+};
+
+
+/**
+ * @class Sorter - sorts rows too big to fit in memory.
+ *
+ * Rows are add()ed, encoded along with their normalized key, and gathered into a run until the
+ * run outgrows EvalPlan::memory_budget; then the run is sorted and written sequentially to a
+ * spill file. Once all rows are in, sort() merges the runs with a LoserTree (in several passes
+ * if there are more than MERGE_FAN_IN of them) and next() streams the rows back in order.
+ * If everything fit in memory no files are written at all. The sort is stable.
+ */
+class Sorter {
+public:
+    /**
+     * Most runs merged at once, which bounds the number of open files and read buffers.
+     */
+    static const uint MERGE_FAN_IN = 64;
+
+    /**
+     * @param keys  columns to sort on, most significant first
+     */
+    Sorter(const SortKeys &keys);
+
+    virtual ~Sorter();
+
+    Sorter(const Sorter &other) = delete;
+
+    Sorter &operator=(const Sorter &other) = delete;
+
+    /**
+     * Add a row to be sorted.
+     * @param row  row to add
+     */
+    virtual void add(const ValueRow &row);
+
+    /**
+     * Done adding rows: get ready to produce them in order.
+     */
+    virtual void sort();
+
+    /**
+     * Produce the next row in order.
+     * @param row  returned by reference: the row
+     * @returns    false if there are no more rows
+     */
+    virtual bool next(ValueRow &row);
+
+    /**
+     * Discard all rows and runs so the Sorter can be used again.
+     */
+    virtual void clear();
+
+    /**
+     * Number of runs written to spill files.
+     */
+    uint get_spilled_runs() const { return spilled_runs; }
+
+protected:
+    SortKeys keys;
+    std::vector<std::string> records;  // current in-memory run
+    size_t records_bytes;
+    uint next_record;
+    std::vector<SpillFile *> runs;
+    uint spilled_runs;
+    LoserTree *merge;
+    std::string record;
+
+    virtual void sort_records();
+
+    virtual void spill_records();
+
+    virtual SpillFile *merge_runs(const std::vector<SpillFile *> &runs);
+
+    static void unpack(const std::string &record, ValueRow &row);
+};
+
+
+/**
+ * @class Sort - ORDER BY: produces its input's rows sorted on some of their columns.
+ */
+class Sort : public EvalPlan {
+public:
+    /**
+     * @param relation  input plan (owned by the Sort from now on)
+     * @param keys      columns to sort on, most significant first
+     */
+    Sort(EvalPlan *relation, const SortKeys &keys);
+
+    virtual ~Sort();
+
+    virtual std::vector<EvalPlan *> get_inputs() const { return std::vector<EvalPlan *>{relation}; }
+
+    virtual std::string describe() const;
+
+protected:
+    EvalPlan *relation;
+    SortKeys keys;
+    Sorter sorter;
+
+    virtual void do_open();
+
+    virtual bool do_next(ValueRow &row);
+
+    virtual void do_close();
+};
+
+
+/**
+ * @class TopN - ORDER BY ... LIMIT: the first rows of its input in sorted order, without sorting it all.
+ *
+ * Keeps a max-heap of the best offset + limit rows seen so far (normalized key plus encoded row),
+ * so it makes a single pass over the input in O(offset + limit) memory. Rows whose key does
+ * not beat the worst one kept are rejected before they are even encoded. Ties keep the earlier
+ * row, as Sort does.
+ */
+class TopN : public EvalPlan {
+public:
+    /**
+     * @param relation  input plan (owned by the TopN from now on)
+     * @param keys      columns to sort on, most significant first
+     * @param limit     number of rows to produce
+     * @param offset    number of leading rows to skip first
+     */
+    TopN(EvalPlan *relation, const SortKeys &keys, uint64_t limit, uint64_t offset);
+
+    virtual ~TopN();
+
+    virtual std::vector<EvalPlan *> get_inputs() const { return std::vector<EvalPlan *>{relation}; }
+
+    virtual std::string describe() const;
+
+protected:
+    struct Entry {
+        std::string key;
+        uint64_t sequence;  // input position, to break ties
+        std::string row;
+    };
+
+    EvalPlan *relation;
+    SortKeys keys;
+    uint64_t limit;
+    uint64_t offset;
+    std::vector<Entry> heap;
+    uint64_t next_entry;
+
+    virtual void do_open();
+
+    virtual bool do_next(ValueRow &row);
+
+    virtual void do_close();
+
+    static bool less(const Entry &a, const Entry &b);
+};
+
+bool test_sort();
@@ -0,0 +1,80 @@
+/**
+ * @file spill_file.cpp - implementation of temporary spill files
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#include <cstdlib>
+#include <unistd.h>
+#include "spill_file.h"
+#include "counters.h"
+
+using namespace std;
+
+/*
+ * ****************************
+ * SpillFile class implementation
+ * ****************************
+ */
+
+// ctor - takes ownership of an open, empty file
+SpillFile::SpillFile(FILE *file) : file(file), buffer(new char[BUFFER_SZ]), count(0), size(0) {
+    setvbuf(this->file, this->buffer, _IOFBF, BUFFER_SZ);
+}
+
+SpillFile::~SpillFile() {
+    fclose(this->file);
+    delete[] this->buffer;
+}
+
+void SpillFile::write(const string &record) {
+    uint32_t length = (uint32_t) record.size();
+    if (fwrite(&length, sizeof(length), 1, this->file) != 1
+        || fwrite(record.data(), 1, length, this->file) != length)
+        throw DbRelationError("could not write to spill file");
+    this->count++;
+    this->size += sizeof(length) + length;
+    Counters::add(Counters::SPILL_BYTES, sizeof(length) + length);
+}
+
+void SpillFile::rewind() {
+    fflush(this->file);
+    fseek(this->file, 0, SEEK_SET);
+}
+
+bool SpillFile::read(string &record) {
+    uint32_t length;
+    if (fread(&length, sizeof(length), 1, this->file) != 1)
+        return false;
+    record.resize(length);
+    if (length > 0 && fread(&record[0], 1, length, this->file) != length)
+        throw DbRelationError("spill file is truncated");
+    return true;
+}
+
+
+/*
+ * *********************************
+ * TempFileManager class implementation
+ * *********************************
+ */
+string TempFileManager::directory() {
+    const char *home = nullptr;
+    if (_DB_ENV != nullptr)
+        _DB_ENV->get_home(&home);
+    return home != nullptr ? string(home) : string(".");
+}
+
+// make a uniquely-named file and unlink it right away so only our descriptor keeps it alive
+SpillFile *TempFileManager::create() {
+    string path = directory() + "/_spill.XXXXXX";
+    int fd = mkstemp(&path[0]);
+    if (fd < 0)
+        throw DbRelationError("could not create spill file in " + directory());
+    unlink(path.c_str());
+    FILE *file = fdopen(fd, "w+b");
+    if (file == nullptr) {
+        close(fd);
+        throw DbRelationError("could not open spill file");
+    }
+    Counters::add(Counters::SPILL_FILES);
+    return new SpillFile(file);
+}
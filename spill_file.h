@@ -0,0 +1,86 @@
+/**
+ * @file spill_file.h - temporary files for operators that run out of memory
+ * SpillFile
+ * TempFileManager
+ *
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include "storage_engine.h"
+
+/**
+ * @class SpillFile - a temporary file of length-prefixed records, written sequentially then read back sequentially.
+ *
+ * The file is unlinked as soon as it is created, so it disappears when closed (or if we crash).
+ */
+class SpillFile {
+public:
+    /**
+     * Size of the stdio buffer, so reads and writes reach the disk in large sequential chunks.
+     */
+    static const size_t BUFFER_SZ = 64 * 1024;
+
+    SpillFile(FILE *file);
+
+    virtual ~SpillFile();
+
+    SpillFile(const SpillFile &other) = delete;
+
+    SpillFile &operator=(const SpillFile &other) = delete;
+
+    /**
+     * Append a record. Only valid before rewind().
+     * @param record  bytes to append
+     */
+    virtual void write(const std::string &record);
+
+    /**
+     * Switch from writing to reading, starting back at the first record.
+     */
+    virtual void rewind();
+
+    /**
+     * Read the next record.
+     * @param record  returned by reference: the record's bytes
+     * @returns       false if there are no more records
+     */
+    virtual bool read(std::string &record);
+
+    /**
+     * Number of records written.
+     */
+    uint64_t get_count() const { return count; }
+
+    /**
+     * Number of bytes written, including length prefixes.
+     */
+    uint64_t get_size() const { return size; }
+
+protected:
+    FILE *file;
+    char *buffer;
+    uint64_t count;
+    uint64_t size;
+};
+
+
+/**
+ * @class TempFileManager - hands out SpillFiles in the database environment's directory
+ */
+class TempFileManager {
+public:
+    /**
+     * Create a new, empty spill file.
+     * @returns  the spill file (freed by caller)
+     * @throws DbRelationError if the file cannot be created
+     */
+    static SpillFile *create();
+
+    /**
+     * Directory spill files go in: the database environment's home.
+     */
+    static std::string directory();
+};
@@ -1,10 +1,21 @@
+#include <csignal>
 #include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <string>
+#include <unistd.h>
+#include "aggregate.h"
+#include "bulk_load.h"
+#include "catalog_cache.h"
 #include "db_cxx.h"
-#include "SQLParser.h"
+#include "hash_join.h"
+#include "heap_storage.h"
 #include "ParseTreeToString.h"
-#include "SQLExec.h"
+#include "protocol.h"
+#include "server.h"
+#include "shell.h"
+#include "sort.h"
+#include "transaction.h"
 
 using namespace std;
 using namespace hsql;
@@ -18,61 +29,149 @@ void initialize_environment(char *envHome) {
     env->set_message_stream(&cout);
     env->set_error_stream(&cerr);
     try {
-        env->open(envHome, DB_CREATE | DB_INIT_MPOOL, 0);
+        env->open(envHome, DB_CREATE | DB_INIT_MPOOL | DB_THREAD, 0);
     } catch (DbException &exc) {
         cerr << "(sql5300: " << exc.what() << ")" << endl;
         exit(1);
     }
     _DB_ENV = env;
-    initialize_schema_tables();
+    try {
+        Transaction::open_log(envHome);
+        if (Transaction::get_log()->get_recovered() > 0)
+            cout << "(sql5300: recovered " << Transaction::get_log()->get_recovered() << " committed transactions)"
+                 << endl;
+        initialize_schema_tables();
+        Transaction::get_log()->checkpoint();  // the schema tables are created without logging
+    } catch (DbRelationError &exc) {
+        cerr << "(sql5300: " << exc.what() << ")" << endl;
+        exit(1);
+    }
+}
+
+// the server, while one is running (for the signal handler)
+Server *server = nullptr;
+
+void stop_server(int) {
+    server->stop();
+}
+
+/**
+ * Serve clients until interrupted (SIGINT or SIGTERM).
+ * @param address  port number on localhost or Unix socket path to listen on
+ * @param workers  number of worker threads
+ */
+int serve(const string &address, uint workers) {
+    try {
+        server = new Server(address, workers);
+    } catch (ProtocolError &e) {
+        cerr << "(sql5300: " << e.what() << ")" << endl;
+        return EXIT_FAILURE;
+    }
+    signal(SIGINT, stop_server);
+    signal(SIGTERM, stop_server);
+    cout << "(sql5300: listening on " << address << " with " << workers << " workers)" << endl;
+    server->run();
+    cout << "(sql5300: served " << server->get_requests() << " requests on " << server->get_connections()
+         << " connections)" << endl;
+    delete server;
+    Transaction::close_log();
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Finish a shell's session: roll back a transaction left in progress, print the timing totals and
+ * empty the log.
+ */
+void finish(Shell &shell) {
+    if (shell.in_transaction())
+        shell.run("rollback");
+    shell.print_timing_totals();
+    Transaction::close_log();
+}
+
+/**
+ * Run a script without echoing its statements.
+ * @param path  the script's path, or "-" (or empty) for stdin
+ * @returns     the exit status: failure if the script can't be read or any statement in it failed
+ */
+int run_script(const string &path) {
+    ifstream file;
+    if (!path.empty() && path != "-") {
+        file.open(path);
+        if (!file) {
+            cerr << "(sql5300: can't read " << path << ")" << endl;
+            return EXIT_FAILURE;
+        }
+    }
+    Shell shell(cout, cerr, false);
+    bool ok = shell.run_script(file.is_open() ? file : cin);
+    finish(shell);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 /**
  * Main entry point of the sql5300 program
  * @args dbenvpath  the path to the BerkeleyDB database environment
+ * @args -f         run this script (- for stdin) instead of reading from the terminal; so does
+ *                  stdin that is not a terminal
+ * @args --listen   serve clients on this port number (on localhost) or Unix socket path instead of
+ *                  reading from the terminal, with --workers threads running their statements
  */
 int main(int argc, char *argv[]) {
 
     // Open/create the db environment
-    if (argc != 2) {
-        cerr << "Usage: cpsc5300: dbenvpath" << endl;
+    string address, script;
+    uint workers = Server::default_workers();
+    char *env_home = nullptr;
+    bool valid = true;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--listen" && i + 1 < argc)
+            address = argv[++i];
+        else if (arg == "-f" && i + 1 < argc)
+            script = argv[++i];
+        else if (arg == "--workers" && i + 1 < argc && atoi(argv[i + 1]) > 0)
+            workers = (uint) atoi(argv[++i]);
+        else if (env_home == nullptr && arg[0] != '-')
+            env_home = argv[i];
+        else
+            valid = false;
+    }
+    if (!valid || env_home == nullptr || (!address.empty() && !script.empty())) {
+        cerr << "Usage: cpsc5300: dbenvpath [-f script.sql | --listen port|socketpath [--workers n]]" << endl;
         return EXIT_FAILURE;
     }
-    initialize_environment(argv[1]);
+    initialize_environment(env_home);
+    if (!address.empty())
+        return serve(address, workers);
+    if (!script.empty() || !isatty(STDIN_FILENO))
+        return run_script(script);
 
     // Enter the SQL shell loop
+    Shell shell(cout, cerr);
     while (true) {
-        cout << "SQL> ";
+        shell.console() << "SQL> ";
         string query;
         getline(cin, query);
         if (query.length() == 0)
             continue;
-        if (query == "quit")
+        if (query == "quit") {
+            finish(shell);
             break;  // only way to get out
+        }
         if (query == "test") {
-            cout << "test_heap_storage: " << (test_heap_storage() ? "ok" : "failed") << endl;
+            shell.console() << "test_heap_storage: " << (test_heap_storage() ? "ok" : "failed") << endl;
+            shell.console() << "test_hash_join: " << (test_hash_join() ? "ok" : "failed") << endl;
+            shell.console() << "test_sort: " << (test_sort() ? "ok" : "failed") << endl;
+            shell.console() << "test_aggregate: " << (test_aggregate() ? "ok" : "failed") << endl;
+            shell.console() << "test_bulk_load: " << (test_bulk_load() ? "ok" : "failed") << endl;
+            shell.console() << "test_catalog_cache: " << (test_catalog_cache() ? "ok" : "failed") << endl;
+            shell.console() << "test_lock_manager: " << (test_lock_manager() ? "ok" : "failed") << endl;
+            shell.console() << "test_parse_tree_to_string: " << (test_parse_tree_to_string() ? "ok" : "failed")
+                            << endl;
             continue;
         }
-
-        // parse and execute
-        SQLParserResult *parse = SQLParser::parseSQLString(query);
-        if (!parse->isValid()) {
-            cout << "invalid SQL: " << query << endl;
-            cout << parse->errorMsg() << endl;
-        } else {
-            for (uint i = 0; i < parse->size(); ++i) {
-                const SQLStatement *statement = parse->getStatement(i);
-                try {
-                    cout << ParseTreeToString::statement(statement) << endl;
-                    QueryResult *result = SQLExec::execute(statement);
-                    cout << *result << endl;
-                    delete result;
-                } catch (SQLExecError &e) {
-                    cout << "Error: " << e.what() << endl;
-                }
-            }
-        }
-        delete parse;
+        shell.run(query);
     }
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,46 @@
+/**
+ * @file sql5300_client.cpp - command-line client for the sql5300 server
+ *
+ * Usage: sql5300_client port|socketpath
+ * Sends each line read from stdin to the server (see sql5300 --listen) and prints the response as
+ * the shell would: the output to stdout and, in the formats other than table, the messages to
+ * stderr. Prompts when stdin is a terminal. Exits with 1 if any line failed.
+ *
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include "protocol.h"
+
+using namespace std;
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        cerr << "Usage: sql5300_client port|socketpath" << endl;
+        return EXIT_FAILURE;
+    }
+    bool interactive = isatty(STDIN_FILENO);
+    bool failed = false;
+    try {
+        Connection connection(argv[1]);
+        while (true) {
+            if (interactive)
+                cout << "SQL> " << flush;
+            string line;
+            if (!getline(cin, line) || line == "quit")
+                break;
+            if (line.empty())
+                continue;
+            connection.send(line);
+            bool ok = connection.receive(cout, cerr);
+            cout << flush;
+            failed = failed || !ok;
+        }
+    } catch (ProtocolError &e) {
+        cerr << "(sql5300_client: " << e.what() << ")" << endl;
+        return EXIT_FAILURE;
+    }
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
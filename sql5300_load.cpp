@@ -0,0 +1,140 @@
+/**
+ * @file sql5300_load.cpp - load generator for the sql5300 server
+ *
+ * Usage: sql5300_load port|socketpath [--clients n] [--seconds s] [--keys k] [--setup line]... line...
+ * Opens n connections (default 16), each running the --setup lines once (say, PREPARE statements,
+ * which are kept per connection) and then sending the other lines round-robin, waiting for each
+ * response, for s seconds (default 10). Each %d in a line is replaced by a random number below k
+ * (default 1000000). Prints requests per second and the latency percentiles over all connections.
+ *
+ * $ ./sql5300_load /tmp/sql5300.sock --clients 32 --setup "prepare q as select * from foo where id = ?" \
+ *       "execute q(%d)" "insert into foo values (%d, \"x\")"
+ *
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "protocol.h"
+
+using namespace std;
+
+struct Worker {
+    vector<uint64_t> latencies;  // nanoseconds, one per request
+    uint64_t errors = 0;
+    string first_error;          // response to the first request that failed
+    string failure;              // why the connection was lost, if it was
+};
+
+// replace each %d with a random key
+static string instantiate(const string &line, mt19937_64 &random, uint64_t keys) {
+    string result;
+    for (size_t i = 0; i < line.size(); i++) {
+        if (line[i] == '%' && i + 1 < line.size() && line[i + 1] == 'd') {
+            result += to_string(random() % keys);
+            i++;
+        } else {
+            result += line[i];
+        }
+    }
+    return result;
+}
+
+static void run_client(const string &address, const vector<string> &setup, const vector<string> &lines,
+                       uint64_t keys, uint id, chrono::steady_clock::time_point deadline, Worker &worker) {
+    mt19937_64 random(id * 7919 + 1);
+    try {
+        Connection connection(address);
+        for (auto const &line : setup) {
+            Response response = connection.request(line);
+            if (!response.ok)
+                throw ProtocolError("setup failed: " + line + ": " + response.output + response.messages);
+        }
+        for (size_t i = id; chrono::steady_clock::now() < deadline; i++) {
+            string line = instantiate(lines[i % lines.size()], random, keys);
+            auto start = chrono::steady_clock::now();
+            Response response = connection.request(line);
+            worker.latencies.push_back((uint64_t) chrono::duration_cast<chrono::nanoseconds>(
+                    chrono::steady_clock::now() - start).count());
+            if (!response.ok && worker.errors++ == 0)
+                worker.first_error = line + ": " + response.output + response.messages;
+        }
+    } catch (ProtocolError &e) {
+        worker.failure = e.what();
+    }
+}
+
+int main(int argc, char *argv[]) {
+    string address;
+    uint clients = 16;
+    double seconds = 10;
+    uint64_t keys = 1000000;
+    vector<string> setup, lines;
+    bool valid = argc > 1;
+    for (int i = 2; i < argc && valid; i++) {
+        string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--clients" && has_value)
+            clients = (uint) atoi(argv[++i]);
+        else if (arg == "--seconds" && has_value)
+            seconds = atof(argv[++i]);
+        else if (arg == "--keys" && has_value)
+            keys = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--setup" && has_value)
+            setup.push_back(argv[++i]);
+        else if (arg.compare(0, 2, "--") == 0)
+            valid = false;
+        else
+            lines.push_back(arg);
+    }
+    if (!valid || lines.empty() || clients == 0 || seconds <= 0 || keys == 0) {
+        cerr << "Usage: sql5300_load port|socketpath [--clients n] [--seconds s] [--keys k] [--setup line]... line..."
+             << endl;
+        return EXIT_FAILURE;
+    }
+    address = argv[1];
+
+    vector<Worker> workers(clients);
+    vector<thread> threads;
+    auto start = chrono::steady_clock::now();
+    auto deadline = start + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(seconds));
+    for (uint id = 0; id < clients; id++)
+        threads.emplace_back(run_client, cref(address), cref(setup), cref(lines), keys, id, deadline,
+                             ref(workers[id]));
+    for (auto &thread : threads)
+        thread.join();
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    vector<uint64_t> latencies;
+    uint64_t errors = 0;
+    bool lost = false;
+    for (auto const &worker : workers) {
+        latencies.insert(latencies.end(), worker.latencies.begin(), worker.latencies.end());
+        errors += worker.errors;
+        if (!worker.failure.empty())
+            cerr << "(sql5300_load: " << worker.failure << ")" << endl;
+        if (!worker.first_error.empty())
+            cerr << "(sql5300_load: failed: " << worker.first_error << ")" << endl;
+        lost = lost || !worker.failure.empty();
+    }
+    sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) {
+        if (latencies.empty())
+            return 0.0;
+        size_t i = min(latencies.size() - 1, (size_t) (p / 100 * latencies.size()));
+        return latencies[i] / 1000.0;
+    };
+    cout << clients << " clients, " << latencies.size() << " requests (" << errors << " failed) in " << fixed
+         << setprecision(1) << elapsed << " s: " << (uint64_t) (latencies.size() / elapsed) << " requests/sec"
+         << endl;
+    cout << "latency us: p50 " << percentile(50) << "  p90 " << percentile(90) << "  p99 " << percentile(99)
+         << "  p99.9 " << percentile(99.9) << "  max " << percentile(100) << endl;
+    return errors > 0 || lost ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,101 @@
+/**
+ * @file statement_statistics.cpp - implementation of the statement statistics table
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include "statement_statistics.h"
+
+using namespace std;
+
+// lower a to b if b is smaller, racing other threads doing the same
+static void lower(atomic<uint64_t> &a, uint64_t b) {
+    uint64_t current = a.load(memory_order_relaxed);
+    while (b < current && !a.compare_exchange_weak(current, b, memory_order_relaxed))
+        continue;
+}
+
+// raise a to b if b is bigger
+static void raise(atomic<uint64_t> &a, uint64_t b) {
+    uint64_t current = a.load(memory_order_relaxed);
+    while (b > current && !a.compare_exchange_weak(current, b, memory_order_relaxed))
+        continue;
+}
+
+
+/*
+ * ****************************************
+ * StatementStatistics class implementation
+ * ****************************************
+ */
+
+StatementStatistics::StatementStatistics() : entries(new Entry[CAPACITY]), dropped(0) {
+    for (uint i = 0; i < CAPACITY; i++) {
+        Entry &entry = this->entries[i];
+        entry.hash.store(0, memory_order_relaxed);
+        entry.fingerprint.store(nullptr, memory_order_relaxed);
+        entry.calls.store(0, memory_order_relaxed);
+        entry.total_nanos.store(0, memory_order_relaxed);
+        entry.min_nanos.store(UINT64_MAX, memory_order_relaxed);
+        entry.max_nanos.store(0, memory_order_relaxed);
+        entry.rows.store(0, memory_order_relaxed);
+        entry.pages.store(0, memory_order_relaxed);
+    }
+}
+
+StatementStatistics::~StatementStatistics() {
+    for (uint i = 0; i < CAPACITY; i++)
+        delete this->entries[i].fingerprint.load(memory_order_relaxed);
+}
+
+void StatementStatistics::record(const string &fingerprint, uint64_t nanos, uint64_t rows, uint64_t pages) {
+    Entry *entry = find(fingerprint);
+    if (entry == nullptr) {
+        this->dropped.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+    entry->calls.fetch_add(1, memory_order_relaxed);
+    entry->total_nanos.fetch_add(nanos, memory_order_relaxed);
+    lower(entry->min_nanos, nanos);
+    raise(entry->max_nanos, nanos);
+    entry->rows.fetch_add(rows, memory_order_relaxed);
+    entry->pages.fetch_add(pages, memory_order_relaxed);
+    entry->latencies.add(nanos);
+}
+
+// Linear probing from the hash's home slot. Two fingerprints with the same 64-bit hash share a slot.
+StatementStatistics::Entry *StatementStatistics::find(const string &fingerprint) {
+    uint64_t hash = (uint64_t) std::hash<string>()(fingerprint) | 1;  // never 0, which marks a free slot
+    for (uint probe = 0; probe < CAPACITY; probe++) {
+        Entry &entry = this->entries[(hash + probe) & (CAPACITY - 1)];
+        uint64_t found = entry.hash.load(memory_order_acquire);
+        if (found == 0 && entry.hash.compare_exchange_strong(found, hash, memory_order_acq_rel)) {
+            entry.fingerprint.store(new string(fingerprint), memory_order_release);
+            return &entry;
+        }
+        if (found == hash)
+            return &entry;
+    }
+    return nullptr;
+}
+
+void StatementStatistics::get_summaries(vector<Summary> &summaries) const {
+    for (uint i = 0; i < CAPACITY; i++) {
+        const Entry &entry = this->entries[i];
+        const string *fingerprint = entry.fingerprint.load(memory_order_acquire);
+        uint64_t calls = entry.calls.load(memory_order_relaxed);
+        if (fingerprint == nullptr || calls == 0)
+            continue;  // still being claimed
+        Summary summary;
+        summary.fingerprint = *fingerprint;
+        summary.calls = calls;
+        summary.total_nanos = entry.total_nanos.load(memory_order_relaxed);
+        summary.min_nanos = entry.min_nanos.load(memory_order_relaxed);
+        summary.max_nanos = entry.max_nanos.load(memory_order_relaxed);
+        summary.p99_nanos = min(entry.latencies.percentile(0.99), summary.max_nanos);
+        summary.rows = entry.rows.load(memory_order_relaxed);
+        summary.pages = entry.pages.load(memory_order_relaxed);
+        summaries.push_back(summary);
+    }
+}
@@ -0,0 +1,178 @@
+/**
+ * @file statement_statistics.h - what each kind of statement has cost so far
+ * BasicLatencyHistogram
+ * StatementStatistics
+ *
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @class BasicLatencyHistogram - counts of durations in buckets of bounded relative width, for percentiles.
+ *
+ * Durations are bucketed by their highest set bit and the SUB_BITS bits below it, so a bucket is
+ * never wider than 1/2^SUB_BITS of its lower bound whatever the magnitude, from nanoseconds to
+ * hours (as in HdrHistogram). Counting is one relaxed atomic increment, safe from any number of
+ * threads.
+ */
+template<uint SUB_BITS>
+class BasicLatencyHistogram {
+public:
+    static const uint BUCKETS = (64 - SUB_BITS + 1) << SUB_BITS;
+
+    BasicLatencyHistogram() {
+        for (auto &count: this->counts)
+            count.store(0, std::memory_order_relaxed);
+    }
+
+    void add(uint64_t nanos) { counts[bucket(nanos)].fetch_add(1, std::memory_order_relaxed); }
+
+    /**
+     * Add another histogram's counts to this one's.
+     */
+    void add(const BasicLatencyHistogram &other) {
+        for (uint i = 0; i < BUCKETS; i++)
+            this->counts[i].fetch_add(other.counts[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+
+    /**
+     * Number of durations counted.
+     */
+    uint64_t count() const {
+        uint64_t total = 0;
+        for (auto const &count: this->counts)
+            total += count.load(std::memory_order_relaxed);
+        return total;
+    }
+
+    /**
+     * Estimate a percentile.
+     * @param fraction  e.g. 0.99 for the 99th percentile
+     * @returns         upper bound of the bucket holding that percentile (0 if nothing was counted)
+     */
+    uint64_t percentile(double fraction) const {
+        uint64_t total = count();
+        if (total == 0)
+            return 0;
+        uint64_t rank = (uint64_t) (fraction * total);
+        if (rank >= total)
+            rank = total - 1;
+        uint64_t seen = 0;
+        for (uint i = 0; i < BUCKETS; i++) {
+            seen += this->counts[i].load(std::memory_order_relaxed);
+            if (seen > rank)
+                return upper_bound(i);
+        }
+        return upper_bound(BUCKETS - 1);
+    }
+
+protected:
+    std::atomic<uint32_t> counts[BUCKETS];
+
+    // Values below 2^SUB_BITS get a bucket each; above that, (top bit, next SUB_BITS bits) pick the bucket.
+    static uint bucket(uint64_t nanos) {
+        if (nanos < (1ULL << SUB_BITS))
+            return (uint) nanos;
+        uint top = 63 - (uint) __builtin_clzll(nanos);
+        uint shift = top - SUB_BITS;
+        return ((shift + 1) << SUB_BITS) + (uint) ((nanos >> shift) & ((1ULL << SUB_BITS) - 1));
+    }
+
+    static uint64_t upper_bound(uint bucket) {
+        if (bucket < (1U << SUB_BITS))
+            return bucket;
+        uint shift = (bucket >> SUB_BITS) - 1;
+        uint64_t mantissa = (1ULL << SUB_BITS) | (bucket & ((1U << SUB_BITS) - 1));
+        return ((mantissa + 1) << shift) - 1;
+    }
+};
+
+// buckets at most 12.5% wide, small enough to keep one per statement fingerprint
+typedef BasicLatencyHistogram<3> LatencyHistogram;
+
+
+/**
+ * @class StatementStatistics - per statement fingerprint: calls, latency, rows and pages read.
+ *
+ * A fixed-size open-addressing hash table that executing threads update without locks: a new
+ * fingerprint claims an empty slot with a compare-and-swap of its hash, and every counter is an
+ * atomic updated with relaxed fetch-adds (min and max with compare-and-swap loops). Readers see
+ * each counter's latest value, though not necessarily a consistent set of them. Slots are never
+ * freed; once the table is full, statements with new fingerprints are only counted as dropped.
+ */
+class StatementStatistics {
+public:
+    /**
+     * Number of different fingerprints that can be tracked (a power of 2).
+     */
+    static const uint CAPACITY = 512;
+
+    /**
+     * What has been recorded for one fingerprint.
+     */
+    struct Summary {
+        std::string fingerprint;
+        uint64_t calls;
+        uint64_t total_nanos;
+        uint64_t min_nanos;
+        uint64_t max_nanos;
+        uint64_t p99_nanos;
+        uint64_t rows;
+        uint64_t pages;
+    };
+
+    StatementStatistics();
+
+    virtual ~StatementStatistics();
+
+    StatementStatistics(const StatementStatistics &other) = delete;
+
+    StatementStatistics &operator=(const StatementStatistics &other) = delete;
+
+    /**
+     * Count one execution of a statement.
+     * @param fingerprint  the statement's fingerprint (see ParseTreeToString::fingerprint)
+     * @param nanos        how long it took
+     * @param rows         rows it returned or inserted
+     * @param pages        blocks it read
+     */
+    virtual void record(const std::string &fingerprint, uint64_t nanos, uint64_t rows, uint64_t pages);
+
+    /**
+     * Everything recorded so far, one summary per fingerprint.
+     * @param summaries  returned by reference: the summaries, in no particular order
+     */
+    virtual void get_summaries(std::vector<Summary> &summaries) const;
+
+    /**
+     * Number of executions not recorded because the table was full.
+     */
+    uint64_t get_dropped() const { return dropped.load(std::memory_order_relaxed); }
+
+protected:
+    struct Entry {
+        std::atomic<uint64_t> hash;  // 0 while the slot is free
+        std::atomic<const std::string *> fingerprint;  // set just after the slot is claimed
+        std::atomic<uint64_t> calls;
+        std::atomic<uint64_t> total_nanos;
+        std::atomic<uint64_t> min_nanos;
+        std::atomic<uint64_t> max_nanos;
+        std::atomic<uint64_t> rows;
+        std::atomic<uint64_t> pages;
+        LatencyHistogram latencies;
+    };
+
+    std::unique_ptr<Entry[]> entries;
+    std::atomic<uint64_t> dropped;
+
+    /**
+     * Find the slot of a fingerprint, claiming a free one for a new fingerprint.
+     * @returns  the slot, or nullptr if the table is full
+     */
+    Entry *find(const std::string &fingerprint);
+};
@@ -0,0 +1,249 @@
+/**
+ * @file statistics.cpp - implementation of table and column statistics
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include "statistics.h"
+#include "hash_join.h"
+#include "parallel_scan.h"
+
+using namespace std;
+
+// rows ANALYZE keeps (on average) for building histograms
+static const uint64_t SAMPLE_ROWS = 30000;
+
+int compare_values(const Value &a, const Value &b) {
+    if (a.data_type == ColumnAttribute::TEXT)
+        return a.s.compare(b.s);
+    return a.n < b.n ? -1 : a.n > b.n ? 1 : 0;
+}
+
+double default_selectivity(ColumnPredicate::Comparison comparison) {
+    switch (comparison) {
+        case ColumnPredicate::EQ:
+            return 0.1;
+        case ColumnPredicate::NE:
+            return 0.9;
+        default:
+            return 1.0 / 3;
+    }
+}
+
+
+/*
+ * ********************************
+ * HyperLogLog class implementation
+ * ********************************
+ */
+
+HyperLogLog::HyperLogLog() : registers(1U << PRECISION, 0) {
+}
+
+void HyperLogLog::add(uint64_t hash) {
+    uint64_t rest = hash << PRECISION;
+    uint8_t rank = 1;
+    while (rank <= 64 - PRECISION && (rest & (1ULL << 63)) == 0) {
+        rest <<= 1;
+        rank++;
+    }
+    uint8_t &reg = this->registers[hash >> (64 - PRECISION)];
+    reg = max(reg, rank);
+}
+
+void HyperLogLog::merge(const HyperLogLog &other) {
+    for (uint i = 0; i < this->registers.size(); i++)
+        this->registers[i] = max(this->registers[i], other.registers[i]);
+}
+
+uint64_t HyperLogLog::estimate() const {
+    double m = this->registers.size();
+    double sum = 0;
+    uint zeros = 0;
+    for (auto const &reg: this->registers) {
+        sum += ldexp(1.0, -reg);
+        if (reg == 0)
+            zeros++;
+    }
+    double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+    if (estimate <= 2.5 * m && zeros > 0)
+        estimate = m * log(m / zeros);  // linear counting is better for small counts
+    return (uint64_t) llround(estimate);
+}
+
+
+/*
+ * *************************************
+ * ColumnStatistics class implementation
+ * *************************************
+ */
+
+double ColumnStatistics::selectivity(ColumnPredicate::Comparison comparison, const Value &value) const {
+    if (this->bounds.empty())
+        return 0;  // nothing in the table
+    double eq = equal(value);
+    double lt = below(value);
+    switch (comparison) {
+        case ColumnPredicate::EQ:
+            return eq;
+        case ColumnPredicate::NE:
+            return 1 - eq;
+        case ColumnPredicate::LT:
+            return lt;
+        case ColumnPredicate::LE:
+            return min(1.0, lt + eq);
+        case ColumnPredicate::GT:
+            return max(0.0, 1 - lt - eq);
+        case ColumnPredicate::GE:
+            return 1 - lt;
+        default:
+            return 1;
+    }
+}
+
+// Longest run of a repeated upper bound, as a fraction of the rows.
+double ColumnStatistics::most_common() const {
+    uint buckets = (uint) this->bounds.size() - 1;
+    uint longest = 0;
+    for (uint i = 1, run = 0; i < this->bounds.size(); i++) {
+        run = i > 1 && this->bounds[i] == this->bounds[i - 1] ? run + 1 : 1;
+        longest = max(longest, run);
+    }
+    if (longest >= 2)
+        return (double) longest / buckets;
+    return this->distinct == 0 ? 0 : 1.0 / this->distinct;
+}
+
+// A value filling k buckets is the upper bound of k of them; anything rarer gets 1 / distinct.
+double ColumnStatistics::equal(const Value &value) const {
+    uint buckets = (uint) this->bounds.size() - 1;
+    if (compare_values(value, this->bounds.front()) < 0 || compare_values(value, this->bounds.back()) > 0)
+        return 0;
+    uint k = (uint) count(this->bounds.begin() + 1, this->bounds.end(), value);
+    if (k >= 2)
+        return (double) k / buckets;
+    return this->distinct == 0 ? 0 : 1.0 / this->distinct;
+}
+
+// Fraction of rows less than value: the buckets wholly below it, plus a share of the one it falls in.
+double ColumnStatistics::below(const Value &value) const {
+    uint buckets = (uint) this->bounds.size() - 1;
+    if (buckets == 0 || compare_values(value, this->bounds.front()) <= 0)
+        return 0;
+    if (compare_values(value, this->bounds.back()) > 0)
+        return 1;
+    uint i = 0;
+    while (i < buckets && compare_values(this->bounds[i + 1], value) < 0)
+        i++;
+    const Value &low = this->bounds[i];
+    const Value &high = this->bounds[i + 1];
+    double share = 0.5;
+    if (low.data_type != ColumnAttribute::TEXT && high.n > low.n)
+        share = ((double) value.n - low.n) / ((double) high.n - low.n);
+    double fraction = (i + share) / buckets;
+    if (compare_values(value, high) == 0)
+        fraction -= equal(value);  // the rows equal to the bound are not below it
+    return max((double) i / buckets, fraction);
+}
+
+
+/*
+ * ************************************
+ * TableStatistics class implementation
+ * ************************************
+ */
+
+// What one scan thread has seen.
+struct ScanStatistics {
+    uint64_t rows;
+    uint64_t bytes;
+    vector<HyperLogLog> sketches;
+    ValueRow min, max;
+    ValueRows sample;
+    mt19937_64 random;
+};
+
+// Each thread sketches distinct values, tracks min/max and samples rows; then the threads' findings are combined.
+void TableStatistics::gather(DbRelation &table) {
+    const ColumnNames &column_names = table.get_column_names();
+    uint n = (uint) column_names.size();
+    vector<vector<uint>> keys(n);
+    for (uint column = 0; column < n; column++)
+        keys[column].push_back(column);
+    uint64_t expected = table.row_count();
+    double rate = expected <= SAMPLE_ROWS ? 1.0 : (double) SAMPLE_ROWS / expected;
+
+    ParallelScan scan(table, table.get_table_name());
+    vector<ScanStatistics> threads(scan.get_max_threads());
+    for (uint worker = 0; worker < threads.size(); worker++) {
+        threads[worker].rows = threads[worker].bytes = 0;
+        threads[worker].sketches.resize(n);
+        threads[worker].random.seed(worker + 1);
+    }
+    scan.run([&](uint worker, ValueRows &rows) {
+        ScanStatistics &mine = threads[worker];
+        uniform_real_distribution<double> coin(0, 1);
+        for (auto &row: rows) {
+            mine.rows++;
+            mine.bytes += row_bytes(row);
+            if (mine.min.empty())
+                mine.min = mine.max = row;
+            for (uint column = 0; column < n; column++) {
+                mine.sketches[column].add(hash_key(row, keys[column]));
+                if (compare_values(row[column], mine.min[column]) < 0)
+                    mine.min[column] = row[column];
+                if (compare_values(row[column], mine.max[column]) > 0)
+                    mine.max[column] = row[column];
+            }
+            if (rate >= 1 || coin(mine.random) < rate)
+                mine.sample.push_back(move(row));
+        }
+        return true;
+    });
+
+    BlockIDs *block_ids = table.block_ids();
+    this->pages = block_ids->size();
+    delete block_ids;
+    this->rows = this->row_width = 0;
+    for (auto const &mine: threads) {
+        this->rows += mine.rows;
+        this->row_width += mine.bytes;
+    }
+    if (this->rows > 0)
+        this->row_width /= this->rows;
+
+    this->columns.clear();
+    for (uint column = 0; column < n; column++) {
+        ColumnStatistics &stats = this->columns[column_names[column]];
+        HyperLogLog sketch;
+        ValueRow values;
+        Value low, high;
+        bool any = false;
+        for (auto const &mine: threads) {
+            if (mine.min.empty())
+                continue;
+            sketch.merge(mine.sketches[column]);
+            if (!any || compare_values(mine.min[column], low) < 0)
+                low = mine.min[column];
+            if (!any || compare_values(mine.max[column], high) > 0)
+                high = mine.max[column];
+            any = true;
+            for (auto const &row: mine.sample)
+                values.push_back(row[column]);
+        }
+        if (!any)
+            continue;
+        stats.distinct = max<uint64_t>(1, min(sketch.estimate(), this->rows));
+
+        sort(values.begin(), values.end(), [](const Value &a, const Value &b) { return compare_values(a, b) < 0; });
+        stats.bounds.push_back(low);
+        if (!values.empty())
+            for (uint i = 1; i < HISTOGRAM_BUCKETS; i++)
+                stats.bounds.push_back(values[(uint64_t) i * values.size() / HISTOGRAM_BUCKETS]);
+        stats.bounds.push_back(high);
+        for (auto &bound: stats.bounds)
+            if (bound.s.size() > HISTOGRAM_TEXT_LENGTH)
+                bound.s.resize(HISTOGRAM_TEXT_LENGTH);
+    }
+}
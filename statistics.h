@@ -0,0 +1,135 @@
+/**
+ * @file statistics.h - table and column statistics for the query planner
+ * HyperLogLog
+ * ColumnStatistics
+ * TableStatistics
+ *
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#pragma once
+
+#include <map>
+#include "eval_plan.h"
+
+/**
+ * @class HyperLogLog - estimates the number of distinct values in a stream in fixed memory.
+ *
+ * Each value's 64-bit hash picks a register with its top PRECISION bits, and the register keeps
+ * the longest run of leading zeros seen in the rest of the hash. The harmonic mean of the
+ * registers gives the estimate (about 1.6% standard error with 4096 registers), with linear
+ * counting taking over for small counts. Sketches of different parts of a table merge exactly.
+ */
+class HyperLogLog {
+public:
+    /**
+     * Number of hash bits used to pick a register.
+     */
+    static const uint PRECISION = 12;
+
+    HyperLogLog();
+
+    virtual ~HyperLogLog() {}
+
+    /**
+     * Count a value.
+     * @param hash  64-bit hash of the value
+     */
+    virtual void add(uint64_t hash);
+
+    /**
+     * Fold in the values counted by another sketch.
+     * @param other  sketch to merge (unchanged)
+     */
+    virtual void merge(const HyperLogLog &other);
+
+    /**
+     * Estimated number of distinct values counted.
+     */
+    virtual uint64_t estimate() const;
+
+protected:
+    std::vector<uint8_t> registers;
+};
+
+
+/**
+ * Number of buckets in a column's histogram.
+ */
+const uint HISTOGRAM_BUCKETS = 32;
+
+/**
+ * Longest TEXT value kept as a histogram bound (longer ones are cut short).
+ */
+const uint HISTOGRAM_TEXT_LENGTH = 32;
+
+
+/**
+ * @class ColumnStatistics - what the planner knows about the values of one column.
+ *
+ * The histogram is equi-depth: bounds[0] is the column's minimum, bounds[HISTOGRAM_BUCKETS] its
+ * maximum, and each bucket (bounds[i], bounds[i + 1]] holds about the same number of rows.
+ * A value common enough to fill whole buckets shows up as the same bound repeated, which is how
+ * skew is detected.
+ */
+class ColumnStatistics {
+public:
+    ColumnStatistics() : distinct(0) {}
+
+    virtual ~ColumnStatistics() {}
+
+    uint64_t distinct;  // estimated number of distinct values
+    ValueRow bounds;    // histogram bucket bounds (empty if the table was empty)
+
+    /**
+     * Estimated fraction of the rows satisfying a comparison with a constant.
+     * @param comparison  the comparison
+     * @param value       the constant the column is compared with
+     * @returns           selectivity between 0 and 1
+     */
+    virtual double selectivity(ColumnPredicate::Comparison comparison, const Value &value) const;
+
+    /**
+     * Estimated fraction of the rows holding the column's most common value.
+     */
+    virtual double most_common() const;
+
+protected:
+    virtual double equal(const Value &value) const;
+
+    virtual double below(const Value &value) const;
+};
+
+
+/**
+ * @class TableStatistics - what ANALYZE found out about a table.
+ */
+class TableStatistics {
+public:
+    TableStatistics() : rows(0), pages(0), row_width(0) {}
+
+    virtual ~TableStatistics() {}
+
+    uint64_t rows;
+    uint64_t pages;
+    uint64_t row_width;  // average bytes of memory a row takes in a plan (see row_bytes)
+    std::map<Identifier, ColumnStatistics> columns;
+
+    /**
+     * Scan a table and gather its statistics.
+     * Distinct counts and min/max are over every row; histograms are built from a random sample.
+     * @param table  relation to analyze
+     */
+    virtual void gather(DbRelation &table);
+};
+
+
+/**
+ * Order two values of the same type.
+ * @returns  negative, zero or positive as a is less than, equal to or greater than b
+ */
+int compare_values(const Value &a, const Value &b);
+
+/**
+ * Selectivity the planner assumes for a comparison on a column it has no statistics for.
+ */
+double default_selectivity(ColumnPredicate::Comparison comparison);
@@ -11,6 +11,7 @@
 
 #include <exception>
 #include <map>
+#include <memory>
 #include <utility>
 #include <vector>
 #include "db_cxx.h"
@@ -28,6 +29,8 @@ typedef u_int32_t BlockID;
 typedef std::vector<RecordID> RecordIDs;
 typedef std::length_error DbBlockNoRoomError;
 
+class ColumnBatch;  // forward declare
+
 /**
  * @class DbBlock - abstract base class for blocks in our database files 
  * (DbBlock's belong to DbFile's.)
@@ -137,6 +140,11 @@ public:
 
     virtual ~DbFile() {}
 
+    /**
+     * Name the file was created with.
+     */
+    const std::string &get_name() const { return name; }
+
     /**
      * Create the file.
      */
@@ -225,7 +233,7 @@ public:
 
     Value(int32_t n) : n(n) { data_type = ColumnAttribute::INT; }
 
-    Value(std::string s) : s(s) { data_type = ColumnAttribute::TEXT; }
+    Value(std::string s) : n(0), s(s) { data_type = ColumnAttribute::TEXT; }
 
     bool operator==(const Value &other) const;
 
@@ -242,6 +250,24 @@ typedef std::map<Identifier, Value> ValueDict;
 typedef std::vector<ValueDict *> ValueDicts;
 
 
+/**
+ * @class DbBlockScanner - decodes blocks of a relation into column batches.
+ *
+ * Threads scanning a relation in parallel each use their own scanner.
+ */
+class DbBlockScanner {
+public:
+    virtual ~DbBlockScanner() {}
+
+    /**
+     * Decode the records of one block into a column batch.
+     * @param block_id  which block to decode
+     * @param batch     returned by reference: the block's records, all selected
+     */
+    virtual void scan_block(BlockID block_id, ColumnBatch &batch) = 0;
+};
+
+
 /**
  * @class DbRelationError - generic exception class for DbRelation
  */
@@ -269,6 +295,7 @@ public:
  *	select(where)
  *	project(handle)
  *	project(handle, column_names)
+ *	row_count()
  */
 class DbRelation {
 public:
@@ -351,6 +378,14 @@ public:
      */
     virtual ValueDict *project(Handle handle) = 0;
 
+    /**
+     * Accessor for table_name.
+     * @returns table_name  name of this relation
+     */
+    virtual const Identifier &get_table_name() const {
+        return table_name;
+    }
+
     /**
      * Accessor for column_names.
      * @returns column_names   list of column names for this relation, in order
@@ -385,6 +420,93 @@ public:
      */
     virtual ValueDict *project(Handle handle, const ValueDict *column_names);
 
+    /**
+     * Number of rows in the relation (SELECT COUNT(*) FROM <table_name>).
+     * @returns  row count
+     */
+    virtual uint64_t row_count() {
+        Handles *handles = select();
+        uint64_t count = handles->size();
+        delete handles;
+        return count;
+    }
+
+    /**
+     * Get the blocks holding this relation's records, for scanning them a batch at a time.
+     * @returns  pointer to list of block ids (freed by caller)
+     */
+    virtual BlockIDs *block_ids() {
+        throw DbRelationError("batch scan not supported");
+    }
+
+    /**
+     * Decode the records of one block into a column batch.
+     * @param block_id  which block to decode
+     * @param batch     returned by reference: the block's records, all selected
+     */
+    virtual void scan_block(BlockID block_id, ColumnBatch &batch) {
+        throw DbRelationError("batch scan not supported");
+    }
+
+    /**
+     * Get a scanner of this relation's blocks for use by one thread, while other threads use others.
+     * @returns  pointer to the scanner (freed by caller)
+     */
+    virtual DbBlockScanner *block_scanner() {
+        throw DbRelationError("parallel scan not supported");
+    }
+
+    /**
+     * Encode a row the way this relation stores its records, for load().
+     * @param row    the row's values, in column order (each of its column's type)
+     * @param bytes  returned by reference: the record is appended here
+     * @returns      size of the record
+     */
+    virtual uint16_t encode(const std::vector<Value> &row, std::string &bytes) const {
+        throw DbRelationError("bulk load not supported");
+    }
+
+    /**
+     * Append records in bulk, filling each block before writing it once, instead of reading
+     * and writing the last block for every record as insert() does. Indices are not updated.
+     * @param records  records made by encode(), back to back
+     * @param sizes    size of each record, in order
+     * @param handles  if not null, returned by reference: the new records' handles are appended
+     */
+    virtual void load(const char *records, const std::vector<uint16_t> &sizes, Handles *handles) {
+        throw DbRelationError("bulk load not supported");
+    }
+
+    /**
+     * Copy one of the relation's blocks as it is stored, for dumping the relation.
+     * @param block_id  which block (one of block_ids())
+     * @param bytes     returned by reference: the block's DbBlock::BLOCK_SZ bytes are copied here
+     */
+    virtual void read_block(BlockID block_id, char *bytes) {
+        throw DbRelationError("raw dump not supported");
+    }
+
+    /**
+     * Append blocks copied by read_block from a relation with the same columns, without decoding
+     * and re-encoding their records. Indices are not updated.
+     * @param bytes    the blocks, DbBlock::BLOCK_SZ bytes each
+     * @param count    number of blocks
+     * @param handles  if not null, returned by reference: the handles of their records are appended
+     * @returns        number of records in the blocks
+     */
+    virtual uint64_t load_blocks(const char *bytes, uint count, Handles *handles) {
+        throw DbRelationError("raw restore not supported");
+    }
+
+    /**
+     * Number of times one of this relation's blocks was found in the buffer pool instead of
+     * being read in (counted since the environment was opened, so callers take differences).
+     * @returns  hit count, or 0 if the relation does not know
+     */
+    virtual uint64_t cache_hits() {
+        return 0;
+    }
+
 protected:
     Identifier table_name;
     ColumnNames column_names;
@@ -463,3 +585,9 @@ protected:
     ColumnNames key_columns;
     bool unique;
 };
+
+/*
+ * Reference-counted relations and indices, as the schema tables hand them out
+ */
+typedef std::shared_ptr<DbRelation> RelationRef;
+typedef std::shared_ptr<DbIndex> IndexRef;
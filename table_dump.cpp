@@ -0,0 +1,164 @@
+/**
+ * @file table_dump.cpp - implementation of table dumps
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "table_dump.h"
+
+using namespace std;
+
+static const char MAGIC[] = "K5TD";
+
+static void put_uint16(string &bytes, uint16_t n) {
+    bytes += (char) (n & 0xFF);
+    bytes += (char) (n >> 8);
+}
+
+static void put_uint32(string &bytes, uint32_t n) {
+    for (int shift = 0; shift < 32; shift += 8)
+        bytes += (char) ((n >> shift) & 0xFF);
+}
+
+static void put_name(string &bytes, const string &name) {
+    put_uint16(bytes, (uint16_t) name.size());
+    bytes += name;
+}
+
+static uint32_t get_uint(const char *bytes, uint length) {
+    uint32_t n = 0;
+    for (uint i = 0; i < length; i++)
+        n |= (uint32_t) (uint8_t) bytes[i] << (8 * i);
+    return n;
+}
+
+static void write_fully(int fd, const char *bytes, size_t length, const string &path) {
+    while (length > 0) {
+        ssize_t n = write(fd, bytes, length);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            throw DbRelationError("cannot write " + path + ": " + strerror(errno));
+        bytes += n;
+        length -= (size_t) n;
+    }
+}
+
+uint64_t TableDump::dump(DbRelation &table, const Identifier &table_name, const string &path) {
+    string header(MAGIC, 4);
+    put_uint16(header, VERSION);
+    put_uint32(header, DbBlock::BLOCK_SZ);
+    put_name(header, table_name);
+    ColumnNames column_names = table.get_column_names();
+    ColumnAttributes column_attributes = table.get_column_attributes();
+    put_uint16(header, (uint16_t) column_names.size());
+    for (uint i = 0; i < column_names.size(); i++) {
+        header += (char) column_attributes[i].get_data_type();
+        put_name(header, column_names[i]);
+    }
+
+    unique_ptr<BlockIDs> block_ids(table.block_ids());
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        throw DbRelationError("cannot create " + path + ": " + strerror(errno));
+    try {
+        write_fully(fd, header.data(), header.size(), path);
+        unique_ptr<char[]> batch(new char[BATCH_BLOCKS * DbBlock::BLOCK_SZ]);
+        for (size_t done = 0; done < block_ids->size();) {
+            uint count = 0;
+            for (; count < BATCH_BLOCKS && done < block_ids->size(); count++, done++)
+                table.read_block((*block_ids)[done], batch.get() + count * DbBlock::BLOCK_SZ);
+            write_fully(fd, batch.get(), count * DbBlock::BLOCK_SZ, path);
+        }
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    if (close(fd) < 0)
+        throw DbRelationError("cannot write " + path + ": " + strerror(errno));
+    return block_ids->size();
+}
+
+TableDump::TableDump(const string &path) : path(path), fd(-1), data_bytes(0) {
+    this->fd = open(path.c_str(), O_RDONLY);
+    if (this->fd < 0)
+        throw DbRelationError("cannot open " + path + ": " + strerror(errno));
+    try {
+        struct stat status;
+        if (fstat(this->fd, &status) < 0 || !S_ISREG(status.st_mode))
+            throw DbRelationError("cannot read " + path + ": not a file");
+        char fixed[10];
+        read_fully(fixed, sizeof(fixed));
+        if (memcmp(fixed, MAGIC, 4) != 0)
+            throw DbRelationError(path + " is not a table dump");
+        if (get_uint(fixed + 4, 2) != VERSION)
+            throw DbRelationError(path + ": unsupported dump version " + to_string(get_uint(fixed + 4, 2)));
+        if (get_uint(fixed + 6, 4) != DbBlock::BLOCK_SZ)
+            throw DbRelationError(path + ": dumped with " + to_string(get_uint(fixed + 6, 4)) + "-byte blocks, not "
+                                  + to_string(DbBlock::BLOCK_SZ));
+        size_t header_bytes = sizeof(fixed);
+        auto read_name = [this, &header_bytes]() {
+            char length[2];
+            read_fully(length, 2);
+            string name(get_uint(length, 2), '\0');
+            read_fully(&name[0], name.size());
+            header_bytes += 2 + name.size();
+            return name;
+        };
+        this->table_name = read_name();
+        char count[2];
+        read_fully(count, 2);
+        header_bytes += 2;
+        for (uint i = get_uint(count, 2); i > 0; i--) {
+            char type;
+            read_fully(&type, 1);
+            header_bytes++;
+            if (type != ColumnAttribute::INT && type != ColumnAttribute::TEXT && type != ColumnAttribute::BOOLEAN)
+                throw DbRelationError(path + ": unknown column type " + to_string((int) type));
+            this->column_attributes.push_back(ColumnAttribute((ColumnAttribute::DataType) type));
+            this->column_names.push_back(read_name());
+        }
+        this->data_bytes = (uint64_t) status.st_size - header_bytes;
+        if (this->data_bytes % DbBlock::BLOCK_SZ != 0)
+            throw DbRelationError(path + " is cut short");
+    } catch (...) {
+        close(this->fd);
+        throw;
+    }
+}
+
+TableDump::~TableDump() {
+    close(this->fd);
+}
+
+uint64_t TableDump::restore(DbRelation &table, Handles *handles, uint64_t &blocks) {
+    unique_ptr<char[]> batch(new char[BATCH_BLOCKS * DbBlock::BLOCK_SZ]);
+    uint64_t rows = 0;
+    blocks = this->data_bytes / DbBlock::BLOCK_SZ;
+    for (uint64_t done = 0; done < blocks;) {
+        uint count = (uint) min<uint64_t>(BATCH_BLOCKS, blocks - done);
+        read_fully(batch.get(), count * DbBlock::BLOCK_SZ);
+        rows += table.load_blocks(batch.get(), count, handles);
+        done += count;
+    }
+    return rows;
+}
+
+void TableDump::read_fully(char *bytes, size_t length) {
+    while (length > 0) {
+        ssize_t n = read(this->fd, bytes, length);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            throw DbRelationError("cannot read " + this->path + ": " + strerror(errno));
+        if (n == 0)
+            throw DbRelationError(this->path + " is cut short");
+        bytes += n;
+        length -= (size_t) n;
+    }
+}
@@ -0,0 +1,73 @@
+/**
+ * @file table_dump.h - dumping a table's blocks to a file and restoring them
+ * TableDump
+ *
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#pragma once
+
+#include <string>
+#include "storage_engine.h"
+
+/**
+ * @class TableDump - a file holding a table's blocks exactly as they are stored, after a header
+ * describing the table, so it can be restored without decoding and re-encoding its rows.
+ *
+ * The header is "K5TD", a version (uint16), the block size (uint32), the table name and, per
+ * column, its type (uint8) and name; names are a uint16 length and the bytes, and all integers are
+ * little-endian. The blocks follow, back to back, to the end of the file. They are read and
+ * written BATCH_BLOCKS at a time.
+ */
+class TableDump {
+public:
+    static const uint16_t VERSION = 1;
+
+    /**
+     * Blocks read or written as a unit.
+     */
+    static const uint BATCH_BLOCKS = 256;
+
+    /**
+     * Write a table's blocks to a file.
+     * @param table       table to dump
+     * @param table_name  its name, and the columns are taken from the table
+     * @param path        file to write (replaced if it exists)
+     * @returns           number of blocks written
+     * @throws DbRelationError  if the file cannot be written
+     */
+    static uint64_t dump(DbRelation &table, const Identifier &table_name, const std::string &path);
+
+    /**
+     * Open a dump and read its header.
+     * @param path  file to read
+     * @throws DbRelationError  if the file cannot be read or is not a dump
+     */
+    explicit TableDump(const std::string &path);
+
+    virtual ~TableDump();
+
+    TableDump(const TableDump &other) = delete;
+
+    TableDump &operator=(const TableDump &other) = delete;
+
+    /**
+     * Append the dumped blocks to a table with the same columns (see DbRelation::load_blocks).
+     * @param table    table to restore into
+     * @param handles  if not null, returned by reference: the handles of the restored rows are appended
+     * @param blocks   returned by reference: number of blocks restored
+     * @returns        number of rows restored
+     * @throws DbRelationError  if the file is cut short
+     */
+    virtual uint64_t restore(DbRelation &table, Handles *handles, uint64_t &blocks);
+
+    Identifier table_name;
+    ColumnNames column_names;
+    ColumnAttributes column_attributes;
+
+protected:
+    std::string path;
+    int fd;
+    uint64_t data_bytes;  // bytes of blocks after the header
+
+    void read_fully(char *bytes, size_t length);
+};
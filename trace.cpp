@@ -0,0 +1,196 @@
+/**
+ * @file trace.cpp - implementation of timeline tracing
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#include <cxxabi.h>
+#include <cctype>
+#include <cstdlib>
+#include <iomanip>
+#include <map>
+#include <string>
+#include <vector>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "trace.h"
+
+using namespace std;
+
+/*
+ * ***************************
+ * Trace class implementation
+ * ***************************
+ */
+
+atomic<bool> Trace::enabled(false);
+atomic<uint64_t> Trace::started(0);
+atomic<Trace::Buffer *> Trace::buffers[Trace::BUFFERS];
+
+// which buffers are claimed by a thread
+static atomic<bool> buffer_taken[Trace::BUFFERS];
+
+// whether the calling thread has given its buffer back (it is exiting)
+static thread_local bool buffer_returned = false;
+
+// claims a free buffer when the thread first records and gives it back when the thread exits
+struct Trace::ThreadBuffer {
+    Buffer *buffer;
+    int slot;
+    uint32_t thread;
+
+    ThreadBuffer() : buffer(nullptr), slot(-1), thread((uint32_t) syscall(SYS_gettid)) {
+        for (uint i = 0; i < BUFFERS; i++) {
+            bool taken = false;
+            if (buffer_taken[i].compare_exchange_strong(taken, true)) {
+                slot = (int) i;
+                buffer = buffers[i].load();
+                if (buffer == nullptr) {
+                    buffer = new Buffer();
+                    buffers[i].store(buffer);
+                }
+                break;
+            }
+        }
+    }
+
+    ~ThreadBuffer() {
+        buffer_returned = true;
+        if (slot >= 0)
+            buffer_taken[slot].store(false, memory_order_release);
+    }
+};
+
+void Trace::start() {
+    started.store(now());
+    enabled.store(true);
+}
+
+void Trace::stop() {
+    enabled.store(false);
+}
+
+// The fence keeps the stores to the event from being seen before the head is seen to have
+// reached it, so dump can tell which events it may have read while they were overwritten.
+void Trace::record(const char *name, const char *category, const char *arg_name, int64_t arg,
+                   uint64_t started, uint64_t ended) {
+    if (buffer_returned)
+        return;
+    static thread_local ThreadBuffer thread;
+    Buffer *buffer = thread.buffer;
+    if (buffer == nullptr)
+        return;
+    uint64_t head = buffer->head.load(memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    Event &event = buffer->events[head % EVENTS];
+    event.name.store(name, memory_order_relaxed);
+    event.category.store(category, memory_order_relaxed);
+    event.arg_name.store(arg_name, memory_order_relaxed);
+    event.arg.store(arg, memory_order_relaxed);
+    event.started.store(started, memory_order_relaxed);
+    event.nanos.store(ended - started, memory_order_relaxed);
+    event.thread.store(thread.thread, memory_order_relaxed);
+    buffer->head.store(head + 1, memory_order_release);
+}
+
+// events copied out of a buffer between checks that the thread has not overwritten them
+static const uint64_t DUMP_CHUNK = 1024;
+
+// an event as copied out of a buffer
+struct Copy {
+    const char *name;
+    const char *category;
+    const char *arg_name;
+    int64_t arg;
+    uint64_t started;
+    uint64_t nanos;
+    uint32_t thread;
+};
+
+// a JSON string (the names are identifiers and literals, so only quotes and backslashes are escaped)
+static void write_string(ostream &out, const string &s) {
+    out << '"';
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            out << '\\';
+        out << c;
+    }
+    out << '"';
+}
+
+// An operator's spans are named by the typeid name of its class (which starts with a digit, or
+// N if the class is in a namespace) and categorized by the call: they are shown as Class::call.
+static bool operator_span(const char *name) {
+    return isdigit(name[0]) || name[0] == 'N';
+}
+
+static string span_name(const char *name, const char *category, map<const char *, string> &demangled) {
+    if (!operator_span(name))
+        return name;
+    auto found = demangled.find(name);
+    if (found == demangled.end()) {
+        int status;
+        char *readable = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+        found = demangled.emplace(name, status == 0 ? readable : name).first;
+        free(readable);
+    }
+    return found->second + "::" + category;
+}
+
+uint64_t Trace::dump(ostream &out) {
+    uint64_t since = started.load();
+    int pid = getpid();
+    map<const char *, string> demangled;
+    uint64_t written = 0;
+    out << "{\"traceEvents\":[";
+    for (auto &slot : buffers) {
+        Buffer *buffer = slot.load();
+        if (buffer == nullptr)
+            continue;
+        uint64_t head = buffer->head.load(memory_order_acquire);
+        uint64_t first = head > EVENTS ? head - EVENTS : 0;
+        vector<Copy> copies(head - first);
+
+        // Copy the newest events first, a chunk at a time, until the thread has gone on to overwrite
+        // (or is overwriting) the ones being copied: it overwrites the oldest first.
+        uint64_t from = head;  // the events from here to head are intact
+        while (from > first) {
+            uint64_t start = from - min(from - first, DUMP_CHUNK);
+            for (uint64_t i = start; i < from; i++) {
+                const Event &event = buffer->events[i % EVENTS];
+                copies[i - first] = Copy{event.name.load(memory_order_relaxed),
+                                         event.category.load(memory_order_relaxed),
+                                         event.arg_name.load(memory_order_relaxed),
+                                         event.arg.load(memory_order_relaxed),
+                                         event.started.load(memory_order_relaxed),
+                                         event.nanos.load(memory_order_relaxed),
+                                         event.thread.load(memory_order_relaxed)};
+            }
+            atomic_thread_fence(memory_order_acquire);
+            uint64_t now_head = buffer->head.load(memory_order_relaxed);
+            uint64_t intact = now_head >= EVENTS ? now_head - EVENTS + 1 : 0;
+            if (intact > start) {
+                from = min(intact, from);
+                break;
+            }
+            from = start;
+        }
+        for (uint64_t i = from; i < head; i++) {
+            const Copy &event = copies[i - first];
+            if (event.started < since)
+                continue;
+            out << (written++ == 0 ? "" : ",") << "\n{\"name\":";
+            write_string(out, span_name(event.name, event.category, demangled));
+            out << ",\"cat\":";
+            write_string(out, operator_span(event.name) ? "operator" : event.category);
+            out << ",\"ph\":\"X\",\"ts\":" << fixed << setprecision(3) << (event.started - since) / 1000.0
+                << ",\"dur\":" << event.nanos / 1000.0 << ",\"pid\":" << pid << ",\"tid\":" << event.thread;
+            if (event.arg_name != nullptr) {
+                out << ",\"args\":{";
+                write_string(out, event.arg_name);
+                out << ":" << event.arg << "}";
+            }
+            out << "}";
+        }
+    }
+    out << "\n],\"displayTimeUnit\":\"ns\"}" << endl;
+    return written;
+}
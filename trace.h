@@ -0,0 +1,132 @@
+/**
+ * @file trace.h - timeline tracing of statement execution, for chrome://tracing or Perfetto
+ * Trace
+ * Trace::Span
+ *
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <sys/types.h>
+
+/**
+ * @class Trace - spans of time (parsing, planning, each operator's open/next/close, block reads,
+ * catalog lookups) recorded while tracing is on, and written out as Chrome trace JSON.
+ *
+ * Each thread records into a ring buffer of its own: the thread writes an event's fields and then
+ * publishes it by advancing the buffer's head, with no lock and no locked instruction. Once a
+ * buffer is full the oldest events are overwritten. dump reads the buffers while threads go on
+ * writing, and drops any event that may have been overwritten as it read it. A thread claims one
+ * of BUFFERS buffers the first time it records and gives it back when it exits, leaving its events
+ * for the next dump; a thread that found none free records nothing.
+ *
+ * With tracing off, a span costs one test of a flag.
+ */
+class Trace {
+public:
+    static const uint BUFFERS = 128;
+    static const uint EVENTS = 1 << 16;  // per buffer
+
+    /**
+     * @class Span - records the time from its construction to its destruction, if tracing is on.
+     * The strings must outlive the trace (string literals, typeid names).
+     */
+    class Span {
+    public:
+        /**
+         * @param name      what is being done, e.g. "parse"
+         * @param category  what part of the engine does it, e.g. "sql"
+         * @param arg_name  name of a number to show with the span (nullptr for none)
+         * @param arg       the number
+         */
+        explicit Span(const char *name, const char *category, const char *arg_name = nullptr, int64_t arg = 0)
+                : name(Trace::on() ? name : nullptr), category(category), arg_name(arg_name), arg(arg), started(0) {
+            if (this->name != nullptr)
+                this->started = now();
+        }
+
+        ~Span() {
+            if (this->name != nullptr)
+                record(this->name, this->category, this->arg_name, this->arg, this->started, now());
+        }
+
+        Span(const Span &other) = delete;
+
+        Span &operator=(const Span &other) = delete;
+
+    protected:
+        const char *name;  // nullptr if tracing was off
+        const char *category;
+        const char *arg_name;
+        int64_t arg;
+        uint64_t started;
+    };
+
+    static bool on() { return enabled.load(std::memory_order_relaxed); }
+
+    /**
+     * Start recording spans. Events recorded before are left out of dumps.
+     */
+    static void start();
+
+    /**
+     * Stop recording spans (what was recorded can still be dumped).
+     */
+    static void stop();
+
+    /**
+     * Write the spans recorded since tracing was last started as Chrome trace JSON (the object
+     * form, with complete "X" events), each thread's oldest first.
+     * @param out  where to write it
+     * @returns    number of events written
+     */
+    static uint64_t dump(std::ostream &out);
+
+    /**
+     * Record a span that has ended.
+     * @param name      what was done
+     * @param category  what part of the engine did it
+     * @param arg_name  name of a number to show with the span (nullptr for none)
+     * @param arg       the number
+     * @param started   when it started (see now)
+     * @param ended     when it ended
+     */
+    static void record(const char *name, const char *category, const char *arg_name, int64_t arg,
+                       uint64_t started, uint64_t ended);
+
+    /**
+     * Nanoseconds on the steady clock.
+     */
+    static uint64_t now() {
+        return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+protected:
+    // the fields are atomic only so that dump may read an event being overwritten
+    struct Event {
+        std::atomic<const char *> name;
+        std::atomic<const char *> category;
+        std::atomic<const char *> arg_name;
+        std::atomic<int64_t> arg;
+        std::atomic<uint64_t> started;
+        std::atomic<uint64_t> nanos;
+        std::atomic<uint32_t> thread;
+    };
+
+    struct Buffer {
+        std::atomic<uint64_t> head;  // events ever recorded; event i is in events[i % EVENTS]
+        Event events[EVENTS];
+    };
+
+    static std::atomic<bool> enabled;
+    static std::atomic<uint64_t> started;  // when tracing was last started
+    static std::atomic<Buffer *> buffers[BUFFERS];
+
+    // the calling thread's claim on its buffer
+    struct ThreadBuffer;
+};
@@ -0,0 +1,663 @@
+/**
+ * @file transaction.cpp - implementation of transactions and the write-ahead log
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <set>
+#include <thread>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "transaction.h"
+#include "heap_storage.h"
+
+using namespace std;
+
+/*
+ * Each log record is its length (uint32, not counting these 8 bytes), a CRC-32 of the rest, then
+ * its type (uint8) and transaction id (uint64), all in host byte order. Records other than COMMIT
+ * go on with a file name (uint16 length and the bytes); a PAGE record ends with the block id
+ * (uint32) and the block.
+ */
+enum LogRecordType : uint8_t {
+    LOG_PAGE = 1, LOG_CREATE = 2, LOG_DROP = 3, LOG_COMMIT = 4
+};
+
+static const size_t LOG_HEADER = 8;
+
+// CRC-32 (as zlib's), eight bytes at a time
+static const uint32_t *crc_tables() {
+    static uint32_t tables[8][256];
+    static bool built = [] {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            tables[0][n] = c;
+        }
+        for (uint32_t n = 0; n < 256; n++)
+            for (int t = 1; t < 8; t++)
+                tables[t][n] = (tables[t - 1][n] >> 8) ^ tables[0][tables[t - 1][n] & 0xFF];
+        return true;
+    }();
+    (void) built;
+    return &tables[0][0];
+}
+
+static uint32_t crc32(const char *bytes, size_t length) {
+    const uint32_t *t = crc_tables();
+    const uint8_t *p = (const uint8_t *) bytes;
+    uint32_t c = 0xFFFFFFFF;
+    for (; length >= 8; p += 8, length -= 8) {
+        uint32_t low, high;
+        memcpy(&low, p, 4);
+        memcpy(&high, p + 4, 4);
+        low ^= c;
+        c = t[7 * 256 + (low & 0xFF)] ^ t[6 * 256 + ((low >> 8) & 0xFF)] ^ t[5 * 256 + ((low >> 16) & 0xFF)] ^
+            t[4 * 256 + (low >> 24)] ^ t[3 * 256 + (high & 0xFF)] ^ t[2 * 256 + ((high >> 8) & 0xFF)] ^
+            t[256 + ((high >> 16) & 0xFF)] ^ t[high >> 24];
+    }
+    for (; length > 0; p++, length--)
+        c = t[(c ^ *p) & 0xFF] ^ (c >> 8);
+    return c ^ 0xFFFFFFFF;
+}
+
+template<typename T>
+static void put(string &bytes, T n) {
+    bytes.append((const char *) &n, sizeof(n));
+}
+
+template<typename T>
+static T get(const char *bytes) {
+    T n;
+    memcpy(&n, bytes, sizeof(n));
+    return n;
+}
+
+static void put_record(string &records, LogRecordType type, uint64_t id, const string *name = nullptr,
+                       BlockID block_id = 0, const string *block = nullptr) {
+    size_t start = records.size();
+    records.append(LOG_HEADER, '\0');
+    put(records, (uint8_t) type);
+    put(records, id);
+    if (name != nullptr) {
+        put(records, (uint16_t) name->size());
+        records += *name;
+    }
+    if (block != nullptr) {
+        put(records, block_id);
+        records += *block;
+    }
+    uint32_t length = (uint32_t) (records.size() - start - LOG_HEADER);
+    uint32_t crc = crc32(records.data() + start + LOG_HEADER, length);
+    memcpy(&records[start], &length, 4);
+    memcpy(&records[start + 4], &crc, 4);
+}
+
+/*
+ * *********************************
+ * LogManager class implementation
+ * *********************************
+ */
+
+LogManager::LogManager(const string &directory)
+        : path(directory + "/sql5300.wal"), fd(-1), buffered_lsn(0), durable_lsn(0), file_bytes(0),
+          flushing(false), checkpointing(false), unapplied(0), commits(0), syncs(0), recovered(0) {
+    this->fd = open(this->path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (this->fd < 0)
+        throw DbRelationError("cannot open " + this->path + ": " + strerror(errno));
+    try {
+        recover();
+    } catch (...) {
+        close(this->fd);
+        throw;
+    }
+}
+
+LogManager::~LogManager() {
+    close(this->fd);
+}
+
+uint64_t LogManager::append(const string &records) {
+    unique_lock<mutex> guard(this->lock);
+    this->flushed.wait(guard, [this] { return !this->checkpointing; });
+    this->buffer += records;
+    this->buffered_lsn += records.size();
+    this->unapplied++;
+    this->commits++;
+    return this->buffered_lsn;
+}
+
+// The committer that finds no sync under way writes everything buffered so far and syncs it; the
+// rest wait for it, then check whether its sync covered them.
+void LogManager::flush(uint64_t lsn) {
+    unique_lock<mutex> guard(this->lock);
+    while (this->durable_lsn < lsn) {
+        if (this->flushing) {
+            this->flushed.wait(guard);
+            continue;
+        }
+        this->flushing = true;
+        string batch;
+        batch.swap(this->buffer);
+        uint64_t end = this->buffered_lsn;
+        guard.unlock();
+        try {
+            write_fully(batch.data(), batch.size());
+            if (fdatasync(this->fd) < 0)
+                throw DbRelationError("cannot sync " + this->path + ": " + strerror(errno));
+        } catch (DbRelationError &e) {
+            // Deliberately fatal. The transactions in the batch are published and have released
+            // their locks, and later commits may already be logged on top of their blocks, so they
+            // cannot be rolled back; nor can the write be retried, since after a failed fdatasync
+            // the kernel may have dropped the dirty pages and a second sync can succeed without
+            // them. Nobody has read them yet (snapshots wait for durable_lsn) and no committer has
+            // been told they succeeded, so stopping here and letting recovery replay what the log
+            // really holds loses nothing that was acknowledged.
+            cerr << "(sql5300: " << e.what() << "; stopping so recovery can restore a consistent state)" << endl;
+            abort();
+        }
+        guard.lock();
+        this->file_bytes += batch.size();
+        this->durable_lsn = end;
+        this->flushing = false;
+        this->syncs++;
+        this->flushed.notify_all();
+        this->quiet.notify_all();
+    }
+}
+
+void LogManager::applied() {
+    lock_guard<mutex> guard(this->lock);
+    this->unapplied--;
+    this->quiet.notify_all();
+}
+
+bool LogManager::wants_checkpoint() const {
+    lock_guard<mutex> guard(this->lock);
+    return this->file_bytes + this->buffer.size() >= CHECKPOINT_BYTES;
+}
+
+void LogManager::checkpoint() {
+    unique_lock<mutex> guard(this->lock);
+    if (this->checkpointing)
+        return;
+    this->checkpointing = true;
+    this->quiet.wait(guard, [this] { return this->unapplied == 0 && !this->flushing; });
+    try {
+        _DB_ENV->memp_sync(nullptr);
+        if (ftruncate(this->fd, 0) < 0 || fsync(this->fd) < 0)
+            throw DbRelationError("cannot truncate " + this->path + ": " + strerror(errno));
+        this->file_bytes = 0;
+    } catch (...) {
+        this->checkpointing = false;
+        this->flushed.notify_all();
+        throw;
+    }
+    this->checkpointing = false;
+    this->flushed.notify_all();
+}
+
+// Replay the blocks of each committed transaction in log order; stop at the first record that is
+// cut short or fails its checksum (the end of what was synced).
+void LogManager::recover() {
+    struct stat status;
+    if (fstat(this->fd, &status) < 0)
+        throw DbRelationError("cannot read " + this->path + ": " + strerror(errno));
+    string log((size_t) status.st_size, '\0');
+    for (size_t done = 0; done < log.size();) {
+        ssize_t n = pread(this->fd, &log[done], log.size() - done, (off_t) done);
+        if (n <= 0)
+            throw DbRelationError("cannot read " + this->path + ": " + strerror(errno));
+        done += (size_t) n;
+    }
+
+    map<string, unique_ptr<HeapFile>> files;  // opened for PAGE records
+    vector<size_t> batch;  // offsets of the records of the transaction being read
+    for (size_t at = 0; at + LOG_HEADER <= log.size();) {
+        uint32_t length = get<uint32_t>(&log[at]);
+        if (length < 9 || length > log.size() - at - LOG_HEADER
+            || get<uint32_t>(&log[at + 4]) != crc32(&log[at + LOG_HEADER], length))
+            break;
+        if ((LogRecordType) log[at + LOG_HEADER] != LOG_COMMIT) {
+            batch.push_back(at);
+            at += LOG_HEADER + length;
+            continue;
+        }
+        at += LOG_HEADER + length;
+        for (size_t record: batch) {
+            const char *p = &log[record + LOG_HEADER];
+            LogRecordType type = (LogRecordType) p[0];
+            string name(p + 11, get<uint16_t>(p + 9));
+            p += 11 + name.size();
+            if (type == LOG_PAGE) {
+                auto found = files.find(name);
+                if (found == files.end()) {
+                    found = files.emplace(name, unique_ptr<HeapFile>(new HeapFile(name))).first;
+                    try {
+                        found->second->open();
+                    } catch (DbException &e) {
+                        found->second.reset();  // dropped since
+                    }
+                }
+                if (found->second) {
+                    BlockID block_id = get<BlockID>(p);
+                    Dbt data((void *) (p + sizeof(BlockID)), DbBlock::BLOCK_SZ);
+                    SlottedPage page(data, block_id);
+                    found->second->put(&page);
+                }
+            } else {
+                auto found = files.find(name);
+                if (found != files.end() && found->second)
+                    found->second->close();
+                files.erase(name);
+                HeapFile file(name);
+                try {
+                    file.remove();
+                } catch (DbException &e) {
+                    // already gone
+                }
+                if (type == LOG_CREATE) {
+                    file.create();
+                    file.close();
+                }
+            }
+        }
+        batch.clear();
+        this->recovered++;
+    }
+    if (this->recovered > 0)
+        _DB_ENV->memp_sync(nullptr);
+    for (auto &file: files)
+        if (file.second)
+            file.second->close();
+    if (log.empty())
+        return;
+    if (ftruncate(this->fd, 0) < 0 || fsync(this->fd) < 0)
+        throw DbRelationError("cannot truncate " + this->path + ": " + strerror(errno));
+}
+
+void LogManager::write_fully(const char *bytes, size_t length) {
+    while (length > 0) {
+        ssize_t n = write(this->fd, bytes, length);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            throw DbRelationError("cannot write " + this->path + ": " + strerror(errno));
+        bytes += n;
+        length -= (size_t) n;
+    }
+}
+
+
+/*
+ * ******************************
+ * Snapshot class implementation
+ * ******************************
+ */
+
+/*
+ * What snapshots and the version collector share. It is never destroyed, since the collector's
+ * thread may still be waiting on it when the program exits.
+ */
+struct SnapshotRegistry {
+    mutex lock;
+    uint64_t last_commit = 0;
+    uint64_t last_lsn = 0;                // log sequence number just past the last commit
+    map<uint64_t, uint> live;             // commit number -> snapshots held of it
+    weak_ptr<const Snapshot> latest;      // shared by readers until the next commit
+    set<HeapFile *> files;                // files that may have kept versions
+    condition_variable wanted;            // the oldest snapshot was released
+    bool pending = false;
+    bool collector = false;               // whether its thread has been started
+};
+
+static SnapshotRegistry &registry() {
+    static SnapshotRegistry *registry = new SnapshotRegistry();
+    return *registry;
+}
+
+static uint64_t oldest_live(const SnapshotRegistry &registry) {
+    return registry.live.empty() ? numeric_limits<uint64_t>::max() : registry.live.begin()->first;
+}
+
+// The version collector: each time the oldest snapshot is released, drop the versions no snapshot
+// left can read.
+static void collect_versions() {
+    SnapshotRegistry &shared = registry();
+    unique_lock<mutex> guard(shared.lock);
+    for (;;) {
+        shared.wanted.wait(guard, [&shared] { return shared.pending; });
+        shared.pending = false;
+        uint64_t oldest = oldest_live(shared);
+        for (auto file = shared.files.begin(); file != shared.files.end();) {
+            if ((*file)->collect(oldest))
+                ++file;
+            else
+                file = shared.files.erase(file);
+        }
+    }
+}
+
+Snapshot::~Snapshot() {
+    SnapshotRegistry &shared = registry();
+    lock_guard<mutex> guard(shared.lock);
+    auto found = shared.live.find(this->commit);
+    if (--found->second > 0)
+        return;
+    bool oldest = found == shared.live.begin();
+    shared.live.erase(found);
+    if (oldest && !shared.files.empty()) {
+        shared.pending = true;
+        shared.wanted.notify_one();
+    }
+}
+
+shared_ptr<const Snapshot> Snapshot::take() {
+    SnapshotRegistry &shared = registry();
+    shared_ptr<const Snapshot> latest;  // released after the lock, in case it is the last reference
+    lock_guard<mutex> guard(shared.lock);
+    latest = shared.latest.lock();
+    if (latest && latest->commit == shared.last_commit)
+        return latest;
+    shared_ptr<const Snapshot> snapshot(new Snapshot(shared.last_commit, shared.last_lsn));
+    shared.live[shared.last_commit]++;
+    shared.latest = snapshot;
+    return snapshot;
+}
+
+uint64_t Snapshot::get_last_commit() {
+    SnapshotRegistry &shared = registry();
+    lock_guard<mutex> guard(shared.lock);
+    return shared.last_commit;
+}
+
+void Snapshot::make_visible(const function<uint64_t(uint64_t commit, bool keep)> &publish,
+                            const vector<HeapFile *> &files) {
+    SnapshotRegistry &shared = registry();
+    lock_guard<mutex> guard(shared.lock);
+    uint64_t commit = shared.last_commit + 1;
+    bool keep = !shared.live.empty();  // every snapshot held is older than this commit
+    uint64_t lsn = publish(commit, keep);
+    shared.last_commit = commit;
+    shared.last_lsn = max(shared.last_lsn, lsn);
+    if (!keep)
+        return;
+    shared.files.insert(files.begin(), files.end());
+    if (!shared.collector) {
+        thread(collect_versions).detach();
+        shared.collector = true;
+    }
+}
+
+void Snapshot::forget(HeapFile *file) {
+    SnapshotRegistry &shared = registry();
+    lock_guard<mutex> guard(shared.lock);
+    shared.files.erase(file);
+}
+
+
+/*
+ * **********************************
+ * Transaction class implementation
+ * **********************************
+ */
+
+atomic<uint64_t> Transaction::next_id(1);
+LogManager *Transaction::log = nullptr;
+LockManager Transaction::lock_manager;
+
+static thread_local Transaction *current_transaction = nullptr;
+
+Transaction::Transaction() : id(next_id++), snapshot(durable_snapshot()), finished(false) {
+}
+
+Transaction::~Transaction() {
+    if (!this->finished)
+        rollback();
+}
+
+Transaction *Transaction::current() {
+    return current_transaction;
+}
+
+void Transaction::set_current(Transaction *transaction) {
+    current_transaction = transaction;
+}
+
+void Transaction::open_log(const string &directory) {
+    if (log == nullptr)
+        log = new LogManager(directory);
+}
+
+void Transaction::close_log() {
+    if (log == nullptr)
+        return;
+    log->checkpoint();
+    delete log;
+    log = nullptr;
+}
+
+const Transaction::FileChanges *Transaction::find(const HeapFile *file) const {
+    auto found = this->files.find(const_cast<HeapFile *>(file));
+    return found == this->files.end() ? nullptr : &found->second;
+}
+
+Transaction::FileChanges &Transaction::changes(HeapFile *file) {
+    auto found = this->files.find(file);
+    if (found != this->files.end())
+        return found->second;
+    lock(LockName(file->get_name()), LockManager::IX);
+    if (this->files.empty())
+        this->snapshot = durable_snapshot();  // so blocks it goes on to read are as recent as those it changes
+    FileChanges &changes = this->files[file];
+    changes.last = 0;
+    changes.records = 0;
+    changes.created = false;
+    return changes;
+}
+
+void Transaction::created(HeapFile *file) {
+    lock(LockName(file->get_name()), LockManager::X);
+    changes(file).created = true;
+}
+
+bool Transaction::dropping(HeapFile *file) {
+    lock(LockName(file->get_name()), LockManager::X);
+    auto found = this->files.find(file);
+    bool created = found != this->files.end() && found->second.created;
+    if (found != this->files.end())
+        this->files.erase(found);
+    if (!created)
+        this->dropped.push_back(file->get_name());
+    return created;
+}
+
+// Log and publish, release the locks, wait for the log, then write the blocks back. Blocks shared
+// with other writers are rebuilt and logged while commits are serialized (in make_visible), so the
+// log has them in the order they became visible. The commit is visible before it is durable, but
+// nobody reads it until it is (see durable_snapshot), and whoever takes its locks next commits
+// after it in the log, so the locks need not be held through the sync.
+void Transaction::commit() {
+    if (this->finished)
+        return;
+    this->finished = true;
+    if (!has_changes()) {
+        release_locks();
+        return;
+    }
+
+    string records;
+    vector<pair<HeapFile *, HeapFile::Blocks>> published;
+    vector<HeapFile *> changed;
+    for (auto &file: this->files) {
+        const string &name = file.first->get_name();
+        if (file.second.created)
+            put_record(records, LOG_CREATE, this->id, &name);
+        HeapFile::Blocks blocks;
+        for (auto &block: file.second.blocks) {
+            if (file.second.merged.count(block.first))
+                continue;
+            put_record(records, LOG_PAGE, this->id, &name, block.first, &block.second);
+            blocks[block.first] = make_shared<const string>(move(block.second));
+        }
+        published.emplace_back(file.first, move(blocks));
+        changed.push_back(file.first);
+    }
+
+    uint64_t lsn = 0;
+    Snapshot::make_visible([this, &records, &published, &lsn](uint64_t commit, bool keep) -> uint64_t {
+        for (auto &file: published) {
+            FileChanges &changes = this->files[file.first];
+            if (changes.merged.empty())
+                continue;
+            const string &name = file.first->get_name();
+            for (auto const &block: changes.merged) {
+                string &bytes = changes.blocks[block.first];
+                file.first->rebase(block.first, block.second, bytes);
+                put_record(records, LOG_PAGE, this->id, &name, block.first, &bytes);
+                file.second[block.first] = make_shared<const string>(move(bytes));
+            }
+        }
+        for (auto const &name: this->dropped)
+            put_record(records, LOG_DROP, this->id, &name);
+        put_record(records, LOG_COMMIT, this->id);
+        if (log != nullptr)
+            lsn = log->append(records);
+        for (auto const &file: published)
+            file.first->publish(commit, this->files[file.first], file.second, keep);
+        return lsn;
+    }, changed);
+    this->files.clear();
+    release_locks();
+
+    if (log != nullptr)
+        log->flush(lsn);
+    for (auto const &file: published)
+        file.first->write_back(file.second);
+    for (auto const &name: this->dropped) {
+        try {
+            HeapFile(name).remove();
+        } catch (DbException &e) {
+            // already gone
+        }
+    }
+    this->dropped.clear();
+    if (log != nullptr) {
+        log->applied();
+        if (log->wants_checkpoint())
+            log->checkpoint();
+    }
+}
+
+// A snapshot of everything committed so far, once the log is durable up to the last commit in it:
+// a commit that a crash could still take back must not be read.
+shared_ptr<const Snapshot> Transaction::durable_snapshot() {
+    shared_ptr<const Snapshot> snapshot = Snapshot::take();
+    if (log != nullptr && snapshot->get_lsn() > 0)
+        log->flush(snapshot->get_lsn());
+    return snapshot;
+}
+
+void Transaction::rollback() {
+    if (this->finished)
+        return;
+    this->finished = true;
+    for (auto &file: this->files)
+        if (file.second.created)
+            file.first->remove();
+    this->files.clear();
+    this->dropped.clear();
+    release_locks();
+}
+
+void Transaction::lock(const LockName &name, LockManager::Mode mode) {
+    if (holds(name, mode))
+        return;
+    if (!name.is_table()) {
+        LockManager::Mode intention = mode == LockManager::S || mode == LockManager::IS ? LockManager::IS
+                                                                                         : LockManager::IX;
+        lock(name.record == 0 ? LockName(name.table) : LockName(name.table, name.block), intention);
+    }
+    lock_manager.lock(this->id, name, mode);
+    auto held = this->locks.find(name);
+    if (held == this->locks.end())
+        this->locks.emplace(name, mode);
+    else
+        held->second = LockManager::combine(held->second, mode);
+}
+
+bool Transaction::try_lock(const LockName &name, LockManager::Mode mode) {
+    if (holds(name, mode))
+        return true;
+    if (!name.is_table()) {
+        LockManager::Mode intention = mode == LockManager::S || mode == LockManager::IS ? LockManager::IS
+                                                                                         : LockManager::IX;
+        if (!try_lock(name.record == 0 ? LockName(name.table) : LockName(name.table, name.block), intention))
+            return false;
+    }
+    if (!lock_manager.try_lock(this->id, name, mode))
+        return false;
+    auto held = this->locks.find(name);
+    if (held == this->locks.end())
+        this->locks.emplace(name, mode);
+    else
+        held->second = LockManager::combine(held->second, mode);
+    return true;
+}
+
+bool Transaction::holds(const LockName &name, LockManager::Mode mode) const {
+    auto held = this->locks.find(name);
+    if (held != this->locks.end() && LockManager::combine(held->second, mode) == held->second)
+        return true;
+    bool reading = mode == LockManager::S || mode == LockManager::IS;
+    for (LockName parent = name; !parent.is_table();) {
+        parent = parent.record == 0 ? LockName(parent.table) : LockName(parent.table, parent.block);
+        held = this->locks.find(parent);
+        if (held != this->locks.end() &&
+            (held->second == LockManager::X || (reading && held->second == LockManager::S)))
+            return true;
+    }
+    return false;
+}
+
+void Transaction::release_locks() {
+    for (auto const &held: this->locks)
+        lock_manager.unlock(this->id, held.first);
+    this->locks.clear();
+}
+
+
+/*
+ * *********************************
+ * Autocommit class implementation
+ * *********************************
+ */
+
+Autocommit::Autocommit() : own(nullptr) {
+    if (Transaction::current() == nullptr) {
+        this->own = new Transaction();
+        Transaction::set_current(this->own);
+    }
+}
+
+Autocommit::~Autocommit() {
+    if (this->own != nullptr) {
+        Transaction::set_current(nullptr);
+        delete this->own;
+    }
+}
+
+void Autocommit::commit() {
+    if (this->own == nullptr)
+        return;
+    unique_ptr<Transaction> transaction(this->own);
+    this->own = nullptr;
+    Transaction::set_current(nullptr);
+    transaction->commit();
+}
@@ -0,0 +1,382 @@
+/**
+ * @file transaction.h - transactions over heap files, with a write-ahead log and group commit
+ * LogManager
+ * Snapshot
+ * Transaction
+ * Autocommit
+ *
+ * @see "Seattle University, CPSC5300, Spring 2020"
+ */
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "storage_engine.h"
+#include "lock_manager.h"
+
+class HeapFile;
+
+/**
+ * @class LogManager - the write-ahead log: an append-only file of the blocks committed transactions
+ * wrote, in commit order.
+ *
+ * A transaction's records (see Transaction::commit) are appended as one batch that ends with its
+ * commit record, and the transaction is durable once the log has been synced past that batch.
+ * Committers do not each sync the log: the first one to need a sync writes and syncs everything
+ * appended so far, and the others wait for it, so one sync covers every commit appended while the
+ * previous sync was running (group commit).
+ *
+ * Blocks reach the database files only after their batch is durable, and the files are synced
+ * only at a checkpoint, after which the log starts over. After a crash, recover() writes the blocks
+ * of every transaction whose commit record made it into the log back into the files. Each record
+ * carries a checksum, so a batch torn by the crash is recognized and ignored.
+ */
+class LogManager {
+public:
+    /**
+     * Log size at which a commit starts a checkpoint.
+     */
+    static const uint64_t CHECKPOINT_BYTES = 64 * 1024 * 1024;
+
+    /**
+     * Open (or create) the log in a directory and recover from it (see Transaction::open_log).
+     * @param directory  the database environment's home
+     * @throws DbRelationError  if the log cannot be opened
+     */
+    explicit LogManager(const std::string &directory);
+
+    virtual ~LogManager();
+
+    LogManager(const LogManager &other) = delete;
+
+    LogManager &operator=(const LogManager &other) = delete;
+
+    /**
+     * Add a transaction's records to the end of the log, in memory.
+     * @param records  the records, ending with the commit record
+     * @returns        the log sequence number just past them, to pass to flush()
+     */
+    virtual uint64_t append(const std::string &records);
+
+    /**
+     * Wait until the log is durable up to a sequence number, writing and syncing it if no other
+     * committer is already doing so. If the log cannot be written or synced the process stops.
+     * @param lsn  from append()
+     */
+    virtual void flush(uint64_t lsn);
+
+    /**
+     * Note that a transaction appended earlier has written its blocks to the database files.
+     */
+    virtual void applied();
+
+    /**
+     * Once every appended transaction has been applied, sync the database files and empty the log.
+     * Appends wait while this runs.
+     */
+    virtual void checkpoint();
+
+    /**
+     * Whether the log has grown enough to be worth a checkpoint.
+     */
+    bool wants_checkpoint() const;
+
+    /**
+     * Number of transactions appended, and of log syncs done for them.
+     */
+    uint64_t get_commits() const { return commits; }
+
+    uint64_t get_syncs() const { return syncs; }
+
+    /**
+     * Number of transactions whose blocks were written back by the last recovery.
+     */
+    uint64_t get_recovered() const { return recovered; }
+
+protected:
+    std::string path;
+    int fd;
+    mutable std::mutex lock;
+    std::condition_variable flushed;    // durable advanced, or a checkpoint finished
+    std::condition_variable quiet;      // unapplied or flushing changed
+    std::string buffer;                 // appended but not yet written
+    uint64_t buffered_lsn;              // sequence number just past buffer
+    uint64_t durable_lsn;               // everything before this is synced
+    uint64_t file_bytes;                // size of the log file
+    bool flushing;                      // a committer is writing and syncing the log
+    bool checkpointing;
+    uint64_t unapplied;                 // transactions appended but not yet applied
+    std::atomic<uint64_t> commits;
+    std::atomic<uint64_t> syncs;
+    uint64_t recovered;
+
+    void recover();
+
+    void write_fully(const char *bytes, size_t length);
+};
+
+
+/**
+ * @class Snapshot - the committed state of the database as of one commit. A reader holding a
+ * snapshot sees the blocks of every transaction committed up to and including that one, and none
+ * committed after it, however long it goes on reading.
+ *
+ * Commits are numbered in the order they become visible. While a snapshot older than a commit is
+ * held, the heap files the commit changed keep the versions of the blocks it replaced (see
+ * HeapFile). A background thread, the version collector, drops them once the snapshots that could
+ * read them have all been released.
+ */
+class Snapshot {
+public:
+    /**
+     * Releases the snapshot, letting the version collector drop versions only it could read.
+     */
+    virtual ~Snapshot();
+
+    Snapshot(const Snapshot &other) = delete;
+
+    Snapshot &operator=(const Snapshot &other) = delete;
+
+    /**
+     * Number of the last commit the snapshot sees.
+     */
+    uint64_t get_commit() const { return commit; }
+
+    /**
+     * Log sequence number just past the last commit the snapshot sees: the log must be durable up
+     * to here before the snapshot is read.
+     */
+    uint64_t get_lsn() const { return lsn; }
+
+    /**
+     * A snapshot of everything committed so far. Readers taking one before the next commit share it.
+     */
+    static std::shared_ptr<const Snapshot> take();
+
+    /**
+     * Number of the last commit made visible (0 before any).
+     */
+    static uint64_t get_last_commit();
+
+    // for Transaction
+    /**
+     * Make a commit visible: number it and have it publish its blocks while no snapshot can be taken.
+     * @param publish  called with the commit's number and whether any snapshot is held (so that the
+     *                 blocks it replaces must be kept); returns the log sequence number just past the
+     *                 commit's records (see get_lsn)
+     * @param files    the files it publishes to, for the version collector
+     */
+    static void make_visible(const std::function<uint64_t(uint64_t commit, bool keep)> &publish,
+                             const std::vector<HeapFile *> &files);
+
+    // for HeapFile
+    /**
+     * Stop collecting a file's versions (before the file goes away).
+     */
+    static void forget(HeapFile *file);
+
+protected:
+    uint64_t commit;
+    uint64_t lsn;
+
+    Snapshot(uint64_t commit, uint64_t lsn) : commit(commit), lsn(lsn) {}
+};
+
+
+/**
+ * @class Transaction - a unit of work whose changes to heap files are all kept or all discarded.
+ *
+ * The blocks a transaction writes are kept in the transaction, not written to their files, until
+ * it commits; reads made by the transaction see them, other readers see only committed blocks.
+ * Its reads see the database as of the Snapshot it took when it began, or when it first wrote, if
+ * later, so a long scan neither waits for writers nor sees their commits half-way.
+ * At commit the blocks are logged (LogManager), and once the log is durable they are written to
+ * their files. Rolling back just forgets them. Files created by the transaction are removed if it
+ * rolls back, and files it drops are only removed once it has committed.
+ *
+ * A thread works on behalf of at most one transaction at a time, its current() one; heap files
+ * check it on every read and write. Blocks written with no current transaction go straight to
+ * their files, unlogged, as they always have (the schema tables are created that way).
+ *
+ * A commit is visible once it is published, before its log records are durable, but a transaction
+ * whose snapshot would include it waits for the log to be synced past it before reading anything.
+ *
+ * Transactions that write lock what they change (see LockManager) and hold the locks until their
+ * changes are visible: IX on the table, X on the blocks they add records to and X on the rows they
+ * delete (with IX on their blocks). Inserts go to a block no other transaction has locked, so writers
+ * working on different rows run side by side. Readers take no locks and never wait for writers.
+ */
+class Transaction {
+public:
+    /**
+     * What a transaction has changed in one file.
+     */
+    struct FileChanges {
+        BlockID last;                            // last block the transaction added (0 if none)
+        std::map<BlockID, std::string> blocks;   // blocks written, in full
+        std::map<BlockID, std::vector<RecordID>> merged;  // records deleted from blocks others may
+                                                 // change too, deleted again at commit (see HeapFile::rebase)
+        int64_t records;                         // records added, less those deleted
+        bool created;                            // whether the transaction created the file
+    };
+
+    Transaction();
+
+    /**
+     * Rolls back, unless committed.
+     */
+    virtual ~Transaction();
+
+    Transaction(const Transaction &other) = delete;
+
+    Transaction &operator=(const Transaction &other) = delete;
+
+    /**
+     * Make the transaction's changes permanent: log them, wait for the log to be durable, then
+     * write them to the files. If the log cannot be made durable the process stops (see
+     * LogManager::flush), to recover from the log when it is restarted.
+     */
+    virtual void commit();
+
+    /**
+     * Discard the transaction's changes.
+     */
+    virtual void rollback();
+
+    /**
+     * Whether the transaction has written anything.
+     */
+    bool has_changes() const { return !files.empty() || !dropped.empty(); }
+
+    uint64_t get_id() const { return id; }
+
+    /**
+     * The committed state the transaction reads.
+     */
+    const std::shared_ptr<const Snapshot> &get_snapshot() const { return snapshot; }
+
+    /**
+     * Lock something the transaction is about to change (see LockManager::lock), first locking
+     * the table, and the block for a row, in the matching intention mode. Locks are held until the
+     * transaction commits or rolls back.
+     * @throws DbRelationError  if waiting would deadlock (the transaction should roll back)
+     */
+    virtual void lock(const LockName &name, LockManager::Mode mode);
+
+    /**
+     * Lock something without waiting (see LockManager::try_lock).
+     * @return whether the lock is held
+     */
+    virtual bool try_lock(const LockName &name, LockManager::Mode mode);
+
+    /**
+     * Whether the transaction holds a lock at least as strong, or an X lock (an S lock, if mode is S
+     * or IS) on the table or block it belongs to.
+     */
+    bool holds(const LockName &name, LockManager::Mode mode) const;
+
+    /**
+     * The lock manager all transactions lock through.
+     */
+    static LockManager &get_lock_manager() { return lock_manager; }
+
+    /**
+     * The transaction the calling thread is working for, or null.
+     */
+    static Transaction *current();
+
+    /**
+     * Make a transaction (or none) the calling thread's current one.
+     */
+    static void set_current(Transaction *transaction);
+
+    /**
+     * Open the write-ahead log in the database environment's home, writing back the blocks of any
+     * transaction committed before a crash. Until this is called, commits are not logged (nor
+     * durable until the files are closed).
+     * @param directory  the environment's home
+     */
+    static void open_log(const std::string &directory);
+
+    /**
+     * Checkpoint (see LogManager::checkpoint) and close the log.
+     */
+    static void close_log();
+
+    /**
+     * The write-ahead log, or null if it has not been opened.
+     */
+    static LogManager *get_log() { return log; }
+
+    // for HeapFile
+    /**
+     * The transaction's changes to a file, or null if it has none.
+     */
+    const FileChanges *find(const HeapFile *file) const;
+
+    /**
+     * The transaction's changes to a file, to be added to. The first call for a file locks its table
+     * IX; the first call for any file moves the transaction's snapshot up to the latest commit.
+     */
+    FileChanges &changes(HeapFile *file);
+
+    /**
+     * Note that the transaction created a file, locking its table X until it commits.
+     */
+    void created(HeapFile *file);
+
+    /**
+     * Forget a file the transaction is dropping, to be removed once it commits. Its table is locked X.
+     * @returns  whether the transaction created the file (so it can be removed now)
+     */
+    bool dropping(HeapFile *file);
+
+protected:
+    static std::atomic<uint64_t> next_id;
+    static LogManager *log;
+    static LockManager lock_manager;
+
+    uint64_t id;
+    std::shared_ptr<const Snapshot> snapshot;
+    std::map<HeapFile *, FileChanges> files;
+    std::vector<std::string> dropped;  // names of files to remove once committed
+    std::map<LockName, LockManager::Mode> locks;  // held
+    bool finished;
+
+    void release_locks();
+
+    static std::shared_ptr<const Snapshot> durable_snapshot();
+};
+
+
+/**
+ * @class Autocommit - runs a statement in a transaction of its own, unless the thread already has
+ * a current transaction (begun with BEGIN), which the statement then joins.
+ */
+class Autocommit {
+public:
+    Autocommit();
+
+    /**
+     * Rolls the statement's own transaction back, unless committed.
+     */
+    virtual ~Autocommit();
+
+    Autocommit(const Autocommit &other) = delete;
+
+    Autocommit &operator=(const Autocommit &other) = delete;
+
+    /**
+     * Commit the statement's own transaction (nothing to do when joining one).
+     */
+    virtual void commit();
+
+protected:
+    Transaction *own;
+};